@@ -0,0 +1,155 @@
+// Allocation audit. See alloc_audit.h.
+//
+// The wrappers only exist in audit builds. Linking with ALLOC_AUDIT_LDFLAGS turns every
+// call to malloc() in the program into a call to __wrap_malloc(), which counts it and
+// hands it on to the real one, __real_malloc(). Same for the others.
+
+#include "alloc_audit.h"
+
+#if ALLOC_AUDIT
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "log.h"
+
+#ifdef _arch_dreamcast
+#include <kos.h>
+typedef kthread_t * thread_id;
+static thread_id current_thread(){ return thd_get_current(); }
+#else
+#include <pthread.h>
+typedef pthread_t thread_id;
+static thread_id current_thread(){ return pthread_self(); }
+#endif
+
+static volatile uint32_t allocations = 0;
+static volatile uint32_t frees = 0;
+static volatile uint64_t bytes = 0;
+static volatile uint32_t frame_allocations = 0;
+
+// Only one thread is watched at a time: the game thread, between begin and end
+static volatile int watching = 0;
+static thread_id watched;
+static uint32_t watched_frame;
+static const char * watched_phase;
+static uint32_t allocations_this_frame;
+static int paused = 0; // only touched by the watched thread
+static int reporting = 0; // printing can allocate, don't report those
+
+static void count(size_t size, void * caller){
+	__atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&bytes, size, __ATOMIC_RELAXED);
+
+	if(!watching || paused || reporting || current_thread() != watched){
+		return;
+	}
+	allocations_this_frame++;
+	if(watched_frame == 0){
+		return; // the first frame can still set things up
+	}
+	__atomic_fetch_add(&frame_allocations, 1, __ATOMIC_RELAXED);
+
+	// Straight to the console, not through the log ring: with ALLOC_AUDIT_FATAL the
+	// drain thread would never get to print it
+	reporting = 1;
+#ifdef _arch_dreamcast
+	dbglog(DBG_ERROR, "ALLOC AUDIT: %u bytes allocated in frame %u (%s), called from %p\n",
+		(unsigned)size, (unsigned)watched_frame, watched_phase, caller);
+#else
+	fprintf(stderr, "ALLOC AUDIT: %u bytes allocated in frame %u (%s), called from %p\n",
+		(unsigned)size, (unsigned)watched_frame, watched_phase, caller);
+#endif
+	reporting = 0;
+#if ALLOC_AUDIT_FATAL
+	abort();
+#endif
+}
+
+void * __real_malloc(size_t size);
+void * __real_calloc(size_t count, size_t size);
+void * __real_realloc(void * memory, size_t size);
+void __real_free(void * memory);
+
+void * __wrap_malloc(size_t size){
+	count(size, __builtin_return_address(0));
+	return __real_malloc(size);
+}
+
+void * __wrap_calloc(size_t count_, size_t size){
+	count(count_ * size, __builtin_return_address(0));
+	return __real_calloc(count_, size);
+}
+
+void * __wrap_realloc(void * memory, size_t size){
+	count(size, __builtin_return_address(0));
+	return __real_realloc(memory, size);
+}
+
+void __wrap_free(void * memory){
+	if(memory){
+		__atomic_fetch_add(&frees, 1, __ATOMIC_RELAXED);
+	}
+	__real_free(memory);
+}
+
+#ifdef _arch_dreamcast
+void * __real_memalign(size_t alignment, size_t size);
+
+void * __wrap_memalign(size_t alignment, size_t size){
+	count(size, __builtin_return_address(0));
+	return __real_memalign(alignment, size);
+}
+#endif
+
+int __real_posix_memalign(void ** memory, size_t alignment, size_t size);
+
+int __wrap_posix_memalign(void ** memory, size_t alignment, size_t size){
+	count(size, __builtin_return_address(0));
+	return __real_posix_memalign(memory, alignment, size);
+}
+
+void alloc_audit_frame_begin(uint32_t frame, const char * phase){
+	watched = current_thread();
+	watched_frame = frame;
+	watched_phase = phase;
+	allocations_this_frame = 0;
+	__atomic_store_n(&watching, 1, __ATOMIC_RELEASE);
+}
+
+uint32_t alloc_audit_frame_end(){
+	__atomic_store_n(&watching, 0, __ATOMIC_RELEASE);
+#if !ALLOC_AUDIT_FATAL
+	if(allocations_this_frame && watched_frame){
+		LOG_ERROR("ALLOC AUDIT: %u allocations in frame %u (%s)", (unsigned)allocations_this_frame,
+			(unsigned)watched_frame, watched_phase);
+	}
+#endif
+	return allocations_this_frame;
+}
+
+void alloc_audit_pause(){
+	paused++;
+}
+
+void alloc_audit_resume(){
+	paused--;
+}
+
+alloc_audit_totals alloc_audit_totals_now(){
+	alloc_audit_totals totals;
+	totals.allocations = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+	totals.frees = __atomic_load_n(&frees, __ATOMIC_RELAXED);
+	totals.bytes = __atomic_load_n(&bytes, __ATOMIC_RELAXED);
+	totals.frame_allocations = __atomic_load_n(&frame_allocations, __ATOMIC_RELAXED);
+	return totals;
+}
+
+void alloc_audit_log_totals(){
+	alloc_audit_totals totals = alloc_audit_totals_now();
+	LOG_INFO("Alloc audit: %u allocations (%u KB), %u frees, %u in frames after the first",
+		(unsigned)totals.allocations, (unsigned)((totals.bytes + 1023) / 1024), (unsigned)totals.frees,
+		(unsigned)totals.frame_allocations);
+}
+
+#endif
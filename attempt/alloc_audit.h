@@ -0,0 +1,64 @@
+// Allocation audit: proves the game loop never touches the heap.
+//
+// Everything the game needs is either a fixed array or set up at boot (the font, assets,
+// see arena.h), so once the first frame is out, nothing on the game thread should call
+// malloc(), free() or realloc() again. In an audit build (make ALLOC_AUDIT=1, or the
+// alloc_audit_host target in Makefile.host) every call to them is counted: the linker
+// sends them through the wrappers in alloc_audit.c (--wrap, see ALLOC_AUDIT_LDFLAGS),
+// libraries included. Between alloc_audit_frame_begin() and alloc_audit_frame_end() the
+// calls made by that thread count against the frame, and one after the first frame
+// stops the game right there with the size and the caller, so it can't go unnoticed.
+//
+// Other threads (the VMU save thread, audio, logging) aren't watched, they're off the
+// frame's critical path. Normal builds get empty macros and no wrappers.
+
+#ifndef ALLOC_AUDIT_H
+#define ALLOC_AUDIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef ALLOC_AUDIT
+#define ALLOC_AUDIT 0
+#endif
+
+// 0 only counts them and logs the total at the end of each frame instead of stopping
+#ifndef ALLOC_AUDIT_FATAL
+#define ALLOC_AUDIT_FATAL 1
+#endif
+
+typedef struct Alloc_Audit_Totals {
+	uint32_t allocations; // malloc, calloc, realloc, memalign...
+	uint32_t frees;
+	uint64_t bytes; // asked for, in total
+	uint32_t frame_allocations; // ...of those, on a watched thread inside a frame after the first
+} alloc_audit_totals;
+
+#if ALLOC_AUDIT
+
+// Starts watching the calling thread. phase names what's running for the messages
+// ("draw", "update"). Frame 0 (the first frame) is allowed to allocate.
+void alloc_audit_frame_begin(uint32_t frame, const char * phase);
+// Stops watching. Returns how many allocations happened since begin.
+uint32_t alloc_audit_frame_end();
+
+// Around something that's allowed to allocate on the game thread (opening a file to
+// record a replay to, once per game). Nests.
+void alloc_audit_pause();
+void alloc_audit_resume();
+
+// Snapshot of the counts so far, every thread
+alloc_audit_totals alloc_audit_totals_now();
+void alloc_audit_log_totals();
+
+#else
+
+#define alloc_audit_frame_begin(frame, phase) do {} while(0)
+#define alloc_audit_frame_end() ((void)0)
+#define alloc_audit_pause() do {} while(0)
+#define alloc_audit_resume() do {} while(0)
+#define alloc_audit_log_totals() do {} while(0)
+
+#endif
+
+#endif
@@ -0,0 +1,84 @@
+// The allocation audit (alloc_audit.h) on a PC: plays bot games through everything the
+// game thread does every frame that isn't Dreamcast only (game logic, replay recording,
+// particles, the 3D background, logging) and fails if any frame after the first one
+// touches the heap. glibc is a shared library here, so only the calls it gets from our
+// code are seen (not the ones inside fopen()), on the Dreamcast newlib is linked in and
+// gets wrapped too.
+//
+// Usage: alloc_audit_host [frames] [replay file]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "alloc_audit.h"
+#include "background.h"
+#include "bot.h"
+#include "log.h"
+#include "particles.h"
+#include "replay.h"
+#include "tetris.h"
+
+static const uint32_t type_argb[8] = {
+	0xff000000, 0xff00ffff, 0xffffff00, 0xffff00ff, 0xff00ff00, 0xffff0000, 0xff0000ff, 0xffff8000
+};
+
+int main(int argc, char ** argv){
+	int frames = argc > 1 ? atoi(argv[1]) : 100000;
+	const char * replay_path = argc > 2 ? argv[2] : "alloc_audit.trp";
+
+	// Everything big is static, like on the Dreamcast
+	static tetris_game game;
+	static replay_writer replay;
+	static particle_pool particles;
+	static background scenery;
+	bot brain;
+	uint32_t seed = 1;
+	int games = 0;
+
+	tetris_init();
+	bot_setup(&brain, 0);
+	background_init(&scenery, seed, type_argb);
+	particles_clear(&particles, seed);
+
+	for(int frame=0; frame<frames; frame++){
+		alloc_audit_frame_begin(frame, "update");
+
+		if(frame == 0 || game.loss){
+			// A new game, and a new recording: opening files is allowed to allocate
+			alloc_audit_pause();
+			replay_writer_close(&replay);
+			if(!replay_writer_open(&replay, replay_path, seed)){
+				fprintf(stderr, "can't write %s\n", replay_path);
+				return 1;
+			}
+			alloc_audit_resume();
+			tetris_game_reset(&game, seed++);
+			games++;
+		}
+
+		uint32_t buttons = bot_buttons(&brain, &game);
+		replay_record(&replay, &game, buttons);
+		int events = tetris_game_tick(&game, buttons);
+		if(events & (TETRIS_EVENT_LINE_CLEAR | TETRIS_EVENT_HARD_DROP)){
+			particles_burst(&particles, 220, 40, 200, 400, events & TETRIS_EVENT_TETRIS ? 640 : 160, 0xffffffff, 3.0f, 45);
+		}
+		if(events & TETRIS_EVENT_TETRIS){
+			LOG_INFO("Tetris!");
+		}
+		particles_update(&particles);
+		background_set_level(&scenery, game.level);
+		background_update(&scenery);
+
+		alloc_audit_frame_end();
+		log_drain(0);
+	}
+
+	alloc_audit_pause();
+	replay_writer_close(&replay);
+	alloc_audit_resume();
+
+	alloc_audit_totals totals = alloc_audit_totals_now();
+	printf("%d frames, %d games: %u allocations, %u of them in frames after the first\n",
+		frames, games, (unsigned)totals.allocations, (unsigned)totals.frame_allocations);
+	return totals.frame_allocations != 0;
+}
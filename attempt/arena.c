@@ -0,0 +1,26 @@
+// Arenas. See arena.h.
+
+#include "arena.h"
+
+void arena_init(arena * a, void * memory, size_t size){
+	a->base = memory;
+	a->size = size;
+	a->used = 0;
+	a->peak = 0;
+	a->failed = 0;
+}
+
+void * arena_alloc(arena * a, size_t size, size_t align){
+	uintptr_t start = ((uintptr_t)a->base + a->used + (align - 1)) & ~(uintptr_t)(align - 1);
+	size_t end = start - (uintptr_t)a->base + size;
+
+	if(end > a->size || end < size){
+		a->failed++;
+		return NULL;
+	}
+	a->used = end;
+	if(end > a->peak){
+		a->peak = end;
+	}
+	return (void *)start;
+}
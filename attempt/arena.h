@@ -0,0 +1,33 @@
+// Arenas: memory handed out from one fixed block, for things that need dynamic memory
+// but shouldn't go to the heap.
+//
+// Allocating just bumps a pointer. There's no freeing one thing: everything goes at once
+// with arena_reset(), or back to an earlier arena_mark(). Each arena gets its block once
+// (usually a static array) and never grows, so running out returns NULL instead of
+// touching malloc(). The peak is kept, to size the block from.
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct Arena {
+	uint8_t * base;
+	size_t size;
+	size_t used;
+	size_t peak; // most that was ever used at once
+	uint32_t failed; // allocations that didn't fit
+} arena;
+
+void arena_init(arena * a, void * memory, size_t size);
+
+// align has to be a power of 2. NULL if it doesn't fit.
+void * arena_alloc(arena * a, size_t size, size_t align);
+
+// Frees everything allocated since the mark was taken
+static inline size_t arena_mark(const arena * a){ return a->used; }
+static inline void arena_release(arena * a, size_t mark){ a->used = mark; }
+static inline void arena_reset(arena * a){ a->used = 0; }
+
+#endif
@@ -0,0 +1,242 @@
+// Romdisk assets. See asset.h.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "asset.h"
+#include "log.h"
+#include "lz.h"
+
+#ifdef _arch_dreamcast
+#include <kos.h>
+#else
+#include <time.h>
+#endif
+
+#define ASSET_PATH_LENGTH 128
+#define ASSET_CACHE_MAX 16 // different assets loaded, more than that get loaded again every time
+
+asset_totals asset_loaded;
+
+// asset_map() unpacks into here rather than the heap. Whatever doesn't fit still gets
+// malloc()ed, with a warning to make this bigger.
+static uint8_t asset_memory[ASSET_ARENA_SIZE] __attribute__((aligned(32)));
+static arena asset_arena = {asset_memory, sizeof(asset_memory), 0, 0, 0};
+
+// Everything loaded so far, so asking for an asset again gets the same buffer instead of
+// unpacking it again into more of the arena (which is never freed)
+typedef struct Loaded_Asset {
+	char path[ASSET_PATH_LENGTH];
+	int as_file; // asset_file(), file_name is what it's for
+	const void * data;
+	size_t size;
+	char file_name[ASSET_PATH_LENGTH];
+} loaded_asset;
+
+static loaded_asset loaded[ASSET_CACHE_MAX];
+static int loaded_count = 0;
+
+static const loaded_asset * find_loaded(const char * path, int as_file){
+	for(int i=0; i<loaded_count; i++){
+		if(loaded[i].as_file == as_file && !strcmp(loaded[i].path, path)){
+			return &loaded[i];
+		}
+	}
+	return NULL;
+}
+
+static void remember(const char * path, int as_file, const void * data, size_t size, const char * file_name){
+	if(loaded_count == ASSET_CACHE_MAX || strlen(path) >= ASSET_PATH_LENGTH){
+		LOG_WARN("%s: can't remember it, make ASSET_CACHE_MAX bigger", path);
+		return;
+	}
+	loaded_asset * asset = &loaded[loaded_count++];
+	strcpy(asset->path, path);
+	asset->as_file = as_file;
+	asset->data = data;
+	asset->size = size;
+	snprintf(asset->file_name, sizeof(asset->file_name), "%s", file_name ? file_name : "");
+}
+
+static uint64_t now_us(){
+#ifdef _arch_dreamcast
+	return timer_us_gettime64();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+// The whole file, and whether it has to be freed (it doesn't if it's mapped)
+static const uint8_t * read_file(const char * path, size_t * size, int * copied){
+#ifdef _arch_dreamcast
+	file_t file = fs_open(path, O_RDONLY);
+	if(file < 0){
+		return NULL;
+	}
+	*size = fs_total(file);
+	// A pointer into the romdisk image, nothing gets copied. Other filesystems (/pc/)
+	// can't map, those get read.
+	uint8_t * data = fs_mmap(file);
+	*copied = 0;
+	if(!data){
+		data = malloc(*size ? *size : 1);
+		*copied = 1;
+		if(data && fs_read(file, data, *size) != (ssize_t)*size){
+			free(data);
+			data = NULL;
+		}
+	}
+	fs_close(file);
+	return data;
+#else
+	FILE * file = fopen(path, "rb");
+	if(!file){
+		return NULL;
+	}
+	fseek(file, 0, SEEK_END);
+	*size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	uint8_t * data = malloc(*size ? *size : 1);
+	if(data && fread(data, 1, *size, file) != *size){
+		free(data);
+		data = NULL;
+	}
+	fclose(file);
+	*copied = 1;
+	return data;
+#endif
+}
+
+// Unpacks a packed file into a buffer of its own (in the arena if it can), NULL if it's broken
+static uint8_t * unpack(const char * path, const uint8_t * packed, size_t packed_size, size_t * size, int use_arena){
+	long unpacked = lz_unpacked_size(packed, packed_size);
+	size_t mark = arena_mark(&asset_arena);
+	uint8_t * data = NULL;
+	int in_arena = 0;
+
+	if(unpacked >= 0 && use_arena){
+		data = arena_alloc(&asset_arena, unpacked, 32);
+		in_arena = data != NULL;
+		if(!data){
+			LOG_WARN("%s: %ld bytes don't fit in the asset arena (%u used), make ASSET_ARENA_SIZE bigger",
+				path, unpacked, (unsigned)asset_arena.used);
+		}
+	}
+	if(unpacked >= 0 && !data){
+		data = malloc(unpacked ? unpacked : 1);
+	}
+	if(!data){
+		LOG_ERROR("%s: not a packed file, or no memory for it", path);
+		return NULL;
+	}
+
+	uint64_t start = now_us();
+	if(!lz_unpack(packed, packed_size, data, unpacked)){
+		LOG_ERROR("%s: broken", path);
+		if(in_arena){
+			arena_release(&asset_arena, mark);
+		}
+		else {
+			free(data);
+		}
+		return NULL;
+	}
+	uint32_t us = now_us() - start;
+
+	asset_loaded.packed++;
+	asset_loaded.unpack_us += us;
+	*size = unpacked;
+	LOG_INFO("%s: %u -> %u bytes in %u us", path, (unsigned)packed_size, (unsigned)unpacked, (unsigned)us);
+	return data;
+}
+
+// owned: the caller got a buffer of its own (malloc()ed, unless use_arena)
+static const uint8_t * load(const char * path, size_t * size, int * owned, int use_arena){
+	char packed_path[ASSET_PATH_LENGTH];
+	size_t stored_size;
+	int copied;
+	uint64_t start = now_us();
+	const uint8_t * data;
+
+	snprintf(packed_path, sizeof(packed_path), "%s.lz", path);
+	const uint8_t * packed = read_file(packed_path, &stored_size, &copied);
+	if(packed){
+		data = unpack(packed_path, packed, stored_size, size, use_arena);
+		if(copied){
+			free((void *)packed);
+		}
+		*owned = 1;
+	}
+	else {
+		data = read_file(path, &stored_size, owned);
+		*size = stored_size;
+	}
+	if(!data){
+		return NULL;
+	}
+
+	asset_loaded.files++;
+	asset_loaded.stored_bytes += stored_size;
+	asset_loaded.bytes += *size;
+	asset_loaded.load_us += now_us() - start;
+	return data;
+}
+
+const void * asset_map(const char * path, size_t * size){
+	const loaded_asset * asset = find_loaded(path, 0);
+	if(asset){
+		*size = asset->size;
+		return asset->data;
+	}
+	int owned;
+	const void * data = load(path, size, &owned, 1);
+	if(data){
+		remember(path, 0, data, *size, NULL);
+	}
+	return data;
+}
+
+#ifdef _arch_dreamcast
+const char * asset_file(const char * path, char * name, size_t name_size){
+	const loaded_asset * asset = find_loaded(path, 1);
+	if(asset){
+		snprintf(name, name_size, "%s", asset->file_name);
+		return name;
+	}
+
+	size_t size;
+	int owned;
+	const uint8_t * data = load(path, &size, &owned, 0); // the ramdisk wants a malloc()ed buffer
+	if(!data){
+		return NULL;
+	}
+	if(!owned){
+		snprintf(name, name_size, "%s", path); // plain romdisk file, open it there
+		remember(path, 1, data, size, name);
+		return name;
+	}
+
+	// The /ram file is the buffer itself, the ramdisk takes it over
+	const char * base = strrchr(path, '/');
+	snprintf(name, name_size, "/ram/%s", base ? base + 1 : path);
+	if(fs_ramdisk_attach(name, (void *)data, size) < 0){
+		LOG_ERROR("%s: can't put it in /ram", path);
+		free((void *)data);
+		return NULL;
+	}
+	remember(path, 1, data, size, name);
+	return name;
+}
+#endif
+
+void asset_log_totals(){
+	LOG_INFO("Asset arena: %u of %u bytes used", (unsigned)asset_arena.peak, (unsigned)asset_arena.size);
+	LOG_INFO("Assets: %d files (%d packed), %u KB stored, %u KB in memory, %u us loading (%u us unpacking)",
+		asset_loaded.files, asset_loaded.packed,
+		(unsigned)(asset_loaded.stored_bytes + 1023) / 1024, (unsigned)(asset_loaded.bytes + 1023) / 1024,
+		(unsigned)asset_loaded.load_us, (unsigned)asset_loaded.unpack_us);
+}
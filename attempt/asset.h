@@ -0,0 +1,47 @@
+// Romdisk assets, packed or not.
+//
+// The romdisk is built from assets/ by lz_tool (see Makefile.host), and every file that
+// gets meaningfully smaller is stored packed as name.lz (lz.h). A smaller romdisk means
+// a smaller attempt.elf, which is faster to push over dc-tool-ser and to read off a CD.
+//
+// Code asks for "/rd/name" and doesn't care which way it was stored: a packed file is
+// unpacked on first access straight into the buffer it gets used from, a plain one is
+// mapped from the romdisk without a copy. Asking for it again gets the same buffer (or
+// /ram file) back, nothing is loaded twice. Every load is timed, asset_log_totals() logs
+// what it all cost at the end of boot.
+
+#ifndef ASSET_H
+#define ASSET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// What asset_map() can unpack without going to the heap (asset_file() always does, the
+// ramdisk takes over its buffers). Everything is loaded at boot and kept.
+#ifndef ASSET_ARENA_SIZE
+#define ASSET_ARENA_SIZE (64 * 1024)
+#endif
+
+typedef struct Asset_Totals {
+	int files; // loaded so far
+	int packed; // how many of them were packed
+	size_t stored_bytes; // as stored on the romdisk
+	size_t bytes; // after unpacking
+	uint32_t load_us; // opening, reading and unpacking, all of it
+	uint32_t unpack_us; // just the unpacking
+} asset_totals;
+
+// The asset's contents, or NULL if it isn't there (or is broken). They stay valid until
+// the game exits and are read only, a plain romdisk file is the romdisk image itself.
+const void * asset_map(const char * path, size_t * size);
+
+// For code that wants a file name instead of a buffer (plx_font_load() for one): a
+// packed asset is unpacked into a /ram file and that file's name is written to name,
+// a plain one just gets its own name. Returns NULL if it isn't there. Dreamcast only.
+const char * asset_file(const char * path, char * name, size_t name_size);
+
+extern asset_totals asset_loaded;
+
+void asset_log_totals();
+
+#endif
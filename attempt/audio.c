@@ -0,0 +1,512 @@
+// Background music streaming + sound effect mixer. See audio.h for the big picture.
+//
+// Threads:
+//  - the game thread only calls audio_play_sfx() (and audio_start_music() at startup)
+//  - the audio thread calls audio_refill() and, through the stream callback, audio_render()
+// The only things shared between them are the event queue and the music switch request,
+// and both of those are single-producer/single-consumer, so no locks are needed.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "audio.h"
+#include "log.h"
+
+#ifdef _arch_dreamcast
+#include <kos.h>
+#endif
+
+volatile uint32_t audio_dropped_events = 0;
+volatile uint32_t audio_underruns = 0;
+
+/**************************************** Event queue ****************************************/
+
+// Ring buffer of sfx_ids. event_head is only ever written by the game thread and
+// event_tail only by the audio thread, so a release store/acquire load on each is enough.
+static uint8_t event_queue[AUDIO_EVENT_QUEUE_SIZE];
+static volatile uint32_t event_head = 0;
+static volatile uint32_t event_tail = 0;
+
+void audio_play_sfx(sfx_id id){
+	uint32_t head = event_head;
+	uint32_t tail = __atomic_load_n(&event_tail, __ATOMIC_ACQUIRE);
+
+	if(head - tail >= AUDIO_EVENT_QUEUE_SIZE){
+		audio_dropped_events++;
+		return;
+	}
+	event_queue[head & (AUDIO_EVENT_QUEUE_SIZE-1)] = id;
+	__atomic_store_n(&event_head, head+1, __ATOMIC_RELEASE);
+}
+
+/**************************************** Sound effects ****************************************/
+
+// The effects are synthesized into these buffers once in audio_init(), so playing one is
+// just pointing a voice at its buffer. They're mono and get mixed into both channels.
+#define SFX_MAX_SAMPLES 16384 // a little over a third of a second
+
+static int16_t sfx_data[SFX_COUNT][SFX_MAX_SAMPLES];
+static int sfx_length[SFX_COUNT];
+
+typedef struct Voice {
+	const int16_t * data;
+	int length;
+	int pos;
+} voice;
+
+static voice voices[AUDIO_SFX_VOICES];
+
+static uint32_t noise_seed = 0x1234567;
+
+static int16_t noise_sample(){
+	noise_seed = noise_seed * 1103515245 + 12345;
+	return (int16_t)(noise_seed >> 16);
+}
+
+static uint32_t phase_step(uint32_t freq_hz){
+	// How much to advance a 32-bit phase accumulator each sample to get freq_hz
+	return (uint32_t)(((uint64_t)freq_hz << 32) / AUDIO_RATE);
+}
+
+static int synth_tone(int16_t * out, int start, int samples, uint32_t freq_from, uint32_t freq_to, int amplitude){
+	// Square wave sliding linearly from freq_from to freq_to with a linear fade out.
+	// Returns the position just after the tone, so tones can be chained.
+	uint32_t phase = 0;
+	for(int i=0; i<samples && start+i<SFX_MAX_SAMPLES; i++){
+		uint32_t freq = freq_from + (int)(freq_to - freq_from) * i / samples;
+		int level = amplitude * (samples - i) / samples;
+		phase += phase_step(freq);
+		out[start+i] = (phase & 0x80000000) ? level : -level;
+	}
+	return start + samples;
+}
+
+static void build_sfx(){
+	int len;
+
+	// Lock: short low blip
+	len = synth_tone(sfx_data[SFX_LOCK], 0, AUDIO_RATE/20, 220, 180, 6000);
+	sfx_length[SFX_LOCK] = len;
+
+	// Hard drop: a burst of noise with a falling thump under it
+	len = synth_tone(sfx_data[SFX_HARD_DROP], 0, AUDIO_RATE/12, 160, 60, 7000);
+	for(int i=0; i<len; i++){
+		int fade = (len - i);
+		int mixed = sfx_data[SFX_HARD_DROP][i] + (noise_sample() / 6) * fade / len;
+		sfx_data[SFX_HARD_DROP][i] = mixed;
+	}
+	sfx_length[SFX_HARD_DROP] = len;
+
+	// Line clear: rising sweep
+	len = synth_tone(sfx_data[SFX_LINE_CLEAR], 0, AUDIO_RATE/7, 600, 1200, 5000);
+	sfx_length[SFX_LINE_CLEAR] = len;
+
+	// Tetris: a quick 4 note arpeggio (A, C#, E, A)
+	len = 0;
+	len = synth_tone(sfx_data[SFX_TETRIS], len, AUDIO_RATE/14, 880, 880, 5000);
+	len = synth_tone(sfx_data[SFX_TETRIS], len, AUDIO_RATE/14, 1109, 1109, 5000);
+	len = synth_tone(sfx_data[SFX_TETRIS], len, AUDIO_RATE/14, 1319, 1319, 5000);
+	len = synth_tone(sfx_data[SFX_TETRIS], len, AUDIO_RATE/7, 1760, 1760, 5000);
+	sfx_length[SFX_TETRIS] = len;
+}
+
+static void start_voice(sfx_id id){
+	// Use a free voice, or steal the one that's been playing the longest
+	int best = 0;
+	for(int i=0; i<AUDIO_SFX_VOICES; i++){
+		if(!voices[i].data){
+			best = i;
+			break;
+		}
+		if(voices[i].pos > voices[best].pos){
+			best = i;
+		}
+	}
+	voices[best].data = sfx_data[id];
+	voices[best].length = sfx_length[id];
+	voices[best].pos = 0;
+}
+
+static void process_events(){
+	uint32_t tail = event_tail;
+	uint32_t head = __atomic_load_n(&event_head, __ATOMIC_ACQUIRE);
+
+	while(tail != head){
+		uint8_t id = event_queue[tail & (AUDIO_EVENT_QUEUE_SIZE-1)];
+		if(id < SFX_COUNT){
+			start_voice(id);
+		}
+		tail++;
+	}
+	__atomic_store_n(&event_tail, tail, __ATOMIC_RELEASE);
+}
+
+/**************************************** Music ****************************************/
+
+// Music is decoded a whole chunk at a time into one of these two buffers while the
+// mixer plays from the other one.
+static int16_t music_buf[2][AUDIO_CHUNK_FRAMES*2];
+static int music_buf_frames[2];
+static volatile int music_buf_full[2];
+static int music_play_buf = 0;
+static int music_play_pos = 0;
+static int music_starved = 0; // the underrun has been counted, waiting for music_play_buf to fill
+
+typedef struct Music_Source {
+	FILE * file; // NULL means the built-in tune
+	int channels;
+	long data_start; // byte offset of the first sample
+	long data_size; // bytes of sample data
+	long data_pos; // how far into the sample data we are
+
+	// built-in tune state
+	int note;
+	int note_pos;
+	uint32_t phase;
+} music_source;
+
+static music_source music;
+static music_source music_pending;
+static volatile int music_switch_pending = 0;
+static volatile int music_enabled = 0;
+
+// The built-in tune (Korobeiniki), used when there's no music file.
+// Each pair is a MIDI note number (0 = rest) and a length in eighth notes.
+static const uint8_t tune[][2] = {
+	{76,2}, {71,1}, {72,1}, {74,2}, {72,1}, {71,1}, {69,2}, {69,1}, {72,1}, {76,2}, {74,1}, {72,1},
+	{71,3}, {72,1}, {74,2}, {76,2}, {72,2}, {69,2}, {69,2}, {0,2},
+	{74,3}, {77,1}, {81,2}, {79,1}, {77,1}, {76,3}, {72,1}, {76,2}, {74,1}, {72,1},
+	{71,2}, {71,1}, {72,1}, {74,2}, {76,2}, {72,2}, {69,2}, {69,2}, {0,2},
+};
+#define TUNE_LENGTH (sizeof(tune)/sizeof(tune[0]))
+#define TUNE_EIGHTH_SAMPLES (AUDIO_RATE/5) // 150 beats per minute
+
+// Frequencies of MIDI notes 60-71 (C4 to B4) in hundredths of a Hz
+static const uint32_t octave4_centihz[12] = {
+	26163, 27718, 29366, 31113, 32963, 34923, 36999, 39200, 41530, 44000, 46616, 49388
+};
+
+static uint32_t midi_note_step(int note){
+	uint32_t centihz = octave4_centihz[note % 12];
+	int octave = (note / 12) - 5;
+	if(octave > 0){
+		centihz <<= octave;
+	}
+	else if(octave < 0){
+		centihz >>= -octave;
+	}
+	return (uint32_t)(((uint64_t)centihz << 32) / (AUDIO_RATE * 100ULL));
+}
+
+static void decode_tune(int16_t * out, int frames){
+	for(int i=0; i<frames; i++){
+		int note = tune[music.note][0];
+		int length = tune[music.note][1] * TUNE_EIGHTH_SAMPLES;
+		int16_t sample = 0;
+
+		if(note){
+			// square wave that fades to half volume, with a tiny gap before the next note
+			int level = 1800 - (900 * music.note_pos / length);
+			if(music.note_pos < length - AUDIO_RATE/50){
+				music.phase += midi_note_step(note);
+				sample = (music.phase & 0x80000000) ? level : -level;
+			}
+		}
+		out[i*2] = sample;
+		out[i*2+1] = sample;
+
+		music.note_pos++;
+		if(music.note_pos >= length){
+			music.note_pos = 0;
+			music.note = (music.note + 1) % TUNE_LENGTH;
+		}
+	}
+}
+
+static int decode_wav(int16_t * out, int frames){
+	// Reads up to `frames` frames from the .wav, looping back to the start at the end.
+	// Mono files get copied into both channels. Returns how many frames were decoded.
+	int bytes_per_frame = music.channels * 2;
+	int done = 0;
+
+	while(done < frames){
+		if(music.data_pos >= music.data_size){
+			fseek(music.file, music.data_start, SEEK_SET);
+			music.data_pos = 0;
+		}
+
+		int want = frames - done;
+		long left = (music.data_size - music.data_pos) / bytes_per_frame;
+		if(want > left){
+			want = left;
+		}
+
+		int16_t * dst = out + done*2;
+		int got;
+		if(music.channels == 2){
+			got = fread(dst, bytes_per_frame, want, music.file);
+		}
+		else {
+			// read into the back half of the space so expanding in place doesn't overwrite
+			// samples we haven't copied yet
+			int16_t * src = dst + want;
+			got = fread(src, bytes_per_frame, want, music.file);
+			for(int i=0; i<got; i++){
+				dst[i*2] = src[i];
+				dst[i*2+1] = src[i];
+			}
+		}
+		if(got <= 0){
+			break; // read error, just play what we have
+		}
+		music.data_pos += got * bytes_per_frame;
+		done += got;
+	}
+	return done;
+}
+
+static uint32_t read_u32(const uint8_t * p){
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t read_u16(const uint8_t * p){
+	return p[0] | (p[1] << 8);
+}
+
+static int open_wav(music_source * src, const char * path){
+	// Finds the "fmt " and "data" chunks of a RIFF wave file.
+	// Only 16-bit PCM at AUDIO_RATE is accepted, we don't resample.
+	uint8_t chunk[24];
+	FILE * f = fopen(path, "rb");
+
+	if(!f){
+		return 0;
+	}
+	if(fread(chunk, 1, 12, f) != 12 || memcmp(chunk, "RIFF", 4) || memcmp(chunk+8, "WAVE", 4)){
+		LOG_WARN("audio: %s is not a wave file", path);
+		fclose(f);
+		return 0;
+	}
+
+	src->channels = 0;
+	while(fread(chunk, 1, 8, f) == 8){
+		uint32_t size = read_u32(chunk+4);
+
+		if(!memcmp(chunk, "fmt ", 4)){
+			if(size < 16 || fread(chunk+8, 1, 16, f) != 16){
+				break;
+			}
+			int format = read_u16(chunk+8);
+			int channels = read_u16(chunk+10);
+			uint32_t rate = read_u32(chunk+12);
+			int bits = read_u16(chunk+22);
+			if(format != 1 || bits != 16 || rate != AUDIO_RATE || channels < 1 || channels > 2){
+				LOG_WARN("audio: %s must be 16-bit PCM at %d Hz", path, AUDIO_RATE);
+				break;
+			}
+			src->channels = channels;
+			fseek(f, size - 16 + (size & 1), SEEK_CUR);
+		}
+		else if(!memcmp(chunk, "data", 4)){
+			if(!src->channels){
+				break; // data before fmt, give up
+			}
+			src->file = f;
+			src->data_start = ftell(f);
+			src->data_size = size;
+			src->data_pos = 0;
+			return 1;
+		}
+		else {
+			fseek(f, size + (size & 1), SEEK_CUR); // chunks are padded to an even size
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+int audio_start_music(const char * path){
+	music_source src;
+	int from_file = 0;
+
+	memset(&src, 0, sizeof(src));
+	if(path){
+		from_file = open_wav(&src, path);
+	}
+
+	// Hand the new source over to the audio thread, which swaps it in the next time
+	// it refills. Only one switch can be in flight, so wait out any previous one.
+	while(__atomic_load_n(&music_switch_pending, __ATOMIC_ACQUIRE)){
+#ifdef _arch_dreamcast
+		thd_pass();
+#else
+		audio_refill();
+#endif
+	}
+	music_pending = src;
+	__atomic_store_n(&music_switch_pending, 1, __ATOMIC_RELEASE);
+	music_enabled = 1;
+
+#ifndef _arch_dreamcast
+	audio_refill(); // no audio thread on the host
+#endif
+	return from_file;
+}
+
+void audio_stop_music(){
+	music_enabled = 0;
+}
+
+void audio_refill(){
+	if(__atomic_load_n(&music_switch_pending, __ATOMIC_ACQUIRE)){
+		if(music.file){
+			fclose(music.file);
+		}
+		music = music_pending;
+		music_buf_full[0] = 0;
+		music_buf_full[1] = 0;
+		music_play_pos = 0;
+		__atomic_store_n(&music_switch_pending, 0, __ATOMIC_RELEASE);
+	}
+
+	// The one the mixer is on (or waiting on) first, so the chunks play in order
+	for(int n=0; n<2; n++){
+		int i = music_play_buf ^ n;
+		if(!music_buf_full[i]){
+			int frames;
+			if(music.file){
+				frames = decode_wav(music_buf[i], AUDIO_CHUNK_FRAMES);
+			}
+			else {
+				decode_tune(music_buf[i], AUDIO_CHUNK_FRAMES);
+				frames = AUDIO_CHUNK_FRAMES;
+			}
+			music_buf_frames[i] = frames;
+			music_buf_full[i] = frames > 0;
+		}
+	}
+}
+
+/**************************************** Mixer ****************************************/
+
+static inline int16_t clamp16(int x){
+	if(x > 32767) return 32767;
+	if(x < -32768) return -32768;
+	return x;
+}
+
+void audio_render(int16_t * out, int frames){
+	process_events();
+
+	for(int i=0; i<frames; i++){
+		int left = 0;
+		int right = 0;
+
+		if(music_enabled){
+			if(music_buf_full[music_play_buf] && music_play_pos >= music_buf_frames[music_play_buf]){
+				// done with this buffer, let audio_refill() decode into it again
+				music_buf_full[music_play_buf] = 0;
+				music_play_buf ^= 1;
+				music_play_pos = 0;
+			}
+			if(music_buf_full[music_play_buf]){
+				left = music_buf[music_play_buf][music_play_pos*2];
+				right = music_buf[music_play_buf][music_play_pos*2+1];
+				music_play_pos++;
+				music_starved = 0;
+			}
+			else if(!music_starved){
+				// refill didn't keep up, play silence on this buffer until it's full again
+				audio_underruns++;
+				music_starved = 1;
+			}
+		}
+
+		for(int v=0; v<AUDIO_SFX_VOICES; v++){
+			if(voices[v].data){
+				int sample = voices[v].data[voices[v].pos++];
+				left += sample;
+				right += sample;
+				if(voices[v].pos >= voices[v].length){
+					voices[v].data = NULL;
+				}
+			}
+		}
+
+		out[i*2] = clamp16(left);
+		out[i*2+1] = clamp16(right);
+	}
+}
+
+/**************************************** Dreamcast glue ****************************************/
+
+#ifdef _arch_dreamcast
+
+// Small stream buffer = low latency for the sound effects. At 44.1 kHz stereo 8 KB is
+// about 46 ms, and the thread polls far more often than that.
+#define AUDIO_STREAM_BUFFER 8192
+
+static snd_stream_hnd_t stream;
+static kthread_t * audio_thread;
+static volatile int audio_running = 0;
+static int16_t stream_out[AUDIO_STREAM_BUFFER/2];
+
+static void * stream_callback(snd_stream_hnd_t hnd, int smp_req, int * smp_recv){
+	// smp_req is in bytes (4 per stereo frame)
+	int frames = smp_req / 4;
+	if(frames > AUDIO_STREAM_BUFFER/4){
+		frames = AUDIO_STREAM_BUFFER/4;
+	}
+	audio_render(stream_out, frames);
+	*smp_recv = frames * 4;
+	return stream_out;
+}
+
+static void * audio_thread_main(void * param){
+	while(audio_running){
+		audio_refill();
+		snd_stream_poll(stream);
+		thd_sleep(5);
+	}
+	return NULL;
+}
+
+void audio_init(){
+	build_sfx();
+
+	snd_stream_init();
+	stream = snd_stream_alloc(stream_callback, AUDIO_STREAM_BUFFER);
+	snd_stream_start(stream, AUDIO_RATE, 1);
+
+	audio_running = 1;
+	audio_thread = thd_create(0, audio_thread_main, NULL);
+}
+
+void audio_shutdown(){
+	audio_running = 0;
+	thd_join(audio_thread, NULL);
+
+	snd_stream_stop(stream);
+	snd_stream_destroy(stream);
+	snd_stream_shutdown();
+
+	if(music.file){
+		fclose(music.file);
+		music.file = NULL;
+	}
+}
+
+#else
+
+void audio_init(){
+	build_sfx();
+}
+
+void audio_shutdown(){
+	if(music.file){
+		fclose(music.file);
+		music.file = NULL;
+	}
+}
+
+#endif
@@ -0,0 +1,57 @@
+// Background music streaming + sound effect mixer.
+//
+// Everything audio related runs on its own thread so the game loop never waits on it.
+// The game only ever calls audio_play_sfx(), which drops an event into a lock-free
+// queue and returns right away. The audio thread reads those events, decodes the
+// music a chunk ahead into one of two buffers, and mixes both into the AICA stream.
+//
+// The mixer itself doesn't know anything about KOS, so it also builds on a normal PC
+// (see audio_host.c and Makefile.host) where audio_render() is called directly and
+// the result is written to a file.
+
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdint.h>
+
+#define AUDIO_RATE 44100 // samples per second, per channel
+#define AUDIO_CHUNK_FRAMES 4096 // size of each of the two music decode buffers (stereo frames)
+#define AUDIO_SFX_VOICES 4 // how many sound effects can play on top of each other
+#define AUDIO_EVENT_QUEUE_SIZE 32 // must be a power of 2
+
+typedef enum Sfx_Id {
+	SFX_LOCK = 0, // a tetromino got set
+	SFX_HARD_DROP,
+	SFX_LINE_CLEAR,
+	SFX_TETRIS, // 4 lines at once
+	SFX_COUNT
+} sfx_id;
+
+// Sets up the mixer and sound effects. On the Dreamcast this also starts the AICA
+// stream and the audio thread.
+void audio_init();
+void audio_shutdown();
+
+// Starts streaming a 16-bit PCM .wav file (mono or stereo, 44100 Hz) on a loop.
+// If path is NULL or the file can't be used, the built-in tune plays instead.
+// Returns 1 if the file is being used, 0 if it fell back to the built-in tune.
+int audio_start_music(const char * path);
+void audio_stop_music();
+
+// Safe to call from the game loop at any time, never blocks.
+// If the queue is full the event is dropped (and counted in audio_dropped_events).
+void audio_play_sfx(sfx_id id);
+
+// Mixes the next `frames` stereo frames (interleaved L/R) into out.
+// On the Dreamcast the stream callback calls this, on the host you call it yourself.
+void audio_render(int16_t * out, int frames);
+
+// Decodes music into whichever of the two buffers has been used up.
+// The audio thread calls this between stream polls, so decoding never happens
+// inside the stream callback. The host build calls it before each audio_render().
+void audio_refill();
+
+extern volatile uint32_t audio_dropped_events;
+extern volatile uint32_t audio_underruns;
+
+#endif
@@ -0,0 +1,93 @@
+// Host (PC) build of the audio mixer, for checking music and sound effects without
+// pushing an .elf to the Dreamcast every time.
+//
+// Plays the music (a .wav or the built-in tune) with every sound effect fired on a
+// loop, and writes the mix to a 16-bit stereo .wav you can listen to.
+//
+// Build: make -f Makefile.host audio_host
+// Usage: ./audio_host out.wav [music.wav] [seconds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "audio.h"
+#include "log.h"
+
+#define FRAMES_PER_TICK (AUDIO_RATE/60) // one game frame worth of audio
+
+static void write_u32(FILE * f, uint32_t x){
+	uint8_t b[4] = { x, x >> 8, x >> 16, x >> 24 };
+	fwrite(b, 1, 4, f);
+}
+
+static void write_u16(FILE * f, uint16_t x){
+	uint8_t b[2] = { x, x >> 8 };
+	fwrite(b, 1, 2, f);
+}
+
+static void write_wav_header(FILE * f, uint32_t frames){
+	uint32_t data_size = frames * 4;
+	fwrite("RIFF", 1, 4, f);
+	write_u32(f, 36 + data_size);
+	fwrite("WAVEfmt ", 1, 8, f);
+	write_u32(f, 16);
+	write_u16(f, 1); // PCM
+	write_u16(f, 2); // stereo
+	write_u32(f, AUDIO_RATE);
+	write_u32(f, AUDIO_RATE * 4);
+	write_u16(f, 4);
+	write_u16(f, 16);
+	fwrite("data", 1, 4, f);
+	write_u32(f, data_size);
+}
+
+int main(int argc, char ** argv){
+	if(argc < 2){
+		printf("Usage: %s out.wav [music.wav] [seconds]\n", argv[0]);
+		return 1;
+	}
+	const char * music_path = argc > 2 ? argv[2] : NULL;
+	int seconds = argc > 3 ? atoi(argv[3]) : 10;
+
+	FILE * out = fopen(argv[1], "wb");
+	if(!out){
+		printf("ERROR: can't open %s for writing\n", argv[1]);
+		return 1;
+	}
+
+	audio_init();
+	if(!audio_start_music(music_path) && music_path){
+		log_drain(0);
+		printf("Couldn't use %s, playing the built-in tune\n", music_path);
+	}
+
+	int ticks = seconds * 60;
+	int16_t buffer[FRAMES_PER_TICK*2];
+	double render_time = 0;
+
+	write_wav_header(out, ticks * FRAMES_PER_TICK);
+
+	for(int tick=0; tick<ticks; tick++){
+		// every half second, fire the next sound effect
+		if(tick % 30 == 0){
+			audio_play_sfx((tick / 30) % SFX_COUNT);
+		}
+
+		clock_t start = clock();
+		audio_refill();
+		audio_render(buffer, FRAMES_PER_TICK);
+		render_time += (double)(clock() - start) / CLOCKS_PER_SEC;
+
+		fwrite(buffer, sizeof(int16_t), FRAMES_PER_TICK*2, out);
+	}
+
+	fclose(out);
+	audio_shutdown();
+
+	printf("Wrote %d seconds of audio to %s\n", seconds, argv[1]);
+	printf("Mixing took %.3f ms per game frame (%.2f%% of a 60 Hz frame)\n",
+		render_time * 1000 / ticks, render_time * 100 / seconds);
+	printf("Underruns: %u, dropped events: %u\n", audio_underruns, audio_dropped_events);
+	return 0;
+}
@@ -0,0 +1,243 @@
+// 3D background. See background.h.
+
+#include <math.h>
+#include <string.h>
+
+#include "background.h"
+#include "tetris.h"
+
+#ifdef _arch_dreamcast
+#include <kos.h>
+#include <plx/matrix.h>
+#endif
+
+// Camera, the same lens main_old.c had, further back (BACKGROUND_CAMERA_Z) to fit the whole cloud
+#define FOV_Y 60.0f
+#define ASPECT (640.0f / 480.0f)
+#define Z_NEAR 0.1f
+#define Z_FAR 100.0f
+
+// Where the pieces go (around the origin), and how fast it all turns
+#define CLOUD_X 7.0f
+#define CLOUD_Y 5.0f
+#define CLOUD_Z 3.0f
+#define SPIN 0.2f // degrees per frame at level 1...
+#define SPIN_PER_LEVEL 0.15f // ...and this much more for every level after that
+#define JOLT 4.0f // extra degrees per frame right after a level change
+#define JOLT_DECAY 0.95f
+#define TILT 15.0f // degrees up and down
+#define DIM 0.5f // it's a background, keep it darker than the blocks
+
+#ifdef _arch_dreamcast
+#define CMD_VERTEX PVR_CMD_VERTEX
+#define CMD_VERTEX_EOL PVR_CMD_VERTEX_EOL
+#else
+#define CMD_VERTEX 0xe0000000 // the PVR's values, so the host build makes the same list
+#define CMD_VERTEX_EOL 0xf0000000
+#endif
+
+_Static_assert(BACKGROUND_CUBES % BACKGROUND_BATCH_CUBES == 0, "batches have to cover the cubes exactly");
+
+// Corners of a cube are numbered x | y << 1 | z << 2. Every face is a strip in the order
+// draw_square() uses (bottom left, top left, bottom right, top right) as seen from
+// outside the cube, so a face turned towards the camera winds the same way a square does.
+static const uint8_t faces[6][4] = {
+	{4, 6, 5, 7}, // +z, towards the camera before it turns
+	{1, 3, 0, 2}, // -z
+	{5, 7, 1, 3}, // +x
+	{0, 2, 4, 6}, // -x
+	{6, 2, 7, 3}, // +y
+	{0, 4, 1, 5}, // -y
+};
+static const float face_light[6] = {0.85f, 0.55f, 0.7f, 0.7f, 1.0f, 0.45f};
+
+static float random_range(uint32_t * rng, float range){
+	// -range..range
+	return ((tetris_random(rng) >> 16) * (1.0f / 32768.0f) - 1) * range;
+}
+
+static uint32_t shade(uint32_t argb, float light){
+	int r = ((argb >> 16) & 0xff) * light * DIM;
+	int g = ((argb >> 8) & 0xff) * light * DIM;
+	int b = (argb & 0xff) * light * DIM;
+	return 0xff000000 | r << 16 | g << 8 | b;
+}
+
+void background_init(background * bg, uint32_t seed, const uint32_t * type_argb){
+	uint32_t rng = seed ? seed : 1;
+	int cube = 0;
+
+	memset(bg, 0, sizeof(*bg));
+	bg->level = 1;
+#ifdef _arch_dreamcast
+	plx_mat3d_init();
+#endif
+	for(int piece=0; piece<BACKGROUND_PIECES; piece++){
+		color_id type = 1 + piece % 7;
+		const uint8_t * shape = tetris_shape(type, tetris_random(&rng) % 4);
+		int n = tetris_shape_size(type);
+		float center_x = random_range(&rng, CLOUD_X);
+		float center_y = random_range(&rng, CLOUD_Y);
+		float center_z = random_range(&rng, CLOUD_Z);
+
+		for(int row=0; row<n; row++){
+			for(int col=0; col<n; col++){
+				if(!(shape[row] & (1 << col))){
+					continue;
+				}
+				// Rows go down, y goes up
+				float x = center_x + col - n * 0.5f;
+				float y = center_y - row + n * 0.5f - 1;
+				for(int corner=0; corner<8; corner++){
+					float * p = bg->corners[cube*8 + corner];
+					p[0] = x + (corner & 1);
+					p[1] = y + ((corner >> 1) & 1);
+					p[2] = center_z + ((corner >> 2) & 1) - 0.5f;
+					p[3] = 1;
+				}
+				for(int face=0; face<6; face++){
+					bg->face_argb[cube][face] = shade(type_argb[type], face_light[face]);
+				}
+				cube++;
+			}
+		}
+	}
+}
+
+void background_set_level(background * bg, int level){
+	if(level != bg->level){
+		bg->jolt += JOLT;
+		bg->level = level;
+	}
+}
+
+/**************************************** transform ****************************************/
+
+#ifdef _arch_dreamcast
+
+static void load_matrix(const background * bg){
+	// Projection and camera are set up the way main_old.c did, then everything goes into
+	// XMTRX: screen view * projection * modelview
+	plx_mat3d_mode(PLX_MAT_PROJECTION);
+	plx_mat3d_identity();
+	plx_mat3d_perspective(FOV_Y, ASPECT, Z_NEAR, Z_FAR);
+
+	point_t eye = {0.0f, 0.0f, BACKGROUND_CAMERA_Z, 1.0f};
+	point_t target = {0.0f, 0.0f, 0.0f, 1.0f};
+	vector_t up = {0.0f, 1.0f, 0.0f, 0.0f};
+	plx_mat3d_mode(PLX_MAT_MODELVIEW);
+	plx_mat3d_identity();
+	plx_mat3d_lookat(&eye, &target, &up);
+	plx_mat3d_rotate(bg->angle, 0.0f, 1.0f, 0.0f);
+	plx_mat3d_rotate(bg->tilt, 1.0f, 0.0f, 0.0f);
+
+	plx_mat_identity();
+	plx_mat3d_apply_all();
+}
+
+static void transform_batch(const float (*in)[4], float (*out)[4], int count){
+	// ftrv on every corner, then x/w, y/w and 1/w
+	plx_mat_transform((vector_t *)in, (vector_t *)out, count, 4 * sizeof(float));
+}
+
+#else
+
+// The C reference: the same matrices plx_mat3d builds, multiplied out here
+static float matrix[4][4]; // row major, applied to column vectors
+
+static void multiply(float (*a)[4], const float (*b)[4]){
+	// a = a * b
+	float result[4][4];
+	for(int i=0; i<4; i++){
+		for(int j=0; j<4; j++){
+			result[i][j] = a[i][0]*b[0][j] + a[i][1]*b[1][j] + a[i][2]*b[2][j] + a[i][3]*b[3][j];
+		}
+	}
+	memcpy(a, result, sizeof(result));
+}
+
+static void load_matrix(const background * bg){
+	float f = 1.0f / tanf(FOV_Y * (float)M_PI / 360.0f);
+	float ya = bg->angle * (float)M_PI / 180.0f;
+	float xa = bg->tilt * (float)M_PI / 180.0f;
+
+	// plx's screen view: -1..1 to pixels, y flipped
+	float screen[4][4] = {{320, 0, 0, 320}, {0, -240, 0, 240}, {0, 0, 1, 0}, {0, 0, 0, 1}};
+	float projection[4][4] = {
+		{f / ASPECT, 0, 0, 0},
+		{0, f, 0, 0},
+		{0, 0, (Z_FAR + Z_NEAR) / (Z_NEAR - Z_FAR), 2 * Z_FAR * Z_NEAR / (Z_NEAR - Z_FAR)},
+		{0, 0, -1, 0},
+	};
+	// lookat() from (0, 0, BACKGROUND_CAMERA_Z) at the origin is just a step back
+	float camera[4][4] = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, -BACKGROUND_CAMERA_Z}, {0, 0, 0, 1}};
+	float spin[4][4] = {{cosf(ya), 0, sinf(ya), 0}, {0, 1, 0, 0}, {-sinf(ya), 0, cosf(ya), 0}, {0, 0, 0, 1}};
+	float tilt[4][4] = {{1, 0, 0, 0}, {0, cosf(xa), -sinf(xa), 0}, {0, sinf(xa), cosf(xa), 0}, {0, 0, 0, 1}};
+
+	memcpy(matrix, screen, sizeof(matrix));
+	multiply(matrix, (const float (*)[4])projection);
+	multiply(matrix, (const float (*)[4])camera);
+	multiply(matrix, (const float (*)[4])spin);
+	multiply(matrix, (const float (*)[4])tilt);
+}
+
+static void transform_batch(const float (*in)[4], float (*out)[4], int count){
+	for(int i=0; i<count; i++){
+		const float * p = in[i];
+		float x = matrix[0][0]*p[0] + matrix[0][1]*p[1] + matrix[0][2]*p[2] + matrix[0][3]*p[3];
+		float y = matrix[1][0]*p[0] + matrix[1][1]*p[1] + matrix[1][2]*p[2] + matrix[1][3]*p[3];
+		float w = matrix[3][0]*p[0] + matrix[3][1]*p[1] + matrix[3][2]*p[2] + matrix[3][3]*p[3];
+		float rw = 1.0f / w;
+		out[i][0] = x * rw;
+		out[i][1] = y * rw;
+		out[i][2] = rw;
+	}
+}
+
+#endif
+
+/**************************************** building ****************************************/
+
+void background_update(background * bg){
+	float screen[BACKGROUND_BATCH_CUBES * 8][4] __attribute__((aligned(32)));
+	background_vertex * out = bg->vertices;
+
+	bg->frame++;
+	bg->angle += SPIN * (1 + SPIN_PER_LEVEL * (bg->level - 1)) + bg->jolt;
+	if(bg->angle >= 360.0f){
+		bg->angle -= 360.0f;
+	}
+	bg->jolt *= JOLT_DECAY;
+	bg->tilt = TILT * sinf(bg->frame * 0.01f);
+
+	load_matrix(bg);
+	for(int first=0; first<BACKGROUND_CUBES; first+=BACKGROUND_BATCH_CUBES){
+		transform_batch((const float (*)[4])bg->corners[first*8], screen, BACKGROUND_BATCH_CUBES * 8);
+
+		for(int c=0; c<BACKGROUND_BATCH_CUBES; c++){
+			float (*s)[4] = &screen[c*8];
+			for(int face=0; face<6; face++){
+				const uint8_t * v = faces[face];
+				// Facing the camera if it winds like a square on screen
+				float area = (s[v[1]][0] - s[v[0]][0]) * (s[v[2]][1] - s[v[0]][1])
+					- (s[v[1]][1] - s[v[0]][1]) * (s[v[2]][0] - s[v[0]][0]);
+				if(area <= 0){
+					continue;
+				}
+				uint32_t argb = bg->face_argb[first + c][face];
+				for(int k=0; k<4; k++){
+					out->flags = k == 3 ? CMD_VERTEX_EOL : CMD_VERTEX;
+					out->x = s[v[k]][0];
+					out->y = s[v[k]][1];
+					out->z = s[v[k]][2];
+					out->u = 0;
+					out->v = 0;
+					out->argb = argb;
+					out->oargb = 0;
+					out++;
+				}
+			}
+		}
+	}
+	bg->vertex_count = out - bg->vertices;
+}
@@ -0,0 +1,62 @@
+// The 3D background: a slowly turning cloud of tetrominos made of cubes, behind the field.
+// It spins faster as the level goes up, and gives a little jolt on every level change.
+//
+// Every frame the camera and the spin go into one matrix (plx_mat3d on the Dreamcast,
+// the same maths in plain C on a PC) and the cube corners go through it a batch at a
+// time: on the SH4 that's ftrv (plx_mat_transform()) on a batch small enough to stay in
+// the operand cache, and the faces get built out of the batch right away. Only faces
+// turned towards the camera are kept, so a cube is at most 3 quads.
+//
+// The result is a list of finished PVR vertices for the opaque list, all under one
+// header (flat colored, no texture), sent with one pvr_prim(). It's built in the logic
+// half of the frame, like everything else, and only copied while the lists are open.
+//
+// Cost is fixed by the mesh: BACKGROUND_CORNERS transforms and at most
+// BACKGROUND_MAX_VERTICES vertices, whatever the camera does.
+
+#ifndef BACKGROUND_H
+#define BACKGROUND_H
+
+#include <stdint.h>
+
+#define BACKGROUND_PIECES 16
+#define BACKGROUND_CUBES (BACKGROUND_PIECES * 4)
+#define BACKGROUND_CORNERS (BACKGROUND_CUBES * 8) // transformed every frame
+#define BACKGROUND_MAX_VERTICES (BACKGROUND_CUBES * 3 * 4) // 3 faces a cube at most face the camera
+#define BACKGROUND_BATCH_CUBES 4 // 32 corners per transform, 512 bytes in and 512 out
+#define BACKGROUND_BUDGET_PERCENT 5 // of a 60 Hz frame, building it has to stay under this
+#define BACKGROUND_CAMERA_Z 14.0f // looking at the origin from here, the pieces are around it
+
+// Same layout as pvr_vertex_t, so the list goes to the PVR as it is
+typedef struct Background_Vertex {
+	uint32_t flags;
+	float x, y, z; // pixels, and 1/w for the depth
+	float u, v;
+	uint32_t argb, oargb;
+} background_vertex;
+
+typedef struct Background {
+	float corners[BACKGROUND_CORNERS][4] __attribute__((aligned(32))); // x, y, z, 1 (model space)
+	uint32_t face_argb[BACKGROUND_CUBES][6]; // lit per face
+
+	float angle; // degrees around y
+	float tilt; // degrees around x, wobbles
+	float jolt; // extra spin from the last level change, dies down
+	int level;
+	uint32_t frame;
+
+	background_vertex vertices[BACKGROUND_MAX_VERTICES] __attribute__((aligned(32)));
+	int vertex_count;
+} background;
+
+// Scatters the pieces. type_argb is the color of every color_id, like block_argb in main.c.
+// On the Dreamcast this also sets up plx_mat3d.
+void background_init(background * bg, uint32_t seed, const uint32_t * type_argb);
+
+// A level change makes it spin faster, with a jolt right when it happens
+void background_set_level(background * bg, int level);
+
+// Moves the animation on one frame and builds vertices/vertex_count
+void background_update(background * bg);
+
+#endif
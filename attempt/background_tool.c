@@ -0,0 +1,128 @@
+// Host tool for the 3D background (background.h), running the C reference transform.
+//
+//   background_tool check [frames]
+//       runs the animation through level changes and checks every frame's list against
+//       a back face test in 3D, and that it stays inside the vertex budget
+//   background_tool bench [seed]
+//       time per frame to build the list, against BACKGROUND_BUDGET_PERCENT of a frame
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "background.h"
+#include "tetris.h"
+
+#define BENCH_SECONDS 1.0
+#define FRAME_US (1e6 / 60)
+#define EDGE_ON 0.001f // model space units
+
+static const uint32_t type_argb[8] = {
+	0xff000000, 0xff00ffff, 0xffffff00, 0xffff00ff, 0xff00ff00, 0xffff0000, 0xff0000ff, 0xffff8000
+};
+
+static double now_seconds(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int check(int frames){
+	static background bg;
+	int wrong = 0, most = 0;
+
+	background_init(&bg, 12345, type_argb);
+	for(int frame=0; frame<frames; frame++){
+		background_set_level(&bg, 1 + frame / 600);
+		background_update(&bg);
+
+		int ok = bg.vertex_count <= BACKGROUND_MAX_VERTICES && bg.vertex_count % 4 == 0;
+		for(int i=0; ok && i<bg.vertex_count; i++){
+			const background_vertex * v = &bg.vertices[i];
+			ok = isfinite(v->x) && isfinite(v->y) && v->z > 0 && v->x > -640 && v->x < 1280 && v->y > -480 && v->y < 960
+				&& ((i % 4 == 3) == (v->flags == 0xf0000000));
+		}
+
+		// The faces it kept have to be the ones facing the camera in 3D: the camera in
+		// model space is in front of a face's plane. Same order, cube by cube.
+		float ya = bg.angle * (float)M_PI / 180.0f;
+		float xa = bg.tilt * (float)M_PI / 180.0f;
+		float eye[3] = {
+			-sinf(ya) * BACKGROUND_CAMERA_Z,
+			sinf(xa) * cosf(ya) * BACKGROUND_CAMERA_Z,
+			cosf(xa) * cosf(ya) * BACKGROUND_CAMERA_Z,
+		};
+		int vertex = 0;
+		for(int c=0; ok && c<BACKGROUND_CUBES; c++){
+			const float * low = bg.corners[c*8]; // corner 0, the others are +1 along each axis
+			int visible = 0;
+			for(int face=0; face<6; face++){
+				int axis = face / 2; // z, x, y in face order
+				int component = axis == 0 ? 2 : axis == 1 ? 0 : 1;
+				float side = face % 2 == 0 ? low[component] + 1 : low[component];
+				float towards = face % 2 == 0 ? eye[component] - side : side - eye[component];
+				int kept = vertex < bg.vertex_count && bg.vertices[vertex].argb == bg.face_argb[c][face];
+				if(fabsf(towards) < EDGE_ON ? !kept : towards <= 0){
+					continue; // a face seen edge on can go either way
+				}
+				visible++;
+				ok = kept;
+				vertex += 4;
+			}
+			ok = ok && visible >= 1 && visible <= 3;
+		}
+		ok = ok && vertex == bg.vertex_count;
+		if(!ok && wrong++ < 5){
+			printf("frame %d: bad list (%d vertices)\n", frame, bg.vertex_count);
+		}
+		if(bg.vertex_count > most){
+			most = bg.vertex_count;
+		}
+	}
+	printf("%d frames, %d wrong, at most %d of %d vertices, %d corners transformed a frame\n",
+		frames, wrong, most, BACKGROUND_MAX_VERTICES, BACKGROUND_CORNERS);
+	return wrong != 0;
+}
+
+static int bench(uint32_t seed){
+	static background bg;
+	double start, seconds;
+	long frames = 0, vertices = 0;
+
+	background_init(&bg, seed, type_argb);
+	start = now_seconds();
+	do {
+		background_set_level(&bg, 1 + (frames / 600) % 15);
+		background_update(&bg);
+		vertices += bg.vertex_count;
+		frames++;
+	} while((seconds = now_seconds() - start) < BENCH_SECONDS);
+
+	double us = seconds / frames * 1e6;
+	double percent = us / FRAME_US * 100;
+	printf("%d corners, %.0f vertices a frame on average: %.2f us per frame, %.3f%% of a 60 Hz frame (budget %d%%)\n",
+		BACKGROUND_CORNERS, (double)vertices / frames, us, percent, BACKGROUND_BUDGET_PERCENT);
+	return percent > BACKGROUND_BUDGET_PERCENT;
+}
+
+int main(int argc, char ** argv){
+	if(argc < 2){
+		fprintf(stderr, "usage: background_tool check [frames] | bench [seed]\n");
+		return 1;
+	}
+	tetris_init();
+
+	const char * command = argv[1];
+	if(!strcmp(command, "check")){
+		int frames = argc > 2 ? atoi(argv[2]) : 0;
+		return check(frames > 0 ? frames : 10000);
+	}
+	if(!strcmp(command, "bench")){
+		return bench(argc > 2 ? strtoul(argv[2], NULL, 0) : 12345);
+	}
+
+	fprintf(stderr, "unknown command %s\n", command);
+	return 1;
+}
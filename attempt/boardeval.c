@@ -0,0 +1,154 @@
+// Batched field features. See boardeval.h.
+//
+// Everything is done on whole row masks (border bits included, walls count as filled):
+//
+//   above     OR of every row from the top down to this one, so a column's bit is set
+//             from its highest block down. Column heights are how many rows have it.
+//   holes     above & ~row, empty cells with something higher up in the same column
+//   bumpiness the heights of neighbouring columns differ by however many rows have
+//             exactly one of the two set in above: (above ^ above >> 1)
+//   wells     ~above & (above << 1) & (above >> 1), open cells with both sides filled
+//
+// and the row/column transitions compare a row with itself shifted and with the row below.
+
+#include <string.h>
+
+#include "boardeval.h"
+
+#define BOARDEVAL_VISIBLE (TETRIS_FULL_ROW & ~TETRIS_EMPTY_ROW) // the columns inside the walls
+#define BOARDEVAL_PAIRS (BOARDEVAL_VISIBLE & (BOARDEVAL_VISIBLE >> 1)) // bit c: columns c and c+1, both inside the walls
+#define BOARDEVAL_ROW_EDGES (TETRIS_FULL_ROW >> 1) // bit c: columns c and c+1, walls included
+
+// The SIMD kernels keep heights in 5 bit counters and bit counts in bytes (8 a row at most)
+_Static_assert(BOARDEVAL_ROWS <= 31, "boardeval only counts up to 31 rows");
+_Static_assert(sizeof(tetris_row) == 2, "boardeval works on 16 bit rows");
+
+void boardeval_pack(boardeval_block * block, int lane, const tetris_row * rows){
+	for(int r=0; r<BOARDEVAL_ROWS; r++){
+		block->rows[r][lane] = (rows[TETRIS_TOP_ROW + r] | TETRIS_EMPTY_ROW) & TETRIS_FULL_ROW;
+	}
+}
+
+/**************************************** kernels ****************************************/
+
+static void eval_scalar(const boardeval_block * blocks, boardeval_features * out, int count){
+	for(int b=0; b<count; b++){
+		for(int lane=0; lane<BOARDEVAL_LANES; lane++){
+			const boardeval_block * block = &blocks[b];
+			uint32_t above = 0;
+			int heights[BOARDEVAL_COLS] = {0};
+			int max_height = 0, holes = 0, bumpiness = 0, row_transitions = 0, column_transitions = 0, wells = 0;
+
+			for(int r=0; r<BOARDEVAL_ROWS; r++){
+				uint32_t row = block->rows[r][lane] | TETRIS_EMPTY_ROW;
+				uint32_t below = r+1 < BOARDEVAL_ROWS ? (block->rows[r+1][lane] | TETRIS_EMPTY_ROW) : TETRIS_FULL_ROW;
+				uint32_t tops = row & ~above & BOARDEVAL_VISIBLE; // highest block of these columns
+				above |= row;
+
+				while(tops){
+					heights[__builtin_ctz(tops) - TETRIS_LEFT_COL] = BOARDEVAL_ROWS - r;
+					tops &= tops - 1;
+				}
+				max_height += (above & BOARDEVAL_VISIBLE) != 0;
+				holes += __builtin_popcount(above & ~row & BOARDEVAL_VISIBLE);
+				bumpiness += __builtin_popcount((above ^ (above >> 1)) & BOARDEVAL_PAIRS);
+				row_transitions += __builtin_popcount((row ^ (row >> 1)) & BOARDEVAL_ROW_EDGES);
+				column_transitions += __builtin_popcount((row ^ below) & BOARDEVAL_VISIBLE);
+				wells += __builtin_popcount(~above & (above << 1) & (above >> 1) & BOARDEVAL_VISIBLE);
+			}
+
+			boardeval_features * features = &out[b];
+			int aggregate = 0;
+			for(int col=0; col<BOARDEVAL_COLS; col++){
+				features->heights[col][lane] = heights[col];
+				aggregate += heights[col];
+			}
+			features->aggregate_height[lane] = aggregate;
+			features->max_height[lane] = max_height;
+			features->holes[lane] = holes;
+			features->bumpiness[lane] = bumpiness;
+			features->row_transitions[lane] = row_transitions;
+			features->column_transitions[lane] = column_transitions;
+			features->wells[lane] = wells;
+		}
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BOARDEVAL_X86 1
+
+#define KERNEL_NAME eval_sse2
+#define KERNEL_TARGET "sse2"
+#define KERNEL_LANES 8
+#include "boardeval_kernel.h"
+#undef KERNEL_NAME
+#undef KERNEL_TARGET
+#undef KERNEL_LANES
+
+#define KERNEL_NAME eval_avx2
+#define KERNEL_TARGET "avx2"
+#define KERNEL_LANES 16
+#include "boardeval_kernel.h"
+#undef KERNEL_NAME
+#undef KERNEL_TARGET
+#undef KERNEL_LANES
+
+#endif
+
+/**************************************** picking one ****************************************/
+
+typedef void (*kernel_function)(const boardeval_block * blocks, boardeval_features * out, int count);
+
+static const char * kernel_names[BOARDEVAL_KERNELS] = {"scalar", "sse2", "avx2"};
+
+int boardeval_kernel_supported(boardeval_kernel kernel){
+	switch(kernel){
+		case BOARDEVAL_SCALAR:
+			return 1;
+#ifdef BOARDEVAL_X86
+		case BOARDEVAL_SSE2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("sse2");
+		case BOARDEVAL_AVX2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2");
+#endif
+		default:
+			return 0;
+	}
+}
+
+boardeval_kernel boardeval_best_kernel(){
+	for(int kernel=BOARDEVAL_KERNELS-1; kernel>BOARDEVAL_SCALAR; kernel--){
+		if(boardeval_kernel_supported(kernel)){
+			return kernel;
+		}
+	}
+	return BOARDEVAL_SCALAR;
+}
+
+const char * boardeval_kernel_name(boardeval_kernel kernel){
+	return kernel < BOARDEVAL_KERNELS ? kernel_names[kernel] : "?";
+}
+
+static kernel_function kernel_for(boardeval_kernel kernel){
+	switch(kernel){
+#ifdef BOARDEVAL_X86
+		case BOARDEVAL_SSE2: return eval_sse2;
+		case BOARDEVAL_AVX2: return eval_avx2;
+#endif
+		default: return eval_scalar;
+	}
+}
+
+void boardeval_run(boardeval_kernel kernel, const boardeval_block * blocks, boardeval_features * out, int count){
+	kernel_for(kernel)(blocks, out, count);
+}
+
+void boardeval_evaluate(const boardeval_block * blocks, boardeval_features * out, int count){
+	static kernel_function best = NULL; // same answer every time, a race to set it is harmless
+	if(!best){
+		best = kernel_for(boardeval_best_kernel());
+	}
+	best(blocks, out, count);
+}
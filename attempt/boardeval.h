@@ -0,0 +1,63 @@
+// Field features for evaluating lots of candidate fields at once (bots, training).
+//
+// For every field: the height of each column, holes (empty cells with something above
+// them), bumpiness (height differences between neighbouring columns), row and column
+// transitions (filled/empty changes along rows and down columns, the walls and floor
+// count as filled) and well cells (empty cells above the stack with both neighbours
+// filled, the usual "sum of well depths").
+//
+// Fields go in blocks of BOARDEVAL_LANES, stored row by row: row r of all 16 fields is
+// next to each other, so one SIMD register holds one row of 8 (SSE2) or 16 (AVX2) fields
+// and every feature comes out of a handful of mask operations per row, for all of them
+// at once. Nothing walks cells. The features come out in the same layout.
+//
+// The kernel is picked at runtime from what the CPU has, with plain C as the fallback.
+// All of them give the same results. Host only.
+
+#ifndef BOARDEVAL_H
+#define BOARDEVAL_H
+
+#include <stdint.h>
+
+#include "tetris.h"
+
+#define BOARDEVAL_LANES 16 // fields per block
+#define BOARDEVAL_ROWS TETRIS_VISIBLE_ROWS // only the visible rows count, not the buffer above them
+#define BOARDEVAL_COLS (TETRIS_RIGHT_COL - TETRIS_LEFT_COL + 1)
+
+typedef struct Boardeval_Block {
+	tetris_row rows[BOARDEVAL_ROWS][BOARDEVAL_LANES]; // top row first, border bits included
+} __attribute__((aligned(32))) boardeval_block;
+
+typedef struct Boardeval_Features {
+	uint16_t heights[BOARDEVAL_COLS][BOARDEVAL_LANES]; // leftmost column first
+	uint16_t aggregate_height[BOARDEVAL_LANES]; // all the heights added up
+	uint16_t max_height[BOARDEVAL_LANES];
+	uint16_t holes[BOARDEVAL_LANES];
+	uint16_t bumpiness[BOARDEVAL_LANES];
+	uint16_t row_transitions[BOARDEVAL_LANES];
+	uint16_t column_transitions[BOARDEVAL_LANES];
+	uint16_t wells[BOARDEVAL_LANES];
+} __attribute__((aligned(32))) boardeval_features;
+
+typedef enum Boardeval_Kernel {
+	BOARDEVAL_SCALAR,
+	BOARDEVAL_SSE2,
+	BOARDEVAL_AVX2,
+	BOARDEVAL_KERNELS
+} boardeval_kernel;
+
+// Copies the visible rows of a field (TETRIS_ROWS of them, like tetris_game.rows) into
+// one lane of a block. Fields without the border bits are fine too.
+void boardeval_pack(boardeval_block * block, int lane, const tetris_row * rows);
+
+int boardeval_kernel_supported(boardeval_kernel kernel);
+boardeval_kernel boardeval_best_kernel();
+const char * boardeval_kernel_name(boardeval_kernel kernel);
+
+// Features of count blocks with a specific kernel (it has to be supported)
+void boardeval_run(boardeval_kernel kernel, const boardeval_block * blocks, boardeval_features * out, int count);
+// ...or with the best one there is
+void boardeval_evaluate(const boardeval_block * blocks, boardeval_features * out, int count);
+
+#endif
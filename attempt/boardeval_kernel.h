@@ -0,0 +1,88 @@
+// One SIMD kernel of boardeval.c. Included once per instruction set, with these defined:
+//
+//   KERNEL_NAME    name of the function to make
+//   KERNEL_TARGET  what to compile it for (the GCC target attribute), "sse2", "avx2"
+//   KERNEL_LANES   fields per register: 8 for 128 bit registers, 16 for 256 bit ones
+//
+// It's written with GCC vector extensions, so the one body becomes SSE2 or AVX2 code
+// depending on KERNEL_TARGET. Every lane is one field, holding one row mask at a time.
+// No include guard on purpose.
+
+#define KERNEL_CONCAT_(a, b) a##b
+#define KERNEL_CONCAT(a, b) KERNEL_CONCAT_(a, b)
+#define KERNEL_VEC KERNEL_CONCAT(KERNEL_NAME, _vec)
+
+typedef uint16_t KERNEL_VEC __attribute__((vector_size(KERNEL_LANES * 2)));
+
+__attribute__((target(KERNEL_TARGET)))
+static void KERNEL_NAME(const boardeval_block * blocks, boardeval_features * out, int count){
+	const KERNEL_VEC zero = {0};
+
+	for(int b=0; b<count; b++){
+		const boardeval_block * block = &blocks[b];
+		boardeval_features * features = &out[b];
+
+		for(int first=0; first<BOARDEVAL_LANES; first+=KERNEL_LANES){
+			KERNEL_VEC above = zero; // every cell at or below something filled
+			KERNEL_VEC height_bits[5] = {zero, zero, zero, zero, zero}; // heights, one bit per vector
+			KERNEL_VEC max_height = zero;
+			// Bit counts in each byte, added up over all the rows (at most 8 a row, 160 in total)
+			KERNEL_VEC holes = zero, bumpiness = zero, row_transitions = zero, column_transitions = zero, wells = zero;
+
+			KERNEL_VEC row = *(const KERNEL_VEC *)&block->rows[0][first] | TETRIS_EMPTY_ROW;
+			for(int r=0; r<BOARDEVAL_ROWS; r++){
+				KERNEL_VEC below = r+1 < BOARDEVAL_ROWS
+					? *(const KERNEL_VEC *)&block->rows[r+1][first] | TETRIS_EMPTY_ROW
+					: zero + TETRIS_FULL_ROW; // the floor
+				above |= row;
+
+				// One more row for every column with something at or above this row, the
+				// counters are bit sliced: height_bits[k] holds bit k of all the heights
+				KERNEL_VEC carry = above & BOARDEVAL_VISIBLE;
+				for(int k=0; k<5; k++){
+					KERNEL_VEC next_carry = height_bits[k] & carry;
+					height_bits[k] ^= carry;
+					carry = next_carry;
+				}
+				max_height -= (KERNEL_VEC)((above & BOARDEVAL_VISIBLE) != 0); // true is -1
+
+#define ADD_BIT_COUNTS(total, mask) do { \
+		KERNEL_VEC bits_ = (mask); \
+		bits_ = bits_ - ((bits_ >> 1) & 0x5555); \
+		bits_ = (bits_ & 0x3333) + ((bits_ >> 2) & 0x3333); \
+		total += (bits_ + (bits_ >> 4)) & 0x0f0f; \
+	} while(0)
+
+				ADD_BIT_COUNTS(holes, above & ~row & BOARDEVAL_VISIBLE);
+				ADD_BIT_COUNTS(bumpiness, (above ^ (above >> 1)) & BOARDEVAL_PAIRS);
+				ADD_BIT_COUNTS(row_transitions, (row ^ (row >> 1)) & BOARDEVAL_ROW_EDGES);
+				ADD_BIT_COUNTS(column_transitions, (row ^ below) & BOARDEVAL_VISIBLE);
+				ADD_BIT_COUNTS(wells, ~above & (above << 1) & (above >> 1) & BOARDEVAL_VISIBLE);
+
+#undef ADD_BIT_COUNTS
+				row = below;
+			}
+
+			KERNEL_VEC aggregate = zero;
+			for(int col=0; col<BOARDEVAL_COLS; col++){
+				KERNEL_VEC height = zero;
+				for(int k=0; k<5; k++){
+					height |= ((height_bits[k] >> (TETRIS_LEFT_COL + col)) & 1) << k;
+				}
+				*(KERNEL_VEC *)&features->heights[col][first] = height;
+				aggregate += height;
+			}
+			*(KERNEL_VEC *)&features->aggregate_height[first] = aggregate;
+			*(KERNEL_VEC *)&features->max_height[first] = max_height;
+			*(KERNEL_VEC *)&features->holes[first] = (holes & 0xff) + (holes >> 8);
+			*(KERNEL_VEC *)&features->bumpiness[first] = (bumpiness & 0xff) + (bumpiness >> 8);
+			*(KERNEL_VEC *)&features->row_transitions[first] = (row_transitions & 0xff) + (row_transitions >> 8);
+			*(KERNEL_VEC *)&features->column_transitions[first] = (column_transitions & 0xff) + (column_transitions >> 8);
+			*(KERNEL_VEC *)&features->wells[first] = (wells & 0xff) + (wells >> 8);
+		}
+	}
+}
+
+#undef KERNEL_VEC
+#undef KERNEL_CONCAT
+#undef KERNEL_CONCAT_
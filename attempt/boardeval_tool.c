@@ -0,0 +1,242 @@
+// Host tool for the field feature kernels (boardeval.h).
+//
+//   boardeval_tool check [fields] [seed]
+//       compares every kernel the CPU has with a cell by cell reference on random fields
+//   boardeval_tool bench [fields] [seed]
+//       fields per second for each kernel, and for the cell by cell walk
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "boardeval.h"
+
+#define BENCH_SECONDS 0.5 // at least this long per kernel
+
+static double now_seconds(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void * alloc_aligned(size_t size){
+	void * memory;
+	if(posix_memalign(&memory, 32, size)){
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	return memory;
+}
+
+static void random_field(tetris_row * rows, uint32_t * rng){
+	// Columns of random heights, some solid and some full of holes
+	int density = 2 + tetris_random(rng) % 8;
+	tetris_clear_rows(rows);
+	for(int col=TETRIS_LEFT_COL; col<=TETRIS_RIGHT_COL; col++){
+		int height = tetris_random(rng) % (BOARDEVAL_ROWS + 1);
+		for(int i=0; i<height; i++){
+			if(tetris_random(rng) % density){
+				rows[TETRIS_BOTTOM_ROW - i] |= 1 << col;
+			}
+		}
+	}
+}
+
+static int make_blocks(boardeval_block ** blocks, tetris_row ** fields, int count, uint32_t seed){
+	// count is rounded up to whole blocks
+	int block_count = (count + BOARDEVAL_LANES-1) / BOARDEVAL_LANES;
+	uint32_t rng = seed ? seed : 1;
+
+	*blocks = alloc_aligned(block_count * sizeof(boardeval_block));
+	*fields = malloc((size_t)block_count * BOARDEVAL_LANES * TETRIS_ROWS * sizeof(tetris_row));
+	if(!*fields){
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for(int i=0; i<block_count * BOARDEVAL_LANES; i++){
+		tetris_row * rows = *fields + (size_t)i * TETRIS_ROWS;
+		random_field(rows, &rng);
+		boardeval_pack(&(*blocks)[i / BOARDEVAL_LANES], i % BOARDEVAL_LANES, rows);
+	}
+	return block_count;
+}
+
+/**************************************** reference ****************************************/
+
+typedef struct Reference {
+	int heights[BOARDEVAL_COLS];
+	int aggregate_height, max_height, holes, bumpiness, row_transitions, column_transitions, wells;
+} reference;
+
+static int filled(const tetris_row * rows, int row, int col){
+	// Walls and floor count as filled, everything above the visible field as empty
+	if(col < TETRIS_LEFT_COL || col > TETRIS_RIGHT_COL || row > TETRIS_BOTTOM_ROW){
+		return 1;
+	}
+	return row >= TETRIS_TOP_ROW && (rows[row] & (1 << col));
+}
+
+static void reference_features(const tetris_row * rows, reference * ref){
+	// One cell at a time, the way bot.c does it
+	memset(ref, 0, sizeof(*ref));
+	for(int col=TETRIS_LEFT_COL; col<=TETRIS_RIGHT_COL; col++){
+		int height = 0;
+		for(int row=TETRIS_TOP_ROW; row<=TETRIS_BOTTOM_ROW; row++){
+			if(filled(rows, row, col)){
+				if(!height){
+					height = TETRIS_BOTTOM_ROW - row + 1;
+				}
+			}
+			else if(height){
+				ref->holes++;
+			}
+			if(filled(rows, row, col) != filled(rows, row+1, col)){
+				ref->column_transitions++;
+			}
+		}
+		ref->heights[col - TETRIS_LEFT_COL] = height;
+		ref->aggregate_height += height;
+		if(height > ref->max_height){
+			ref->max_height = height;
+		}
+	}
+	for(int col=1; col<BOARDEVAL_COLS; col++){
+		ref->bumpiness += abs(ref->heights[col] - ref->heights[col-1]);
+	}
+	for(int row=TETRIS_TOP_ROW; row<=TETRIS_BOTTOM_ROW; row++){
+		for(int col=TETRIS_LEFT_COL-1; col<=TETRIS_RIGHT_COL; col++){
+			ref->row_transitions += filled(rows, row, col) != filled(rows, row, col+1);
+		}
+	}
+	// Well cells: above a column's stack, with the neighbours (or walls) that high
+	for(int col=TETRIS_LEFT_COL; col<=TETRIS_RIGHT_COL; col++){
+		int i = col - TETRIS_LEFT_COL;
+		int left = col == TETRIS_LEFT_COL ? BOARDEVAL_ROWS : ref->heights[i-1];
+		int right = col == TETRIS_RIGHT_COL ? BOARDEVAL_ROWS : ref->heights[i+1];
+		int walls = left < right ? left : right;
+		if(walls > ref->heights[i]){
+			ref->wells += walls - ref->heights[i];
+		}
+	}
+}
+
+static int same(const reference * ref, const boardeval_features * features, int lane){
+	for(int col=0; col<BOARDEVAL_COLS; col++){
+		if(ref->heights[col] != features->heights[col][lane]){
+			return 0;
+		}
+	}
+	return ref->aggregate_height == features->aggregate_height[lane]
+		&& ref->max_height == features->max_height[lane]
+		&& ref->holes == features->holes[lane]
+		&& ref->bumpiness == features->bumpiness[lane]
+		&& ref->row_transitions == features->row_transitions[lane]
+		&& ref->column_transitions == features->column_transitions[lane]
+		&& ref->wells == features->wells[lane];
+}
+
+/**************************************** check ****************************************/
+
+static int check(int count, uint32_t seed){
+	boardeval_block * blocks;
+	tetris_row * fields;
+	int block_count = make_blocks(&blocks, &fields, count, seed);
+	boardeval_features * features = alloc_aligned(block_count * sizeof(boardeval_features));
+	int failed = 0;
+
+	for(int kernel=0; kernel<BOARDEVAL_KERNELS; kernel++){
+		if(!boardeval_kernel_supported(kernel)){
+			printf("%-6s not supported here\n", boardeval_kernel_name(kernel));
+			continue;
+		}
+		memset(features, 0xff, block_count * sizeof(boardeval_features));
+		boardeval_run(kernel, blocks, features, block_count);
+
+		int wrong = 0;
+		for(int i=0; i<block_count * BOARDEVAL_LANES; i++){
+			reference ref;
+			reference_features(fields + (size_t)i * TETRIS_ROWS, &ref);
+			if(!same(&ref, &features[i / BOARDEVAL_LANES], i % BOARDEVAL_LANES)){
+				if(wrong++ < 5){
+					printf("%s: field %d differs from the reference\n", boardeval_kernel_name(kernel), i);
+				}
+			}
+		}
+		printf("%-6s %d fields, %d wrong\n", boardeval_kernel_name(kernel), block_count * BOARDEVAL_LANES, wrong);
+		failed |= wrong != 0;
+	}
+	free(features);
+	free(blocks);
+	free(fields);
+	return failed;
+}
+
+/**************************************** bench ****************************************/
+
+static int bench(int count, uint32_t seed){
+	boardeval_block * blocks;
+	tetris_row * fields;
+	int block_count = make_blocks(&blocks, &fields, count, seed);
+	int field_count = block_count * BOARDEVAL_LANES;
+	boardeval_features * features = alloc_aligned(block_count * sizeof(boardeval_features));
+	double start, seconds;
+	long passes;
+
+	printf("%d fields (%zu KB of blocks), best kernel here: %s\n", field_count,
+		block_count * sizeof(boardeval_block) / 1024, boardeval_kernel_name(boardeval_best_kernel()));
+
+	// What the bot does today, for comparison
+	volatile int sink = 0;
+	start = now_seconds();
+	passes = 0;
+	do {
+		for(int i=0; i<field_count; i++){
+			reference ref;
+			reference_features(fields + (size_t)i * TETRIS_ROWS, &ref);
+			sink += ref.holes;
+		}
+		passes++;
+	} while((seconds = now_seconds() - start) < BENCH_SECONDS);
+	printf("%-10s %8.2f M fields/s\n", "cell walk", passes * field_count / seconds / 1e6);
+
+	for(int kernel=0; kernel<BOARDEVAL_KERNELS; kernel++){
+		if(!boardeval_kernel_supported(kernel)){
+			continue;
+		}
+		start = now_seconds();
+		passes = 0;
+		do {
+			boardeval_run(kernel, blocks, features, block_count);
+			passes++;
+		} while((seconds = now_seconds() - start) < BENCH_SECONDS);
+		printf("%-10s %8.2f M fields/s, %.2f ns per field\n", boardeval_kernel_name(kernel),
+			passes * field_count / seconds / 1e6, seconds / (passes * field_count) * 1e9);
+	}
+	free(features);
+	free(blocks);
+	free(fields);
+	return 0;
+}
+
+int main(int argc, char ** argv){
+	if(argc < 2){
+		fprintf(stderr, "usage: boardeval_tool check|bench [fields] [seed]\n");
+		return 1;
+	}
+	tetris_init();
+
+	const char * command = argv[1];
+	int count = argc > 2 ? atoi(argv[2]) : 0;
+	uint32_t seed = argc > 3 ? strtoul(argv[3], NULL, 0) : 12345;
+
+	if(!strcmp(command, "check")){
+		return check(count > 0 ? count : 100000, seed);
+	}
+	if(!strcmp(command, "bench")){
+		return bench(count > 0 ? count : 4096, seed);
+	}
+
+	fprintf(stderr, "unknown command %s\n", command);
+	return 1;
+}
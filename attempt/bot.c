@@ -0,0 +1,116 @@
+// A simple bot for host tools. See bot.h.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bot.h"
+
+static double evaluate(const bot * brain, const tetris_row * rows, int lines){
+	int heights[TETRIS_COLS];
+	int holes = 0;
+	int aggregate = 0;
+	int bumpiness = 0;
+
+	for(int col=TETRIS_LEFT_COL; col<=TETRIS_RIGHT_COL; col++){
+		heights[col] = 0;
+		int seen_block = 0;
+		for(int row=TETRIS_FIRST_ROW; row<=TETRIS_BOTTOM_ROW; row++){
+			if(rows[row] & (1 << col)){
+				if(!seen_block){
+					heights[col] = TETRIS_BOTTOM_ROW - row + 1;
+					seen_block = 1;
+				}
+			}
+			else if(seen_block){
+				holes++;
+			}
+		}
+		aggregate += heights[col];
+		if(col > TETRIS_LEFT_COL){
+			bumpiness += abs(heights[col] - heights[col-1]);
+		}
+	}
+
+	return brain->height_weight * aggregate
+		+ brain->holes_weight * holes
+		+ brain->bumpiness_weight * bumpiness
+		+ brain->lines_weight * lines;
+}
+
+static void plan(bot * brain, const tetris_game * game){
+	double best = -1e30;
+	brain->target_orientation = game->active.orientation;
+	brain->target_x = game->active.left_x;
+
+	for(int orientation=0; orientation<4; orientation++){
+		for(int x=-2; x<TETRIS_COLS; x++){
+			tetris_piece piece = game->active;
+			piece.orientation = orientation;
+			piece.left_x = x;
+			// a vertical I overlaps the ceiling at spawn height, in the game the rotation
+			// kicks it down a row or two, so let the search do the same
+			int drop = 0;
+			while(drop < 2 && tetris_collides(game->rows, &piece)){
+				piece.top_y++;
+				drop++;
+			}
+			if(tetris_collides(game->rows, &piece)){
+				continue;
+			}
+
+			tetris_row rows[TETRIS_ROWS];
+			memcpy(rows, game->rows, sizeof(rows));
+			piece.top_y += tetris_drop_distance(rows, &piece);
+			tetris_lock(rows, &piece);
+			tetris_row_set full = tetris_full_rows(rows);
+			tetris_compact_rows(rows, full);
+
+			double score = evaluate(brain, rows, __builtin_popcountll(full));
+			if(score > best){
+				best = score;
+				brain->target_orientation = orientation;
+				brain->target_x = x;
+			}
+		}
+	}
+	brain->planned = 1;
+	brain->frames_on_piece = 0;
+}
+
+uint32_t bot_buttons(bot * brain, const tetris_game * game){
+	if(game->phase!=PHASE_FALLING || game->active_set){
+		brain->planned = 0;
+		return 0;
+	}
+	if(!brain->planned){
+		plan(brain, game);
+	}
+
+	brain->press = !brain->press;
+	brain->frames_on_piece++;
+	if(!brain->press){
+		return 0;
+	}
+
+	if(brain->frames_on_piece > 300){
+		return TETRIS_BTN_HARD_DROP; // got stuck on something, just drop it
+	}
+	if(game->active.orientation != brain->target_orientation){
+		return TETRIS_BTN_ROTATE_CW;
+	}
+	if(game->active.left_x < brain->target_x){
+		return TETRIS_BTN_RIGHT;
+	}
+	if(game->active.left_x > brain->target_x){
+		return TETRIS_BTN_LEFT;
+	}
+	return TETRIS_BTN_HARD_DROP;
+}
+
+void bot_setup(bot * brain, int variant){
+	memset(brain, 0, sizeof(*brain));
+	brain->height_weight = -0.51;
+	brain->holes_weight = variant ? -0.40 : -0.36;
+	brain->bumpiness_weight = variant ? -0.15 : -0.18;
+	brain->lines_weight = 0.76;
+}
@@ -0,0 +1,35 @@
+// A simple bot for host tools (versus_host, replay_tool).
+//
+// When a tetromino spawns it tries every rotation and column, scores the resulting field
+// (height, holes, bumpiness, lines) and then presses buttons until the piece gets there.
+// It goes through tetris_game_tick() like a player would, so all of the real rules
+// (button repeat delays, gravity...) apply to it. It only looks at the current piece,
+// so it's no champion, but it plays long enough games to test things with.
+
+#ifndef BOT_H
+#define BOT_H
+
+#include <stdint.h>
+
+#include "tetris.h"
+
+typedef struct Bot {
+	// weights for the field evaluation
+	double height_weight;
+	double holes_weight;
+	double bumpiness_weight;
+	double lines_weight;
+
+	int planned; // target below is for the current tetromino
+	int target_orientation;
+	int target_x;
+	int frames_on_piece;
+	int press; // alternates so buttons that need a release between presses still fire
+} bot;
+
+// variant picks slightly different weights, so two bots on the same pieces don't mirror each other
+void bot_setup(bot * brain, int variant);
+// The TETRIS_BTN_* to press this frame
+uint32_t bot_buttons(bot * brain, const tetris_game * game);
+
+#endif
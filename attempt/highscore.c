@@ -0,0 +1,247 @@
+// High score table and its VMU save file. See highscore.h.
+
+#include <string.h>
+
+#include "highscore.h"
+#include "log.h"
+
+#ifdef _arch_dreamcast
+#include <kos.h>
+#include <stdlib.h>
+#endif
+
+#define HIGHSCORE_MAGIC 0x43534854 // "THSC"
+#define HIGHSCORE_V1_ENTRY_SIZE 16 // version 1, the score was 32 bits
+#define HIGHSCORE_FILE_MAX (4 * 512) // VMU blocks, the save (header, icon, table) takes 2
+
+static inline void put_u32(uint8_t * p, uint32_t v){
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static inline uint32_t get_u32(const uint8_t * p){
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void highscore_clear(highscore_table * table){
+	memset(table, 0, sizeof(*table));
+}
+
+int highscore_rank(const highscore_table * table, uint64_t score){
+	if(score == 0){
+		return -1; // don't fill the table with games that never got anywhere
+	}
+	for(int i=0; i<table->count; i++){
+		if(score > table->entries[i].score){
+			return i; // ties go below the older score
+		}
+	}
+	return table->count < HIGHSCORE_COUNT ? table->count : -1;
+}
+
+int highscore_insert(highscore_table * table, const highscore_entry * entry){
+	int rank = highscore_rank(table, entry->score);
+	if(rank < 0){
+		return -1;
+	}
+	int last = table->count < HIGHSCORE_COUNT ? table->count : HIGHSCORE_COUNT-1;
+	memmove(&table->entries[rank+1], &table->entries[rank], (last-rank) * sizeof(highscore_entry));
+	table->entries[rank] = *entry;
+	if(table->count < HIGHSCORE_COUNT){
+		table->count++;
+	}
+	return rank;
+}
+
+void highscore_serialize(const highscore_table * table, uint8_t * out){
+	memset(out, 0, HIGHSCORE_DATA_SIZE);
+	put_u32(out, HIGHSCORE_MAGIC);
+	put_u32(out+4, HIGHSCORE_VERSION);
+	put_u32(out+8, table->count);
+
+	uint8_t * p = out + 12;
+	for(int i=0; i<table->count; i++){
+		const highscore_entry * entry = &table->entries[i];
+		put_u32(p, entry->score);
+		put_u32(p+4, entry->score >> 32);
+		put_u32(p+8, entry->lines);
+		put_u32(p+12, entry->level);
+		put_u32(p+16, entry->date);
+		p += HIGHSCORE_ENTRY_SIZE;
+	}
+}
+
+int highscore_deserialize(highscore_table * table, const uint8_t * data, int size){
+	highscore_clear(table);
+	if(size < 12 || get_u32(data) != HIGHSCORE_MAGIC){
+		return 0;
+	}
+	uint32_t version = get_u32(data+4);
+	int entry_size = version == 1 ? HIGHSCORE_V1_ENTRY_SIZE : HIGHSCORE_ENTRY_SIZE;
+	uint32_t count = get_u32(data+8);
+	if((version != 1 && version != HIGHSCORE_VERSION) || size < 12 + HIGHSCORE_COUNT*entry_size || count > HIGHSCORE_COUNT){
+		return 0;
+	}
+
+	const uint8_t * p = data + 12;
+	for(uint32_t i=0; i<count; i++){
+		highscore_entry * entry = &table->entries[i];
+		if(version == 1){
+			entry->score = get_u32(p);
+			p += 4;
+		}
+		else {
+			entry->score = get_u32(p) | (uint64_t)get_u32(p+4) << 32;
+			p += 8;
+		}
+		entry->lines = get_u32(p);
+		entry->level = get_u32(p+4);
+		entry->date = get_u32(p+8);
+		p += 12;
+	}
+	table->count = count;
+	return 1;
+}
+
+#ifdef _arch_dreamcast
+
+/**************************************** VMU file ****************************************/
+
+// The save file's icon: 32x32 pixels, 4 bits each, indexes into a 16 color ARGB4444
+// palette. Only 2 colors get used, made from a 1 bit VMU screen image.
+static uint8_t icon[32*32/2];
+static const uint16_t icon_palette[16] = { 0xfddd, 0xf000 }; // light gray, black
+
+static void build_icon(const uint8_t * lcd_image){
+	// The VMU screen is 48 pixels wide (6 bytes a row, leftmost pixel in the top bit),
+	// the icon takes columns 8 to 39
+	for(int y=0; y<32; y++){
+		for(int x=0; x<32; x+=2){
+			int left = (lcd_image[y*6 + (x+8)/8] >> (7 - (x+8)%8)) & 1;
+			int right = (lcd_image[y*6 + (x+9)/8] >> (7 - (x+9)%8)) & 1;
+			icon[(y*32 + x)/2] = (left << 4) | right;
+		}
+	}
+}
+
+int highscore_load(highscore_table * table){
+	highscore_clear(table);
+
+	file_t file = fs_open(HIGHSCORE_PATH, O_RDONLY);
+	if(file < 0){
+		LOG_INFO("No high scores on the VMU yet");
+		return 0;
+	}
+	// A fixed buffer, so the heap doesn't get touched. The save is a few blocks, anything
+	// bigger isn't one of ours.
+	static uint8_t data[HIGHSCORE_FILE_MAX];
+	int size = fs_total(file);
+	int ok = size <= HIGHSCORE_FILE_MAX && fs_read(file, data, size) == size;
+	fs_close(file);
+
+	vmu_pkg_t pkg;
+	ok = ok && vmu_pkg_parse(data, &pkg) >= 0 && highscore_deserialize(table, pkg.data, pkg.data_len);
+
+	if(!ok){
+		LOG_WARN("%s isn't a high score table, starting a new one", HIGHSCORE_PATH);
+		return 0;
+	}
+	LOG_INFO("Loaded %d high scores", table->count);
+	return 1;
+}
+
+static int write_table(const uint8_t * table_data){
+	vmu_pkg_t pkg;
+	uint8_t * package;
+	int package_size;
+
+	memset(&pkg, 0, sizeof(pkg));
+	strcpy(pkg.desc_short, "Tetris");
+	strcpy(pkg.desc_long, "High scores");
+	strcpy(pkg.app_id, "attempt");
+	pkg.icon_cnt = 1;
+	pkg.icon_anim_speed = 0;
+	pkg.eyecatch_type = VMUPKG_EC_NONE;
+	memcpy(pkg.icon_pal, icon_palette, sizeof(icon_palette));
+	pkg.icon_data = icon;
+	pkg.data_len = HIGHSCORE_DATA_SIZE;
+	pkg.data = table_data;
+
+	// vmu_pkg_build() malloc()s the package. That's fine here on the save thread, the game
+	// thread never waits for it (see alloc_audit.h).
+	if(vmu_pkg_build(&pkg, &package, &package_size) < 0){
+		return 0;
+	}
+	file_t file = fs_open(HIGHSCORE_PATH, O_WRONLY);
+	int ok = (file >= 0);
+	if(ok){
+		ok = fs_write(file, package, package_size) == package_size;
+		ok = (fs_close(file) >= 0) && ok; // vmufs writes the blocks out on close
+	}
+	free(package);
+	return ok;
+}
+
+/**************************************** save thread ****************************************/
+
+// Single producer (the game loop), single consumer (the save thread), lock-free, the
+// same way as the garbage queues in versus.h. Every slot is a whole serialized table.
+static uint8_t save_queue[HIGHSCORE_SAVE_QUEUE_SIZE][HIGHSCORE_DATA_SIZE];
+static volatile uint32_t save_head = 0; // written by the game loop only
+static volatile uint32_t save_tail = 0; // written by the save thread only
+
+static kthread_t * save_thread;
+static volatile int save_running = 0;
+volatile uint32_t highscore_saves_failed = 0;
+
+int highscore_save_async(const highscore_table * table){
+	uint32_t head = save_head;
+	uint32_t tail = __atomic_load_n(&save_tail, __ATOMIC_ACQUIRE);
+
+	if(head - tail >= HIGHSCORE_SAVE_QUEUE_SIZE){
+		return 0;
+	}
+	highscore_serialize(table, save_queue[head & (HIGHSCORE_SAVE_QUEUE_SIZE-1)]);
+	__atomic_store_n(&save_head, head+1, __ATOMIC_RELEASE); // publish it
+	return 1;
+}
+
+static void save_queued(){
+	uint32_t tail = save_tail;
+	uint32_t head = __atomic_load_n(&save_head, __ATOMIC_ACQUIRE);
+
+	if(tail == head){
+		return;
+	}
+	// Only the newest table matters, anything older queued up behind a slow write gets skipped
+	tail = head - 1;
+	if(!write_table(save_queue[tail & (HIGHSCORE_SAVE_QUEUE_SIZE-1)])){
+		highscore_saves_failed++;
+		LOG_WARN("Couldn't save the high scores to %s", HIGHSCORE_PATH);
+	}
+	__atomic_store_n(&save_tail, tail+1, __ATOMIC_RELEASE); // hand the slots back
+}
+
+static void * save_thread_main(void * param){
+	while(save_running){
+		save_queued();
+		thd_sleep(100);
+	}
+	save_queued();
+	return NULL;
+}
+
+void highscore_start_save_thread(const uint8_t * lcd_image){
+	build_icon(lcd_image);
+	save_running = 1;
+	save_thread = thd_create(0, save_thread_main, NULL);
+}
+
+void highscore_stop_save_thread(){
+	save_running = 0;
+	thd_join(save_thread, NULL);
+}
+
+#endif
@@ -0,0 +1,74 @@
+// High score table, kept in a save file on the VMU.
+//
+// The table is loaded once at boot (highscore_load()). After that the game only
+// changes its own copy in memory and hands it to highscore_save_async(). That queues
+// the table for a background thread, which does the actual writing. Writing a VMU file
+// goes through maple one block at a time and takes a few hundred milliseconds, and the
+// game loop never waits on it.
+//
+// The save file is a normal VMU package (it shows up in the Dreamcast's file manager
+// with a name and icon). Its data is HIGHSCORE_DATA_SIZE bytes, everything little endian:
+//
+//   "THSC", version, entry count
+//   HIGHSCORE_COUNT entries of: score (64 bits), lines, level, date (seconds since 1970)
+//
+// Version 1 files had a 32 bit score, they still load.
+//
+// The table logic itself doesn't need KOS and builds on a PC too.
+
+#ifndef HIGHSCORE_H
+#define HIGHSCORE_H
+
+#include <stdint.h>
+
+#define HIGHSCORE_COUNT 10
+#define HIGHSCORE_VERSION 2
+#define HIGHSCORE_ENTRY_SIZE 20
+#define HIGHSCORE_DATA_SIZE (12 + HIGHSCORE_COUNT*HIGHSCORE_ENTRY_SIZE)
+
+#define HIGHSCORE_PATH "/vmu/a1/TETRIS_HS" // the VMU in the first controller's first slot
+#define HIGHSCORE_SAVE_QUEUE_SIZE 4 // tables waiting to be written, must be a power of 2
+
+typedef struct Highscore_Entry {
+	uint64_t score; // tetris_game.score is 64 bits too
+	uint32_t lines;
+	uint32_t level;
+	uint32_t date;
+} highscore_entry;
+
+typedef struct Highscore_Table {
+	int count;
+	highscore_entry entries[HIGHSCORE_COUNT]; // best first
+} highscore_table;
+
+void highscore_clear(highscore_table * table);
+
+// Where a score would go in the table (0 is the top), or -1 if it doesn't make it.
+int highscore_rank(const highscore_table * table, uint64_t score);
+// Puts the entry in its place, pushing the last one out if the table is full.
+// Returns its rank, or -1 if it didn't make it (the table is unchanged then).
+int highscore_insert(highscore_table * table, const highscore_entry * entry);
+
+void highscore_serialize(const highscore_table * table, uint8_t * out); // HIGHSCORE_DATA_SIZE bytes
+// Returns 0 (and leaves the table empty) if the data isn't a high score table.
+int highscore_deserialize(highscore_table * table, const uint8_t * data, int size);
+
+#ifdef _arch_dreamcast
+// Reads the save file into table. Blocks, so only call it at boot.
+// Returns 0 if there's no VMU or no save yet (the table is left empty).
+int highscore_load(highscore_table * table);
+
+// Starts the thread that writes queued tables. lcd_image is a 48x32 VMU screen bitmap
+// (like the ones in vmu_img.h), the save file's icon is made from its middle 32 columns.
+void highscore_start_save_thread(const uint8_t * lcd_image);
+// Finishes writing whatever is still queued, then stops the thread.
+void highscore_stop_save_thread();
+
+// Queues a copy of the table to be written and returns right away.
+// Returns 0 if the queue is full (try again later).
+int highscore_save_async(const highscore_table * table);
+
+extern volatile uint32_t highscore_saves_failed;
+#endif
+
+#endif
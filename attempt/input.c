@@ -0,0 +1,163 @@
+// Controller input thread and event queue. See input.h.
+
+#include <string.h>
+
+#include "input.h"
+
+#ifdef _arch_dreamcast
+#include <kos.h>
+#endif
+
+int input_queue_push(input_queue * queue, const input_event * event){
+	// Producer side: only this end writes head, the consumer only writes tail.
+	uint32_t head = queue->head;
+	uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+
+	if(head - tail >= INPUT_QUEUE_SIZE){
+		queue->dropped++;
+		return 0;
+	}
+	queue->events[head & (INPUT_QUEUE_SIZE-1)] = *event;
+	__atomic_store_n(&queue->head, head+1, __ATOMIC_RELEASE); // publish the event
+	return 1;
+}
+
+int input_queue_pop(input_queue * queue, input_event * event){
+	uint32_t tail = queue->tail;
+	uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+
+	if(tail == head){
+		return 0;
+	}
+	*event = queue->events[tail & (INPUT_QUEUE_SIZE-1)];
+	__atomic_store_n(&queue->tail, tail+1, __ATOMIC_RELEASE); // hand the slot back
+	return 1;
+}
+
+void input_frame_update(input_frame * frame, input_queue * queue, uint64_t now_us){
+	input_event event;
+
+	frame->events = 0;
+	frame->max_latency_us = 0;
+	for(int port=0; port<INPUT_PORTS; port++){
+		frame->ports[port].pressed = 0;
+		frame->ports[port].released = 0;
+	}
+
+	while(input_queue_pop(queue, &event)){
+		input_port * port = &frame->ports[event.port & (INPUT_PORTS-1)];
+		if(event.pressed){
+			port->held |= event.buttons;
+			port->pressed |= event.buttons;
+		}
+		else {
+			port->held &= ~event.buttons;
+			port->released |= event.buttons;
+		}
+
+		uint32_t latency = now_us > event.time_us ? (uint32_t)(now_us - event.time_us) : 0;
+		if(latency > frame->max_latency_us){
+			frame->max_latency_us = latency;
+		}
+		frame->events++;
+	}
+}
+
+#ifdef _arch_dreamcast
+
+static input_queue queue;
+static volatile int connected[INPUT_PORTS];
+
+static kthread_t * input_thread;
+static volatile int input_running = 0;
+static volatile int input_sampled = 0; // every port has been looked at once
+
+static uint32_t sample_port(int port, int * present){
+	// Buttons held on one controller, triggers included
+	maple_device_t * cont = maple_enum_type(port, MAPLE_FUNC_CONTROLLER);
+	cont_state_t * state = cont ? (cont_state_t *)maple_dev_status(cont) : NULL;
+
+	*present = (state != NULL);
+	if(!state){
+		return 0; // unplugged counts as everything let go
+	}
+	uint32_t buttons = state->buttons;
+	if(state->ltrig >= INPUT_TRIGGER_THRESHOLD){
+		buttons |= INPUT_LTRIG;
+	}
+	if(state->rtrig >= INPUT_TRIGGER_THRESHOLD){
+		buttons |= INPUT_RTRIG;
+	}
+	return buttons;
+}
+
+static int push_change(int port, uint32_t buttons, int pressed, uint64_t now){
+	if(!buttons){
+		return 1;
+	}
+	input_event event;
+	event.time_us = now;
+	event.buttons = buttons;
+	event.port = port;
+	event.pressed = pressed;
+	return input_queue_push(&queue, &event);
+}
+
+static void * input_thread_main(void * param){
+	uint32_t last[INPUT_PORTS] = {0};
+
+	while(input_running){
+		uint64_t now = timer_us_gettime64();
+
+		for(int port=0; port<INPUT_PORTS; port++){
+			int present;
+			uint32_t buttons = sample_port(port, &present);
+			__atomic_store_n(&connected[port], present, __ATOMIC_RELEASE);
+
+			uint32_t changed = buttons ^ last[port];
+			if(!changed){
+				continue;
+			}
+			// If the queue is full, last stays as it was for the part that didn't make it,
+			// and that goes out next time. A release that did get in isn't sent twice.
+			uint32_t released = changed & ~buttons;
+			uint32_t pressed = changed & buttons;
+			if(push_change(port, released, 0, now)){
+				last[port] &= ~released;
+			}
+			if(push_change(port, pressed, 1, now)){
+				last[port] |= pressed;
+			}
+		}
+		__atomic_store_n(&input_sampled, 1, __ATOMIC_RELEASE);
+		thd_sleep(INPUT_POLL_MS);
+	}
+	return NULL;
+}
+
+void input_start_thread(){
+	input_running = 1;
+	input_thread = thd_create(0, input_thread_main, NULL);
+	// So input_connected() is right from the start
+	while(!__atomic_load_n(&input_sampled, __ATOMIC_ACQUIRE)){
+		thd_pass();
+	}
+}
+
+void input_stop_thread(){
+	input_running = 0;
+	thd_join(input_thread, NULL);
+}
+
+int input_connected(int port){
+	return __atomic_load_n(&connected[port], __ATOMIC_ACQUIRE);
+}
+
+void input_poll(input_frame * frame){
+	input_frame_update(frame, &queue, timer_us_gettime64());
+	for(int port=0; port<INPUT_PORTS; port++){
+		frame->ports[port].connected = __atomic_load_n(&connected[port], __ATOMIC_ACQUIRE);
+	}
+}
+
+#endif
@@ -0,0 +1,79 @@
+// Controller input, sampled on its own thread.
+//
+// A KOS thread looks at every controller port every INPUT_POLL_MS milliseconds. KOS
+// itself refreshes the controller state once per vblank, so that notices a change
+// within a couple of milliseconds of maple delivering it. Every button that goes down
+// or up becomes a timestamped event in a lock-free queue (one producer, the input
+// thread; one consumer, the game loop).
+//
+// Once per tick the game calls input_poll(). That drains the queue into an input_frame:
+// what's held right now, plus everything that was pressed or released since the last
+// tick. A tap that starts and ends between two ticks (a long frame, or just bad timing)
+// still shows up in pressed. Edge detection lives here, so the game code doesn't need
+// any "was it released yet" flags of its own.
+//
+// The queue and input_frame don't need KOS, only the thread does.
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdint.h>
+
+#define INPUT_PORTS 4
+#define INPUT_QUEUE_SIZE 128 // events, must be a power of 2
+#define INPUT_POLL_MS 2
+
+// Button bits are the CONT_* ones from KOS, plus the analog triggers as two more
+#define INPUT_LTRIG (1u << 16) // left trigger at least half way down
+#define INPUT_RTRIG (1u << 17)
+#define INPUT_TRIGGER_THRESHOLD 128
+
+typedef struct Input_Event {
+	uint64_t time_us; // when the input thread saw it
+	uint32_t buttons; // the buttons that changed
+	uint8_t port;
+	uint8_t pressed; // 1 = went down, 0 = came up
+} input_event;
+
+typedef struct Input_Queue {
+	uint32_t head __attribute__((aligned(64))); // written by the input thread only
+	uint32_t dropped;
+	uint32_t tail __attribute__((aligned(64))); // written by the game loop only
+	input_event events[INPUT_QUEUE_SIZE] __attribute__((aligned(64)));
+} input_queue;
+
+typedef struct Input_Port {
+	int connected;
+	uint32_t held; // buttons down right now
+	uint32_t pressed; // went down since the last tick
+	uint32_t released; // came up since the last tick
+} input_port;
+
+typedef struct Input_Frame {
+	input_port ports[INPUT_PORTS];
+	int events; // how many events this tick
+	uint32_t max_latency_us; // oldest event this tick, from the input thread seeing it to input_poll()
+} input_frame;
+
+int input_queue_push(input_queue * queue, const input_event * event);
+int input_queue_pop(input_queue * queue, input_event * event);
+
+// Drains the queue into frame. now_us is the current time, for max_latency_us.
+void input_frame_update(input_frame * frame, input_queue * queue, uint64_t now_us);
+
+// Held down, or pressed and already let go since the last tick
+static inline uint32_t input_down(const input_frame * frame, int port){
+	return frame->ports[port].held | frame->ports[port].pressed;
+}
+
+#ifdef _arch_dreamcast
+void input_start_thread();
+void input_stop_thread();
+// Whether there's a controller in port as of the thread's last look, between ticks too.
+// Everything goes through the thread, nothing else reads maple for controllers.
+int input_connected(int port);
+// input_frame_update() on the queue the thread fills
+void input_poll(input_frame * frame);
+#endif
+
+#endif
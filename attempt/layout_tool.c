@@ -0,0 +1,98 @@
+// Where the hot part of tetris_game is (see TETRIS_HOT_BYTES in tetris.h), and how long a
+// tick takes with it in the cache and with it pushed out.
+//
+// Usage: layout_tool [ticks]
+//
+// Prints the offset, size and 32 byte cache line of every field a tick touches, then
+// times tetris_game_tick() with made up buttons: back to back, then with EVICT_BYTES of
+// other memory read before each tick, like a frame's drawing does on the Dreamcast. Only
+// the ticks themselves are timed (clock_gettime() included, so take ~20 ns off both). A
+// PC's caches are a lot bigger than the SH4's 16 KB and much better at guessing what's
+// next, so the difference is smaller here than with TICK_BENCH in main.c.
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "tetris.h"
+
+#define EVICT_BYTES (1024 * 1024) // more than most L2 caches
+#define EVICT_STRIDE 64 // a PC's cache line
+
+#define FIELD(name) { #name, offsetof(tetris_game, name), sizeof(((tetris_game *)0)->name) }
+
+static const struct {
+	const char * name;
+	size_t offset;
+	size_t size;
+} hot_fields[] = {
+	FIELD(rows), FIELD(rows_to_clear), FIELD(active), FIELD(version), FIELD(falltime),
+	FIELD(fall_timer), FIELD(line_clear_delay), FIELD(clear_timer), FIELD(move_timebuffer),
+	FIELD(phase), FIELD(active_set), FIELD(loss), FIELD(hold_eligible),
+	FIELD(released_y_button), FIELD(released_x_button), FIELD(released_up_button),
+};
+
+static double now_seconds(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double run(tetris_game * game, int ticks, int evict){
+	// Seconds ticks ticks took, each one after reading evict bytes of other memory
+	static volatile uint8_t memory[EVICT_BYTES];
+	uint32_t rng = 12345;
+	uint8_t sink = 0;
+	double took = 0;
+
+	tetris_game_reset(game, 1);
+	for(int i=0; i<ticks; i++){
+		for(int j=0; j<evict; j+=EVICT_STRIDE){
+			sink += memory[j];
+		}
+		uint32_t buttons = tetris_random(&rng)
+			& (TETRIS_BTN_LEFT | TETRIS_BTN_RIGHT | TETRIS_BTN_ROTATE_CW | TETRIS_BTN_SOFT_DROP);
+		double start = now_seconds();
+		tetris_game_tick(game, buttons);
+		took += now_seconds() - start;
+		if(game->loss){
+			tetris_game_reset(game, i);
+		}
+	}
+	memory[0] = sink;
+	return took;
+}
+
+int main(int argc, char ** argv){
+	int ticks = argc > 1 ? atoi(argv[1]) : 20000;
+	if(argc > 2 || ticks <= 0){
+		fprintf(stderr, "usage: layout_tool [ticks]\n");
+		return 1;
+	}
+	static tetris_game game;
+	size_t hot_end = 0;
+	uint64_t lines = 0; // bit n = cache line n of tetris_game has a hot field in it
+
+	tetris_init();
+	printf("%-20s %6s %4s %5s\n", "field", "offset", "size", "line");
+	for(size_t i=0; i<sizeof(hot_fields)/sizeof(hot_fields[0]); i++){
+		size_t end = hot_fields[i].offset + hot_fields[i].size;
+		printf("%-20s %6zu %4zu %5zu\n", hot_fields[i].name, hot_fields[i].offset, hot_fields[i].size,
+			hot_fields[i].offset / TETRIS_CACHE_LINE);
+		if(end > hot_end){
+			hot_end = end;
+		}
+		for(size_t line=hot_fields[i].offset / TETRIS_CACHE_LINE; line<(end + TETRIS_CACHE_LINE - 1) / TETRIS_CACHE_LINE; line++){
+			lines |= 1ull << line;
+		}
+	}
+	printf("hot fields: in %d cache lines, the first %zu of %d bytes; tetris_game is %zu bytes, aligned to %zu\n",
+		__builtin_popcountll(lines), hot_end, TETRIS_HOT_BYTES, sizeof(tetris_game), _Alignof(tetris_game));
+
+	double warm = run(&game, ticks, 0);
+	double cold = run(&game, ticks, EVICT_BYTES);
+	printf("tick: %.1f ns in the cache, %.1f ns after %d KB of other reads (%d ticks)\n",
+		warm * 1e9 / ticks, cold * 1e9 / ticks, EVICT_BYTES / 1024, ticks);
+	return 0;
+}
@@ -0,0 +1,143 @@
+// Ring buffered logger. See log.h.
+//
+// The ring is a bounded multi-producer/single-consumer queue: every slot has a sequence
+// number saying whose turn it is. A writer claims a slot by bumping write_pos with a
+// compare-and-swap, fills it in, then publishes it by advancing the slot's sequence.
+// The reader only prints slots whose sequence says they've been published.
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "log.h"
+
+#ifdef _arch_dreamcast
+#include <kos.h>
+#endif
+
+#define LOG_RING_MASK (LOG_RING_SIZE-1)
+
+typedef struct Log_Slot {
+	// Stored relative to the slot's index so that an all-zero ring is already valid
+	// (slot i starts out free for position i). See slot_seq().
+	volatile uint32_t seq;
+	uint8_t level;
+	char text[LOG_LINE_LENGTH];
+} log_slot;
+
+static log_slot ring[LOG_RING_SIZE];
+static volatile uint32_t write_pos = 0;
+static uint32_t read_pos = 0;
+
+volatile uint32_t log_dropped = 0;
+static uint32_t dropped_reported = 0;
+
+static const char * level_names[] = { "ERROR", "WARN", "INFO", "DEBUG" };
+
+// Slot sequence for position pos:
+//   == pos      free, the writer that claims pos can use it
+//   == pos + 1  written, ready for the reader
+static inline uint32_t slot_seq(uint32_t pos){
+	return __atomic_load_n(&ring[pos & LOG_RING_MASK].seq, __ATOMIC_ACQUIRE) + (pos & LOG_RING_MASK);
+}
+
+static inline void set_slot_seq(uint32_t pos, uint32_t seq){
+	__atomic_store_n(&ring[pos & LOG_RING_MASK].seq, seq - (pos & LOG_RING_MASK), __ATOMIC_RELEASE);
+}
+
+void log_write(int level, const char * format, ...){
+	uint32_t pos = __atomic_load_n(&write_pos, __ATOMIC_RELAXED);
+
+	// claim a slot
+	for(;;){
+		int32_t diff = (int32_t)(slot_seq(pos) - pos);
+		if(diff == 0){
+			if(__atomic_compare_exchange_n(&write_pos, &pos, pos+1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+				break;
+			}
+			// someone else got it first, pos now holds the new write_pos, try again
+		}
+		else if(diff < 0){
+			// the reader hasn't caught up, the ring is full
+			__atomic_add_fetch(&log_dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+		else {
+			pos = __atomic_load_n(&write_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	log_slot * slot = &ring[pos & LOG_RING_MASK];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(slot->text, LOG_LINE_LENGTH, format, args);
+	va_end(args);
+	slot->level = level;
+
+	set_slot_seq(pos, pos+1); // publish
+}
+
+int log_drain(int max_messages){
+	int printed = 0;
+
+	while(max_messages == 0 || printed < max_messages){
+		if(slot_seq(read_pos) != read_pos+1){
+			break; // nothing (finished) to print
+		}
+		log_slot * slot = &ring[read_pos & LOG_RING_MASK];
+		printf("[%s] %s\n", level_names[slot->level & 3], slot->text);
+
+		set_slot_seq(read_pos, read_pos + LOG_RING_SIZE); // free for the next lap
+		read_pos++;
+		printed++;
+	}
+
+	uint32_t dropped = log_dropped;
+	if(dropped != dropped_reported){
+		printf("[LOG] %u messages dropped, the ring was full\n", dropped - dropped_reported);
+		dropped_reported = dropped;
+	}
+	return printed;
+}
+
+#ifdef _arch_dreamcast
+
+static kthread_t * drain_thread;
+static volatile int drain_running = 0;
+
+static void * drain_thread_main(void * param){
+	while(drain_running){
+		// One message at a time. The thread is below the game's priority, so it only gets
+		// here while the game thread is waiting (mostly in pvr_wait_ready()) and is switched
+		// out as soon as that wakes. The exception is a printf() that's already under way,
+		// dcload sends it with interrupts off, so that's at most one message of delay for
+		// the game instead of a batch of them.
+		if(!log_drain(1)){
+			thd_sleep(20);
+		}
+	}
+	log_drain(0);
+	return NULL;
+}
+
+void log_start_drain_thread(){
+	drain_running = 1;
+	drain_thread = thd_create(0, drain_thread_main, NULL);
+	thd_set_prio(drain_thread, PRIO_DEFAULT + 1); // a bigger number is a lower priority
+}
+
+void log_stop_drain_thread(){
+	drain_running = 0;
+	thd_join(drain_thread, NULL);
+}
+
+#else
+
+void log_start_drain_thread(){
+	// no background thread on the host, call log_drain() yourself
+}
+
+void log_stop_drain_thread(){
+	log_drain(0);
+}
+
+#endif
@@ -0,0 +1,69 @@
+// Logging that never stalls a frame.
+//
+// printf() on the Dreamcast goes over the dcload serial console, and the game loop
+// sits there until every character has been sent. LOG_*() instead formats the message
+// into a slot of an in-memory ring buffer and returns. log_drain() (called from a low
+// priority thread, see log_start_drain_thread(), or between frames) is what actually
+// prints them. If the ring fills up, new messages are dropped and counted, and the
+// count gets printed the next time the ring drains.
+//
+// Messages below LOG_LEVEL are compiled out completely, e.g. build with
+// -DLOG_LEVEL=LOG_LEVEL_WARN to get rid of the info and debug messages.
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_RING_SIZE 64 // messages, must be a power of 2
+#define LOG_LINE_LENGTH 96 // longer messages get cut off
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) log_write(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while(0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) log_write(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while(0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) log_write(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while(0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) log_write(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while(0)
+#endif
+
+// Use the macros above instead of calling this directly.
+// Safe to call from any thread, never blocks.
+void log_write(int level, const char * format, ...) __attribute__((format(printf, 2, 3)));
+
+// Prints up to max_messages queued messages (or all of them if max_messages is 0).
+// Only one thread may drain at a time. Returns how many were printed.
+int log_drain(int max_messages);
+
+// Dreamcast only: starts a thread below the game thread's priority that drains the ring
+// whenever the game is waiting.
+void log_start_drain_thread();
+void log_stop_drain_thread();
+
+extern volatile uint32_t log_dropped;
+
+#endif
@@ -0,0 +1,213 @@
+// LZ4 block packing and unpacking. See lz.h.
+//
+// A block is a list of sequences, each one:
+//
+//   token         high nibble: literal count, low nibble: match length - 4
+//   [more count]  if the nibble was 15, bytes to add on until one isn't 255
+//   literals
+//   offset        u16 little endian, how far back the match starts (1..65535)
+//   [more length] like the literal count
+//
+// The last sequence is literals only. Matches stop 12 bytes before the end and the last
+// 5 bytes are always literals, which is what lets other LZ4 decoders copy in big steps.
+
+#include <string.h>
+
+#include "lz.h"
+
+#define MIN_MATCH 4
+#define LAST_LITERALS 5 // the end of the input is always literals...
+#define MATCH_SAFE_END 12 // ...and no match starts this close to it
+#define HASH_BITS 12
+#define MAX_OFFSET 65535
+
+static uint32_t read_u32(const uint8_t * p){
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+long lz_unpacked_size(const uint8_t * data, size_t size){
+	if(size < LZ_HEADER_SIZE || memcmp(data, LZ_MAGIC, 4)){
+		return -1;
+	}
+	uint32_t unpacked = read_u32(data + 4);
+	return unpacked <= LZ_MAX_SIZE ? (long)unpacked : -1;
+}
+
+int lz_unpack(const uint8_t * data, size_t size, uint8_t * dst, size_t dst_size){
+	long unpacked = lz_unpacked_size(data, size);
+	if(unpacked < 0 || (size_t)unpacked > dst_size){
+		return 0;
+	}
+	return lz_decompress(data + LZ_HEADER_SIZE, size - LZ_HEADER_SIZE, dst, unpacked) == unpacked;
+}
+
+/**************************************** unpacking ****************************************/
+
+long lz_decompress(const uint8_t * src, size_t src_size, uint8_t * dst, size_t dst_capacity){
+	const uint8_t * in = src;
+	const uint8_t * in_end = src + src_size;
+	uint8_t * out = dst;
+	uint8_t * out_end = dst + dst_capacity;
+
+	while(in < in_end){
+		unsigned token = *in++;
+
+		size_t literals = token >> 4;
+		if(literals == 15){
+			unsigned byte;
+			do {
+				if(in >= in_end){
+					return -1;
+				}
+				byte = *in++;
+				literals += byte;
+			} while(byte == 255);
+		}
+		if(literals > (size_t)(in_end - in) || literals > (size_t)(out_end - out)){
+			return -1;
+		}
+		memcpy(out, in, literals);
+		in += literals;
+		out += literals;
+
+		if(in == in_end){
+			break; // the last sequence has no match
+		}
+
+		if(in_end - in < 2){
+			return -1;
+		}
+		size_t offset = in[0] | in[1] << 8;
+		in += 2;
+		if(offset == 0 || offset > (size_t)(out - dst)){
+			return -1;
+		}
+
+		size_t length = (token & 15) + MIN_MATCH;
+		if((token & 15) == 15){
+			unsigned byte;
+			do {
+				if(in >= in_end){
+					return -1;
+				}
+				byte = *in++;
+				length += byte;
+			} while(byte == 255);
+		}
+		if(length > (size_t)(out_end - out)){
+			return -1;
+		}
+
+		// Matches can overlap what they write (offset < length repeats the last bytes),
+		// so no memcpy unless they're far enough apart
+		const uint8_t * match = out - offset;
+		if(offset >= length){
+			memcpy(out, match, length);
+			out += length;
+		}
+		else {
+			uint8_t * end = out + length;
+			while(out < end){
+				*out++ = *match++;
+			}
+		}
+	}
+	return out - dst;
+}
+
+/**************************************** packing ****************************************/
+
+#ifndef _arch_dreamcast
+
+size_t lz_pack_bound(size_t size){
+	return LZ_HEADER_SIZE + size + size / 255 + 16;
+}
+
+static uint8_t * write_count(uint8_t * out, size_t count){
+	// The part of a count that didn't fit in its nibble
+	while(count >= 255){
+		*out++ = 255;
+		count -= 255;
+	}
+	*out++ = count;
+	return out;
+}
+
+static uint8_t * write_sequence(uint8_t * out, const uint8_t * literals, size_t literal_count, size_t offset, size_t length){
+	// length 0 means literals only (the last sequence)
+	uint8_t * token = out++;
+	size_t match_code = length ? length - MIN_MATCH : 0;
+
+	*token = (literal_count < 15 ? literal_count : 15) << 4 | (match_code < 15 ? match_code : 15);
+	if(literal_count >= 15){
+		out = write_count(out, literal_count - 15);
+	}
+	memcpy(out, literals, literal_count);
+	out += literal_count;
+
+	if(length){
+		*out++ = offset & 0xff;
+		*out++ = offset >> 8;
+		if(match_code >= 15){
+			out = write_count(out, match_code - 15);
+		}
+	}
+	return out;
+}
+
+static unsigned hash4(const uint8_t * p){
+	return (read_u32(p) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+size_t lz_pack(const uint8_t * src, size_t size, uint8_t * dst){
+	// Greedy: at every position, take the last place the same 4 bytes were seen (if it's
+	// in range) and extend the match as far as it goes
+	uint32_t table[1 << HASH_BITS];
+	const uint8_t * in = src;
+	const uint8_t * anchor = src; // start of the literals not written yet
+	const uint8_t * end = src + size;
+	uint8_t * out = dst;
+
+	memcpy(out, LZ_MAGIC, 4);
+	out[4] = size & 0xff;
+	out[5] = size >> 8 & 0xff;
+	out[6] = size >> 16 & 0xff;
+	out[7] = size >> 24 & 0xff;
+	out += LZ_HEADER_SIZE;
+
+	if(size > MATCH_SAFE_END){
+		const uint8_t * match_limit = end - MATCH_SAFE_END; // matches start before this...
+		const uint8_t * extend_limit = end - LAST_LITERALS; // ...and end before this
+		memset(table, 0xff, sizeof(table));
+
+		while(in < match_limit){
+			unsigned hash = hash4(in);
+			uint32_t candidate = table[hash];
+			table[hash] = in - src;
+
+			if(candidate == UINT32_MAX || (size_t)(in - src) - candidate > MAX_OFFSET || read_u32(src + candidate) != read_u32(in)){
+				in++;
+				continue;
+			}
+
+			const uint8_t * match = src + candidate;
+			const uint8_t * scan = in + MIN_MATCH;
+			match += MIN_MATCH;
+			while(scan < extend_limit && *scan == *match){
+				scan++;
+				match++;
+			}
+			out = write_sequence(out, anchor, in - anchor, in - (src + candidate), scan - in);
+
+			// Remember a position inside the match too, it's often where the next one starts
+			if(scan - 2 < match_limit){
+				table[hash4(scan - 2)] = scan - 2 - src;
+			}
+			in = anchor = scan;
+		}
+	}
+	out = write_sequence(out, anchor, end - anchor, 0, 0);
+	return out - dst;
+}
+
+#endif
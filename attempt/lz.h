@@ -0,0 +1,43 @@
+// LZ compression for romdisk assets.
+//
+// The data is an LZ4 block (literal runs and back references, nothing to set up and
+// no tables), the kind of LZ that decompresses about as fast as memcpy, which is what
+// matters here: files are packed once on the PC and unpacked at boot on the SH4.
+//
+// A packed file is a small header followed by the block:
+//
+//   0   'T' 'L' 'Z' '1'
+//   4   unpacked size, u32 little endian
+//   8   the LZ4 block, to the end of the file
+//
+// Packing (lz_compress) is host only, unpacking works everywhere.
+
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LZ_MAGIC "TLZ1"
+#define LZ_HEADER_SIZE 8
+#define LZ_MAX_SIZE (64u << 20) // unpacked sizes above this are treated as corrupt
+
+// Unpacked size of a packed file, or -1 if it isn't one
+long lz_unpacked_size(const uint8_t * data, size_t size);
+
+// Unpacks a packed file into dst, which has room for lz_unpacked_size() bytes.
+// Every read and write is bounds checked. Returns 1 if it all went fine.
+int lz_unpack(const uint8_t * data, size_t size, uint8_t * dst, size_t dst_size);
+
+// Just the block: returns the number of bytes written to dst, or -1 if the block is
+// broken or doesn't fit
+long lz_decompress(const uint8_t * src, size_t src_size, uint8_t * dst, size_t dst_capacity);
+
+#ifndef _arch_dreamcast
+// Worst case size of a packed file for size bytes of input
+size_t lz_pack_bound(size_t size);
+// Packs size bytes into dst (lz_pack_bound() bytes of room), returns the packed size
+size_t lz_pack(const uint8_t * src, size_t size, uint8_t * dst);
+#endif
+
+#endif
@@ -0,0 +1,238 @@
+// Host tool for romdisk packing (lz.h, asset.h).
+//
+//   lz_tool pack <assets dir> <romdisk dir>
+//       packs every file in assets into romdisk as name.lz, or copies it over as it is
+//       if packing doesn't save enough to be worth unpacking at boot (or the game maps
+//       it directly, see store_as_is)
+//   lz_tool check <assets dir> <romdisk dir>
+//       loads every asset back through asset_map() and compares it with the original
+//   lz_tool bench <file>...
+//       packed sizes, packing and unpacking speed, and the upload time saved
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "asset.h"
+#include "log.h"
+#include "lz.h"
+
+#define BENCH_SECONDS 0.5 // at least this long per file
+#define PACK_MIN_SAVING 8 // only pack files that get at least 1/8 smaller...
+#define PACK_MIN_BYTES 256 // ...and at least this many bytes smaller
+#define SERIAL_BAUD 1500000 // dc-tool-ser -b 1500000, 10 bits a byte on the wire
+
+// Never packed: the game maps these straight from the romdisk (puzzle_pack_map()), a
+// packed one would have to be unpacked into the asset arena instead
+static const char * const store_as_is[] = { ".tpz" };
+
+static int must_store_as_is(const char * name){
+	size_t length = strlen(name);
+	for(size_t i=0; i<sizeof(store_as_is)/sizeof(store_as_is[0]); i++){
+		size_t suffix = strlen(store_as_is[i]);
+		if(length >= suffix && !strcmp(name + length - suffix, store_as_is[i])){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static double now_seconds(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint8_t * read_all(const char * path, size_t * size){
+	FILE * file = fopen(path, "rb");
+	if(!file){
+		return NULL;
+	}
+	fseek(file, 0, SEEK_END);
+	*size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	uint8_t * data = malloc(*size ? *size : 1);
+	if(!data || fread(data, 1, *size, file) != *size){
+		fprintf(stderr, "%s: can't read it\n", path);
+		exit(1);
+	}
+	fclose(file);
+	return data;
+}
+
+static void write_all(const char * path, const uint8_t * data, size_t size){
+	FILE * file = fopen(path, "wb");
+	if(!file || fwrite(data, 1, size, file) != size || fclose(file)){
+		fprintf(stderr, "%s: can't write it\n", path);
+		exit(1);
+	}
+}
+
+// Calls fn for every regular file in dir, sorted so the output doesn't depend on the filesystem
+static int for_each_file(const char * dir, int (*fn)(const char * name, void * context), void * context){
+	struct dirent ** entries;
+	int count = scandir(dir, &entries, NULL, alphasort);
+	int failed = 0;
+	if(count < 0){
+		fprintf(stderr, "can't list %s\n", dir);
+		return 1;
+	}
+	for(int i=0; i<count; i++){
+		char path[512];
+		struct stat st;
+		snprintf(path, sizeof(path), "%s/%s", dir, entries[i]->d_name);
+		if(!stat(path, &st) && S_ISREG(st.st_mode)){
+			failed |= fn(entries[i]->d_name, context);
+		}
+		free(entries[i]);
+	}
+	free(entries);
+	return failed;
+}
+
+typedef struct Dirs {
+	const char * assets;
+	const char * romdisk;
+	size_t bytes, stored_bytes;
+} dirs;
+
+/**************************************** pack ****************************************/
+
+static int pack_file(const char * name, void * context){
+	dirs * d = context;
+	char source[512], plain[512], packed_path[512];
+	size_t size;
+
+	snprintf(source, sizeof(source), "%s/%s", d->assets, name);
+	snprintf(plain, sizeof(plain), "%s/%s", d->romdisk, name);
+	snprintf(packed_path, sizeof(packed_path), "%s/%s.lz", d->romdisk, name);
+
+	uint8_t * data = read_all(source, &size);
+	uint8_t * packed = malloc(lz_pack_bound(size));
+	size_t packed_size = lz_pack(data, size, packed);
+	int worth_it = size - packed_size >= size / PACK_MIN_SAVING && packed_size + PACK_MIN_BYTES <= size
+		&& !must_store_as_is(name);
+
+	// Only one of the two may be on the romdisk, asset_map() would take the packed one
+	if(worth_it){
+		write_all(packed_path, packed, packed_size);
+		unlink(plain);
+		d->stored_bytes += packed_size;
+	}
+	else {
+		write_all(plain, data, size);
+		unlink(packed_path);
+		d->stored_bytes += size;
+	}
+	d->bytes += size;
+	printf("%-24s %8zu -> %8zu bytes (%5.1f%%) %s\n", name, size, packed_size,
+		size ? 100.0 * packed_size / size : 100.0, worth_it ? "packed" : "stored as it is");
+
+	free(packed);
+	free(data);
+	return 0;
+}
+
+static int pack(dirs * d){
+	int failed = for_each_file(d->assets, pack_file, d);
+	printf("romdisk: %zu bytes -> %zu bytes, %.2f s less to upload at %d baud\n", d->bytes, d->stored_bytes,
+		(d->bytes - d->stored_bytes) * 10.0 / SERIAL_BAUD, SERIAL_BAUD);
+	return failed;
+}
+
+/**************************************** check ****************************************/
+
+static int check_file(const char * name, void * context){
+	dirs * d = context;
+	char source[512], path[512];
+	size_t size, loaded_size;
+
+	snprintf(source, sizeof(source), "%s/%s", d->assets, name);
+	snprintf(path, sizeof(path), "%s/%s", d->romdisk, name);
+	uint8_t * data = read_all(source, &size);
+	const void * loaded = asset_map(path, &loaded_size);
+
+	int ok = loaded && loaded_size == size && !memcmp(loaded, data, size);
+	printf("%-24s %s\n", name, !loaded ? "missing" : ok ? "ok" : "DIFFERENT");
+	free(data);
+	return !ok;
+}
+
+static int check(dirs * d){
+	int failed = for_each_file(d->assets, check_file, d);
+	asset_log_totals();
+	log_drain(0);
+	return failed;
+}
+
+/**************************************** bench ****************************************/
+
+static int bench(int count, char ** paths){
+	for(int i=0; i<count; i++){
+		size_t size;
+		uint8_t * data = read_all(paths[i], &size);
+		uint8_t * packed = malloc(lz_pack_bound(size));
+		uint8_t * unpacked = malloc(size ? size : 1);
+		size_t packed_size = 0;
+		double start, pack_seconds, unpack_seconds;
+		long passes;
+
+		start = now_seconds();
+		passes = 0;
+		do {
+			packed_size = lz_pack(data, size, packed);
+			passes++;
+		} while((pack_seconds = now_seconds() - start) < BENCH_SECONDS);
+		pack_seconds /= passes;
+
+		start = now_seconds();
+		passes = 0;
+		do {
+			if(!lz_unpack(packed, packed_size, unpacked, size) || memcmp(unpacked, data, size)){
+				fprintf(stderr, "%s: doesn't unpack to what went in\n", paths[i]);
+				return 1;
+			}
+			passes++;
+		} while((unpack_seconds = now_seconds() - start) < BENCH_SECONDS);
+		unpack_seconds /= passes;
+
+		// The upload is the serial link's time, unpacking here is a PC's. The boot log has
+		// what unpacking really costs on the SH4.
+		printf("%s: %zu -> %zu bytes (%.1f%%), packs at %.0f MB/s, unpacks at %.0f MB/s (%.1f us), "
+			"%.1f ms less to upload at %d baud\n", paths[i], size, packed_size, size ? 100.0 * packed_size / size : 100.0,
+			size / pack_seconds / 1e6, size / unpack_seconds / 1e6, unpack_seconds * 1e6,
+			((double)size - packed_size) * 10.0 / SERIAL_BAUD * 1e3, SERIAL_BAUD);
+
+		free(unpacked);
+		free(packed);
+		free(data);
+	}
+	return 0;
+}
+
+int main(int argc, char ** argv){
+	if(argc < 3 || (strcmp(argv[1], "bench") && argc < 4)){
+		fprintf(stderr, "usage: lz_tool pack|check <assets dir> <romdisk dir>\n       lz_tool bench <file>...\n");
+		return 1;
+	}
+
+	const char * command = argv[1];
+	dirs d = {argv[2], argv[3], 0, 0};
+
+	if(!strcmp(command, "pack")){
+		return pack(&d);
+	}
+	if(!strcmp(command, "check")){
+		return check(&d);
+	}
+	if(!strcmp(command, "bench")){
+		return bench(argc - 2, argv + 2);
+	}
+
+	fprintf(stderr, "unknown command %s\n", command);
+	return 1;
+}
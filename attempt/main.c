@@ -22,6 +22,22 @@
 
 #include "vmu_img.h"
 #include "display.c"
+#include "audio.h"
+#include "log.h"
+#include "tetris.h"
+#include "versus.h"
+#include "replay.h"
+#include "highscore.h"
+#include "puzzle.h"
+#include "vmu_status.h"
+#include "input.h"
+#include "asset.h"
+#include "particles.h"
+#include "background.h"
+#include "alloc_audit.h"
+#include "opponent.h"
+#include "pvr_capture.h"
+#include "ocram.h"
 
 // font stuff
 #include <plx/font.h>
@@ -31,75 +47,110 @@
 
 #define SCREEN_WIDTH 640
 #define SCREEN_HEIGHT 480
-#define FIELD_HEIGHT 400 // 20 blocks x 20 pixels each
-#define FIELD_WIDTH 200 // 10 blocks x 20 pixels each
+// Blocks are 20 pixels, smaller if the field is bigger than the standard 10x20 (see
+// TETRIS_WIDTH in tetris.h) so it still fits the same 200x400 space on screen
+#define BLOCK_SIZE_FOR(blocks, pixels) ((blocks) * 20 > (pixels) ? (pixels) / (blocks) : 20)
+#define BLOCK_SIZE (BLOCK_SIZE_FOR(TETRIS_WIDTH, 200) < BLOCK_SIZE_FOR(TETRIS_VISIBLE_ROWS, 400) \
+	? BLOCK_SIZE_FOR(TETRIS_WIDTH, 200) : BLOCK_SIZE_FOR(TETRIS_VISIBLE_ROWS, 400))
+#define FIELD_HEIGHT (TETRIS_VISIBLE_ROWS * BLOCK_SIZE) // 400 for the standard field
+#define FIELD_WIDTH (TETRIS_WIDTH * BLOCK_SIZE) // 200 for the standard field
+
+// When this is 1, blocks and grid lines are written straight into the SH4 store queues
+// with the pvr_dr ("direct rendering") API instead of being copied through pvr_prim().
+// Set it to 0 to fall back to the old pvr_prim path (handy when debugging in an emulator).
+// Capture builds need the pvr_prim path, see pvr_capture.h.
+#ifndef USE_DR_RENDERING
+#define USE_DR_RENDERING !PVR_CAPTURE
+#endif
+
+// When this is 1, every single player game gets recorded to REPLAY_PATH (see replay.h),
+// the file is closed when the game ends. Off by default since /pc/ needs dcload.
+#ifndef RECORD_REPLAYS
+#define RECORD_REPLAYS 0
+#endif
+#define REPLAY_PATH "/pc/last_game.trp"
+// ...with a hash of the game state every frame, so `replay_tool crosscheck` can play the
+// same inputs on a PC and find the first frame where the two builds disagree
+#ifndef REPLAY_TICK_HASHES
+#define REPLAY_TICK_HASHES 1
+#endif
+
+#define PUZZLE_PACK_PATH "/rd/puzzles.tpz" // built from puzzles.txt, see Makefile.host
+#define FONT_PATH "/rd/typewriter.txf"
+
+// Particle bursts when rows clear and when a hard drop lands (see particles.h).
+// Set it to 0 to turn them off.
+#ifndef USE_PARTICLES
+#define USE_PARTICLES 1
+#endif
+#define PARTICLE_SIZE 3.0f // pixels square
+
+// The turning cloud of 3D tetrominos behind the field (see background.h). 0 turns it off.
+#ifndef USE_BACKGROUND
+#define USE_BACKGROUND 1
+#endif
+#define BACKGROUND_BUDGET_US (1000000 / 60 * BACKGROUND_BUDGET_PERCENT / 100)
+
+// Versus against the computer (see opponent.h): hold B while pressing START with only one
+// controller plugged in. Its search runs in a slice after each frame's logic, at most
+// CPU_BUDGET_US and never into the last FRAME_MARGIN_US of the frame, so the next
+// draw_frame_gameplay() still makes it before vsync.
+#ifndef USE_CPU_OPPONENT
+#define USE_CPU_OPPONENT 1
+#endif
+#define CPU_PIECES_PER_MINUTE 90
+#define CPU_LOOKAHEAD 1 // also place the next tetromino
+#define CPU_BUDGET_US 3000
+#define FRAME_US (1000000 / 60)
+#define FRAME_MARGIN_US 1500
+
+// When this is 1, the game, the versus match and the CPU's search live in the SH4's
+// operand cache RAM instead of main RAM (see ocram.h): ticks never wait on a cache miss
+// for them, but everything else gets half the data cache. TICK_BENCH shows which wins.
+#ifndef USE_OCRAM
+#define USE_OCRAM 0
+#endif
+#define OCRAM_GAME_SIZE 512 // room for game at the start of the first block, match goes after it
+
+// Times this many ticks of a game at boot and logs how long one took, with the game
+// already in the cache and with it pushed out first (like drawing a frame does). 0 skips it.
+#ifndef TICK_BENCH
+#define TICK_BENCH 0
+#endif
+
+// The VMU screens show the next and held tetromino, level and lines (see vmu_status.h).
+// They're only sent when they change, and at most once every this many frames.
+#ifndef VMU_STATUS_MIN_FRAMES
+#define VMU_STATUS_MIN_FRAMES 10
+#endif
+
+// When this is 1, the fields, holds and line clear effect are built into a buffer in main
+// RAM, and as long as nothing visible changes the same buffer is sent again next frame
+// instead of building every header and vertex from scratch (see frame_cache below).
+// That and the particles get built at the end of update_frame(), while the PVR is still
+// busy with the last frame, so after pvr_wait_ready() there's only copying and text left
+// (see prepare_frame()). Off in capture builds, a cached frame would only have one mark,
+// and everything is built after pvr_wait_ready() the old way.
+#ifndef USE_FRAME_CACHE
+#define USE_FRAME_CACHE !PVR_CAPTURE
+#endif
+
+// In a capture build (make PVR_CAPTURE=1) the first PVR_CAPTURE_FRAMES frames are written
+// to PVR_CAPTURE_PATH for `pvr_raster` to draw on a PC (see pvr_capture.h)
+#define PVR_CAPTURE_PATH "/pc/frames.tpc"
+#define PVR_CAPTURE_FRAMES 600
 
 plx_font_t * fnt;
 plx_fcxt_t * fnt_cxt;
 point_t w;
 
-int loss = 0;
-int paused = 0;
-int pause_button_released=1;
-
-// When a tetromino is rotated, Tetris does a series of tests to find a valid (open) position to rotate the tetromino into.
-// The tests are done in order and the first test that succeeds determines where the tetromino is placed.
-// The test sets for Z, S, L, J, and T are all the same, but I has its own (O doesn't have one cause it doesn't rotate).
-// If they all fail, the rotation is cancelled.
-// The first test is a simple in place 90 degree rotation.
-// Tests 2-5 involve nudging the tetromino left, right, up, and down by a block or two to find a free spot.
-// This 4-dimensional matrix represents the (x, y) offsets of each test.
-// IMPORTANT: Because the tests are done IN ORDER, each pair of (x,y) represents the position RELATIVE TO THE LAST TEST,
-// NOT relative to the first test or the original position!
-// The last inner array (undo) represents the offset to get from test 5 back to the first test position, which is needed to cancel the rotation
-// when all tests fail.
-// First level: the tetromino type
-// Second level: the rotation type
-// Third level: the test number
-// Fourth level: x, y offset
-int rotation_tests_cw[2][4][5][2] =
-{
-	{ // This test matrix applies to Red/Z, Green/S, Orange/L, Dark Blue/J, Purple/T tetros. (Everything but Light Blue/I )
-		// Test 2, 3, 4, 5, and undo.
-		{ {-1,0}, {0,-1}, {1,3}, {-1,0}, {1,-2} }, // 0 to R
-		{ {1,0}, {0,1}, {-1,-3}, {1,0}, {-1,2} }, // R to 2
-		{ {1,0}, {0,-1}, {-1,3}, {1,0}, {-1,-2} }, // 2 to L
-		{ {-1,0}, {0,1}, {1,-3}, {-1,0}, {1,2} } // L to 0
-	},
-	{ // This test matrix applies only to Light Blue/I tetrominos
-		{ {-2,0}, {3,0}, {-3,1}, {3,-3}, {-1,2} }, // 0 to R
-		{ {-1,0}, {3,0}, {-3,-2}, {3,3}, {-2,-1} }, // R to 2
-		{ {2,0}, {-3,0}, {3,-1}, {-3,3}, {1,-2} }, // 2 to L
-		{ {1,0}, {-3,0}, {3,2}, {-3,-3}, {2,1} } // L to 0
-	},
-};
+pvr_poly_hdr_t square_hdr; // compiled once in init(), shared by every square in a list
+pvr_poly_hdr_t block_hdr; // same idea, but textured with the block atlas
+pvr_dr_state_t dr_state;
 
-int rotation_tests_ccw[2][4][5][2] =
-{
-	{ //J, L, S, T, Z
-		{ {1, 0}, {0, -1}, {-1,3}, {1,0}, {-1,-2} }, //0 to L
-		{ {1, 0}, {0, 1}, {-1,-3}, {1,0}, {-1,2} }, // R to 0
-		{ {-1, 0}, {0, -1}, {1, 3}, {-1, 0}, {1,-2} }, //2 to R
-		{ {-1, 0}, {0, 1}, {1,-3}, {-1,0}, {1,2} } //L to 2
-	},
-	{ //Light Blue
-		{ {-1, 0}, {3, 0}, {-3,-2}, {3,-3}, {-2,-1} }, //0 to L
-		{ {2, 0}, {-3, 0}, {3,-1}, {-3,3}, {1,-2} }, // R to 0
-		{ {1, 0}, {-3, 0}, {3, 2}, {-3,-3}, {2,1} }, //2 to R
-		{ {-2, 0}, {3, 0}, {-3, 1}, {3, -3}, {-1,2} } //L to 2
-	}
-};
+int paused = 0;
 
-typedef enum Color_Id {
-	EMPTY = 0,
-	RED = 1, // Z
-	ORANGE = 2, // L
-	YELLOW = 3, // O
-	GREEN = 4, // S
-	LIGHT_BLUE = 5, // I
-	DARK_BLUE = 6, // J
-	PURPLE = 7 // T
-} color_id;
+input_frame input; // this tick's controller state, from input_poll()
 
 typedef struct Color {
 	uint8 a;
@@ -108,86 +159,12 @@ typedef struct Color {
 	uint8 b;
 } color;
 
-typedef enum Rotation {
-	DEFAULT,
-	RIGHT,
-	TWO,
-	LEFT
-} rotation;
-
-typedef struct Tetrodata {
-	int top_y;
-	int left_x;
-	color_id type;
-	int dimensions;
-	rotation orientation;
-	int set;
-	int tetro_index;
-} tetrodata;
-
 int field_left = (SCREEN_WIDTH/2) - (FIELD_WIDTH/2);
-int field_right = (SCREEN_WIDTH/2) + (FIELD_WIDTH/2);
 int field_top = (SCREEN_HEIGHT/2) - (FIELD_HEIGHT/2);
-int field_bottom = (SCREEN_HEIGHT/2) + (FIELD_HEIGHT/2);
-
-// Arrays representing what each tetromino looks like.
-// These are intended to be read-only and are copied over to the dummy arrays
-color_id TETRO_Z[3][3] = {
-	{ 1, 1, 0 },
-	{ 0, 1, 1 },
-	{ 0, 0, 0 }
-};
-color_id TETRO_L[3][3] = {
-	{ 0, 0, 2 },
-	{ 2, 2, 2 },
-	{ 0, 0, 0 }
-};
-color_id TETRO_O[2][2] = {
-	{ 3, 3 },
-	{ 3, 3 }
-};
-color_id TETRO_S[3][3] = {
-	{ 0, 4, 4 },
-	{ 4, 4, 0 },
-	{ 0, 0, 0 }
-};
-color_id TETRO_I[4][4] = {
-	{ 0, 0, 0, 0 },
-	{ 5, 5, 5, 5 },
-	{ 0, 0, 0, 0 },
-	{ 0, 0, 0, 0 }
-};
-color_id TETRO_J[3][3] = {
-	{ 6, 0, 0 },
-	{ 6, 6, 6 },
-	{ 0, 0, 0 }
-};
-color_id TETRO_T[3][3] = {
-	{ 0, 7, 0 },
-	{ 7, 7, 7 },
-	{ 0, 0, 0 }
-};
 
-// Arrays for holding the real current tetromino.
-// When a new tetromino is spawned, the relevant tetro array (TETRO_Z, TETRO_L, etc)
-// is copied into it.
-// Then, these "dummy" arrays can be rotated, without effecting how the next
-// tetromino of the same type will spawn in.
-// There are 3 of them because while most tetrominos go in the 3x3 one, the I needs 4x4 and
-// the O needs 2x2.
-color_id tetro_dummy_4x4[4][4] = {0};
-color_id tetro_dummy_3x3[3][3] = {0};
-color_id tetro_dummy_2x2[2][2] = {0};
-
-color_id held_tetro = 0;
-int hold_eligible = 1; // whether we will let the user perform a tetromino hold
-
-int has_drawn_new_tetro = 0;
-
-int line_clears = 0;
-long int score = 0;
-int level = 1;
-int falltime = 93;
+// In versus mode the two fields sit side by side, each with its hold box to its left
+#define VERSUS_FIELD_LEFT_1 110
+#define VERSUS_FIELD_LEFT_2 420
 
 color COLOR_RED = {255, 255, 0, 0};
 color COLOR_ORANGE = {255, 255, 174, 94};
@@ -196,135 +173,377 @@ color COLOR_GREEN = {255, 0, 255, 0};
 color COLOR_LIGHT_BLUE = {255, 0, 255, 255};
 color COLOR_DARK_BLUE = {255, 0, 0, 255};
 color COLOR_PURPLE = {255, 255, 0, 255};
+color COLOR_GRAY = {255, 128, 128, 128};
 color COLOR_WHITE = {255, 255, 255, 255};
 color COLOR_BLACK = {255, 0, 0, 0};
 
-//setting up the field data structure.
-color_id field_backup[24][12] = {
-//    0       1  2  3  4  5  6  7  8  9  10      11
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 0
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 1
-	{ 1, /**/ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /**/ 1}, // 2
-	/**********************************************/ //Top boundary of visible area
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 3
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 4
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 5
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 6
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 7
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 8
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 9
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 10
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 11
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 12
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 13
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 14
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 15
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 16
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 17
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 18
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 19
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 20
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 21
-	{ 1, /**/ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /**/ 1}, // 22
-	/**********************************************/ //Bottom boundary of visible area
-	{ 1, /**/ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /**/ 1}, // 23
-//        ^--- Left boundary of vis. area     ^--- Right boundary of visible area
+// The colors above are the "theme". They get turned into these lookup tables once in
+// build_block_palette() so nothing has to convert colors while drawing a frame.
+// Everything is indexed by color_id (EMPTY is slot 0 and is never drawn).
+#define BLOCK_COLORS 9
+color * block_palette[BLOCK_COLORS] = {
+	&COLOR_BLACK, &COLOR_RED, &COLOR_ORANGE, &COLOR_YELLOW,
+	&COLOR_GREEN, &COLOR_LIGHT_BLUE, &COLOR_DARK_BLUE, &COLOR_PURPLE,
+	&COLOR_GRAY // GARBAGE
 };
-// The border of 1's is interpreted as tetromino blocks (red ones to be exact) but are not
-// rendered to the screen and are ignored when checking for filled lines. The purpose of
-// this is so I can prevent tetrominos from going off the screen in the same exact way that I
-// prevent tetrominos from overlapping/intersecting with other tetrominos.
+uint32 block_argb[BLOCK_COLORS]; // packed vertex colors, ready to go straight into pvr_vertex_t.argb
+uint32 ARGB_WHITE;
+uint32 ARGB_BLACK;
 
-color_id field[24][12];
+// Block skin texture atlas: one 32x32 tile per color_id side by side in a 512x32 texture
+// (texture sizes have to be powers of 2, so there's room for 16 tiles).
+// Every block is a single textured quad, and block_uv[id] says which tile it uses.
+#define BLOCK_TILE_SIZE 32
+#define BLOCK_ATLAS_WIDTH (BLOCK_TILE_SIZE*16)
+#define BLOCK_ATLAS_HEIGHT BLOCK_TILE_SIZE
 
-//memcpy(field, field_backup, 12*24*sizeof(int));
-
-// an array of 23 arrays, each with 12 items in it
-color_id temp_field[24][12] = {EMPTY};
-// This variable an empty version of the field matrix. It is where the current active tetromino is put.
-// It is rendered to the screen directly on top of the main field matrix. When a tetromino is set,
-// it is copied over to the main field matrix in the same location, and the temp_field matrix is
-// cleared out for the next tetromino.
-
-color_id hold_field[4][4] = {EMPTY};
+pvr_ptr_t block_atlas;
+float block_uv[BLOCK_COLORS][2]; // left and right u coordinate of each tile (v is always 0 to 1)
 
 extern uint8 romdisk[];
 KOS_INIT_FLAGS(INIT_DEFAULT);
 KOS_INIT_ROMDISK(romdisk);
 
-float position_x = SCREEN_WIDTH/2;
-float position_y = SCREEN_HEIGHT/2;
-
-tetrodata active_tetro;
-// This holds data on the current active tetromino. It is continuously overwritten with the next
-// tetromino as the old tetromino get committed to the field matrix and doesn't need to be kept
-// track of anymore.
+// The whole state of the game (field, active tetromino, hold, score...) lives in here.
+// The rules that change it are in tetris.c, this file just draws it and feeds it buttons.
+// match is used instead of game when versus_mode is on.
+#if USE_OCRAM
+OCRAM_VARIABLE(tetris_game, game, OCRAM_BLOCK_1);
+OCRAM_VARIABLE(versus_match, match, OCRAM_BLOCK_1 + OCRAM_GAME_SIZE);
+_Static_assert(sizeof(tetris_game) <= OCRAM_GAME_SIZE, "game doesn't fit in OCRAM_GAME_SIZE");
+_Static_assert(OCRAM_GAME_SIZE + sizeof(versus_match) <= OCRAM_BLOCK_SIZE, "match doesn't fit in the OCRAM block after game");
+#else
+tetris_game game;
+versus_match match;
+#endif
+int versus_mode = 0;
+
+#if RECORD_REPLAYS
+replay_writer replay;
+#endif
+
+highscore_table high_scores; // loaded from the VMU in init(), single player only
+int new_high_score = -1; // rank the last game got in high_scores, -1 if it didn't make it
+int high_scores_unsaved = 0; // the save queue was full, try again next frame
+
+// Puzzle mode: hold A while pressing START on the game over screen. The pack is used
+// straight from the romdisk, puzzle points at the current record inside it.
+puzzle_pack puzzles;
+int puzzle_mode = 0;
+
+// Player 2 is the computer. Like the particles it isn't part of the snapshot, drawing
+// never looks at it.
+#if USE_OCRAM
+OCRAM_VARIABLE(opponent, cpu, OCRAM_BLOCK_2);
+_Static_assert(sizeof(opponent) <= OCRAM_BLOCK_SIZE, "cpu doesn't fit in an OCRAM block");
+#else
+opponent cpu;
+#endif
+int cpu_mode = 0; // B was held for the last START
+int cpu_playing = 0; // this game is against it
+uint64 frame_start_us = 0; // when pvr_wait_ready() let the last frame in, the CPU's deadline is a frame after
+uint32 puzzle_index = 0;
+const uint8_t * puzzle = NULL;
+puzzle_status puzzle_state = PUZZLE_PLAYING;
+
+vmu_status vmu_screens[2]; // one for the VMU in each player's controller
+
+// Unlike the games, the particles aren't copied into the render snapshot (that would be
+// up to PARTICLES_MAX of them every frame). Their vertices are built straight from the
+// pool right after it's updated (prepare_frame()).
+particle_pool particles;
+
+// Same deal as the particles: built at the end of update_frame(), sent in the next frame's
+// opaque list. The time it takes is checked against its budget every frame.
+background scenery;
+pvr_poly_hdr_t scenery_hdr;
+uint32 scenery_worst_us = 0;
+_Static_assert(sizeof(background_vertex) == sizeof(pvr_vertex_t), "background vertices go to the PVR as they are");
+
+// The drawing code never looks at game/match directly. Once per frame the logic copies
+// what's visible into a render snapshot and the display lists get built from that alone.
+typedef struct Board_Snapshot {
+	uint8 colors[TETRIS_ROWS][TETRIS_COLS];
+	tetris_row_set rows_to_clear;
+	int clearing; // the line clear animation is playing
+	int clear_timer;
+	int line_clear_delay;
+	int show_active; // there's a falling tetromino to draw
+	tetris_piece active;
+	color_id held;
+	int64_t score;
+	int level;
+	int line_clears;
+	int lines_sent; // versus only
+	uint32 version; // tetris_game.version
+} board_snapshot;
+
+typedef struct Render_Snapshot {
+	int versus;
+	int cpu; // player 2 is the computer
+	board_snapshot boards[2]; // only boards[0] in single player
+	int paused;
+	int game_over;
+	int winner; // versus_winner() once the game is over
+	highscore_table scores; // only filled in once a single player game is over
+	int new_high_score;
+	int puzzle; // single player puzzle mode
+	puzzle_status puzzle_state;
+	uint32 puzzle_number;
+	char puzzle_name[PUZZLE_NAME_LENGTH+1];
+	char puzzle_goal[16];
+} render_snapshot;
+
+// Only one: draw_frame_gameplay() is done with it (the lists are submitted) before the
+// next update_frame() writes it again. The same goes for the vertex buffers below, the TA
+// has its own copy of everything once it's been sent.
+render_snapshot snapshot;
+
+// The geometry of the last frame (everything but text), as the headers and vertices that
+// went to the TA, plus what it was built from. At low levels the picture only changes
+// when a button moves the tetromino or it falls a row, so most frames just resend this.
+// Worst case is two full fields: per field 2 headers, 32 grid line quads, 200 blocks and
+// a 4 block tetromino, plus a hold box and line clear effect each, under 2200 entries.
+// Bigger fields get room for the same worst case, with the same margin.
+#define FRAME_CACHE_FIELD_QUADS (4 + TETRIS_WIDTH + TETRIS_VISIBLE_ROWS + TETRIS_WIDTH * TETRIS_VISIBLE_ROWS + 12)
+#define FRAME_CACHE_WORST_CASE (2 * (8 + 4 * FRAME_CACHE_FIELD_QUADS))
+#define FRAME_CACHE_ENTRIES (FRAME_CACHE_WORST_CASE * 2 > 4096 ? FRAME_CACHE_WORST_CASE * 2 : 4096)
+
+// Headers and vertices built in main RAM, to go to the TA later with one pvr_prim()
+typedef struct Vertex_Buffer {
+	pvr_vertex_t * entries; // headers go in here too, same size
+	int capacity;
+	int count;
+	int overflowed;
+} vertex_buffer;
+
+typedef struct Frame_Cache {
+	pvr_vertex_t entries[FRAME_CACHE_ENTRIES] __attribute__((aligned(32)));
+	vertex_buffer list; // in entries
+
+	int valid;
+	int versus;
+	uint32 version[2];
+} frame_cache;
+
+frame_cache scene_cache = { .list = { scene_cache.entries, FRAME_CACHE_ENTRIES, 0, 0 } };
+
+#if USE_PARTICLES && USE_FRAME_CACHE
+// One header and a quad per particle
+#define PARTICLE_ENTRIES (1 + 4 * PARTICLES_MAX)
+pvr_vertex_t particle_entries[PARTICLE_ENTRIES] __attribute__((aligned(32)));
+vertex_buffer particle_list = { particle_entries, PARTICLE_ENTRIES, 0, 0 };
+#endif
+
+vertex_buffer * recording = NULL; // the draw functions write in here instead of to the TA
+
+// How long the lists took after pvr_wait_ready() let the frame in, and what got built
+// ahead of it instead, worst of this game (log_frame_totals())
+uint32 submit_worst_us = 0;
+uint32 prepare_worst_us = 0;
+
+void log_frame_totals(){
+	// How long the last game's frames kept the TA waiting, then start over for the next one
+	if(submit_worst_us){
+		LOG_INFO("Frames: worst %u us from pvr_wait_ready() to pvr_scene_finish(), worst %u us built ahead of it",
+			(unsigned)submit_worst_us, (unsigned)prepare_worst_us);
+	}
+	submit_worst_us = 0;
+	prepare_worst_us = 0;
+}
 
-int fall_timer=93;
-int first_run=1;
+#if USE_CPU_OPPONENT
+void log_cpu_totals(){
+	// How the last game's search did with its slices
+	if(!cpu.slices){
+		return;
+	}
+	LOG_INFO("CPU: %u slices used %u of %u us (%u%%), %u over budget, %u searches cut short, slowest placement %u us",
+		(unsigned)cpu.slices, (unsigned)cpu.used_total_us, (unsigned)cpu.budget_total_us,
+		(unsigned)(cpu.budget_total_us ? cpu.used_total_us * 100 / cpu.budget_total_us : 0),
+		(unsigned)cpu.overruns, (unsigned)cpu.searches_cut_short, (unsigned)cpu.placement_worst_us);
+}
+#endif
 
 void initiate_game(){
-	memset(temp_field, EMPTY, sizeof(temp_field));
-	memset(tetro_dummy_2x2, EMPTY, sizeof(tetro_dummy_2x2));
-	memset(tetro_dummy_3x3, EMPTY, sizeof(tetro_dummy_3x3));
-	memset(tetro_dummy_4x4, EMPTY, sizeof(tetro_dummy_4x4));
-	memset(hold_field, EMPTY, sizeof(hold_field));
-	memcpy(field, field_backup, 288*sizeof(int));
-	held_tetro = 0;
-	hold_eligible = 1; // whether we will let the user perform a tetromino hold
-	has_drawn_new_tetro = 0;
-	line_clears = 0;
-	score = 0;
-	level = 1;
-	falltime = 93;
-	fall_timer = 93;
-	loss = 0;
+	// Fresh game, seeded from the clock so every game gets different tetrominos.
+	// If a second controller is plugged in, it's a versus game. So is one against the CPU.
+	uint32 seed = (uint32)timer_us_gettime64();
+
+	int second_controller = input_connected(1);
+	versus_mode = second_controller || cpu_mode;
+	log_frame_totals();
+#if USE_CPU_OPPONENT
+	log_cpu_totals();
+	cpu_playing = versus_mode && !second_controller;
+	opponent_reset(&cpu);
+#endif
+	puzzle = (puzzle_mode && !versus_mode) ? puzzle_get(&puzzles, puzzle_index) : NULL;
+	puzzle_state = PUZZLE_PLAYING;
+	if(versus_mode){
+		versus_reset(&match, seed);
+	}
+	else if(puzzle){
+		puzzle_start(puzzle, &game, seed);
+	}
+	else {
+		tetris_game_reset(&game, seed);
+	}
 	paused = 0;
-	first_run = 1;
-	active_tetro.set = 0;
+	new_high_score = -1;
+	particles_clear(&particles, seed);
+	scene_cache.valid = 0; // the new game's versions start over at 0
+	vmu_status_invalidate(&vmu_screens[0]);
+	vmu_status_invalidate(&vmu_screens[1]);
+
+#if RECORD_REPLAYS
+	// Opening and closing files allocates, once a game is fine (see alloc_audit.h)
+	alloc_audit_pause();
+	replay_writer_close(&replay); // whatever was left of the last game
+	// keyframes don't have the fixed tetrominos of a puzzle in them, so only marathon games
+	if(!versus_mode && !puzzle && !replay_writer_open(&replay, REPLAY_PATH, seed)){
+		LOG_WARN("Can't record the replay to %s", REPLAY_PATH);
+	}
+	replay.hash_ticks = REPLAY_TICK_HASHES;
+	alloc_audit_resume();
+#endif
+}
+
+uint32 pack_color(color c){
+	// Packs a color into the 32-bit ARGB format the PVR wants in its vertices.
+	// (Don't use PVR_PACK_COLOR with c.r/255 here, integer division turns every channel
+	// that isn't exactly 255 into 0, which is why orange used to come out red.)
+	return (c.a << 24) | (c.r << 16) | (c.g << 8) | c.b;
 }
 
-color get_argb_from_enum(color_id id){
-	switch(id){
-		case RED:
-			return COLOR_RED;
-		case ORANGE:
-			return COLOR_ORANGE;
-		case YELLOW:
-			return COLOR_YELLOW;
-		case GREEN:
-			return COLOR_GREEN;
-		case LIGHT_BLUE:
-			return COLOR_LIGHT_BLUE;
-		case DARK_BLUE:
-			return COLOR_DARK_BLUE;
-		case PURPLE:
-			return COLOR_PURPLE;
-		default:
-			printf("Get_argb_from_enum provided with invalid enum: %d\n",id);
-			return COLOR_WHITE;
+uint16 pack_rgb565(color c, int brightness){
+	// brightness is a percentage, so 100 is the color as-is, lower is darker, higher is lighter
+	int r = (c.r * brightness) / 100;
+	int g = (c.g * brightness) / 100;
+	int b = (c.b * brightness) / 100;
+	if(r>255) r=255;
+	if(g>255) g=255;
+	if(b>255) b=255;
+	return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+}
+
+void build_block_palette(){
+	for(int id=0; id<BLOCK_COLORS; id++){
+		block_argb[id] = pack_color(*block_palette[id]);
 	}
+	ARGB_WHITE = pack_color(COLOR_WHITE);
+	ARGB_BLACK = pack_color(COLOR_BLACK);
+}
+
+void build_block_atlas(){
+	// Draws a simple beveled skin for every color into the atlas. This only happens at
+	// startup (or when the palette changes), so changing the look of the blocks costs
+	// nothing while the game is running.
+	static uint16 pixels[BLOCK_ATLAS_HEIGHT][BLOCK_ATLAS_WIDTH];
+
+	for(int id=0; id<BLOCK_COLORS; id++){
+		color c = *block_palette[id];
+		for(int y=0; y<BLOCK_TILE_SIZE; y++){
+			for(int x=0; x<BLOCK_TILE_SIZE; x++){
+				int brightness = 100;
+				if(x<2 || y<2 || x>=BLOCK_TILE_SIZE-2 || y>=BLOCK_TILE_SIZE-2){
+					brightness = 40; // dark outline
+				}
+				else if(x<5 || y<5){
+					brightness = 150; // lit top and left edge
+				}
+				else if(x>=BLOCK_TILE_SIZE-5 || y>=BLOCK_TILE_SIZE-5){
+					brightness = 65; // shadowed bottom and right edge
+				}
+				pixels[y][id*BLOCK_TILE_SIZE + x] = pack_rgb565(c, brightness);
+			}
+		}
+		block_uv[id][0] = (float)(id*BLOCK_TILE_SIZE) / BLOCK_ATLAS_WIDTH;
+		block_uv[id][1] = (float)((id+1)*BLOCK_TILE_SIZE) / BLOCK_ATLAS_WIDTH;
+	}
+
+	if(!block_atlas){
+		block_atlas = pvr_mem_malloc(sizeof(pixels));
+	}
+	pvr_txr_load(pixels, block_atlas, sizeof(pixels));
 }
 
 void init(){
+	// Anything logged with LOG_*() gets printed from this thread, so the game loop
+	// never waits on the serial console
+	log_start_drain_thread();
+	input_start_thread();
+
 	pvr_init_defaults();
+	if(PVR_CAPTURE && !pvr_capture_open(PVR_CAPTURE_PATH, PVR_CAPTURE_FRAMES)){
+		LOG_ERROR("Can't capture frames to %s", PVR_CAPTURE_PATH);
+	}
+	uint64 boot_start = timer_us_gettime64();
+
+	// The VMU writes happen on their own thread, this read at boot is the only one that blocks
+	highscore_load(&high_scores);
+	highscore_start_save_thread(vmu_carl);
+#if RECORD_REPLAYS
+	replay_start_writer_thread(&replay); // and the replay's on theirs
+#endif
+
+	// Used straight from the romdisk, lz_tool never packs it
+	if(puzzle_pack_map(&puzzles, PUZZLE_PACK_PATH)){
+		LOG_INFO("%u puzzles in %s", puzzles.count, PUZZLE_PACK_PATH);
+	}
+	else if(!PUZZLE_FITS_FIELD){
+		LOG_INFO("Puzzles are off, they need a %dx%d field", PUZZLE_FIELD_COLS, PUZZLE_FIELD_ROWS);
+	}
 
 	pvr_set_bg_color(1.0,0.5,0.2);
 
 	maple_device_t *vmu = maple_enum_type(0, MAPLE_FUNC_LCD);
-	vmu_draw_lcd(vmu, vmu_carl);
+	vmu_draw_lcd(vmu, vmu_carl); // until the game starts drawing its status
+	vmu_status_init(&vmu_screens[0], VMU_STATUS_MIN_FRAMES);
+	vmu_status_init(&vmu_screens[1], VMU_STATUS_MIN_FRAMES);
 
-	//plx_font_t * fnt = plx_font_load("/rd/axaxax.txf");
-	plx_font_t * fnt = plx_font_load("/pc/typewriter.txf");
+	char font_file[64]; // unpacked from the romdisk into /ram, see asset.h
+	plx_font_t * fnt = plx_font_load(asset_file(FONT_PATH, font_file, sizeof(font_file)));
 
 	fnt_cxt = plx_fcxt_create(fnt, PVR_LIST_TR_POLY);
 
+	// Every square is a plain colored translucent poly, so the header only has to be
+	// compiled once instead of once per square.
+	pvr_poly_cxt_t cxt;
+	pvr_poly_cxt_col(&cxt, PVR_LIST_TR_POLY);
+	pvr_poly_compile(&square_hdr, &cxt);
+
+	build_block_palette();
+	build_block_atlas();
+
+#if USE_BACKGROUND
+	background_init(&scenery, (uint32)timer_us_gettime64(), block_argb);
+	// Flat colored and opaque, the faces facing away are already left out
+	pvr_poly_cxt_col(&cxt, PVR_LIST_OP_POLY);
+	cxt.gen.culling = PVR_CULLING_NONE;
+	pvr_poly_compile(&scenery_hdr, &cxt);
+#endif
+#if USE_CPU_OPPONENT
+	opponent_setup(&cpu, CPU_PIECES_PER_MINUTE, CPU_LOOKAHEAD);
+#endif
+
+	// Music streams from the romdisk if there's a music.wav on it, otherwise the
+	// built-in tune plays. Either way it runs on the audio thread, not in the game loop.
+	audio_init();
+	audio_start_music("/rd/music.wav");
+
+	pvr_poly_cxt_txr(&cxt, PVR_LIST_TR_POLY, PVR_TXRFMT_RGB565 | PVR_TXRFMT_NONTWIDDLED,
+		BLOCK_ATLAS_WIDTH, BLOCK_ATLAS_HEIGHT, block_atlas, PVR_FILTER_NONE);
+	pvr_poly_compile(&block_hdr, &cxt);
+
+	asset_log_totals();
+	LOG_INFO("Boot took %u us after the PVR came up", (unsigned)(timer_us_gettime64() - boot_start));
 }
 
 void draw_triangle(float x1, float y1,
 				   float x2, float y2,
 				   float x3, float y3,
-				   color argb)
+				   uint32 argb)
 				   {
 	// POINTS SUBMITTED MUST BE IN CLOCKWISE ORDER
 	pvr_poly_hdr_t hdr;
@@ -341,7 +560,7 @@ void draw_triangle(float x1, float y1,
 	vert.z = 5.0f;
 	vert.u = 0;
 	vert.v = 0;
-	vert.argb = PVR_PACK_COLOR(argb.a/255, argb.r/255, argb.g/255, argb.b/255);
+	vert.argb = argb;
 	vert.oargb = 0;
 	pvr_prim(&vert, sizeof(vert));
 
@@ -355,10 +574,90 @@ void draw_triangle(float x1, float y1,
 	pvr_prim(&vert, sizeof(vert));
 }
 
-void draw_square(float left, float right, float top, float bottom, color argb) {
-	pvr_poly_hdr_t hdr;
-	pvr_poly_cxt_t cxt;
-	pvr_vertex_t vert;
+pvr_vertex_t * recording_next(){
+	// The next free entry of the buffer being built. Never runs out in practice (see
+	// FRAME_CACHE_ENTRIES), but if it does the buffer gets thrown away and that part of
+	// the frame is drawn straight to the TA instead.
+	static pvr_vertex_t spare;
+	if(recording->count >= recording->capacity){
+		recording->overflowed = 1;
+		return &spare;
+	}
+	return &recording->entries[recording->count++];
+}
+
+void record_into(vertex_buffer * list){
+	// Everything drawn from here until stop_recording() goes into list, from the start
+	list->count = 0;
+	list->overflowed = 0;
+	recording = list;
+}
+
+void stop_recording(){
+	recording = NULL;
+}
+
+void submit_vertex(pvr_vertex_t * vert){
+	// For the pvr_prim path, when the vertex was built on the stack
+	if(recording){
+		*recording_next() = *vert;
+		return;
+	}
+	pvr_prim(vert, sizeof(pvr_vertex_t));
+}
+
+void submit_header(pvr_poly_hdr_t * hdr){
+	if(recording){
+		memcpy(recording_next(), hdr, sizeof(pvr_poly_hdr_t));
+		return;
+	}
+#if USE_DR_RENDERING
+	// The header is the same size as a vertex (32 bytes), so it goes through the
+	// store queue the same way. Store queues only take 32-bit writes, so copy it
+	// a word at a time instead of with a struct assignment.
+	uint32 *dst = (uint32 *)pvr_dr_target(dr_state);
+	uint32 *src = (uint32 *)hdr;
+	for(int i=0; i<8; i++){
+		dst[i] = src[i];
+	}
+	pvr_dr_commit(dst);
+#else
+	pvr_prim(hdr, sizeof(pvr_poly_hdr_t));
+#endif
+}
+
+void begin_squares(){
+	// Sends the shared square header. Every draw_square() after this is just a 4 vertex
+	// strip that reuses it, until something else (like a font) submits its own header.
+	// Call it again after drawing text.
+	submit_header(&square_hdr);
+}
+
+void begin_blocks(){
+	// Same as begin_squares(), but for textured blocks drawn with draw_block()
+	submit_header(&block_hdr);
+}
+
+#if USE_DR_RENDERING
+void draw_square_vert(uint32 flags, float x, float y, float u, float v, uint32 argb){
+	// Writes one vertex directly into the store queue (or the frame cache), no copy from the stack
+	pvr_vertex_t *vert = recording ? recording_next() : pvr_dr_target(dr_state);
+	vert->flags = flags;
+	vert->x = x;
+	vert->y = y;
+	vert->z = 5.0f;
+	vert->u = u;
+	vert->v = v;
+	vert->argb = argb;
+	vert->oargb = 0;
+	if(!recording){
+		pvr_dr_commit(vert);
+	}
+}
+#endif
+
+void draw_square(float left, float right, float top, float bottom, uint32 argb) {
+	// Only sends vertices, call begin_squares() first so the PVR has a header to use.
 
 	// x1 = left
 	// x2 = right
@@ -381,10 +680,14 @@ void draw_square(float left, float right, float top, float bottom, color argb) {
 		right = swap_x;
 	}
 
-	pvr_poly_cxt_col(&cxt, PVR_LIST_TR_POLY);
-	pvr_poly_compile(&hdr, &cxt);
+#if USE_DR_RENDERING
+	draw_square_vert(PVR_CMD_VERTEX, left, bottom, 0, 0, argb); // bottom left
+	draw_square_vert(PVR_CMD_VERTEX, left, top, 0, 0, argb); // top left
+	draw_square_vert(PVR_CMD_VERTEX, right, bottom, 0, 0, argb); // bottom right
+	draw_square_vert(PVR_CMD_VERTEX_EOL, right, top, 0, 0, argb); // top right
+#else
+	pvr_vertex_t vert;
 
-	pvr_prim(&hdr, sizeof(hdr));
 	vert.flags = PVR_CMD_VERTEX;
 	// bottom left
 	vert.x = left;
@@ -392,25 +695,75 @@ void draw_square(float left, float right, float top, float bottom, color argb) {
 	vert.z = 5.0f;
 	vert.u = 0;
 	vert.v = 0;
-	vert.argb = PVR_PACK_COLOR(argb.a/255, argb.r/255, argb.g/255, argb.b/255);
+	vert.argb = argb;
 	vert.oargb = 0;
-	pvr_prim(&vert, sizeof(vert));
+	submit_vertex(&vert);
 
 	// top left
 	vert.y = top;
-	pvr_prim(&vert, sizeof(vert));
+	submit_vertex(&vert);
 
 	// bottom right
 	vert.x = right;
 	vert.y = bottom;
-	pvr_prim(&vert, sizeof(vert));
+	submit_vertex(&vert);
 
 	// top right
 	vert.flags = PVR_CMD_VERTEX_EOL;
 	vert.y = top;
-	pvr_prim(&vert, sizeof(vert));
+	submit_vertex(&vert);
+#endif
 }
-void draw_square_centered_on(float center_x, float center_y, float width, float height, color argb) {
+
+void draw_block(float left, float top, color_id id){
+	// One BLOCK_SIZE square block as a single textured quad. Call begin_blocks() first.
+	// The color comes entirely from the atlas tile, so the vertex color is plain white.
+	float right = left + BLOCK_SIZE;
+	float bottom = top + BLOCK_SIZE;
+	float u0 = block_uv[id][0];
+	float u1 = block_uv[id][1];
+
+#if USE_DR_RENDERING
+	draw_square_vert(PVR_CMD_VERTEX, left, bottom, u0, 1, 0xffffffff); // bottom left
+	draw_square_vert(PVR_CMD_VERTEX, left, top, u0, 0, 0xffffffff); // top left
+	draw_square_vert(PVR_CMD_VERTEX, right, bottom, u1, 1, 0xffffffff); // bottom right
+	draw_square_vert(PVR_CMD_VERTEX_EOL, right, top, u1, 0, 0xffffffff); // top right
+#else
+	pvr_vertex_t vert;
+
+	vert.flags = PVR_CMD_VERTEX;
+	vert.z = 5.0f;
+	vert.argb = 0xffffffff;
+	vert.oargb = 0;
+
+	// bottom left
+	vert.x = left;
+	vert.y = bottom;
+	vert.u = u0;
+	vert.v = 1;
+	submit_vertex(&vert);
+
+	// top left
+	vert.y = top;
+	vert.v = 0;
+	submit_vertex(&vert);
+
+	// bottom right
+	vert.x = right;
+	vert.y = bottom;
+	vert.u = u1;
+	vert.v = 1;
+	submit_vertex(&vert);
+
+	// top right
+	vert.flags = PVR_CMD_VERTEX_EOL;
+	vert.y = top;
+	vert.v = 0;
+	submit_vertex(&vert);
+#endif
+}
+
+void draw_square_centered_on(float center_x, float center_y, float width, float height, uint32 argb) {
 	float left = center_x - (width/2);
 	float right = center_x + (width/2);
 	float top = center_y - (height/2);
@@ -422,709 +775,254 @@ void draw_square_centered_on(float center_x, float center_y, float width, float
 	draw_square(left, right, top, bottom, argb);
 }
 
-void draw_vert_line(float x, float top, float bottom, color argb) {
+void draw_vert_line(float x, float top, float bottom, uint32 argb) {
 	draw_square(x, x+1, top, bottom, argb);
 }
 
-void draw_horiz_line(float left, float right, float y, color argb) {
+void draw_horiz_line(float left, float right, float y, uint32 argb) {
 	draw_square(left, right, y, y+1, argb);
 }
 
-void init_new_tetro(color_id id){
-	// This function takes a color_id (which also dictates the type of tetromino) and
-	// populates the active_tetro variable with data representing a newly spawned
-	// tetromino of that type.
-	// It also fills the relevant "dummy" tetromino array with a fresh copy of that tetromino's
-	// data array (TETRO_I, TETRO_J, etc)
-
-	active_tetro.orientation=DEFAULT;
-	active_tetro.type=id;
-	active_tetro.set=0;
-
-	if(id==LIGHT_BLUE){
-		// reset the I tetromino holder to its initial state
-		for(int i=0; i<4; i++){
-			for(int j=0; j<4; j++){
-				tetro_dummy_4x4[i][j] = TETRO_I[i][j];
-			}
-		}
-		//now configure the correct initial settings in the active tetro struct
-		active_tetro.left_x=4;
-		active_tetro.top_y=2;
-		active_tetro.dimensions=4;
-		active_tetro.tetro_index=1;
-	}
-	else if(id==YELLOW){
-		for(int i=0; i<2; i++){
-			for(int j=0; j<2; j++){
-				tetro_dummy_2x2[i][j] = TETRO_O[i][j];
-			}
-		}
-
-		active_tetro.left_x = 5;
-		active_tetro.top_y=3;
-		active_tetro.dimensions=2;
-		active_tetro.tetro_index=-1;
-	}
-	else {
-		active_tetro.dimensions=3;
-		active_tetro.left_x=4;
-		active_tetro.top_y=3;
-
-		if(id==RED){ //Z			
-			for(int i=0; i<3; i++){
-				for(int j=0; j<3; j++){
-					tetro_dummy_3x3[i][j] = TETRO_Z[i][j];
-				}
-			}
-			active_tetro.tetro_index=0;
-		}
-		else if(id==ORANGE){ //L
-			for(int i=0; i<3; i++){
-				for(int j=0; j<3; j++){
-					tetro_dummy_3x3[i][j] = TETRO_L[i][j];
-				}
-			}
-			active_tetro.tetro_index=0;
-		}
-		else if(id==GREEN){ //S
-			for(int i=0; i<3; i++){
-				for(int j=0; j<3; j++){
-					tetro_dummy_3x3[i][j] = TETRO_S[i][j];
-				}
-			}
-			active_tetro.tetro_index=0;
-		}
-
-		else if(id==DARK_BLUE){ //J
-			for(int i=0; i<3; i++){
-				for(int j=0; j<3; j++){
-					tetro_dummy_3x3[i][j] = TETRO_J[i][j];
-				}
-			}
-			active_tetro.tetro_index=0;
-		}
-
-		else if(id==PURPLE){ //T
-			//printf("Loading T tetro...\n");
-			for(int i=0; i<3; i++){
-				for(int j=0; j<3; j++){
-					tetro_dummy_3x3[i][j] = TETRO_T[i][j];
-					//printf("%d ",tetro_dummy_3x3[i][j]);
-				}
-				//printf("\n");
-			}
-			active_tetro.tetro_index=0;
-		}
-
-		else{
-			printf("ERROR: invalid tetro id provided to init_tetro(): %d\n",id);
-			exit(1);
-		}
-	}
-}
-
-void replot_active_tetro(){
-	// Adds active_tetro to the temp_field matrix, in the position and
-	// orientation specified by the data members in active_tetro.
-	// You have to do this before you check the validity of the fields.
+uint32 read_buttons(int port){
+	// Turns the state of one controller into the TETRIS_BTN_* mask that tetris_game_tick() wants.
+	// A button tapped and let go since the last tick still counts as held for this one.
 
-	memset(temp_field, EMPTY, sizeof(temp_field));
-
-	if(active_tetro.dimensions==2){
-		// use tetro_dummy_2x2
-		for(int row=0; row<2; row++){
-			for(int cell=0; cell<2; cell++){
-				if(active_tetro.top_y+row<24 && active_tetro.left_x+cell<12){ //don't go off the grid
-					temp_field[active_tetro.top_y+row][active_tetro.left_x+cell] = tetro_dummy_2x2[row][cell];
-				}
-			}
-		}
-	}
-	else if (active_tetro.dimensions==4){
-		// use tetro_Dummy_4x4
-		for(int row=0; row<4; row++){
-			for(int cell=0; cell<4; cell++){
-				if(active_tetro.top_y+row<24 && active_tetro.left_x+cell<12){ //don't go off the grid
-					temp_field[active_tetro.top_y+row][active_tetro.left_x+cell] = tetro_dummy_4x4[row][cell];
-				}
-			}
-		}
-	}
-	else if (active_tetro.dimensions==3){
-		// use tetro_dummy_3x3
-		for(int row=0; row<3; row++){
-			for(int cell=0; cell<3; cell++){
-				if(active_tetro.top_y+row<24 && active_tetro.left_x+cell<12){ //don't go off the grid
-					temp_field[active_tetro.top_y+row][active_tetro.left_x+cell] = tetro_dummy_3x3[row][cell];
-				}
-			}
-		}
-	}
-	else{
-		printf("ERROR: replot_active_tetro() called with invalid dimension: %d\n",active_tetro.dimensions);
-		exit(1);
-	}
-}
+	// https://cadcdev.sourceforge.net/docs/kos-2.0.0/group__controller__buttons.html
 
-void commit_tetro(){
-	// The active tetromino gets copied from the active tetromino array to the main field
-	// data structure to "set" it.
-	// THIS DOES NOT DO CHECKS to validate position! Check it first with check_valid_state()
+	uint32 down = input_down(&input, port);
+	uint32 buttons = 0;
 
-	for(int row=0; row<24; row=row+1){
-		for(int cell=0; cell<12; cell=cell+1){
-			if(temp_field[row][cell]>0){
-				field[row][cell]=temp_field[row][cell];
-			}
-		}
-	}
+	// the triggers on the sega dreamcast are analog triggers, not digital buttons,
+	// the input thread turns the left one into INPUT_LTRIG once it's at least half-pressed
+	if(down & INPUT_LTRIG) buttons |= TETRIS_BTN_HOLD;
+	if(down & CONT_DPAD_UP) buttons |= TETRIS_BTN_HARD_DROP;
+	if(down & CONT_DPAD_DOWN) buttons |= TETRIS_BTN_SOFT_DROP;
+	if(down & CONT_DPAD_LEFT) buttons |= TETRIS_BTN_LEFT;
+	if(down & CONT_DPAD_RIGHT) buttons |= TETRIS_BTN_RIGHT;
+	if(down & CONT_Y) buttons |= TETRIS_BTN_ROTATE_CW;
+	if(down & CONT_X) buttons |= TETRIS_BTN_ROTATE_CCW;
 
+	return buttons;
 }
 
-int check_valid_state(){
-	// Checks for overlapping tiles/blocks between the temp_field (the active tetromino) and
-	// the field (all other tetrominos and the edges of the screen).
-	// Returns 0 (false) if an overlap is found (state is invalid).
-	// Returns 1 (true) if an overlap is NOT found (state is valid).
-	// It does not undo it, it just determines if it's valid.
-
-	for(int row=0; row<24; row++){
-		for(int cell=0; cell<12; cell++){
-			if(field[row][cell]!=0 && temp_field[row][cell]!=0){
-				return 0;
-			}
-		}
+void handle_game_events(const tetris_game * g, int events){
+	// Sounds and log messages for whatever happened in the last tick
+	if(events & TETRIS_EVENT_LOCK){
+		audio_play_sfx(SFX_LOCK);
 	}
-	return 1;
-}
-
-void tetro_left(){
-	active_tetro.left_x -= 1;
-	replot_active_tetro();
-	if(!check_valid_state()){
-		active_tetro.left_x += 1; //undo it
-		replot_active_tetro();
+	if(events & TETRIS_EVENT_HARD_DROP){
+		audio_play_sfx(SFX_HARD_DROP);
 	}
-}
-
-void tetro_right(){
-	active_tetro.left_x += 1;
-	replot_active_tetro();
-	if(!check_valid_state()){
-		active_tetro.left_x -= 1; //undo it
-		replot_active_tetro();
+	if(events & TETRIS_EVENT_TETRIS){
+		audio_play_sfx(SFX_TETRIS);
+		LOG_INFO("Tetris!");
 	}
-}
-
-void tetro_fall(int award_score){
-	active_tetro.top_y += 1;
-	replot_active_tetro();
-	if(!check_valid_state()){
-		active_tetro.top_y -= 1; //undo it
-		replot_active_tetro();
-		commit_tetro();
-		active_tetro.set=1;
+	else if(events & TETRIS_EVENT_LINE_CLEAR){
+		audio_play_sfx(SFX_LINE_CLEAR);
 	}
-	if(award_score){
-		score+=1;
+	if(events & TETRIS_EVENT_LINE_CLEAR){
+		LOG_DEBUG("Total line clears: %d", g->line_clears);
 	}
-}
-
-void hard_drop(){
-	// Falls straight down until the tetromino gets set
-	int blocks_fallen=0;
-	while(!active_tetro.set){
-		tetro_fall(0);
-		blocks_fallen++;
-	}
-	score = score + (blocks_fallen * 2);
-}
-
-// https://stackoverflow.com/questions/27288694/transpose-of-a-matrix-2d-array
-
-void print_tetro_array(){
-	int n = active_tetro.dimensions;
-
-	color_id (*arr_ptr)[n][n];
-
-	if(n==3){
-		arr_ptr = &(tetro_dummy_3x3);
-	}
-	else if(n==4){
-		arr_ptr = &(tetro_dummy_4x4);
-	}
-	else if(n==2){
-		arr_ptr = &(tetro_dummy_2x2);
+	if(events & TETRIS_EVENT_HOLD){
+		LOG_DEBUG("Holding: tetro of type %d", g->held);
 	}
-
-	for(int i=0; i<n; i++){
-		for(int j=0; j<n; j++){
-			printf("%d",(*arr_ptr)[i][j]);
-		}
-	printf("\n");
+	if(events & TETRIS_EVENT_GARBAGE){
+		audio_play_sfx(SFX_LOCK);
 	}
-
 }
 
-void swap(color_id* arg1, color_id* arg2)
-// Swap the two values in memory (in place)
-// Used in tetromino rotation
-{
-    color_id buffer = *arg1;
-    *arg1 = *arg2;
-    *arg2 = buffer;
-}
-
-void transpose_active_tetro(){
-	// Flips the array of the active tetromino along the diagonal (in place)
-	// This is one of the steps in tetromino rotation
-
-	int n = active_tetro.dimensions;
-	for( int i = 0; i < n; i++)
-	{
-		for ( int j = i+1; j < n; j++ ) // only the upper is iterated
-		{
-			if(active_tetro.dimensions==3){
-				swap(&(tetro_dummy_3x3[i][j]), &(tetro_dummy_3x3[j][i]));}
-			else if(active_tetro.dimensions==4){
-				swap(&(tetro_dummy_4x4[i][j]), &(tetro_dummy_4x4[j][i]));}
+void spawn_effects(const tetris_game * g, int events, float field_left, float field_top){
+	// Particle bursts for whatever happened in the last tick, where it happened
+#if USE_PARTICLES
+	if(events & TETRIS_EVENT_LINE_CLEAR){
+		// Every block of the cleared rows bursts in its own color, a tetris twice as much
+		int per_block = (events & TETRIS_EVENT_TETRIS) ? 16 : 8;
+		for(int row=TETRIS_TOP_ROW; row<=TETRIS_BOTTOM_ROW; row++){
+			if(!(g->rows_to_clear & TETRIS_ROW_BIT(row))){
+				continue;
+			}
+			float top = field_top + BLOCK_SIZE*(row-TETRIS_TOP_ROW);
+			for(int col=TETRIS_LEFT_COL; col<=TETRIS_RIGHT_COL; col++){
+				float left = field_left + BLOCK_SIZE*(col-TETRIS_LEFT_COL);
+				particles_burst(&particles, left, top, BLOCK_SIZE, BLOCK_SIZE, per_block,
+					block_argb[g->colors[row][col]], 3.0f, 45);
+			}
 		}
 	}
-}
-
-
-void reverse_active_tetro_row(int row){
-	// Reverse the given row in the active tetromino array (in place)
-	// This is one of the steps in tetromino rotation
-
-	int n = active_tetro.dimensions;
-
-	color_id (*arr_ptr)[n]; //pointer to this row in memory
-
-	if(n==3){
-		arr_ptr = &(tetro_dummy_3x3[row]); //point to the row in the 3x3 array
-	}
-	else if(n==4){
-		arr_ptr = &(tetro_dummy_4x4[row]); //point to the row in the 4x4 array
-	}
-	else{
-		printf("ERROR: reverse_active_tetro_row called with an array size other than 3 or 4: %d\n",n);
-		exit(1);
-	}
-
-	// Reverse the row in the relevant array
-	for(int i = 0; i<n/2; i++)
-	{
-		int temp = (*arr_ptr)[i];
-		(*arr_ptr)[i] = (*arr_ptr)[n-i-1];
-		(*arr_ptr)[n-i-1] = temp;        
-	}
-}
-
-void rotate_tetro_counterclockwise();
-// ^ tell compiler that this function will exist so it doesnt get mad when I call it before i define it.
-
-void update_orientation_cw(){
-	active_tetro.orientation++;
-	if(active_tetro.orientation>3){
-		active_tetro.orientation=0;
-	}
-}
-
-void update_orientation_ccw(){
-	active_tetro.orientation--;
-	if(active_tetro.orientation<0){
-		active_tetro.orientation=3;
-	}
-}
-
-void move_tetro_like_this(int x, int y){
-	active_tetro.left_x+=x;
-	active_tetro.top_y+=y;
-}
-
-// Tetromino rotation test cases taken from here:
-// https://www.reddit.com/r/Tetris/comments/bdu02w/i_made_some_srs_charts/
-
-void rotate_tetro_clockwise(){
-
-	if(active_tetro.dimensions==2){
-		return; // O tetrominos don't rotate :)
-	}
-
-	//test 1 - Plain rotation, no offset.
-
-	// 1. Transpose
-	transpose_active_tetro();
-
-	// 2. Reverse each row
-	for(int i=0; i<active_tetro.dimensions; i++){
-		reverse_active_tetro_row(i);
-	}
-
-	replot_active_tetro();
-
-	if(check_valid_state()){
-		update_orientation_cw();
-		return;
-	}
-
-	// If the basic tetro rotation failed, we will start to iterate through the tests,
-	// each test involves translating the tetromino in different ways.
-
-	int rotation_type_index = active_tetro.orientation;
-
-	// iterate through each test
-	for (int test_index=0; test_index<=3; test_index++){
-		//printf("Running rotation test: %d\n",test_index);
-		move_tetro_like_this(rotation_tests_cw[active_tetro.tetro_index][rotation_type_index][test_index][0],
-							 rotation_tests_cw[active_tetro.tetro_index][rotation_type_index][test_index][1]);
-		replot_active_tetro();
-
-		if(check_valid_state()){
-			//printf("This rotation test worked!\n");
-			return;
+	if(events & TETRIS_EVENT_HARD_DROP){
+		// Dust off the bottom of every block of the tetromino that landed (it's still the
+		// active one until the next spawn)
+		const uint8 * shape = tetris_shape(g->active.type, g->active.orientation);
+		int n = tetris_shape_size(g->active.type);
+		for(int row=0; row<n; row++){
+			for(int col=0; col<n; col++){
+				int field_row = g->active.top_y + row;
+				if((shape[row] & (1 << col)) && field_row>=TETRIS_TOP_ROW){
+					float left = field_left + BLOCK_SIZE*(g->active.left_x+col-TETRIS_LEFT_COL);
+					float bottom = field_top + BLOCK_SIZE*(field_row-TETRIS_TOP_ROW+1);
+					particles_burst(&particles, left, bottom - 2, BLOCK_SIZE, 2, 6, ARGB_WHITE, 1.5f, 20);
+				}
+			}
 		}
 	}
-
-	//Never found a valid one, undo
-	// (The 4th index in the rotation test inner array is movement instructions to get back to the original location)
-	//printf("Never found a valid rotation, undoing it\n");
-	move_tetro_like_this(rotation_tests_cw[active_tetro.tetro_index][rotation_type_index][4][0],
-						 rotation_tests_cw[active_tetro.tetro_index][rotation_type_index][4][1]);
-	rotate_tetro_counterclockwise();
-	replot_active_tetro();
-
+#endif
 }
 
-void rotate_tetro_counterclockwise(){
-	//printf("Rotate CCW called\n");
-	//printf("Array before CCW:\n");
-	//print_tetro_array();
-
-	if(active_tetro.dimensions==2){
-		return;
-	}
-
-	// Test 1 - plain rotation, no offset
-
-	// 1. Reverse each row
-	for(int i=0; i<active_tetro.dimensions; i++){
-		reverse_active_tetro_row(i);
-	}
-	// 2. Transpose
-	transpose_active_tetro();
-
-	replot_active_tetro();
-
-	if(check_valid_state()){
-		update_orientation_ccw();
+void draw_particles(const particle_pool * pool){
+	// Every particle is a PARTICLE_SIZE quad under the one square header, fading out as
+	// it dies. Built again every frame, since they all move.
+	if(!pool->count){
 		return;
 	}
-	
-	// Iterate through each test
-	for (int test_index=0; test_index<=3; test_index++){
-		move_tetro_like_this(rotation_tests_ccw[active_tetro.tetro_index][active_tetro.orientation][test_index][0],
-							 rotation_tests_ccw[active_tetro.tetro_index][active_tetro.orientation][test_index][1]);
-		replot_active_tetro();
-
-		if(check_valid_state()){
-			return;
+	pvr_capture_mark("particles");
+	begin_squares();
+	for(int i=0; i<pool->count; i++){
+		float x = pool->x[i];
+		float y = pool->y[i];
+		if(y > SCREEN_HEIGHT){
+			continue; // fell off the bottom, nothing to see
 		}
+		uint32 argb = (uint32)(pool->life[i] * 255) << 24 | pool->rgb[i];
+		draw_square(x, x+PARTICLE_SIZE, y, y+PARTICLE_SIZE, argb);
 	}
-
-	//Never found a valid one, undo
-	move_tetro_like_this(rotation_tests_cw[active_tetro.tetro_index][active_tetro.orientation][4][0],
-						 rotation_tests_cw[active_tetro.tetro_index][active_tetro.orientation][4][1]);
-	rotate_tetro_clockwise();
-	replot_active_tetro();
-
-	//printf("Array after CCW:\n");
-	//print_tetro_array();
 }
 
-void generate_new_tetro();//so compiler doesn't yell at us
-
-void hold_tetromino(){
-
-	color_id tetromino_to_hold = active_tetro.type;
-	
-	if(held_tetro){ //if there's currently a tetromino already in the hold
-	// swap it
-		init_new_tetro(held_tetro);
-		replot_active_tetro();
-
-		held_tetro = tetromino_to_hold;
-	}
-	else {
-		//otherwise, make a new one
-		held_tetro = tetromino_to_hold;
-		generate_new_tetro();
-	}
-	hold_eligible=0;
-	printf("Holding: tetro of type %d\n", held_tetro);
-}
-
-
-int move_timebuffer = 10;
-int released_y_button=1;
-int released_x_button=1;
-int released_up_button=1;
-int released_ltrig=1;
-
-char ltrig_text[10];
-
-int move_tetromino(){
-
-	// https://cadcdev.sourceforge.net/docs/kos-2.0.0/group__controller__buttons.html
-	// http://gamedev.allusion.net/docs/kos-2.0.0/structcont__state__t.html
-
-	maple_device_t *cont;
-    cont_state_t *state;
-
-    cont = maple_enum_type(0, MAPLE_FUNC_CONTROLLER);
-
-	if(cont) {
-		state=(cont_state_t *)maple_dev_status(cont);
-
-		if(!state){
-			return 0;
+void update_scenery(){
+	// Spins faster with the level (the higher one in versus) and builds this frame's vertices
+	uint64 start = timer_us_gettime64();
+	int level = versus_mode ? (match.players[0].game.level > match.players[1].game.level
+		? match.players[0].game.level : match.players[1].game.level) : game.level;
+	background_set_level(&scenery, level);
+	background_update(&scenery);
+
+	uint32 us = timer_us_gettime64() - start;
+	if(us > scenery_worst_us){
+		scenery_worst_us = us;
+		if(us > BACKGROUND_BUDGET_US){
+			LOG_WARN("Background took %u us, over its %u us budget", (unsigned)us, (unsigned)BACKGROUND_BUDGET_US);
 		}
-
-		// the triggers on the sega dreamcast are analog triggers, not digital buttons,
-		// so they range from 0-255 (inclusive)
-		// I have the hold function trigger if it's at least half-pressed (128)
-		if(state->ltrig >= 128 && hold_eligible){
-			hold_tetromino();
-			hold_eligible=0;
-		}
-
-		if(move_timebuffer==0){
-			if((state->buttons & CONT_DPAD_UP) && released_up_button){
-				hard_drop();
-				//printf("LTRIG: %d\n", state->ltrig);
-				move_timebuffer=10;
-				released_up_button = 0;
-			}
-			if(state->buttons & CONT_DPAD_DOWN){
-				// softdrop
-				tetro_fall(1);
-				move_timebuffer=10;
-			}
-			if(state->buttons & CONT_DPAD_LEFT){
-				tetro_left();
-				move_timebuffer=10;
-			}
-			if(state->buttons & CONT_DPAD_RIGHT){
-				tetro_right();
-				move_timebuffer=10;
-			}
-			
-
-			if( (state->buttons & CONT_Y) && released_y_button){
-				rotate_tetro_clockwise();
-				released_y_button=0;
-			}
-			if( (state->buttons & CONT_X) && released_x_button){
-				rotate_tetro_counterclockwise();
-				released_x_button=0;
-			}
-
-			if( !(state->buttons & CONT_X) && !released_x_button){
-				released_x_button=1;
-			}
-			if( !(state->buttons & CONT_Y) && !released_y_button){
-				released_y_button=1;
-			}
-			if ( !(state->buttons & CONT_DPAD_UP) && !released_up_button){
-				released_up_button = 1;
-			}
-
-			
-		}
-		if(move_timebuffer>0){
-			move_timebuffer-=1;
-		}
-
-	}
-	return 0;
-}
-
-void generate_new_tetro(){
-	color_id random_id = (rand() % 7)+1;
-
-	init_new_tetro(random_id);
-	replot_active_tetro();
-
-	if(!check_valid_state()){
-		loss = 1;
 	}
 }
 
-void draw_field(){
-	// One block is 20 pixels x 20 pixels
+void draw_field(const board_snapshot * g, float field_left, float field_top){
+	// One block is BLOCK_SIZE pixels x BLOCK_SIZE pixels (20 for the standard field)
 	// it is 20 blocks * 20 pixels tall = 400 pixels
 	// and 10 blocks * 20 pixels wide = 200 pixels
+	float field_right = field_left + FIELD_WIDTH;
+	float field_bottom = field_top + FIELD_HEIGHT;
+
+	pvr_capture_mark("grid");
+	begin_squares();
 
 	//draw edges
-	draw_horiz_line(field_left, field_right, field_top, COLOR_WHITE);
-	draw_horiz_line(field_left, field_right, field_bottom, COLOR_WHITE);
-	draw_vert_line(field_left, field_top, field_bottom, COLOR_WHITE);
-	draw_vert_line(field_right, field_top, field_bottom, COLOR_WHITE);
+	draw_horiz_line(field_left, field_right, field_top, ARGB_WHITE);
+	draw_horiz_line(field_left, field_right, field_bottom, ARGB_WHITE);
+	draw_vert_line(field_left, field_top, field_bottom, ARGB_WHITE);
+	draw_vert_line(field_right, field_top, field_bottom, ARGB_WHITE);
 
 	//draw each row
-	for(int i=20; i<FIELD_HEIGHT; i=i+20){
-		draw_horiz_line(field_left, field_right, field_top+i, COLOR_BLACK);
+	for(int i=BLOCK_SIZE; i<FIELD_HEIGHT; i=i+BLOCK_SIZE){
+		draw_horiz_line(field_left, field_right, field_top+i, ARGB_BLACK);
 	}
 
 	//draw each column
-	for(int j=20; j<FIELD_WIDTH; j=j+20){
-		draw_vert_line(field_left+j, field_top, field_bottom, COLOR_BLACK);
+	for(int j=BLOCK_SIZE; j<FIELD_WIDTH; j=j+BLOCK_SIZE){
+		draw_vert_line(field_left+j, field_top, field_bottom, ARGB_BLACK);
 	}
 
 	float block_x;
 	float block_y;
 	//now draw the blocks
-	for(int row=3; row<23; row=row+1){
-		for(int col=1;col<11; col=col+1){
-			if (field[row][col]){
-				block_x = field_left + (20*(col-1)) + 10;
-				block_y = field_top + (20*(row-3)) + 10;
-				draw_square_centered_on(block_x, block_y, 20, 20, get_argb_from_enum(field[row][col]));
-			}
-			if (temp_field[row][col]){
-				block_x = field_left + (20*(col-1)) + 10;
-				block_y = field_top + (20*(row-3)) + 10;
-				draw_square_centered_on(block_x, block_y, 20, 20, get_argb_from_enum(temp_field[row][col]));
+	pvr_capture_mark("blocks");
+	begin_blocks();
+	for(int row=TETRIS_TOP_ROW; row<=TETRIS_BOTTOM_ROW; row=row+1){
+		if(g->rows_to_clear & TETRIS_ROW_BIT(row)){
+			continue; // drawn by draw_line_clear_effect() instead
+		}
+		for(int col=TETRIS_LEFT_COL; col<=TETRIS_RIGHT_COL; col=col+1){
+			if (g->colors[row][col]){
+				block_x = field_left + (BLOCK_SIZE*(col-TETRIS_LEFT_COL));
+				block_y = field_top + (BLOCK_SIZE*(row-TETRIS_TOP_ROW));
+				draw_block(block_x, block_y, g->colors[row][col]);
 			}
 		}
 	}
-}
 
-void clear_line(int rownum){
-	// Copy every line above the cleared line down 1 row
-	for(int row=rownum; row>=4; row--){
-		for(int cell=1; cell<=10; cell++){
-			field[row][cell] = field[row-1][cell];
+	// and the active tetromino on top, if there is one
+	if(g->show_active){
+		pvr_capture_mark("active");
+		const uint8 * shape = tetris_shape(g->active.type, g->active.orientation);
+		int n = tetris_shape_size(g->active.type);
+		for(int row=0; row<n; row++){
+			for(int col=0; col<n; col++){
+				int field_row = g->active.top_y + row;
+				if((shape[row] & (1 << col)) && field_row>=TETRIS_TOP_ROW && field_row<=TETRIS_BOTTOM_ROW){
+					block_x = field_left + (BLOCK_SIZE*(g->active.left_x+col-TETRIS_LEFT_COL));
+					block_y = field_top + (BLOCK_SIZE*(field_row-TETRIS_TOP_ROW));
+					draw_block(block_x, block_y, g->active.type);
+				}
+			}
 		}
 	}
-
-	field[3][0]=1;
-	for(int cell=1; cell<=10; cell++){
-		field[3][cell]=0;
-	}
-	field[3][11]=1;
 }
 
-void check_lines(){
-	//printf("Checking lines...\n");
-	int found_empty_tile=0;
-	
-	int new_line_clears=0;
-
-	for(int row=3; row<=22; row++){
-		int cell=1;
-		while(cell<=10 && !found_empty_tile){
-			//printf("%d ", field[row][cell]);
-			if(!field[row][cell]){
-				found_empty_tile=1;
-			}
-			cell++;
-			//printf("Row: %d Cell: %d\n",row, cell);
-		}
-		//printf("\n");
-		if(!found_empty_tile){
-			//printf("Found full line: %d\n",row);
-			clear_line(row);
-			line_clears++;
-			new_line_clears++;
-			printf("Total line clears: %d\n",line_clears);
-		}
-		found_empty_tile=0;
-	}
-	if(new_line_clears==1){
-		score = score + (level * 100);
-	}
-	else if(new_line_clears==2){
-		score = score + (level * 300);
-	}
-	else if(new_line_clears==3){
-		score = score + (level * 500);
-	}
-	else if(new_line_clears==4){
-		printf("Tetris!");
-		score = score + (level * 800);
+void draw_line_clear_effect(const board_snapshot * g, float field_left, float field_top){
+	// Rows being cleared flash white for the first half of the animation, then shrink
+	// towards the middle and fade out. Each row is one quad under one shared header,
+	// so a 4 line clear is 4 quads total (cheaper than the 40 blocks it replaces).
+	int line_clear_delay = g->line_clear_delay;
+	if(!g->clearing || line_clear_delay<=0){
+		return;
 	}
 
-	if(level < 15){
-		int new_level = ((line_clears-(line_clears%10))/10)+1;
-		if(new_level>level){
-			level=new_level;
-			//falltime=85-(new_level*5);
-			falltime= 93 - (new_level*6);
+	float field_right = field_left + FIELD_WIDTH;
+	int elapsed = line_clear_delay - g->clear_timer;
+	int half = line_clear_delay/2;
+	uint32 argb;
+	float inset = 0;
+
+	if(elapsed < half){
+		// flash: alternate white and dim every 4 frames
+		argb = ((elapsed/4) % 2) ? 0x60ffffff : 0xffffffff;
+	}
+	else {
+		// dissolve: shrink from both sides and fade out
+		int progress = ((elapsed-half) * 255) / (line_clear_delay-half);
+		argb = ((255-progress) << 24) | 0x00ffffff;
+		inset = (FIELD_WIDTH/2) * progress / 255.0f;
+	}
+
+	pvr_capture_mark("line clear");
+	begin_squares();
+	for(int row=TETRIS_TOP_ROW; row<=TETRIS_BOTTOM_ROW; row++){
+		if(g->rows_to_clear & TETRIS_ROW_BIT(row)){
+			float top = field_top + (BLOCK_SIZE*(row-TETRIS_TOP_ROW));
+			draw_square(field_left+inset, field_right-inset, top, top+BLOCK_SIZE, argb);
 		}
 	}
-	// FALL TIME CALCULATION:
-	// Level 1 - falls every 87 frames
-	// Level 15 - falls every 2 frames
-	// Equation:  y = -6x + 93
-	// falltime = -6*level + 93
 }
 
-void draw_hold(){
-	if(!held_tetro){
+void draw_hold(const board_snapshot * g, int hold_left, int hold_top){
+	if(!g->held){
 		return;
 	}
 
-	int hold_left = 50;
-	int hold_top = 50;
-
 	float block_x;
 	float block_y;
 
-	int dimensions;
-
-	if(held_tetro==LIGHT_BLUE){
-		dimensions=4;
-	}
-	else if(held_tetro==YELLOW){
-		dimensions=2;
-	}
-	else{
-		dimensions=3;
-	}
-	color_id (*arr_ptr)[dimensions][dimensions];
-
-	switch(held_tetro){
-		case LIGHT_BLUE:
-			arr_ptr = &TETRO_I;
-			break;
-		case RED:
-			arr_ptr = &TETRO_Z;
-			break;
-		case ORANGE:
-			arr_ptr = &TETRO_L;
-			break;
-		case YELLOW:
-			arr_ptr = &TETRO_O;
-			break;
-		case GREEN:
-			arr_ptr = &TETRO_S;
-			break;
-		case DARK_BLUE:
-			arr_ptr = &TETRO_J;
-			break;
-		case PURPLE:
-			arr_ptr = &TETRO_T;
-	}
+	// the held tetromino is always shown the way it spawns
+	const uint8 * shape = tetris_shape(g->held, DEFAULT);
+	int dimensions = tetris_shape_size(g->held);
+
+	pvr_capture_mark("hold");
+	begin_blocks(); // whatever was drawn before this might have been squares
 
 	for(int row=0; row<dimensions; row++){
 		for(int col=0; col<dimensions; col++){
-			if((*arr_ptr)[row][col]){
-				block_x= hold_left + (20*(col-1)) + 10;
-				block_y = hold_top + (20*(row-1)) + 10;
-				draw_square_centered_on(block_x, block_y, 20, 20, get_argb_from_enum(held_tetro));
+			if(shape[row] & (1 << col)){
+				block_x= hold_left + (BLOCK_SIZE*(col-1));
+				block_y = hold_top + (BLOCK_SIZE*(row-1));
+				draw_block(block_x, block_y, g->held);
 			}
 		}
 	}
@@ -1147,27 +1045,25 @@ void draw_text(float x, float y, char * text){
 }
 
 
-char score_string[10];
+char score_string[24];
 char lines_string[10];
 char level_string[10];
 
-void draw_hud(){
+void draw_hud(const board_snapshot * g){
 
 	draw_text(50,300,"Score");
 	// draw score
-	sprintf(score_string, "%ld", score);
+	sprintf(score_string, "%lld", (long long)g->score);
 	draw_text(50,340,score_string);
 
 	draw_text(500,200,"Level");
-	sprintf(level_string, "%d", level);
+	sprintf(level_string, "%d", g->level);
 	draw_text(500,240,level_string);
 
 	draw_text(500,300,"Lines");
-	sprintf(lines_string, "%d", line_clears);
+	sprintf(lines_string, "%d", g->line_clears);
 	draw_text(500,340,lines_string);
 
-	draw_hold();
-
 	/*
 	maple_device_t *cont;
     cont_state_t *state;
@@ -1181,113 +1077,473 @@ void draw_hud(){
 	*/
 }
 
+// In versus mode each player's hold box is left of their field, with their lines and the
+// garbage they've sent below it
+const int versus_hud_left[2] = { VERSUS_FIELD_LEFT_1 - 100, VERSUS_FIELD_LEFT_2 - 90 };
+
+void draw_hud_versus(const render_snapshot * snap){
+	for(int i=0; i<2; i++){
+		const board_snapshot * board = &snap->boards[i];
+
+		draw_text(versus_hud_left[i], 300, "Lines");
+		sprintf(lines_string, "%d", board->line_clears);
+		draw_text(versus_hud_left[i], 340, lines_string);
+
+		draw_text(versus_hud_left[i], 380, "Sent");
+		sprintf(lines_string, "%d", board->lines_sent);
+		draw_text(versus_hud_left[i], 420, lines_string);
+	}
+}
+
+void draw_scene_geometry(const render_snapshot * snap){
+	// Everything but the text: the fields, line clear effects and hold boxes
+	if(snap->versus){
+		draw_field(&snap->boards[0], VERSUS_FIELD_LEFT_1, field_top);
+		draw_field(&snap->boards[1], VERSUS_FIELD_LEFT_2, field_top);
+		draw_line_clear_effect(&snap->boards[0], VERSUS_FIELD_LEFT_1, field_top);
+		draw_line_clear_effect(&snap->boards[1], VERSUS_FIELD_LEFT_2, field_top);
+		draw_hold(&snap->boards[0], versus_hud_left[0] + 10, 50);
+		draw_hold(&snap->boards[1], versus_hud_left[1] + 10, 50);
+	}
+	else {
+		draw_field(&snap->boards[0], field_left, field_top);
+		draw_line_clear_effect(&snap->boards[0], field_left, field_top);
+		draw_hold(&snap->boards[0], 50, 50);
+	}
+}
+
+#if USE_FRAME_CACHE
+void prepare_frame(const render_snapshot * snap){
+	// Builds what it can of the next frame in main RAM, from the end of update_frame().
+	// The PVR is still rendering the last frame then, instead of the game waiting on
+	// pvr_wait_ready() with all of this still to do.
+	uint64 start = timer_us_gettime64();
+
+	int unchanged = scene_cache.valid && scene_cache.versus==snap->versus
+		&& scene_cache.version[0]==snap->boards[0].version
+		&& (!snap->versus || scene_cache.version[1]==snap->boards[1].version);
+	if(!unchanged){
+		record_into(&scene_cache.list);
+		draw_scene_geometry(snap);
+		stop_recording();
+
+		scene_cache.valid = !scene_cache.list.overflowed;
+		scene_cache.versus = snap->versus;
+		scene_cache.version[0] = snap->boards[0].version;
+		scene_cache.version[1] = snap->boards[1].version;
+		if(scene_cache.list.overflowed){
+			LOG_WARN("Frame cache overflowed, drawing without it");
+		}
+	}
+#if USE_PARTICLES
+	record_into(&particle_list);
+	draw_particles(&particles);
+	stop_recording();
+#endif
+
+	uint32 us = timer_us_gettime64() - start;
+	if(us > prepare_worst_us){
+		prepare_worst_us = us;
+	}
+}
+#endif
+
+void submit_scene_geometry(const render_snapshot * snap){
+#if USE_FRAME_CACHE
+	if(!scene_cache.valid){
+		draw_scene_geometry(snap); // it overflowed
+		return;
+	}
+	// One big store queue copy, the headers and vertices are exactly what the TA got last time
+	pvr_prim(scene_cache.entries, scene_cache.list.count * sizeof(pvr_vertex_t));
+#else
+	draw_scene_geometry(snap);
+#endif
+}
+
+void submit_particles(){
+#if USE_PARTICLES && USE_FRAME_CACHE
+	if(particle_list.count){ // can't overflow, there's room for all of them
+		pvr_prim(particle_entries, particle_list.count * sizeof(pvr_vertex_t));
+	}
+#elif USE_PARTICLES
+	draw_particles(&particles);
+#endif
+}
+
+void draw_high_scores(const render_snapshot * snap){
+	// Over the field once the game is lost, the game that just ended gets an arrow
+	char line[32];
+
+	draw_text(field_left+10, field_top+35, "High scores");
+	for(int i=0; i<snap->scores.count; i++){
+		sprintf(line, "%d. %llu%s", i+1, (unsigned long long)snap->scores.entries[i].score,
+			i==snap->new_high_score ? " <" : "");
+		draw_text(field_left+10, field_top+70 + i*30, line);
+	}
+}
+
+void draw_puzzle_hud(const render_snapshot * snap){
+	char line[32];
+
+	draw_text(field_left, field_top-8, (char *)snap->puzzle_name);
+	sprintf(line, "Puzzle %u", snap->puzzle_number);
+	draw_text(500, 400, line);
+	draw_text(500, 440, (char *)snap->puzzle_goal);
+
+	if(snap->puzzle_state==PUZZLE_SOLVED){
+		draw_text(50,200,"Solved!");
+		draw_text(50,250,"A+START: next");
+	}
+	else if(snap->puzzle_state==PUZZLE_FAILED){
+		draw_text(50,200,"Failed!");
+		draw_text(50,250,"A+START: retry");
+	}
+}
+
 //void move_active_tetro_downwards
 
 void check_reset_button(){
-	maple_device_t *controller = maple_enum_type(0, MAPLE_FUNC_CONTROLLER);
-	cont_state_t *controllerState = (cont_state_t*) maple_dev_status(controller);
-
-	if (controllerState->buttons & CONT_START){
+	if (input.ports[0].pressed & CONT_START){
+		// A held down picks puzzle mode, if there's a pack, B a game against the CPU
+		puzzle_mode = (input_down(&input, 0) & CONT_A) && puzzles.count;
+		cpu_mode = USE_CPU_OPPONENT && (input_down(&input, 0) & CONT_B);
 		initiate_game();
 	}
-
 }
 
 void check_pause_button(){
-	maple_device_t *controller = maple_enum_type(0, MAPLE_FUNC_CONTROLLER);
-	cont_state_t *controllerState = (cont_state_t*) maple_dev_status(controller);
-
-	if (!(controllerState->buttons & CONT_START)){
-		pause_button_released=1;
-	}
-	else if (pause_button_released==1){
-		if(paused){
-			paused=0;
-			pause_button_released=0;
-		} else {
-			paused=1;
-			pause_button_released=0;
+	if (input.ports[0].pressed & CONT_START){
+		paused = !paused;
+	}
+}
+
+void take_board_snapshot(board_snapshot * out, const tetris_game * g, int lines_sent){
+	memcpy(out->colors, g->colors, sizeof(out->colors));
+	out->rows_to_clear = g->rows_to_clear;
+	out->clearing = (g->phase==PHASE_LINE_CLEAR);
+	out->clear_timer = g->clear_timer;
+	out->line_clear_delay = g->line_clear_delay;
+	out->show_active = (g->phase==PHASE_FALLING && !g->active_set);
+	out->active = g->active;
+	out->held = g->held;
+	out->score = g->score;
+	out->level = g->level;
+	out->line_clears = g->line_clears;
+	out->lines_sent = lines_sent;
+	out->version = g->version;
+}
+
+void record_high_score(const tetris_game * g){
+	highscore_entry entry;
+	entry.score = g->score;
+	entry.lines = g->line_clears;
+	entry.level = g->level;
+	entry.date = rtc_unix_secs();
+
+	new_high_score = highscore_insert(&high_scores, &entry);
+	if(new_high_score >= 0){
+		LOG_INFO("High score #%d: %lld", new_high_score+1, (long long)g->score);
+		high_scores_unsaved = !highscore_save_async(&high_scores);
+	}
+}
+
+maple_device_t * vmu_screen_on_port(int port){
+	// The VMU in the controller's first slot, if it has a screen
+	maple_device_t * dev = maple_enum_dev(port, 1);
+	if(dev && (dev->info.functions & MAPLE_FUNC_LCD)){
+		return dev;
+	}
+	return NULL;
+}
+
+void update_vmu_screens(){
+	for(int port=0; port<(versus_mode ? 2 : 1); port++){
+		const tetris_game * g = versus_mode ? &match.players[port].game : &game;
+		if(!vmu_status_update(&vmu_screens[port], g)){
+			continue;
+		}
+		// If it's busy (like while the high scores are being saved) it's tried again next frame
+		maple_device_t * vmu = vmu_screen_on_port(port);
+		if(vmu && vmu_draw_lcd(vmu, vmu_screens[port].screen) == MAPLE_EOK){
+			vmu_status_sent(&vmu_screens[port]);
 		}
 	}
 }
 
-//int fall_timer = 93;
-//int first_run=1;
+#if USE_CPU_OPPONENT
+void think_cpu(){
+	// Whatever's left of the frame after the logic, less the margin, up to CPU_BUDGET_US
+	uint32 spent = timer_us_gettime64() - frame_start_us;
+	uint32 budget = spent + FRAME_MARGIN_US < FRAME_US ? FRAME_US - FRAME_MARGIN_US - spent : 0;
+	if(budget > CPU_BUDGET_US){
+		budget = CPU_BUDGET_US;
+	}
 
-void draw_frame_gameplay(){
+	uint32 slices = cpu.slices;
+	uint32 used = opponent_think(&cpu, &match.players[1].game, budget);
+	if(cpu.slices == slices){
+		return; // nothing to search for this frame
+	}
+	LOG_DEBUG("CPU slice: %u of %u us, %d placements", (unsigned)used, (unsigned)budget, cpu.last_slice.placements);
+	if(used > budget){
+		LOG_WARN("CPU slice took %u us, over its %u us budget", (unsigned)used, (unsigned)budget);
+	}
+}
+#endif
+
+void update_frame(render_snapshot * snap){
+	// Input and game logic for one frame, ending with the snapshot the next frame gets drawn from
 
-	//check_buttons();
+	// Everything the controllers did since last tick, one consistent picture for the whole frame
+	input_poll(&input);
 	check_pause_button();
 
-	if (!loss && !paused){
-		move_tetromino();
+	if(versus_mode){
+		// Both boards run in the same frame, each one reading its own controller.
+		// Garbage goes between them through the queues in versus.c.
+		if(versus_winner(&match) < 0 && !paused){
+			for(int i=0; i<2; i++){
+				versus_player * player = &match.players[i];
+				uint32 buttons = (i && cpu_playing) ? opponent_buttons(&cpu, &player->game) : read_buttons(i);
+				int events = versus_tick(player, buttons);
+				handle_game_events(&player->game, events);
+				spawn_effects(&player->game, events, i ? VERSUS_FIELD_LEFT_2 : VERSUS_FIELD_LEFT_1, field_top);
+			}
+		}
+		if(versus_winner(&match) >= 0){
+			check_reset_button();
+		}
+	}
+	else if (!game.loss && puzzle_state==PUZZLE_PLAYING && !paused){
+		uint32 buttons = read_buttons(0);
+#if RECORD_REPLAYS
+		replay_record(&replay, &game, buttons);
+#endif
+		int events = tetris_game_tick(&game, buttons);
+		handle_game_events(&game, events);
+		spawn_effects(&game, events, field_left, field_top);
+		if(puzzle){
+			puzzle_state = puzzle_check(puzzle, &game);
+			if(puzzle_state==PUZZLE_SOLVED){
+				LOG_INFO("Puzzle %u solved", puzzle_index+1);
+				puzzle_index = (puzzle_index+1) % puzzles.count; // A+START goes on to the next one
+			}
+		}
+		else if(events & TETRIS_EVENT_LOSS){
+			record_high_score(&game);
+		}
+#if RECORD_REPLAYS
+		if(events & TETRIS_EVENT_LOSS){
+			alloc_audit_pause();
+			replay_writer_close(&replay);
+			alloc_audit_resume();
+		}
+#endif
+	}
+	else if (game.loss || puzzle_state!=PUZZLE_PLAYING){
+		check_reset_button();
+	}
 
-		fall_timer=fall_timer-1;
+#if USE_PARTICLES
+	if(!paused){
+		particles_update(&particles);
+	}
+#endif
+#if USE_BACKGROUND
+	if(!paused){
+		update_scenery();
+	}
+#endif
 
-		if(active_tetro.set==1 || first_run==1){
-			check_lines();
-			generate_new_tetro();
-			hold_eligible=1;
-			fall_timer=falltime;
-			first_run=0;
-			//printf("Generating new tetro...");
-		}
+	if(high_scores_unsaved){
+		high_scores_unsaved = !highscore_save_async(&high_scores);
+	}
+	update_vmu_screens();
 
-		if(fall_timer<=0){
-			fall_timer=falltime;
-			tetro_fall(0);
+	snap->versus = versus_mode;
+	snap->cpu = cpu_playing;
+	snap->paused = paused;
+	if(versus_mode){
+		take_board_snapshot(&snap->boards[0], &match.players[0].game, match.players[0].lines_sent);
+		take_board_snapshot(&snap->boards[1], &match.players[1].game, match.players[1].lines_sent);
+		snap->winner = versus_winner(&match);
+		snap->game_over = (snap->winner >= 0);
+	}
+	else {
+		take_board_snapshot(&snap->boards[0], &game, 0);
+		snap->game_over = game.loss || puzzle_state!=PUZZLE_PLAYING;
+		snap->puzzle = (puzzle != NULL);
+		if(puzzle){
+			snap->puzzle_state = puzzle_state;
+			snap->puzzle_number = (puzzle - puzzles.records) / puzzles.record_size + 1;
+			puzzle_name(puzzle, snap->puzzle_name);
+			if(puzzle_goal_of(puzzle)==PUZZLE_GOAL_PERFECT_CLEAR){
+				strcpy(snap->puzzle_goal, "Perfect");
+			}
+			else {
+				sprintf(snap->puzzle_goal, "%d lines", puzzle_goal_lines(puzzle));
+			}
+		}
+		else if(game.loss){
+			snap->scores = high_scores;
+			snap->new_high_score = new_high_score;
 		}
 	}
 
+#if USE_FRAME_CACHE
+	prepare_frame(snap);
+#endif
+
+#if USE_CPU_OPPONENT
+	// Last, so its budget is whatever the rest of the frame left over
+	if(cpu_playing && !paused && versus_winner(&match) < 0){
+		think_cpu();
+	}
+#endif
+}
+
+void draw_frame_gameplay(const render_snapshot * snap){
+	// Only builds display lists out of the snapshot, no game logic in here
 
 	pvr_wait_ready(); // <-- Prevents those ugly flashes!
+	frame_start_us = timer_us_gettime64();
 	pvr_scene_begin();
 
 	pvr_list_begin(PVR_LIST_OP_POLY);
 	//opaque drawing here
+#if USE_BACKGROUND
+	// Already built, one header and one copy
+	pvr_capture_mark("background");
+	pvr_prim(&scenery_hdr, sizeof(scenery_hdr));
+	pvr_prim(scenery.vertices, scenery.vertex_count * sizeof(background_vertex));
+#endif
 	pvr_list_finish();
 
 	pvr_list_begin(PVR_LIST_TR_POLY);
 	//translucent drawing here
+#if USE_DR_RENDERING
+	pvr_dr_init(&dr_state); // point the store queues at the TA for this list
+#endif
 	
 	/*
-	draw_horiz_line(100, SCREEN_WIDTH-100, 100, COLOR_RED); // red - top one
-	draw_vert_line(SCREEN_WIDTH-100, 100, SCREEN_HEIGHT-100, COLOR_GREEN); // green - right one
-	draw_horiz_line(100, SCREEN_WIDTH-100, SCREEN_HEIGHT-100, COLOR_LIGHT_BLUE); // blue - bottom
-	draw_vert_line(100, SCREEN_HEIGHT-100, 100, COLOR_WHITE); // white - left
+	draw_horiz_line(100, SCREEN_WIDTH-100, 100, block_argb[RED]); // red - top one
+	draw_vert_line(SCREEN_WIDTH-100, 100, SCREEN_HEIGHT-100, block_argb[GREEN]); // green - right one
+	draw_horiz_line(100, SCREEN_WIDTH-100, SCREEN_HEIGHT-100, block_argb[LIGHT_BLUE]); // blue - bottom
+	draw_vert_line(100, SCREEN_HEIGHT-100, 100, ARGB_WHITE); // white - left
 	*/
 	
-	draw_field();
+	submit_scene_geometry(snap);
+	submit_particles();
 
-	//draw_text(100,100,"What's going on?");
-	//draw_text(200,200,"Hello there!");
-	draw_hud();
+	pvr_capture_mark("text");
+	if(snap->versus){
+		draw_hud_versus(snap);
 
-	if(loss){
-		draw_text(50,200,"You lost!");
-		draw_text(50,250,"Press START to reset");
-		check_reset_button();
+		if(snap->game_over){
+			int winner = snap->winner;
+			draw_text(220,200, winner==2 ? "Draw!" : (winner==0 ? "Player 1 wins!" : (snap->cpu ? "CPU wins!" : "Player 2 wins!")));
+			draw_text(220,250,"Press START to reset");
+		}
+	}
+	else {
+		//draw_text(100,100,"What's going on?");
+		//draw_text(200,200,"Hello there!");
+		draw_hud(&snap->boards[0]);
+
+		if(snap->puzzle){
+			draw_puzzle_hud(snap);
+		}
+		else if(snap->game_over){
+			draw_text(50,200,"You lost!");
+			draw_text(50,250,"Press START to reset");
+			draw_high_scores(snap);
+		}
 	}
 
-	if (paused){
+	if (snap->paused){
 		draw_text(50, 200, "PAUSED");
 	}
 
 	pvr_list_finish();
 
 	pvr_scene_finish();
+
+	uint32 us = timer_us_gettime64() - frame_start_us;
+	if(us > submit_worst_us){
+		submit_worst_us = us;
+	}
 }
 
+#if TICK_BENCH
+void bench_ticks(){
+	// tetris_game_tick() with made up buttons, back to back so everything stays in the
+	// cache, then with a cache's worth of other memory read before every tick. Those
+	// reads get timed on their own too and taken off.
+	static volatile uint8 evict[32 * 1024];
+	uint64 took[3];
+
+	for(int run=0; run<3; run++){
+		uint32_t rng = 12345;
+		uint8 sink = 0;
+		tetris_game_reset(&game, 1);
+		uint64 start = timer_us_gettime64();
+		for(int i=0; i<TICK_BENCH; i++){
+			if(run > 0){
+				for(int j=0; j<(int)sizeof(evict); j+=TETRIS_CACHE_LINE){
+					sink += evict[j];
+				}
+			}
+			if(run < 2){
+				tetris_game_tick(&game, tetris_random(&rng)
+					& (TETRIS_BTN_LEFT | TETRIS_BTN_RIGHT | TETRIS_BTN_ROTATE_CW | TETRIS_BTN_SOFT_DROP));
+				if(game.loss){
+					tetris_game_reset(&game, i);
+				}
+			}
+		}
+		took[run] = timer_us_gettime64() - start;
+		evict[0] = sink;
+	}
+	LOG_INFO("Tick: %u ns in the cache, %u ns after it was pushed out (%d ticks, game in %s)",
+		(unsigned)(took[0] * 1000 / TICK_BENCH), (unsigned)((took[1] - took[2]) * 1000 / TICK_BENCH),
+		TICK_BENCH, USE_OCRAM ? "the operand cache RAM" : "main RAM");
+}
+#endif
+
 int main(){
 
 	int exitProgram = 0;
 
+#if USE_OCRAM
+	// Before anything touches game, match or cpu. They start out as whatever was in the
+	// cache, not zeroed like the rest of .bss.
+	if(!ocram_enable()){
+		printf("Can't turn the operand cache RAM on\n");
+		return 1;
+	}
+	memset(&game, 0, sizeof(game));
+	memset(&match, 0, sizeof(match));
+	memset(&cpu, 0, sizeof(cpu));
+#endif
+
+	tetris_init();
 	init();
+#if TICK_BENCH
+	bench_ticks();
+#endif
 	initiate_game();
 
 	printf("Hello world!\n");
 	printf("How are you today? :)\n");
 
+	// With ALLOC_AUDIT on, the heap is off limits to both halves of every frame after
+	// the first one (see alloc_audit.h)
+	uint32 frame = 0;
+	alloc_audit_frame_begin(frame, "update");
+	update_frame(&snapshot);
+	alloc_audit_frame_end();
+
 	while(!exitProgram){
 		/*
 		maple_device_t *controller = maple_enum_type(0, MAPLE_FUNC_CONTROLLER);
@@ -1301,11 +1557,29 @@ int main(){
 			exitProgram = 1;
 		}
 		*/
-		draw_frame_gameplay();
+		alloc_audit_frame_begin(frame, "draw");
+		draw_frame_gameplay(&snapshot);
+		alloc_audit_frame_end();
+		frame++;
+
+		// The PVR renders that frame while the logic works out the next one and builds its lists
+		alloc_audit_frame_begin(frame, "update");
+		update_frame(&snapshot);
+		alloc_audit_frame_end();
 	}
 
 	maple_device_t *vmu = maple_enum_type(0, MAPLE_FUNC_LCD);
 	vmu_draw_lcd(vmu, vmu_clear);
+#if RECORD_REPLAYS
+	replay_writer_close(&replay);
+	replay_stop_writer_thread(); // writes out what's still queued
+#endif
+	audio_shutdown();
+	input_stop_thread();
+	highscore_stop_save_thread(); // lets a save that's still going finish
+	pvr_capture_close();
 	pvr_shutdown();
+	alloc_audit_log_totals();
+	log_stop_drain_thread();
 
 }
\ No newline at end of file
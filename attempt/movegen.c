@@ -0,0 +1,316 @@
+// Placement enumeration and perft. See movegen.h.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "movegen.h"
+
+/**************************************** Zobrist keys ****************************************/
+
+static uint64_t zobrist_cells[TETRIS_ROWS][TETRIS_COLS];
+static uint64_t zobrist_held[8];
+static uint64_t zobrist_next[PERFT_MAX_SEQUENCE+1];
+static uint64_t zobrist_depth[PERFT_MAX_DEPTH+1];
+static uint64_t zobrist_use_hold;
+static int zobrist_ready = 0;
+
+static uint64_t splitmix64(uint64_t * state){
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+static void init_zobrist(){
+	// Fixed seed, so hashes (and table behavior) are the same every run
+	uint64_t state = 0x5eed;
+	for(int row=0; row<TETRIS_ROWS; row++){
+		for(int col=0; col<TETRIS_COLS; col++){
+			zobrist_cells[row][col] = splitmix64(&state);
+		}
+	}
+	for(int i=0; i<8; i++){
+		zobrist_held[i] = splitmix64(&state);
+	}
+	for(int i=0; i<=PERFT_MAX_SEQUENCE; i++){
+		zobrist_next[i] = splitmix64(&state);
+	}
+	for(int i=0; i<=PERFT_MAX_DEPTH; i++){
+		zobrist_depth[i] = splitmix64(&state);
+	}
+	zobrist_use_hold = splitmix64(&state);
+	zobrist_ready = 1;
+}
+
+uint64_t movegen_hash_rows(const tetris_row * rows){
+	uint64_t hash = 0;
+	for(int row=TETRIS_FIRST_ROW; row<=TETRIS_BOTTOM_ROW; row++){
+		tetris_row cells = rows[row] & ~TETRIS_EMPTY_ROW;
+		while(cells){
+			int col = __builtin_ctz(cells);
+			hash ^= zobrist_cells[row][col];
+			cells &= cells - 1;
+		}
+	}
+	return hash;
+}
+
+/**************************************** placements ****************************************/
+
+static inline tetris_row shifted_mask(uint8_t mask, int left_x){
+	return left_x < 0 ? (tetris_row)(mask >> -left_x) : (tetris_row)(mask << left_x);
+}
+
+uint64_t movegen_cells_key(const tetris_piece * piece){
+	const uint8_t * shape = tetris_shape(piece->type, piece->orientation);
+	int n = tetris_shape_size(piece->type);
+	uint8_t masks[4];
+	int count = 0;
+	int first = -1;
+	uint8_t columns = 0;
+
+	// Empty rows and columns of the box don't count, so the same cells in another
+	// rotation (where the box sits somewhere else) come out the same
+	for(int row=0; row<n; row++){
+		if(!shape[row]){
+			continue;
+		}
+		if(first < 0){
+			first = row;
+		}
+		masks[count++] = shape[row];
+		columns |= shape[row];
+	}
+	int left = __builtin_ctz(columns);
+	uint64_t key = 0;
+	for(int i=0; i<count; i++){
+		key |= (uint64_t)(masks[i] >> left) << (i * 4);
+	}
+	return key | ((uint64_t)(uint8_t)(piece->left_x + left) << 16) | ((uint64_t)(piece->top_y + first) << 24);
+}
+
+void movegen_init(movegen * gen){
+	if(!zobrist_ready){
+		init_zobrist();
+	}
+	memset(gen, 0, sizeof(*gen));
+}
+
+static int add_placement(movegen * gen, uint64_t key){
+	// Returns 1 if these cells haven't been found yet this call
+	uint32_t slot = (uint32_t)((key * 0x9e3779b97f4a7c15ull) >> 40) & (MOVEGEN_SET_SIZE-1);
+	while(gen->set_stamps[slot] == gen->stamp){
+		if(gen->set_keys[slot] == key){
+			return 0;
+		}
+		slot = (slot + 1) & (MOVEGEN_SET_SIZE-1);
+	}
+	gen->set_stamps[slot] = gen->stamp;
+	gen->set_keys[slot] = key;
+	return 1;
+}
+
+static inline void visit(movegen * gen, int * count, const tetris_piece * piece, int parent, movegen_move move){
+	int x = piece->left_x + MOVEGEN_X_OFFSET;
+	int y = piece->top_y + MOVEGEN_Y_OFFSET;
+	if(x < 0 || x >= MOVEGEN_X_RANGE || y < 0 || y >= MOVEGEN_Y_RANGE){
+		return; // can't happen with valid positions, but don't write out of bounds
+	}
+	uint32_t * seen = &gen->visited[piece->orientation][y];
+	if(*seen & (1u << x)){
+		return;
+	}
+	*seen |= 1u << x;
+
+	movegen_state * state = &gen->states[(*count)++];
+	state->piece = *piece;
+	state->parent = parent;
+	state->move = move;
+}
+
+int movegen_placements(movegen * gen, const tetris_row * rows, color_id type, placement * out){
+	tetris_piece start;
+	tetris_spawn(&start, type);
+	if(tetris_collides(rows, &start)){
+		return 0;
+	}
+
+	memset(gen->visited, 0, sizeof(gen->visited));
+	if(++gen->stamp == 0){
+		memset(gen->set_stamps, 0, sizeof(gen->set_stamps));
+		gen->stamp = 1;
+	}
+
+	int count = 0;
+	int found = 0;
+	visit(gen, &count, &start, -1, MOVE_NONE);
+
+	for(int i=0; i<count; i++){
+		tetris_piece piece = gen->states[i].piece;
+		tetris_piece next;
+
+		next = piece;
+		if(tetris_move(rows, &next, -1, 0)){
+			visit(gen, &count, &next, i, MOVE_LEFT);
+		}
+		next = piece;
+		if(tetris_move(rows, &next, 1, 0)){
+			visit(gen, &count, &next, i, MOVE_RIGHT);
+		}
+		next = piece;
+		if(tetris_move(rows, &next, 0, 1)){
+			visit(gen, &count, &next, i, MOVE_DOWN);
+		}
+		else {
+			// It's resting on something, trying to move it down again would lock it here
+			uint64_t key = movegen_cells_key(&piece);
+			if(add_placement(gen, key)){
+				out[found].piece = piece;
+				out[found].cells = key;
+				out[found].state = i;
+				found++;
+			}
+		}
+		next = piece;
+		if(tetris_rotate_cw(rows, &next)){
+			visit(gen, &count, &next, i, MOVE_CW);
+		}
+		next = piece;
+		if(tetris_rotate_ccw(rows, &next)){
+			visit(gen, &count, &next, i, MOVE_CCW);
+		}
+	}
+	gen->states_searched += count;
+	return found;
+}
+
+int movegen_path(const movegen * gen, const placement * p, uint8_t * moves, int max){
+	uint8_t reversed[MOVEGEN_MAX_STATES];
+	int length = 0;
+
+	for(int i=p->state; gen->states[i].parent >= 0; i=gen->states[i].parent){
+		reversed[length++] = gen->states[i].move;
+	}
+	if(length > max){
+		length = max;
+	}
+	for(int i=0; i<length; i++){
+		moves[i] = reversed[length-1-i];
+	}
+	return length;
+}
+
+/**************************************** perft ****************************************/
+
+int perft_table_init(perft_table * table, int log2_entries){
+	memset(table, 0, sizeof(*table));
+	table->entries = calloc((size_t)1 << log2_entries, sizeof(perft_entry));
+	table->mask = (1u << log2_entries) - 1;
+	return table->entries != NULL;
+}
+
+void perft_table_free(perft_table * table){
+	free(table->entries);
+	memset(table, 0, sizeof(*table));
+}
+
+void perft_position_init(perft_position * pos, const tetris_row * rows){
+	if(!zobrist_ready){
+		init_zobrist();
+	}
+	memcpy(pos->rows, rows, sizeof(pos->rows));
+	pos->hash = movegen_hash_rows(rows);
+	pos->held = EMPTY;
+	pos->next = 0;
+}
+
+static uint64_t place_all(movegen * gen, perft_table * table, const perft_position * pos, color_id type,
+	color_id held, int next, const uint8_t * sequence, int length, int depth, int use_hold, perft_stats * stats){
+	placement placements[MOVEGEN_MAX_STATES];
+	int count = movegen_placements(gen, pos->rows, type, placements);
+	uint64_t total = 0;
+
+	if(depth == 1){
+		// Every placement is one sequence, no need to make them
+		stats->nodes += count;
+		return count;
+	}
+	for(int i=0; i<count; i++){
+		perft_position child;
+		const tetris_piece * piece = &placements[i].piece;
+
+		memcpy(child.rows, pos->rows, sizeof(child.rows));
+		tetris_lock(child.rows, piece);
+		child.held = held;
+		child.next = next;
+
+		tetris_row_set full = tetris_full_rows(child.rows);
+		if(full){
+			tetris_compact_rows(child.rows, full);
+			child.hash = movegen_hash_rows(child.rows);
+			stats->line_clears++;
+		}
+		else {
+			// Zobrist: only the 4 new cells change the hash
+			const uint8_t * shape = tetris_shape(piece->type, piece->orientation);
+			int n = tetris_shape_size(piece->type);
+			child.hash = pos->hash;
+			for(int row=0; row<n; row++){
+				tetris_row cells = shifted_mask(shape[row], piece->left_x);
+				while(cells){
+					child.hash ^= zobrist_cells[piece->top_y + row][__builtin_ctz(cells)];
+					cells &= cells - 1;
+				}
+			}
+		}
+		stats->nodes++;
+		total += perft(gen, table, &child, sequence, length, depth-1, use_hold, stats);
+	}
+	return total;
+}
+
+uint64_t perft(movegen * gen, perft_table * table, const perft_position * pos,
+	const uint8_t * sequence, int length, int depth, int use_hold, perft_stats * stats){
+	if(depth == 0){
+		return 1;
+	}
+	if(pos->next >= length || pos->next >= PERFT_MAX_SEQUENCE || depth > PERFT_MAX_DEPTH){
+		return 0;
+	}
+
+	uint64_t key = 0;
+	perft_entry * entry = NULL;
+	if(table && depth > 1){ // depth 1 is just a movegen call, cheaper than a cache miss
+		key = pos->hash ^ zobrist_held[pos->held & 7] ^ zobrist_next[pos->next] ^ zobrist_depth[depth]
+			^ (use_hold ? zobrist_use_hold : 0);
+		key |= 1; // 0 marks an empty entry
+		entry = &table->entries[(key >> 20) & table->mask];
+		table->probes++;
+		if(entry->key == key){
+			table->hits++;
+			return entry->count;
+		}
+	}
+
+	color_id current = sequence[pos->next];
+	uint64_t count = place_all(gen, table, pos, current, pos->held, pos->next+1, sequence, length, depth, use_hold, stats);
+
+	if(use_hold){
+		if(pos->held == EMPTY){
+			// The first hold puts this one away and takes the next one
+			if(pos->next+1 < length){
+				count += place_all(gen, table, pos, sequence[pos->next+1], current, pos->next+2, sequence, length, depth, use_hold, stats);
+			}
+		}
+		else if(pos->held != current){
+			// (holding the same type just plays the same placements again)
+			count += place_all(gen, table, pos, pos->held, current, pos->next+1, sequence, length, depth, use_hold, stats);
+		}
+	}
+
+	if(entry){
+		entry->key = key;
+		entry->count = count;
+	}
+	return count;
+}
@@ -0,0 +1,132 @@
+// Placement enumeration and perft, for checking the rules and benchmarking fields.
+//
+// movegen_placements() finds every spot the current tetromino can end up locked in,
+// starting from its spawn position. It's a breadth first search over (x, y, rotation)
+// using the real tetris_move() and tetris_rotate_cw()/ccw() (wall kicks included), so it
+// reaches tucks and spins the same way a player can. Different rotations that fill the
+// same cells (an O in any rotation, S/Z/I flipped) count as one placement.
+//
+// perft() ("performance test", the chess engine term) counts every sequence of
+// placements depth tetrominos deep from a position, hold included. Positions that come
+// up again through different orders of moves are counted once and looked up after that,
+// keyed by a Zobrist hash of the field (one random 64 bit key per cell, XORed together).
+// The counts are the oracle: any other field representation or move generator has to
+// come up with the same numbers, and the time it takes is the benchmark.
+//
+// Host only (perft_tool.c), nothing here is used by the game itself.
+
+#ifndef MOVEGEN_H
+#define MOVEGEN_H
+
+#include <stdint.h>
+
+#include "tetris.h"
+
+// left_x of a piece can go a little past the border (empty columns of its box), top_y a
+// little above row 0 for the same reason. Visited states are indexed with these offsets.
+#define MOVEGEN_X_OFFSET 4
+#define MOVEGEN_Y_OFFSET 4
+#define MOVEGEN_X_RANGE (TETRIS_COLS + MOVEGEN_X_OFFSET)
+#define MOVEGEN_Y_RANGE (TETRIS_ROWS + MOVEGEN_Y_OFFSET)
+#define MOVEGEN_MAX_STATES (4 * MOVEGEN_Y_RANGE * MOVEGEN_X_RANGE)
+// power of 2, at least twice MOVEGEN_MAX_STATES
+#define MOVEGEN_SET_SIZE (MOVEGEN_MAX_STATES <= 2048 ? 4096 : MOVEGEN_MAX_STATES <= 4096 ? 8192 : 16384)
+
+typedef enum Movegen_Move {
+	MOVE_LEFT,
+	MOVE_RIGHT,
+	MOVE_DOWN,
+	MOVE_CW,
+	MOVE_CCW,
+	MOVE_NONE // the spawn position
+} movegen_move;
+
+typedef struct Placement {
+	tetris_piece piece; // first one found, so it has the shortest path
+	uint64_t cells; // which cells it fills, see movegen_cells_key()
+	int state; // index in movegen.states, for movegen_path()
+} placement;
+
+typedef struct Movegen_State {
+	tetris_piece piece;
+	int16_t parent;
+	uint8_t move; // movegen_move that got here from parent
+} movegen_state;
+
+// Scratch space for the search, reused between calls. One per thread.
+typedef struct Movegen {
+	uint32_t visited[4][MOVEGEN_Y_RANGE]; // bit left_x+MOVEGEN_X_OFFSET set = seen
+	movegen_state states[MOVEGEN_MAX_STATES]; // the BFS queue, kept for movegen_path()
+	uint64_t set_keys[MOVEGEN_SET_SIZE]; // placements found this call
+	uint32_t set_stamps[MOVEGEN_SET_SIZE]; // slot is in use if it matches stamp
+	uint32_t stamp;
+
+	uint64_t states_searched; // summed over every call
+} movegen;
+
+void movegen_init(movegen * gen);
+
+// Every placement of a tetromino of this type, spawned at its normal spawn position.
+// Returns how many went into out (up to MOVEGEN_MAX_STATES), 0 if the spawn is blocked.
+int movegen_placements(movegen * gen, const tetris_row * rows, color_id type, placement * out);
+
+// The moves from spawn to a placement from the last movegen_placements() call.
+// Returns how many there are (at most max).
+int movegen_path(const movegen * gen, const placement * p, uint8_t * moves, int max);
+
+// The cells a piece fills: the top row and left column it's in, and which of the 4x4
+// cells from there are filled.
+uint64_t movegen_cells_key(const tetris_piece * piece);
+
+// Zobrist hash of the visible field
+uint64_t movegen_hash_rows(const tetris_row * rows);
+
+/**************************************** perft ****************************************/
+
+typedef struct Perft_Position {
+	tetris_row rows[TETRIS_ROWS];
+	uint64_t hash; // movegen_hash_rows(rows)
+	color_id held; // EMPTY if nothing's held yet
+	int next; // index in the sequence of the tetromino that's about to spawn
+} perft_position;
+
+typedef struct Perft_Entry {
+	uint64_t key;
+	uint64_t count;
+} perft_entry;
+
+// Replace-always, keyed on the field's hash, the held tetromino, the sequence index and
+// the depth left, which is everything the count below a position depends on. It only
+// saves work where the tree actually transposes, which is rarer than in chess: two
+// different sets of placements almost never leave the same cells behind unless rows got
+// cleared along the way. From an empty field that's a handful of hits at depth 5 and
+// none below it (19 of 22102 probes for the first seed). It can only help on deeper
+// counts and on fields with nearly full rows, where clears make different placements
+// meet. perft_tool prints the hit rate next to every count.
+typedef struct Perft_Table {
+	perft_entry * entries;
+	uint32_t mask;
+	uint64_t probes;
+	uint64_t hits;
+} perft_table;
+
+#define PERFT_MAX_SEQUENCE 64
+#define PERFT_MAX_DEPTH 16
+
+// 2^log2_entries entries. Returns 0 if it can't be allocated.
+int perft_table_init(perft_table * table, int log2_entries);
+void perft_table_free(perft_table * table);
+
+void perft_position_init(perft_position * pos, const tetris_row * rows);
+
+typedef struct Perft_Stats {
+	uint64_t nodes; // positions visited (placements made), table hits not included
+	uint64_t line_clears;
+} perft_stats;
+
+// Counts the placement sequences depth tetrominos deep. sequence holds the tetrominos
+// in the order they spawn (at least depth+1 of them if hold is on). table can be NULL.
+uint64_t perft(movegen * gen, perft_table * table, const perft_position * pos,
+	const uint8_t * sequence, int length, int depth, int use_hold, perft_stats * stats);
+
+#endif
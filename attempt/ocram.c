@@ -0,0 +1,37 @@
+// The operand cache RAM. See ocram.h.
+
+#include <kos.h>
+
+#include "ocram.h"
+
+#define CCR (*(volatile uint32 *)0xff00001c) // cache control register
+#define CCR_ORA (1 << 5)
+#define CCR_OIX (1 << 7)
+
+#define P2(address) (((uintptr_t)(address) & 0x1fffffff) | 0xa0000000) // the uncached mirror
+
+static void __attribute__((noinline)) set_ora(){
+	// Only ever called through its P2 address: the cache control register can only be
+	// changed by code that isn't running out of the cache, and the next 8 instructions
+	// can't touch the cache either
+	CCR |= CCR_ORA;
+	__asm__ volatile("nop\n\tnop\n\tnop\n\tnop\n\tnop\n\tnop\n\tnop\n\tnop");
+}
+
+int ocram_enable(){
+	if(CCR & CCR_ORA){
+		return 1;
+	}
+	if(CCR & CCR_OIX){
+		return 0;
+	}
+
+	// Half the cache lines stop being cache, anything dirty in them has to be in RAM by
+	// then. Writing back the whole of main RAM's worth of lines is a few milliseconds,
+	// with interrupts off so nothing gets dirty again in between.
+	int old = irq_disable();
+	dcache_flush_range(0x8c000000, 16 * 1024 * 1024);
+	((void (*)())P2(set_ora))();
+	irq_restore(old);
+	return 1;
+}
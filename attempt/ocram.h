@@ -0,0 +1,39 @@
+// The SH4's operand cache RAM.
+//
+// The SH4 can turn half of its 16 KB operand cache into 8 KB of plain RAM (CCR.ORA). A
+// read or write in there always takes as long as a cache hit, nothing can evict it, and
+// there's no line fill or write back. What's in it never sees main RAM at all: DMA, the
+// store queues and the PVR can't get at it, so only state the CPU alone works on fits.
+// The price is that everything else gets the other 8 KB of cache instead of 16.
+//
+// With the cache set up the way KOS does it (OIX off), the RAM is two 4 KB blocks,
+// OCRAM_BLOCK_1 and OCRAM_BLOCK_2, with a gap between them. Turning it on takes half
+// the cache lines away from the cache, dirty ones included, so ocram_enable() writes
+// everything back to RAM first.
+//
+// Variables get put in there by giving their symbol an address (OCRAM_VARIABLE() below),
+// not by the linker script, so they aren't in .bss: they start out as whatever the cache
+// held, and can't be used before ocram_enable().
+
+#ifndef OCRAM_H
+#define OCRAM_H
+
+#define OCRAM_BLOCK_1 0x7c001000
+#define OCRAM_BLOCK_2 0x7c003000
+#define OCRAM_BLOCK_SIZE 4096
+
+#define OCRAM_STRING(x) OCRAM_STRING_(x)
+#define OCRAM_STRING_(x) #x
+#define OCRAM_SYMBOL(name) OCRAM_STRING(__USER_LABEL_PREFIX__) #name
+
+// Declares a global variable name of type at address (an expression the assembler can
+// work out, so no sizeof). Only once per name, in one file.
+#define OCRAM_VARIABLE(type, name, address) \
+	__asm__(".globl " OCRAM_SYMBOL(name) "\n\t.set " OCRAM_SYMBOL(name) ", " OCRAM_STRING(address)); \
+	extern type name
+
+// Switches it on, if it isn't already. Returns 0 if the cache is set up in a way the
+// addresses above don't work with (OIX on).
+int ocram_enable();
+
+#endif
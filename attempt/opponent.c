@@ -0,0 +1,266 @@
+// The computer opponent. See opponent.h.
+
+#include <string.h>
+
+#include "opponent.h"
+
+#ifdef _arch_dreamcast
+#include <kos.h>
+static uint32_t now_us(){ return (uint32_t)timer_us_gettime64(); }
+#else
+#include <time.h>
+static uint32_t now_us(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(ts.tv_sec * 1000000ull + ts.tv_nsec / 1000);
+}
+#endif
+
+// Until a placement has been timed, assume it takes this long
+#define PLACEMENT_GUESS_US 10
+// Slices per timing window (see opponent.window_worst_us), about half a second
+#define TIMING_WINDOW 32
+// Taking this long on a tetromino means it's stuck on something, just drop it
+#define STUCK_FRAMES 300
+// Score of a first placement the next tetromino doesn't fit anywhere on top of
+#define TOPOUT_PENALTY (-1000000)
+
+/**************************************** evaluation ****************************************/
+
+static int32_t evaluate(const opponent * cpu, const tetris_row * rows, int lines){
+	// Same features as bot.c, straight off the row masks: a column's height is set by the
+	// first row it shows up in, every empty cell under one of those is a hole
+	const uint32_t inside = TETRIS_FULL_ROW & ~TETRIS_EMPTY_ROW;
+	int heights[TETRIS_COLS] = { 0 };
+	uint32_t seen = 0;
+	int holes = 0;
+	int aggregate = 0;
+	int bumpiness = 0;
+
+	for(int row=TETRIS_FIRST_ROW; row<=TETRIS_BOTTOM_ROW; row++){
+		uint32_t filled = rows[row] & inside;
+		holes += __builtin_popcount(~filled & seen & inside);
+		for(uint32_t fresh = filled & ~seen; fresh; fresh &= fresh - 1){
+			heights[__builtin_ctz(fresh)] = TETRIS_BOTTOM_ROW - row + 1;
+			aggregate += TETRIS_BOTTOM_ROW - row + 1;
+		}
+		seen |= filled;
+	}
+	for(int col=TETRIS_LEFT_COL+1; col<=TETRIS_RIGHT_COL; col++){
+		int step = heights[col] - heights[col-1];
+		bumpiness += step < 0 ? -step : step;
+	}
+
+	return cpu->height_weight * aggregate
+		+ cpu->holes_weight * holes
+		+ cpu->bumpiness_weight * bumpiness
+		+ cpu->lines_weight * lines;
+}
+
+static int place(const tetris_row * rows, tetris_piece piece, int candidate, tetris_row * out, int * lines){
+	// Drops the tetromino in one rotation and column (one of OPPONENT_CANDIDATES) and
+	// clears the lines. Returns 0 if it doesn't fit there.
+	piece.orientation = candidate / OPPONENT_COLUMNS;
+	piece.left_x = candidate % OPPONENT_COLUMNS - 2;
+	// a vertical I overlaps the ceiling at spawn height, in the game the rotation kicks
+	// it down a row or two (see bot.c)
+	for(int drop=0; drop<2 && tetris_collides(rows, &piece); drop++){
+		piece.top_y++;
+	}
+	if(tetris_collides(rows, &piece)){
+		return 0;
+	}
+
+	memcpy(out, rows, TETRIS_ROWS * sizeof(tetris_row));
+	piece.top_y += tetris_drop_distance(out, &piece);
+	tetris_lock(out, &piece);
+	tetris_row_set full = tetris_full_rows(out);
+	tetris_compact_rows(out, full);
+	*lines = __builtin_popcountll(full);
+	return 1;
+}
+
+/**************************************** search ****************************************/
+
+static void consider(opponent * cpu, int32_t score){
+	if(!cpu->found || score > cpu->best){
+		cpu->best = score;
+		cpu->target_orientation = cpu->first / OPPONENT_COLUMNS;
+		cpu->target_x = cpu->first % OPPONENT_COLUMNS - 2;
+		cpu->found = 1;
+	}
+}
+
+static void search_step(opponent * cpu){
+	// One placement: of the current tetromino, or of the next one on top of it
+	if(cpu->first == OPPONENT_CANDIDATES){
+		cpu->stage = OPPONENT_DONE;
+		return;
+	}
+
+	if(cpu->second < 0){
+		if(!place(cpu->root, cpu->piece, cpu->first, cpu->after_first, &cpu->first_lines)){
+			cpu->first++;
+		}
+		else if(!cpu->lookahead || cpu->next_type == EMPTY){
+			consider(cpu, evaluate(cpu, cpu->after_first, cpu->first_lines));
+			cpu->first++;
+		}
+		else {
+			cpu->second = 0;
+			cpu->best_second = INT32_MIN;
+		}
+		return;
+	}
+
+	tetris_piece next;
+	tetris_row rows[TETRIS_ROWS];
+	int lines;
+	tetris_spawn(&next, cpu->next_type);
+	if(place(cpu->after_first, next, cpu->second, rows, &lines)){
+		int32_t score = evaluate(cpu, rows, cpu->first_lines + lines);
+		if(score > cpu->best_second){
+			cpu->best_second = score;
+		}
+	}
+
+	if(++cpu->second == OPPONENT_CANDIDATES){
+		if(cpu->best_second == INT32_MIN){
+			cpu->best_second = evaluate(cpu, cpu->after_first, cpu->first_lines) + TOPOUT_PENALTY;
+		}
+		consider(cpu, cpu->best_second);
+		cpu->second = -1;
+		cpu->first++;
+	}
+}
+
+static void follow(opponent * cpu, const tetris_game * game){
+	// Starts a search for each new tetromino, drops the old one once it's locked
+	if(game->phase != PHASE_FALLING || game->active_set || game->loss){
+		cpu->stage = OPPONENT_IDLE;
+		return;
+	}
+	if(cpu->stage != OPPONENT_IDLE){
+		return;
+	}
+
+	// The field doesn't change while a tetromino falls, so it only gets copied once
+	memcpy(cpu->root, game->rows, sizeof(cpu->root));
+	cpu->piece = game->active;
+	cpu->next_type = game->queue[0];
+	cpu->first = 0;
+	cpu->second = -1;
+	cpu->found = 0;
+	cpu->target_orientation = game->active.orientation;
+	cpu->target_x = game->active.left_x;
+	cpu->frames_on_piece = 0;
+	cpu->stage = OPPONENT_SEARCHING;
+}
+
+uint32_t opponent_think(opponent * cpu, const tetris_game * game, uint32_t budget_us){
+	uint32_t start = now_us();
+	uint32_t before = start;
+	int placements = 0;
+
+	follow(cpu, game);
+	if(cpu->stage != OPPONENT_SEARCHING){
+		return 0;
+	}
+
+	// Only start a placement if the slowest one lately would still fit
+	while(cpu->stage == OPPONENT_SEARCHING){
+		uint32_t worst = cpu->window_worst_us > cpu->previous_window_worst_us
+			? cpu->window_worst_us : cpu->previous_window_worst_us;
+		if(before - start + (cpu->timed ? worst : PLACEMENT_GUESS_US) > budget_us){
+			break;
+		}
+		search_step(cpu);
+		placements++;
+
+		uint32_t after = now_us();
+		uint32_t took = after - before;
+		before = after;
+		cpu->timed = 1;
+		if(took > cpu->window_worst_us){
+			cpu->window_worst_us = took;
+		}
+		if(took > cpu->placement_worst_us){
+			cpu->placement_worst_us = took;
+		}
+	}
+	if(++cpu->window_slices == TIMING_WINDOW){
+		cpu->previous_window_worst_us = cpu->window_worst_us;
+		cpu->window_worst_us = 0;
+		cpu->window_slices = 0;
+	}
+
+	uint32_t used = before - start;
+	cpu->last_slice.budget_us = budget_us;
+	cpu->last_slice.used_us = used;
+	cpu->last_slice.placements = placements;
+	cpu->slices++;
+	cpu->overruns += used > budget_us;
+	cpu->budget_total_us += budget_us;
+	cpu->used_total_us += used;
+	return used;
+}
+
+/**************************************** playing ****************************************/
+
+uint32_t opponent_buttons(opponent * cpu, const tetris_game * game){
+	follow(cpu, game);
+	if(cpu->stage == OPPONENT_IDLE){
+		return 0;
+	}
+
+	cpu->frames_on_piece++;
+	if(cpu->stage == OPPONENT_SEARCHING){
+		if(cpu->frames_on_piece < cpu->frames_per_piece){
+			return 0; // there's still time to think
+		}
+		cpu->stage = OPPONENT_DONE; // out of time, go with the best so far
+		cpu->searches_cut_short++;
+	}
+
+	cpu->press = !cpu->press;
+	if(!cpu->press){
+		return 0;
+	}
+	if(cpu->frames_on_piece > cpu->frames_per_piece + STUCK_FRAMES){
+		return TETRIS_BTN_HARD_DROP;
+	}
+	if(game->active.orientation != cpu->target_orientation){
+		return TETRIS_BTN_ROTATE_CW;
+	}
+	if(game->active.left_x < cpu->target_x){
+		return TETRIS_BTN_RIGHT;
+	}
+	if(game->active.left_x > cpu->target_x){
+		return TETRIS_BTN_LEFT;
+	}
+	// there, but not before its time
+	return cpu->frames_on_piece >= cpu->frames_per_piece ? TETRIS_BTN_HARD_DROP : 0;
+}
+
+void opponent_reset(opponent * cpu){
+	cpu->stage = OPPONENT_IDLE;
+	cpu->press = 0;
+	memset(&cpu->last_slice, 0, sizeof(cpu->last_slice));
+	cpu->slices = 0;
+	cpu->overruns = 0;
+	cpu->budget_total_us = 0;
+	cpu->used_total_us = 0;
+	cpu->searches_cut_short = 0;
+}
+
+void opponent_setup(opponent * cpu, int pieces_per_minute, int lookahead){
+	memset(cpu, 0, sizeof(*cpu));
+	cpu->frames_per_piece = pieces_per_minute > 0 ? 3600 / pieces_per_minute : 60;
+	cpu->lookahead = lookahead;
+	// bot.c's weights
+	cpu->height_weight = -51;
+	cpu->holes_weight = -36;
+	cpu->bumpiness_weight = -18;
+	cpu->lines_weight = 76;
+	opponent_reset(cpu);
+}
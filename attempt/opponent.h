@@ -0,0 +1,98 @@
+// The computer opponent for versus mode on the Dreamcast.
+//
+// Like bot.h it picks a rotation and column for every tetromino and presses buttons
+// until it gets there, but it looks one tetromino further: every placement of the
+// current one is tried with every placement of the next one from the queue, that's up
+// to (4 * (TETRIS_COLS+2))^2 fields to evaluate, a few milliseconds' worth on the SH4.
+// That can't happen all at once without missing vsync, so the search is a state
+// machine that opponent_think() advances in slices: it gets a microsecond budget, works
+// through placements until the next one might not fit in what's left, and picks up
+// from there next frame. The partial result (the best placement so far) is kept.
+//
+// Each placement is timed and a slice stops while there's still room for the slowest
+// one lately, so it stays inside its budget unless a placement suddenly takes longer
+// than any recent one (an interrupt, a cold cache). opponent.last_slice says how much of
+// its budget a slice used, overruns counts the ones that went over.
+//
+// How fast it plays is set in pieces per minute: it doesn't hard drop a tetromino before
+// its time is up. If the search isn't done by then, it goes with the best it has.
+// Everything is integer math, the evaluation included.
+
+#ifndef OPPONENT_H
+#define OPPONENT_H
+
+#include <stdint.h>
+
+#include "tetris.h"
+
+#define OPPONENT_COLUMNS (TETRIS_COLS + 2) // left_x from -2, the box can hang over the wall
+#define OPPONENT_CANDIDATES (4 * OPPONENT_COLUMNS) // every rotation in every column
+
+typedef enum Opponent_Stage {
+	OPPONENT_IDLE, // no tetromino to place
+	OPPONENT_SEARCHING,
+	OPPONENT_DONE // target is final, just moving there
+} opponent_stage;
+
+typedef struct Opponent_Slice {
+	uint32_t budget_us;
+	uint32_t used_us;
+	int placements; // evaluated in this slice
+} opponent_slice;
+
+typedef struct Opponent {
+	// settings
+	int frames_per_piece;
+	int lookahead; // 0 only looks at the current tetromino, like bot.c
+	int32_t height_weight; // all weights are in hundredths
+	int32_t holes_weight;
+	int32_t bumpiness_weight;
+	int32_t lines_weight;
+
+	// the search, resumed where the last slice left it
+	opponent_stage stage;
+	tetris_row root[TETRIS_ROWS]; // the field when the tetromino spawned
+	tetris_piece piece;
+	color_id next_type;
+	int first; // candidate of the current tetromino being looked at
+	int second; // candidate of the next tetromino, if first is placed
+	tetris_row after_first[TETRIS_ROWS];
+	int first_lines;
+	int32_t best_second; // best for first so far
+	int32_t best;
+	int target_orientation;
+	int target_x;
+	int found; // best is set
+
+	// moving there
+	int frames_on_piece;
+	int press; // alternates so buttons that need a release between presses still fire
+
+	// timing: the slowest placement lately, so a slice knows when to stop. It's the worst
+	// of this window of slices and the one before, so one placement that got interrupted
+	// doesn't slow the search down (or stop it, if it took longer than a budget) for good.
+	uint32_t placement_worst_us; // of every placement, for the statistics
+	uint32_t window_worst_us;
+	uint32_t previous_window_worst_us;
+	int window_slices;
+	int timed; // there's been a placement to time
+	opponent_slice last_slice;
+	uint32_t slices;
+	uint32_t overruns; // slices that went over their budget anyway
+	uint64_t budget_total_us;
+	uint64_t used_total_us;
+	uint32_t searches_cut_short; // tetrominos it had to drop before the search was done
+} opponent;
+
+// 60 pieces per minute is one a second. lookahead as above.
+void opponent_setup(opponent * cpu, int pieces_per_minute, int lookahead);
+// Forgets the search and the statistics, for a new game
+void opponent_reset(opponent * cpu);
+
+// Searches for up to budget_us microseconds. Call it once per frame, after the game was
+// ticked. Returns the microseconds it took.
+uint32_t opponent_think(opponent * cpu, const tetris_game * game, uint32_t budget_us);
+// The TETRIS_BTN_* to press this frame
+uint32_t opponent_buttons(opponent * cpu, const tetris_game * game);
+
+#endif
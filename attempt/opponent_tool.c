@@ -0,0 +1,104 @@
+// The computer opponent (opponent.h) against the bot from bot.c, in versus matches played
+// frame by frame the way main.c does it: both boards ticked, then the opponent gets its
+// slice of search with a fixed budget.
+//
+// Usage: opponent_tool [matches] [budget us] [pieces per minute] [--no-lookahead]
+//
+// Prints who won and what the slices did with their budget. A PC runs a placement a lot
+// faster than the SH4, so a budget of a few tens of us here is about what a few hundred
+// gets on the Dreamcast. On a busy PC the odd placement gets preempted and takes
+// milliseconds, those show up as slices over budget.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bot.h"
+#include "opponent.h"
+#include "versus.h"
+
+#define MAX_TICKS 200000 // per match, a match that gets this far is a draw
+
+int main(int argc, char ** argv){
+	int numbers[3] = { 10, 30, 90 }; // matches, budget, pieces per minute
+	int count = 0;
+	int lookahead = 1;
+
+	for(int i=1; i<argc; i++){
+		if(!strcmp(argv[i], "--no-lookahead")){
+			lookahead = 0;
+		}
+		else if(count < 3){
+			numbers[count++] = atoi(argv[i]);
+		}
+		else {
+			fprintf(stderr, "usage: opponent_tool [matches] [budget us] [pieces per minute] [--no-lookahead]\n");
+			return 1;
+		}
+	}
+	int matches = numbers[0];
+	uint32_t budget = numbers[1];
+
+	static versus_match match;
+	static opponent cpu;
+	bot brain;
+	int wins[3] = { 0, 0, 0 };
+	uint32_t worst_used = 0;
+	uint32_t slices = 0;
+	uint32_t overruns = 0;
+	uint32_t cut_short = 0;
+	uint64_t budget_total = 0;
+	uint64_t used_total = 0;
+
+	tetris_init();
+	opponent_setup(&cpu, numbers[2], lookahead);
+
+	for(int m=0; m<matches; m++){
+		versus_reset(&match, 0x1234567u + m*7919);
+		bot_setup(&brain, 0);
+		opponent_reset(&cpu);
+
+		long ticks = 0;
+		uint32_t search_slices = 0;
+		uint32_t searches = 0;
+		while(versus_winner(&match) < 0 && ticks < MAX_TICKS){
+			versus_tick(&match.players[0], bot_buttons(&brain, &match.players[0].game));
+			versus_tick(&match.players[1], opponent_buttons(&cpu, &match.players[1].game));
+			ticks++;
+
+			uint32_t before = cpu.slices;
+			opponent_think(&cpu, &match.players[1].game, budget);
+			if(cpu.last_slice.used_us > worst_used){
+				worst_used = cpu.last_slice.used_us;
+			}
+			if(cpu.slices != before){
+				search_slices++;
+				searches += (cpu.stage == OPPONENT_DONE);
+			}
+		}
+
+		int winner = versus_winner(&match);
+		if(winner < 0){
+			winner = 2;
+		}
+		wins[winner]++;
+		printf("match %d: %s after %ld ticks, lines cleared %d (bot) / %d (cpu), %.1f slices per search\n",
+			m, winner==2 ? "draw" : (winner ? "cpu wins" : "bot wins"), ticks,
+			match.players[0].game.line_clears, match.players[1].game.line_clears,
+			searches ? (double)search_slices / searches : 0.0);
+
+		slices += cpu.slices;
+		overruns += cpu.overruns;
+		cut_short += cpu.searches_cut_short;
+		budget_total += cpu.budget_total_us;
+		used_total += cpu.used_total_us;
+	}
+
+	printf("%d matches, %s, %u us per frame, %d pieces per minute: bot %d, cpu %d, draws %d\n",
+		matches, lookahead ? "lookahead" : "no lookahead", (unsigned)budget, numbers[2], wins[0], wins[1], wins[2]);
+	printf("%u slices used %.1f%% of their budget, the busiest %u of %u us, %u over budget, "
+		"%u searches cut short, slowest placement %u us\n",
+		(unsigned)slices, budget_total ? 100.0 * used_total / budget_total : 0.0, (unsigned)worst_used,
+		(unsigned)budget, (unsigned)overruns, (unsigned)cut_short, (unsigned)cpu.placement_worst_us);
+	return 0;
+}
@@ -0,0 +1,74 @@
+// Host benchmark for the particle pool (particles.h).
+//
+//   particle_tool bench [particles] [seed]
+//       keeps the pool topped up to that many live particles (PARTICLES_MAX by
+//       default) with bursts like the game's, and times particles_update()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "particles.h"
+#include "tetris.h"
+
+#define BENCH_SECONDS 1.0
+#define FRAME_US (1e6 / 60)
+
+static double now_seconds(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void top_up(particle_pool * pool, int target){
+	// Line clear sized bursts (8 particles a block, 45 frames) until there are enough
+	while(pool->count + 8 <= target){
+		float left = 220 + 20 * (tetris_random(&pool->rng) % 10);
+		float top = 40 + 20 * (tetris_random(&pool->rng) % 20);
+		particles_burst(pool, left, top, 20, 20, 8, 0xff80c0ff, 3.0f, 45);
+	}
+}
+
+static int bench(int target, uint32_t seed){
+	static particle_pool pool;
+	double start, seconds, update_seconds = 0;
+	long frames = 0, updated = 0;
+
+	particles_clear(&pool, seed);
+	start = now_seconds();
+	do {
+		top_up(&pool, target);
+		updated += pool.count;
+
+		double update_start = now_seconds();
+		particles_update(&pool);
+		update_seconds += now_seconds() - update_start;
+		frames++;
+	} while((seconds = now_seconds() - start) < BENCH_SECONDS);
+
+	printf("%d particles (pool of %d, %zu KB), %ld frames in %.2f s\n", target, PARTICLES_MAX,
+		sizeof(pool) / 1024, frames, seconds);
+	printf("update: %.2f ns per particle, %.2f us per frame (%.2f%% of a 60 Hz frame)\n",
+		update_seconds / updated * 1e9, update_seconds / frames * 1e6, update_seconds / frames * 1e6 / FRAME_US * 100);
+	return 0;
+}
+
+int main(int argc, char ** argv){
+	if(argc < 2){
+		fprintf(stderr, "usage: particle_tool bench [particles] [seed]\n");
+		return 1;
+	}
+	tetris_init();
+
+	const char * command = argv[1];
+	int count = argc > 2 ? atoi(argv[2]) : 0;
+	uint32_t seed = argc > 3 ? strtoul(argv[3], NULL, 0) : 12345;
+
+	if(!strcmp(command, "bench")){
+		return bench(count > 0 && count <= PARTICLES_MAX ? count : PARTICLES_MAX, seed);
+	}
+
+	fprintf(stderr, "unknown command %s\n", command);
+	return 1;
+}
@@ -0,0 +1,73 @@
+// Particle pool. See particles.h.
+
+#include <string.h>
+
+#include "particles.h"
+#include "tetris.h"
+
+// Random float in [0, 1), 16 bits of it is plenty for a particle
+static float random_unit(uint32_t * rng){
+	return (tetris_random(rng) >> 16) * (1.0f / 65536.0f);
+}
+
+void particles_clear(particle_pool * pool, uint32_t seed){
+	pool->count = 0;
+	pool->rng = seed ? seed : 1;
+	pool->dropped = 0;
+}
+
+void particles_burst(particle_pool * pool, float left, float top, float width, float height,
+	int count, uint32_t argb, float speed, int frames){
+	if(count > PARTICLES_MAX - pool->count){
+		pool->dropped += count - (PARTICLES_MAX - pool->count);
+		count = PARTICLES_MAX - pool->count;
+	}
+	if(frames < 1){
+		frames = 1;
+	}
+
+	uint32_t * rng = &pool->rng;
+	for(int i=pool->count; i<pool->count + count; i++){
+		pool->x[i] = left + width * random_unit(rng);
+		pool->y[i] = top + height * random_unit(rng);
+		pool->vx[i] = speed * (random_unit(rng) * 2 - 1);
+		pool->vy[i] = speed * (random_unit(rng) * 2 - 1.5f);
+		pool->life[i] = 1;
+		pool->fade[i] = 1.0f / (frames * (0.5f + random_unit(rng))); // half to one and a half times as long
+		pool->rgb[i] = argb & 0x00ffffff;
+	}
+	pool->count += count;
+}
+
+void particles_update(particle_pool * pool){
+	int count = pool->count;
+	float * restrict x = pool->x;
+	float * restrict y = pool->y;
+	float * restrict vx = pool->vx;
+	float * restrict vy = pool->vy;
+	float * restrict life = pool->life;
+	float * restrict fade = pool->fade;
+
+	for(int i=0; i<count; i++){
+		vy[i] += PARTICLES_GRAVITY;
+		x[i] += vx[i];
+		y[i] += vy[i];
+		life[i] -= fade[i];
+	}
+
+	// Fill every dead slot with the last live particle. Walks down from the end so the
+	// one moved in has already been updated and isn't dead itself.
+	for(int i=count-1; i>=0; i--){
+		if(life[i] <= 0){
+			count--;
+			x[i] = x[count];
+			y[i] = y[count];
+			vx[i] = vx[count];
+			vy[i] = vy[count];
+			life[i] = life[count];
+			fade[i] = fade[count];
+			pool->rgb[i] = pool->rgb[count];
+		}
+	}
+	pool->count = count;
+}
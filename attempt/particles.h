@@ -0,0 +1,51 @@
+// Particle bursts for line clears and hard drops.
+//
+// Every particle lives in one fixed pool, stored as a structure of arrays: all the x
+// positions next to each other, then all the y positions and so on. particles_update()
+// is then one straight loop over plain float arrays (no structs, no branches), followed
+// by a pass that moves the last live particle into every dead one's slot, so the live
+// ones always sit in [0, count). Nothing is allocated, a burst that doesn't fit in the
+// pool just gets fewer particles (and they're counted in dropped).
+//
+// Drawing lives in main.c: every particle is a small quad under one shared header.
+//
+// The pool is the game logic's, like the games themselves: the logic adds and updates
+// particles, drawing only reads them, and it's done with them before the next update.
+
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include <stdint.h>
+
+// Live particles at most. Drawing is 4 vertices each, so this is also what bounds the
+// cost of the effects per frame (see draw_particles() in main.c).
+#ifndef PARTICLES_MAX
+#define PARTICLES_MAX 2048
+#endif
+
+#define PARTICLES_GRAVITY 0.15f // pixels per frame, per frame
+
+typedef struct Particle_Pool {
+	float x[PARTICLES_MAX] __attribute__((aligned(32)));
+	float y[PARTICLES_MAX] __attribute__((aligned(32)));
+	float vx[PARTICLES_MAX] __attribute__((aligned(32)));
+	float vy[PARTICLES_MAX] __attribute__((aligned(32)));
+	float life[PARTICLES_MAX] __attribute__((aligned(32))); // 1 when born, dead at 0 or below
+	float fade[PARTICLES_MAX] __attribute__((aligned(32))); // life lost per frame
+	uint32_t rgb[PARTICLES_MAX] __attribute__((aligned(32))); // the alpha comes from life
+	int count; // live ones, [0, count)
+	uint32_t rng;
+	uint32_t dropped; // particles that didn't fit, since particles_clear()
+} particle_pool;
+
+void particles_clear(particle_pool * pool, uint32_t seed);
+
+// count particles, spread over the rectangle and flying out of it in every direction (a
+// bit more upwards), speed in pixels per frame and lasting about frames frames
+void particles_burst(particle_pool * pool, float left, float top, float width, float height,
+	int count, uint32_t argb, float speed, int frames);
+
+// One frame: moves everything, then drops the particles that died
+void particles_update(particle_pool * pool);
+
+#endif
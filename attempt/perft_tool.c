@@ -0,0 +1,287 @@
+// Host tool for the move generator (movegen.h).
+//
+//   perft_tool perft depth [seed] [hold]
+//       counts placement sequences 1..depth deep on an empty field, tetrominos from seed,
+//       hold on if the last argument is 1. Each depth is counted again without the
+//       transposition table (up to depth 3) and the counts have to match. The table's hit
+//       rate is printed with each count, see perft_table in movegen.h for why it's low.
+//   perft_tool verify [fields] [seed]
+//       checks the generator against the game itself on random fields: every placement
+//       has to come out where it said when its path is played as button presses through
+//       tetris_game_tick(), and random button mashing must only ever lock tetrominos in
+//       places the generator found.
+//   perft_tool bench [calls] [seed]
+//       times movegen_placements() on random fields
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "movegen.h"
+
+#define TABLE_LOG2 20
+#define UNCACHED_MAX_DEPTH 3 // the uncached count gets slow past this
+#define MAX_PATH 256
+
+static double now_seconds(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static movegen gen; // too big for the stack
+
+static void random_field(tetris_row * rows, uint32_t * rng){
+	// Uneven columns with holes and overhangs in them, so tucks and kicks get exercised
+	tetris_clear_rows(rows);
+	for(int col=TETRIS_LEFT_COL; col<=TETRIS_RIGHT_COL; col++){
+		int height = tetris_random(rng) % 11;
+		for(int i=0; i<height; i++){
+			if(tetris_random(rng) % 5){
+				rows[TETRIS_BOTTOM_ROW - i] |= 1 << col;
+			}
+		}
+	}
+	for(int row=TETRIS_TOP_ROW; row<=TETRIS_BOTTOM_ROW; row++){
+		if(rows[row] == TETRIS_FULL_ROW){
+			rows[row] &= ~(1 << (TETRIS_LEFT_COL + tetris_random(rng) % TETRIS_WIDTH));
+		}
+	}
+}
+
+/**************************************** perft ****************************************/
+
+static int run_perft(int max_depth, uint32_t seed, int use_hold){
+	uint8_t sequence[PERFT_MAX_SEQUENCE];
+	uint32_t rng = seed ? seed : 1;
+	tetris_row rows[TETRIS_ROWS];
+	perft_position start;
+	perft_table table;
+	int failed = 0;
+
+	if(max_depth < 1 || max_depth > PERFT_MAX_DEPTH){
+		fprintf(stderr, "depth has to be 1 to %d\n", PERFT_MAX_DEPTH);
+		return 1;
+	}
+	if(!perft_table_init(&table, TABLE_LOG2)){
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	for(int i=0; i<PERFT_MAX_SEQUENCE; i++){
+		sequence[i] = tetris_random_type(&rng);
+	}
+	tetris_clear_rows(rows);
+	perft_position_init(&start, rows);
+
+	printf("sequence:");
+	for(int i=0; i<max_depth+1; i++){
+		printf(" %c", " ZLOSIJT"[sequence[i]]);
+	}
+	printf(", hold %s\n", use_hold ? "on" : "off");
+
+	for(int depth=1; depth<=max_depth; depth++){
+		perft_stats stats = {0};
+		memset(table.entries, 0, ((size_t)table.mask+1) * sizeof(perft_entry));
+		table.probes = table.hits = 0;
+
+		double start_time = now_seconds();
+		uint64_t count = perft(&gen, &table, &start, sequence, PERFT_MAX_SEQUENCE, depth, use_hold, &stats);
+		double seconds = now_seconds() - start_time;
+
+		printf("depth %2d: %14llu sequences, %11llu nodes in %8.3f s (%5.2f M nodes/s), table hits %llu/%llu (%.1f%%)\n",
+			depth, (unsigned long long)count, (unsigned long long)stats.nodes, seconds,
+			stats.nodes / seconds / 1e6, (unsigned long long)table.hits, (unsigned long long)table.probes,
+			table.probes ? 100.0 * table.hits / table.probes : 0.0);
+
+		if(depth <= UNCACHED_MAX_DEPTH){
+			perft_stats uncached_stats = {0};
+			uint64_t uncached = perft(&gen, NULL, &start, sequence, PERFT_MAX_SEQUENCE, depth, use_hold, &uncached_stats);
+			if(uncached != count){
+				printf("  MISMATCH: %llu without the table\n", (unsigned long long)uncached);
+				failed = 1;
+			}
+		}
+	}
+	perft_table_free(&table);
+	return failed;
+}
+
+/**************************************** verify ****************************************/
+
+static uint32_t move_buttons(movegen_move move){
+	switch(move){
+		case MOVE_LEFT: return TETRIS_BTN_LEFT;
+		case MOVE_RIGHT: return TETRIS_BTN_RIGHT;
+		case MOVE_DOWN: return TETRIS_BTN_SOFT_DROP;
+		case MOVE_CW: return TETRIS_BTN_ROTATE_CW;
+		case MOVE_CCW: return TETRIS_BTN_ROTATE_CCW;
+		default: return 0;
+	}
+}
+
+static void press(tetris_game * game, uint32_t buttons){
+	// Let go of everything until the game takes input again, then press for one frame
+	do {
+		tetris_game_tick(game, 0);
+	} while(game->move_timebuffer > 0);
+	tetris_game_tick(game, buttons);
+}
+
+static int play_path(const tetris_row * rows, color_id type, const placement * p){
+	// Plays the path through the game with gravity off and checks where it locks
+	uint8_t moves[MAX_PATH];
+	int length = movegen_path(&gen, p, moves, MAX_PATH);
+	tetris_game game;
+
+	tetris_game_reset(&game, 1);
+	memcpy(game.rows, rows, sizeof(game.rows));
+	tetris_game_set_sequence(&game, (const uint8_t *)&type, 1);
+	game.line_clear_delay = 1000; // keep full rows on the field so they can be compared
+	tetris_game_tick(&game, 0); // spawn
+	game.falltime = game.fall_timer = INT16_MAX; // no gravity for as long as any path takes
+
+	for(int i=0; i<length; i++){
+		press(&game, move_buttons(moves[i]));
+	}
+	if(game.active_set || memcmp(&game.active, &p->piece, sizeof(tetris_piece))){
+		return 0;
+	}
+
+	tetris_row expected[TETRIS_ROWS];
+	memcpy(expected, rows, sizeof(expected));
+	tetris_lock(expected, &p->piece);
+	press(&game, TETRIS_BTN_SOFT_DROP);
+	return game.active_set && !memcmp(game.rows, expected, sizeof(expected));
+}
+
+static int known_placement(const placement * placements, int count, const tetris_piece * piece){
+	uint64_t key = movegen_cells_key(piece);
+	for(int i=0; i<count; i++){
+		if(placements[i].cells == key){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int verify(int fields, uint32_t seed){
+	static placement placements[MOVEGEN_MAX_STATES];
+	uint32_t rng = seed ? seed : 1;
+	long paths = 0, path_failures = 0;
+	long locks = 0, lock_failures = 0;
+
+	// Every placement's path, played as button presses
+	for(int f=0; f<fields; f++){
+		tetris_row rows[TETRIS_ROWS];
+		random_field(rows, &rng);
+		for(color_id type=RED; type<=PURPLE; type++){
+			int count = movegen_placements(&gen, rows, type, placements);
+			for(int i=0; i<count; i++){
+				paths++;
+				if(!play_path(rows, type, &placements[i])){
+					if(path_failures++ < 10){
+						printf("path to placement %d of %c (x %d, y %d, rotation %d) on field %d doesn't end there\n",
+							i, " ZLOSIJT"[type], placements[i].piece.left_x, placements[i].piece.top_y,
+							placements[i].piece.orientation, f);
+					}
+				}
+			}
+		}
+	}
+
+	// Random button presses, gravity on: every lock has to be a known placement
+	for(int f=0; f<fields; f++){
+		tetris_game game;
+		int count = 0;
+
+		tetris_game_reset(&game, tetris_random(&rng));
+		random_field(game.rows, &rng);
+		game.line_clear_delay = 0;
+
+		for(int tick=0; tick<2000 && !game.loss; tick++){
+			uint32_t buttons = tetris_random(&rng) & (TETRIS_BTN_LEFT | TETRIS_BTN_RIGHT | TETRIS_BTN_SOFT_DROP
+				| TETRIS_BTN_ROTATE_CW | TETRIS_BTN_ROTATE_CCW | TETRIS_BTN_HOLD);
+			if(tetris_random(&rng) % 64 == 0){
+				buttons |= TETRIS_BTN_HARD_DROP;
+			}
+			tetris_row before[TETRIS_ROWS];
+			memcpy(before, game.rows, sizeof(before));
+
+			int events = tetris_game_tick(&game, buttons);
+
+			if(events & TETRIS_EVENT_HOLD){
+				// The other tetromino came in at its spawn position and may have moved and
+				// locked in the same frame, so search the field from before the frame
+				count = movegen_placements(&gen, before, game.active.type, placements);
+			}
+			if(events & TETRIS_EVENT_LOCK){
+				locks++;
+				if(!known_placement(placements, count, &game.active) && lock_failures++ < 10){
+					printf("random play locked %c at x %d, y %d, rotation %d, not a known placement\n",
+						" ZLOSIJT"[game.active.type], game.active.left_x, game.active.top_y, game.active.orientation);
+				}
+			}
+			if(events & TETRIS_EVENT_SPAWN){
+				// A new tetromino at its spawn position, on the field as it is now
+				count = movegen_placements(&gen, game.rows, game.active.type, placements);
+			}
+		}
+	}
+
+	printf("%ld paths played, %ld wrong; %ld random locks, %ld unknown\n", paths, path_failures, locks, lock_failures);
+	return path_failures || lock_failures;
+}
+
+/**************************************** bench ****************************************/
+
+#define BENCH_FIELDS 64
+
+static int bench(int calls, uint32_t seed){
+	static placement placements[MOVEGEN_MAX_STATES];
+	static tetris_row fields[BENCH_FIELDS][TETRIS_ROWS];
+	uint32_t rng = seed ? seed : 1;
+	uint64_t total = 0;
+
+	for(int i=0; i<BENCH_FIELDS; i++){
+		random_field(fields[i], &rng);
+	}
+	gen.states_searched = 0;
+
+	double start = now_seconds();
+	for(int i=0; i<calls; i++){
+		total += movegen_placements(&gen, fields[i % BENCH_FIELDS], RED + i % 7, placements);
+	}
+	double seconds = now_seconds() - start;
+
+	printf("%d calls in %.3f s: %.2f us per call, %.1f placements and %.1f states per call\n",
+		calls, seconds, seconds / calls * 1e6, (double)total / calls, (double)gen.states_searched / calls);
+	return 0;
+}
+
+int main(int argc, char ** argv){
+	if(argc < 2){
+		fprintf(stderr, "usage: perft_tool perft|verify|bench ...\n");
+		return 1;
+	}
+	tetris_init();
+	movegen_init(&gen);
+
+	const char * command = argv[1];
+
+	if(!strcmp(command, "perft") && argc > 2){
+		uint32_t seed = argc > 3 ? strtoul(argv[3], NULL, 0) : 12345;
+		return run_perft(atoi(argv[2]), seed, argc > 4 && atoi(argv[4]));
+	}
+	if(!strcmp(command, "verify")){
+		uint32_t seed = argc > 3 ? strtoul(argv[3], NULL, 0) : 12345;
+		return verify(argc > 2 ? atoi(argv[2]) : 50, seed);
+	}
+	if(!strcmp(command, "bench")){
+		uint32_t seed = argc > 3 ? strtoul(argv[3], NULL, 0) : 12345;
+		return bench(argc > 2 ? atoi(argv[2]) : 100000, seed);
+	}
+
+	fprintf(stderr, "unknown command %s\n", command);
+	return 1;
+}
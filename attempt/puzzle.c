@@ -0,0 +1,219 @@
+// Puzzle packs. See puzzle.h.
+
+#include <string.h>
+
+#include "puzzle.h"
+
+#ifdef _arch_dreamcast
+#include <kos.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define PUZZLE_MAGIC 0x4c5a5054 // "TPZL"
+
+#define FIELD_OFFSET 0
+#define GOAL_OFFSET 40
+#define PIECES_OFFSET 44
+#define NAME_OFFSET 60
+
+static inline void put_u16(uint8_t * p, uint32_t v){
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static inline void put_u32(uint8_t * p, uint32_t v){
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static inline uint32_t get_u16(const uint8_t * p){
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t get_u32(const uint8_t * p){
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**************************************** packs ****************************************/
+
+int puzzle_pack_open(puzzle_pack * pack, const uint8_t * data, size_t size){
+	memset(pack, 0, sizeof(*pack));
+	if(!PUZZLE_FITS_FIELD){
+		return 0; // the fields in the records are a different size from this build's
+	}
+	if(size < PUZZLE_HEADER_SIZE || get_u32(data) != PUZZLE_MAGIC || get_u16(data+4) != PUZZLE_VERSION){
+		return 0;
+	}
+	uint32_t record_size = get_u16(data+6);
+	uint32_t count = get_u32(data+8);
+	uint32_t records_offset = get_u32(data+12);
+
+	// Newer packs can have longer records, the start of each one still reads the same
+	if(record_size < PUZZLE_RECORD_SIZE || records_offset > size
+		|| (uint64_t)count * record_size > size - records_offset){
+		return 0;
+	}
+	pack->data = data;
+	pack->size = size;
+	pack->count = count;
+	pack->record_size = record_size;
+	pack->records = data + records_offset;
+	return 1;
+}
+
+#ifdef _arch_dreamcast
+int puzzle_pack_map(puzzle_pack * pack, const char * path){
+	memset(pack, 0, sizeof(*pack));
+	file_t file = fs_open(path, O_RDONLY);
+	if(file < 0){
+		return 0;
+	}
+	// On the romdisk this is a pointer into the romdisk image itself, nothing gets copied.
+	// It stays valid after closing the file.
+	size_t size = fs_total(file);
+	const uint8_t * data = fs_mmap(file);
+	fs_close(file);
+	return data && puzzle_pack_open(pack, data, size);
+}
+#else
+int puzzle_pack_map(puzzle_pack * pack, const char * path){
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+
+	memset(pack, 0, sizeof(*pack));
+	if(fd < 0){
+		return 0;
+	}
+	if(fstat(fd, &st) || st.st_size == 0){
+		close(fd);
+		return 0;
+	}
+	void * mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // the mapping stays valid
+	if(mapping == MAP_FAILED){
+		return 0;
+	}
+
+	if(!puzzle_pack_open(pack, mapping, st.st_size)){
+		munmap(mapping, st.st_size);
+		return 0;
+	}
+	pack->mapping = mapping;
+	pack->mapping_size = st.st_size;
+	return 1;
+}
+#endif
+
+void puzzle_pack_close(puzzle_pack * pack){
+#ifndef _arch_dreamcast
+	if(pack->mapping){
+		munmap(pack->mapping, pack->mapping_size);
+	}
+#endif
+	memset(pack, 0, sizeof(*pack));
+}
+
+const uint8_t * puzzle_get(const puzzle_pack * pack, uint32_t index){
+	if(index >= pack->count){
+		return NULL;
+	}
+	return pack->records + (size_t)index * pack->record_size;
+}
+
+/**************************************** records ****************************************/
+
+puzzle_goal puzzle_goal_of(const uint8_t * record){
+	return (puzzle_goal)record[GOAL_OFFSET];
+}
+
+int puzzle_goal_lines(const uint8_t * record){
+	return record[GOAL_OFFSET+1];
+}
+
+int puzzle_piece_count(const uint8_t * record){
+	int count = record[GOAL_OFFSET+2];
+	return count > TETRIS_SEQUENCE_MAX ? TETRIS_SEQUENCE_MAX : count;
+}
+
+void puzzle_name(const uint8_t * record, char out[PUZZLE_NAME_LENGTH+1]){
+	memcpy(out, record + NAME_OFFSET, PUZZLE_NAME_LENGTH);
+	out[PUZZLE_NAME_LENGTH] = 0;
+}
+
+void puzzle_start(const uint8_t * record, tetris_game * game, uint32_t seed){
+	uint8_t pieces[TETRIS_SEQUENCE_MAX];
+	int count = puzzle_piece_count(record);
+
+	tetris_game_reset(game, seed);
+
+	for(int i=0; i<PUZZLE_FIELD_ROWS; i++){
+		int row = PUZZLE_FIRST_ROW + i;
+		tetris_row cells = get_u16(record + FIELD_OFFSET + i*2) & ~TETRIS_EMPTY_ROW;
+		game->rows[row] = TETRIS_EMPTY_ROW | cells;
+		for(int col=TETRIS_LEFT_COL; col<=TETRIS_RIGHT_COL; col++){
+			game->colors[row][col] = (cells & (1 << col)) ? GARBAGE : EMPTY;
+		}
+	}
+
+	for(int i=0; i<count; i++){
+		uint8_t type = (record[PIECES_OFFSET + i/2] >> ((i & 1) * 4)) & 0xf;
+		pieces[i] = (type >= RED && type <= PURPLE) ? type : PURPLE;
+	}
+	tetris_game_set_sequence(game, pieces, count);
+}
+
+puzzle_status puzzle_check(const uint8_t * record, const tetris_game * game){
+	if(puzzle_goal_of(record) == PUZZLE_GOAL_PERFECT_CLEAR){
+		// Only counts once the cleared rows are actually gone and nothing is falling
+		if(game->phase == PHASE_SPAWN && game->line_clears > 0){
+			int empty = 1;
+			for(int row=TETRIS_FIRST_ROW; row<=TETRIS_BOTTOM_ROW; row++){
+				empty &= (game->rows[row] == TETRIS_EMPTY_ROW);
+			}
+			if(empty){
+				return PUZZLE_SOLVED;
+			}
+		}
+	}
+	else if(game->line_clears >= puzzle_goal_lines(record)){
+		return PUZZLE_SOLVED;
+	}
+	return game->loss ? PUZZLE_FAILED : PUZZLE_PLAYING;
+}
+
+/**************************************** building ****************************************/
+
+void puzzle_build_record(uint8_t * out, const tetris_row * field, puzzle_goal goal, int goal_lines,
+	const uint8_t * pieces, int piece_count, const char * name){
+	memset(out, 0, PUZZLE_RECORD_SIZE);
+
+	for(int i=0; i<PUZZLE_FIELD_ROWS; i++){
+		put_u16(out + FIELD_OFFSET + i*2, field[i] & ~TETRIS_EMPTY_ROW);
+	}
+	if(piece_count > TETRIS_SEQUENCE_MAX){
+		piece_count = TETRIS_SEQUENCE_MAX;
+	}
+	out[GOAL_OFFSET] = goal;
+	out[GOAL_OFFSET+1] = goal_lines;
+	out[GOAL_OFFSET+2] = piece_count;
+	for(int i=0; i<piece_count; i++){
+		out[PIECES_OFFSET + i/2] |= (pieces[i] & 0xf) << ((i & 1) * 4);
+	}
+	if(name){
+		strncpy((char *)out + NAME_OFFSET, name, PUZZLE_NAME_LENGTH);
+	}
+}
+
+void puzzle_build_header(uint8_t * out, uint32_t count){
+	put_u32(out, PUZZLE_MAGIC);
+	put_u16(out+4, PUZZLE_VERSION);
+	put_u16(out+6, PUZZLE_RECORD_SIZE);
+	put_u32(out+8, count);
+	put_u32(out+12, PUZZLE_HEADER_SIZE);
+}
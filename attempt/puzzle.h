@@ -0,0 +1,90 @@
+// Puzzle packs: preset fields with a fixed list of tetrominos and a goal.
+//
+// A pack is one binary file, built on a PC by puzzle_tool from a text description.
+// It's made to be used straight from wherever it's already sitting in memory (the
+// romdisk on the Dreamcast, an mmap on a PC). Opening one only checks the header, and
+// nothing is parsed or allocated up front. Every puzzle is a fixed-size record, so
+// puzzle number i is always at records_offset + i*record_size, however many there are.
+//
+// File layout (everything little endian):
+//
+//   header   16 bytes: "TPZL", version (u16), record size (u16), puzzle count (u32),
+//            offset of the first record (u32)
+//   records  PUZZLE_RECORD_SIZE bytes each:
+//              0  field: 20 rows (top first) of u16, bit c set = column c filled
+//                 (columns 1 to 10, the same bits as a tetris_row without the border)
+//             40  goal (puzzle_goal), goal lines, tetromino count, unused
+//             44  tetrominos: a color_id in every 4 bits, low nibble first
+//                 (TETRIS_SEQUENCE_MAX of them)
+//             60  name, 16 chars, zero padded (not necessarily zero terminated)
+//             76  unused
+//
+// Prefilled cells show up as garbage blocks. The field in a record is always 10 columns
+// by 20 rows and goes at the bottom of the game's field, so packs only open in builds
+// with the standard TETRIS_WIDTH and at least 20 visible rows.
+
+#ifndef PUZZLE_H
+#define PUZZLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tetris.h"
+
+#define PUZZLE_VERSION 1
+#define PUZZLE_HEADER_SIZE 16
+#define PUZZLE_RECORD_SIZE 80
+#define PUZZLE_FIELD_ROWS 20
+#define PUZZLE_FIELD_COLS 10
+#define PUZZLE_FITS_FIELD (TETRIS_WIDTH == PUZZLE_FIELD_COLS && TETRIS_VISIBLE_ROWS >= PUZZLE_FIELD_ROWS)
+#define PUZZLE_FIRST_ROW (TETRIS_BOTTOM_ROW - PUZZLE_FIELD_ROWS + 1) // where the record's top row goes
+#define PUZZLE_NAME_LENGTH 16
+
+typedef enum Puzzle_Goal {
+	PUZZLE_GOAL_LINES = 0, // clear goal_lines lines
+	PUZZLE_GOAL_PERFECT_CLEAR = 1 // empty the field completely
+} puzzle_goal;
+
+typedef enum Puzzle_Status {
+	PUZZLE_PLAYING,
+	PUZZLE_SOLVED,
+	PUZZLE_FAILED // topped out or ran out of tetrominos
+} puzzle_status;
+
+typedef struct Puzzle_Pack {
+	const uint8_t * data;
+	size_t size;
+	uint32_t count;
+	uint32_t record_size;
+	const uint8_t * records;
+
+	void * mapping; // set by puzzle_pack_map() on a PC
+	size_t mapping_size;
+} puzzle_pack;
+
+// Uses a pack that's already in memory (it has to outlive the pack). Returns 0 if it isn't one.
+int puzzle_pack_open(puzzle_pack * pack, const uint8_t * data, size_t size);
+// Maps a pack file: fs_mmap() on the Dreamcast (no copy for romdisk files), mmap() on a PC.
+int puzzle_pack_map(puzzle_pack * pack, const char * path);
+void puzzle_pack_close(puzzle_pack * pack);
+
+// Record of puzzle index, NULL if there's no such puzzle. Constant time.
+const uint8_t * puzzle_get(const puzzle_pack * pack, uint32_t index);
+
+puzzle_goal puzzle_goal_of(const uint8_t * record);
+int puzzle_goal_lines(const uint8_t * record);
+int puzzle_piece_count(const uint8_t * record);
+void puzzle_name(const uint8_t * record, char out[PUZZLE_NAME_LENGTH+1]);
+
+// Resets the game into the puzzle: its field, its tetrominos, level 1.
+void puzzle_start(const uint8_t * record, tetris_game * game, uint32_t seed);
+// Call after every tick.
+puzzle_status puzzle_check(const uint8_t * record, const tetris_game * game);
+
+// Writes a record, for puzzle_tool. pieces are color_ids, name can be NULL.
+void puzzle_build_record(uint8_t * out, const tetris_row * field, puzzle_goal goal, int goal_lines,
+	const uint8_t * pieces, int piece_count, const char * name);
+// Writes a header for count records that directly follow it.
+void puzzle_build_header(uint8_t * out, uint32_t count);
+
+#endif
@@ -0,0 +1,389 @@
+// Host tool for puzzle packs (puzzle.h).
+//
+//   puzzle_tool build puzzles.txt out.tpz
+//       compiles a text description (format below) into a pack
+//   puzzle_tool random out.tpz count [seed]
+//       makes count random garbage puzzles, keeping only the ones the bot from bot.c solves
+//   puzzle_tool info pack.tpz [index]
+//       lists the puzzles, or prints one of them
+//   puzzle_tool check pack.tpz
+//       lets the bot try every puzzle (the bot is no puzzle solver, a fail isn't proof)
+//   puzzle_tool bench pack.tpz [loads]
+//       times opening the pack and starting random puzzles from it
+//
+// Text format, one puzzle after the other:
+//
+//   # comments and blank lines are ignored
+//   puzzle First steps
+//   goal lines 1             (or: goal perfect)
+//   pieces ITO               (I O T S Z J L, up to TETRIS_SEQUENCE_MAX)
+//   |#########.|             field rows, '.' or ' ' is empty, anything else is filled.
+//   end                      the rows sit at the bottom of the field, top row first
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bot.h"
+#include "puzzle.h"
+
+static double now_seconds(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char piece_letters[] = " ZLOSIJT"; // indexed by color_id
+
+static int write_pack(const char * path, const uint8_t * records, uint32_t count){
+	uint8_t header[PUZZLE_HEADER_SIZE];
+	FILE * file = fopen(path, "wb");
+	if(!file){
+		fprintf(stderr, "can't create %s\n", path);
+		return 0;
+	}
+	puzzle_build_header(header, count);
+	int ok = fwrite(header, sizeof(header), 1, file) == 1
+		&& fwrite(records, PUZZLE_RECORD_SIZE, count, file) == count;
+	ok = (fclose(file) == 0) && ok;
+	if(!ok){
+		fprintf(stderr, "writing %s failed\n", path);
+	}
+	return ok;
+}
+
+/**************************************** build ****************************************/
+
+static int build(const char * source_path, const char * pack_path){
+	FILE * source = fopen(source_path, "r");
+	if(!source){
+		fprintf(stderr, "can't open %s\n", source_path);
+		return 1;
+	}
+
+	uint8_t * records = NULL;
+	uint32_t count = 0;
+	uint32_t capacity = 0;
+
+	char line[256];
+	int line_number = 0;
+	int in_puzzle = 0;
+	int errors = 0;
+
+	char name[PUZZLE_NAME_LENGTH+1];
+	puzzle_goal goal = PUZZLE_GOAL_LINES;
+	int goal_lines = 1;
+	uint8_t pieces[TETRIS_SEQUENCE_MAX];
+	int piece_count = 0;
+	tetris_row field_rows[PUZZLE_FIELD_ROWS];
+	int row_count = 0;
+
+	while(fgets(line, sizeof(line), source)){
+		line_number++;
+		line[strcspn(line, "\r\n")] = 0;
+		char * text = line + strspn(line, " \t");
+
+		if(!*text || *text == '#'){
+			continue;
+		}
+		if(!strncmp(text, "puzzle", 6)){
+			in_puzzle = 1;
+			snprintf(name, sizeof(name), "%s", text[6] ? text + 7 : "");
+			goal = PUZZLE_GOAL_LINES;
+			goal_lines = 1;
+			piece_count = 0;
+			row_count = 0;
+		}
+		else if(!in_puzzle){
+			fprintf(stderr, "%s:%d: expected \"puzzle\"\n", source_path, line_number);
+			errors++;
+		}
+		else if(!strncmp(text, "goal", 4)){
+			if(strstr(text, "perfect")){
+				goal = PUZZLE_GOAL_PERFECT_CLEAR;
+			}
+			else if(sscanf(text, "goal lines %d", &goal_lines) == 1 && goal_lines > 0 && goal_lines < 256){
+				goal = PUZZLE_GOAL_LINES;
+			}
+			else {
+				fprintf(stderr, "%s:%d: goal is \"lines N\" or \"perfect\"\n", source_path, line_number);
+				errors++;
+			}
+		}
+		else if(!strncmp(text, "pieces", 6)){
+			for(char * c = text + 6; *c; c++){
+				if(*c == ' ' || *c == '\t'){
+					continue;
+				}
+				const char * found = strchr(piece_letters, *c);
+				if(!found || piece_count == TETRIS_SEQUENCE_MAX){
+					fprintf(stderr, "%s:%d: bad piece '%c' (or more than %d)\n", source_path, line_number, *c, TETRIS_SEQUENCE_MAX);
+					errors++;
+					break;
+				}
+				pieces[piece_count++] = found - piece_letters;
+			}
+		}
+		else if(*text == '|'){
+			if(row_count == PUZZLE_FIELD_ROWS || strlen(text) < 12 || text[11] != '|'){
+				fprintf(stderr, "%s:%d: rows are |..........| and there are at most %d\n", source_path, line_number, PUZZLE_FIELD_ROWS);
+				errors++;
+				continue;
+			}
+			tetris_row row = 0;
+			for(int col=TETRIS_LEFT_COL; col<=TETRIS_RIGHT_COL; col++){
+				if(text[col] != '.' && text[col] != ' '){
+					row |= 1 << col;
+				}
+			}
+			field_rows[row_count++] = row;
+		}
+		else if(!strcmp(text, "end")){
+			if(!piece_count){
+				fprintf(stderr, "%s:%d: puzzle \"%s\" has no pieces\n", source_path, line_number, name);
+				errors++;
+			}
+			// bottom align the rows
+			tetris_row field[PUZZLE_FIELD_ROWS];
+			memset(field, 0, sizeof(field));
+			memcpy(field + PUZZLE_FIELD_ROWS - row_count, field_rows, row_count * sizeof(tetris_row));
+
+			if(count == capacity){
+				capacity = capacity ? capacity*2 : 64;
+				records = realloc(records, (size_t)capacity * PUZZLE_RECORD_SIZE);
+			}
+			puzzle_build_record(records + (size_t)count * PUZZLE_RECORD_SIZE, field, goal, goal_lines, pieces, piece_count, name);
+			count++;
+			in_puzzle = 0;
+		}
+		else {
+			fprintf(stderr, "%s:%d: don't know what \"%s\" is\n", source_path, line_number, text);
+			errors++;
+		}
+	}
+	fclose(source);
+
+	if(in_puzzle){
+		fprintf(stderr, "%s: the last puzzle has no \"end\"\n", source_path);
+		errors++;
+	}
+	if(errors){
+		free(records);
+		return 1;
+	}
+	int ok = write_pack(pack_path, records, count);
+	free(records);
+	if(ok){
+		printf("%u puzzles, %u bytes\n", count, PUZZLE_HEADER_SIZE + count * PUZZLE_RECORD_SIZE);
+	}
+	return !ok;
+}
+
+/**************************************** random ****************************************/
+
+static int bot_solves(const uint8_t * record){
+	tetris_game game;
+	bot brain;
+
+	puzzle_start(record, &game, 1);
+	bot_setup(&brain, 0);
+	for(int tick=0; tick<20000; tick++){
+		puzzle_status status = puzzle_check(record, &game);
+		if(status != PUZZLE_PLAYING){
+			return status == PUZZLE_SOLVED;
+		}
+		tetris_game_tick(&game, bot_buttons(&brain, &game));
+	}
+	return 0;
+}
+
+static int random_pack(const char * path, uint32_t count, uint32_t seed){
+	uint8_t * records = malloc((size_t)count * PUZZLE_RECORD_SIZE);
+	uint32_t made = 0;
+	uint32_t tried = 0;
+	uint32_t rng = seed ? seed : 1;
+
+	while(made < count){
+		// A few rows of garbage with one or two holes each, clear them all with a handful of pieces
+		tetris_row field[PUZZLE_FIELD_ROWS];
+		uint8_t pieces[TETRIS_SEQUENCE_MAX];
+		char name[32];
+		int garbage_rows = 1 + tetris_random(&rng) % 6;
+		int piece_count = 4 + garbage_rows * 2;
+
+		memset(field, 0, sizeof(field));
+		for(int i=0; i<garbage_rows; i++){
+			tetris_row row = TETRIS_FULL_ROW & ~TETRIS_EMPTY_ROW;
+			row &= ~(1 << (TETRIS_LEFT_COL + tetris_random(&rng) % PUZZLE_FIELD_COLS));
+			if(tetris_random(&rng) % 3 == 0){
+				row &= ~(1 << (TETRIS_LEFT_COL + tetris_random(&rng) % PUZZLE_FIELD_COLS));
+			}
+			field[PUZZLE_FIELD_ROWS-1-i] = row;
+		}
+		for(int i=0; i<piece_count; i++){
+			pieces[i] = tetris_random_type(&rng);
+		}
+		snprintf(name, sizeof(name), "Random %u", made+1);
+
+		uint8_t * record = records + (size_t)made * PUZZLE_RECORD_SIZE;
+		puzzle_build_record(record, field, PUZZLE_GOAL_LINES, garbage_rows, pieces, piece_count, name);
+		tried++;
+		if(bot_solves(record)){
+			made++;
+		}
+	}
+
+	int ok = write_pack(path, records, count);
+	free(records);
+	if(ok){
+		printf("%u puzzles (the bot solved %u of the %u it tried), %u bytes\n",
+			count, made, tried, PUZZLE_HEADER_SIZE + count * PUZZLE_RECORD_SIZE);
+	}
+	return !ok;
+}
+
+/**************************************** info / bench ****************************************/
+
+static void print_puzzle(const uint8_t * record, uint32_t index){
+	char name[PUZZLE_NAME_LENGTH+1];
+	tetris_game game;
+
+	puzzle_name(record, name);
+	puzzle_start(record, &game, 1);
+
+	printf("#%u \"%s\": ", index, name);
+	if(puzzle_goal_of(record) == PUZZLE_GOAL_PERFECT_CLEAR){
+		printf("perfect clear");
+	}
+	else {
+		printf("clear %d lines", puzzle_goal_lines(record));
+	}
+	printf(" with ");
+	for(int i=0; i<game.sequence_length; i++){
+		putchar(piece_letters[game.sequence[i]]);
+	}
+	putchar('\n');
+}
+
+static int info(const char * path, int index){
+	puzzle_pack pack;
+	if(!puzzle_pack_map(&pack, path)){
+		fprintf(stderr, "%s isn't a puzzle pack\n", path);
+		return 1;
+	}
+	printf("%s: %u puzzles, %u byte records\n", path, pack.count, pack.record_size);
+
+	if(index >= 0){
+		const uint8_t * record = puzzle_get(&pack, index);
+		if(!record){
+			fprintf(stderr, "there's no puzzle %d\n", index);
+			puzzle_pack_close(&pack);
+			return 1;
+		}
+		tetris_game game;
+		puzzle_start(record, &game, 1);
+		print_puzzle(record, index);
+		for(int row=TETRIS_TOP_ROW; row<=TETRIS_BOTTOM_ROW; row++){
+			putchar('|');
+			for(int col=TETRIS_LEFT_COL; col<=TETRIS_RIGHT_COL; col++){
+				putchar(game.colors[row][col] ? '#' : '.');
+			}
+			puts("|");
+		}
+	}
+	else {
+		for(uint32_t i=0; i<pack.count && i<50; i++){
+			print_puzzle(puzzle_get(&pack, i), i);
+		}
+		if(pack.count > 50){
+			printf("... and %u more\n", pack.count - 50);
+		}
+	}
+	puzzle_pack_close(&pack);
+	return 0;
+}
+
+static int check(const char * path){
+	puzzle_pack pack;
+	if(!puzzle_pack_map(&pack, path)){
+		fprintf(stderr, "%s isn't a puzzle pack\n", path);
+		return 1;
+	}
+	uint32_t solved = 0;
+	for(uint32_t i=0; i<pack.count; i++){
+		const uint8_t * record = puzzle_get(&pack, i);
+		if(bot_solves(record)){
+			solved++;
+		}
+		else if(pack.count <= 50){
+			printf("the bot can't solve ");
+			print_puzzle(record, i);
+		}
+	}
+	printf("the bot solved %u of %u puzzles\n", solved, pack.count);
+	puzzle_pack_close(&pack);
+	return 0;
+}
+
+static int bench(const char * path, int loads){
+	puzzle_pack pack;
+	tetris_game game;
+	uint32_t rng = 0xc0ffee;
+
+	double start = now_seconds();
+	if(!puzzle_pack_map(&pack, path)){
+		fprintf(stderr, "%s isn't a puzzle pack\n", path);
+		return 1;
+	}
+	double open_time = now_seconds() - start;
+	if(!pack.count){
+		fprintf(stderr, "%s is empty\n", path);
+		puzzle_pack_close(&pack);
+		return 1;
+	}
+
+	uint32_t checksum = 0;
+	start = now_seconds();
+	for(int i=0; i<loads; i++){
+		const uint8_t * record = puzzle_get(&pack, tetris_random(&rng) % pack.count);
+		puzzle_start(record, &game, i);
+		checksum += game.rows[TETRIS_BOTTOM_ROW] + game.queue[0];
+	}
+	double load_time = now_seconds() - start;
+
+	printf("%u puzzles: opening took %.1f us, starting a random puzzle %.3f us (checksum %u)\n",
+		pack.count, open_time * 1e6, load_time * 1e6 / loads, checksum);
+	puzzle_pack_close(&pack);
+	return 0;
+}
+
+int main(int argc, char ** argv){
+	if(argc < 3){
+		fprintf(stderr, "usage: puzzle_tool build|random|info|check|bench ...\n");
+		return 1;
+	}
+	tetris_init();
+
+	const char * command = argv[1];
+
+	if(!strcmp(command, "build") && argc > 3){
+		return build(argv[2], argv[3]);
+	}
+	if(!strcmp(command, "random") && argc > 3){
+		uint32_t seed = argc > 4 ? strtoul(argv[4], NULL, 0) : 12345;
+		return random_pack(argv[2], strtoul(argv[3], NULL, 0), seed);
+	}
+	if(!strcmp(command, "info")){
+		return info(argv[2], argc > 3 ? atoi(argv[3]) : -1);
+	}
+	if(!strcmp(command, "check")){
+		return check(argv[2]);
+	}
+	if(!strcmp(command, "bench")){
+		return bench(argv[2], argc > 3 ? atoi(argv[3]) : 100000);
+	}
+
+	fprintf(stderr, "unknown command %s\n", command);
+	return 1;
+}
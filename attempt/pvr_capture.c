@@ -0,0 +1,223 @@
+// PVR capture. See pvr_capture.h.
+//
+// Only exists in capture builds. The wrappers take the place of the KOS functions at link
+// time (__wrap_pvr_prim() gets every call to pvr_prim()) and hand each call on to the
+// real one (__real_pvr_prim()). kos.h isn't included here on purpose, the wrappers only
+// need to agree with the KOS functions on how they're called, not on their prototypes.
+
+#include "pvr_capture.h"
+
+#if PVR_CAPTURE
+
+#include <stdio.h>
+#include <string.h>
+
+#include "log.h"
+
+#define VRAM_64BIT 0xa5000000 // where textures are, pvr_mem_malloc() pointers point in here
+#define MAX_TEXTURES 32
+
+static FILE * file = NULL;
+static uint32_t frames_left;
+static uint32_t frame;
+static int in_scene;
+
+// The frame being captured, with room for its 'E' on the end even when it's full
+static uint8_t buffer[PVR_CAPTURE_BUFFER_SIZE + PVR_CAPTURE_RECORD_SIZE];
+static uint32_t used;
+static uint32_t prims_record; // offset of the last record if it's a 'P', so more prims can go into it
+static int prims_open;
+static int overflowed;
+
+static uint32_t textures[MAX_TEXTURES]; // VRAM offsets already written
+static int texture_count;
+
+static void put_u32(uint8_t * p, uint32_t v){
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static uint8_t * add_record(int tag, uint32_t size){
+	// Room for a record in the frame buffer, NULL if it's full
+	if(tag != 'E' && used + PVR_CAPTURE_RECORD_SIZE + size > PVR_CAPTURE_BUFFER_SIZE){
+		overflowed = 1;
+		return NULL;
+	}
+	uint8_t * p = buffer + used;
+	memset(p, 0, PVR_CAPTURE_RECORD_SIZE);
+	p[0] = tag;
+	put_u32(p+4, size);
+	used += PVR_CAPTURE_RECORD_SIZE + size;
+	prims_open = 0;
+	return p + PVR_CAPTURE_RECORD_SIZE;
+}
+
+static void write_record(int tag, const void * payload, uint32_t size){
+	// Straight to the file, for things that happen outside of frames
+	uint8_t header[PVR_CAPTURE_RECORD_SIZE] = { tag };
+	put_u32(header+4, size);
+	fwrite(header, 1, sizeof(header), file);
+	fwrite(payload, 1, size, file);
+}
+
+static void capture_texture(const uint32_t * hdr){
+	// The texture a header uses, once. Sizes and format are in mode2 and mode3 the way
+	// pvr_poly_compile() put them there.
+	uint32_t mode2 = hdr[2];
+	uint32_t mode3 = hdr[3];
+	uint32_t offset = (mode3 & 0x1fffff) << 3;
+	uint32_t width = 8 << ((mode2 >> 3) & 7);
+	uint32_t height = 8 << (mode2 & 7);
+	uint32_t format = (mode3 >> 27) & 7;
+
+	if(mode3 & (1u << 30)){
+		return; // VQ compressed, pvr_raster doesn't do those
+	}
+	uint32_t bytes = format == 5 ? width * height / 2 : format == 6 ? width * height : width * height * 2;
+
+	for(int i=0; i<texture_count; i++){
+		if(textures[i] == offset){
+			return;
+		}
+	}
+	if(texture_count == MAX_TEXTURES){
+		return;
+	}
+	textures[texture_count++] = offset;
+
+	uint8_t head[4];
+	put_u32(head, offset);
+	uint8_t header[PVR_CAPTURE_RECORD_SIZE] = { 'T' };
+	put_u32(header+4, 4 + bytes);
+	fwrite(header, 1, sizeof(header), file);
+	fwrite(head, 1, 4, file);
+	fwrite((const void *)(uintptr_t)(VRAM_64BIT + offset), 1, bytes, file);
+}
+
+int pvr_capture_open(const char * path, uint32_t frames){
+	uint8_t header[PVR_CAPTURE_HEADER_SIZE] = { 'T', 'P', 'V', 'C' };
+
+	pvr_capture_close();
+	file = fopen(path, "wb");
+	if(!file){
+		return 0;
+	}
+	header[4] = PVR_CAPTURE_VERSION;
+	header[6] = 640 & 0xff; header[7] = 640 >> 8;
+	header[8] = 480 & 0xff; header[9] = 480 >> 8;
+	fwrite(header, 1, sizeof(header), file);
+	frames_left = frames;
+	frame = 0;
+	texture_count = 0;
+	LOG_INFO("Capturing %u frames to %s", (unsigned)frames, path);
+	return 1;
+}
+
+void pvr_capture_close(){
+	if(file){
+		fclose(file);
+		file = NULL;
+		LOG_INFO("PVR capture done, %u frames", (unsigned)frame);
+	}
+}
+
+void pvr_capture_mark(const char * name){
+	if(!file || !in_scene){
+		return;
+	}
+	uint32_t length = strlen(name);
+	uint8_t * p = add_record('M', length);
+	if(p){
+		memcpy(p, name, length);
+	}
+}
+
+/**************************************** wrappers ****************************************/
+
+int __real_pvr_prim(void * data, int size);
+int __real_pvr_list_begin(uint32_t list);
+int __real_pvr_scene_begin(void);
+int __real_pvr_scene_finish(void);
+void __real_pvr_set_bg_color(float r, float g, float b);
+
+int __wrap_pvr_prim(void * data, int size){
+	if(file && in_scene && size > 0){
+		// Headers could be anywhere in it, look for textured ones
+		for(int i=0; i+32<=size; i+=32){
+			const uint32_t * word = (const uint32_t *)((const uint8_t *)data + i);
+			if((word[0] >> 29) == 4 && (word[0] & 8)){
+				capture_texture(word);
+			}
+		}
+
+		if(prims_open && used + size <= PVR_CAPTURE_BUFFER_SIZE){
+			// Goes on the end of the last 'P' record
+			memcpy(buffer + used, data, size);
+			used += size;
+			uint8_t * record = buffer + prims_record;
+			put_u32(record+4, used - prims_record - PVR_CAPTURE_RECORD_SIZE);
+		}
+		else {
+			uint32_t start = used;
+			uint8_t * p = add_record('P', size);
+			if(p){
+				memcpy(p, data, size);
+				prims_record = start;
+				prims_open = 1;
+			}
+		}
+	}
+	return __real_pvr_prim(data, size);
+}
+
+int __wrap_pvr_list_begin(uint32_t list){
+	if(file && in_scene){
+		uint8_t * p = add_record('L', 4);
+		if(p){
+			put_u32(p, list);
+		}
+	}
+	return __real_pvr_list_begin(list);
+}
+
+int __wrap_pvr_scene_begin(void){
+	if(file){
+		used = 0;
+		overflowed = 0;
+		prims_open = 0;
+		in_scene = 1;
+		uint8_t * p = add_record('F', 4);
+		put_u32(p, frame);
+	}
+	return __real_pvr_scene_begin();
+}
+
+int __wrap_pvr_scene_finish(void){
+	if(file && in_scene){
+		in_scene = 0;
+		if(overflowed){
+			// what fit is still written
+			LOG_WARN("PVR capture: frame %u didn't fit in %u bytes, the end is missing",
+				(unsigned)frame, (unsigned)PVR_CAPTURE_BUFFER_SIZE);
+		}
+		add_record('E', 0);
+		fwrite(buffer, 1, used, file);
+		frame++;
+		if(--frames_left == 0){
+			pvr_capture_close();
+		}
+	}
+	return __real_pvr_scene_finish();
+}
+
+void __wrap_pvr_set_bg_color(float r, float g, float b){
+	if(file){
+		float color[3] = { r, g, b };
+		write_record('B', color, sizeof(color));
+	}
+	__real_pvr_set_bg_color(r, g, b);
+}
+
+#endif
@@ -0,0 +1,61 @@
+// PVR capture: records everything a frame sends to the TA, so pvr_raster (a host tool,
+// see pvr_raster.c) can draw it on a PC and count how often each pixel got filled.
+//
+// In a capture build (make PVR_CAPTURE=1) the linker sends pvr_prim() and friends through
+// the wrappers in pvr_capture.c (--wrap, see PVR_CAPTURE_LDFLAGS in the Makefile), so
+// every header and vertex is seen, the ones plx sends for text included. Each frame is
+// collected in memory and written out when the scene is finished. Textures are read
+// back out of VRAM the first time a header uses them. pvr_capture_mark() names what's
+// being drawn ("grid", "blocks"...) so the fill rate can be split up by it.
+//
+// Capture builds send everything through pvr_prim() (USE_DR_RENDERING 0, the store
+// queue path can't be seen) and turn the frame cache off, so marks land where they were
+// drawn. Same headers and vertices either way, just in a slower build. Writing to /pc/
+// over dcload isn't fast either, capture builds don't keep 60 fps.
+//
+// File layout (little endian, like the SH4 writes it):
+//
+//   header     "TPVC", version, screen width and height
+//   records    tag, 3 bytes of 0, payload size, payload:
+//                'B' background color: 3 floats (pvr_set_bg_color())
+//                'F' a frame starts: its number
+//                'L' a list starts: its PVR_LIST_* type
+//                'M' mark: a name for what's drawn next
+//                'P' headers and vertices as they went to the TA, 32 bytes each
+//                'T' texture: VRAM offset, then the texture as it was in VRAM
+//                'E' the frame is done
+
+#ifndef PVR_CAPTURE_H
+#define PVR_CAPTURE_H
+
+#include <stdint.h>
+
+#ifndef PVR_CAPTURE
+#define PVR_CAPTURE 0
+#endif
+
+#define PVR_CAPTURE_VERSION 1
+#define PVR_CAPTURE_HEADER_SIZE 12
+#define PVR_CAPTURE_RECORD_SIZE 8 // before the payload
+
+#if PVR_CAPTURE
+
+// Most a frame can take, anything past it is left out (and logged)
+#ifndef PVR_CAPTURE_BUFFER_SIZE
+#define PVR_CAPTURE_BUFFER_SIZE (1024 * 1024)
+#endif
+
+// Starts capturing the next frames frames to path. Returns 0 if it can't be created.
+int pvr_capture_open(const char * path, uint32_t frames);
+void pvr_capture_close();
+void pvr_capture_mark(const char * name);
+
+#else
+
+#define pvr_capture_open(path, frames) 0
+#define pvr_capture_close() do {} while(0)
+#define pvr_capture_mark(name) do {} while(0)
+
+#endif
+
+#endif
@@ -0,0 +1,769 @@
+// Draws frames captured with a PVR_CAPTURE=1 build (see pvr_capture.h) on a PC, and counts
+// how many times each pixel got drawn.
+//
+// Usage: pvr_raster capture.tpc [output dir] [--every frames]
+//
+// Prints a line per frame: fragments per list, how much of the screen the translucent
+// list covers and the depth complexity (fragments per pixel, every list counted). At the
+// end the fragments are split up by the marks main.c put in (pvr_capture_mark()), with
+// how many were wasted: drawn, then drawn right over by an opaque one later. With an
+// output dir, every frames'th frame (60 by default) is written as frame_NNNNN.png and
+// as a heat map of its depth complexity, overdraw_NNNNN.png.
+//
+// It's a software rasterizer, not an emulator. Polygons are drawn list by list (opaque,
+// punch through, translucent) like the PVR does, with its depth compares, culling,
+// blend modes and texture environments, and point sampled 1555/565/4444 textures. The
+// translucent list is drawn in the order it was sent instead of sorted per pixel, which
+// is the same thing for this game's flat 2D stuff. Sprites, modifier volumes, paletted,
+// YUV and VQ textures aren't drawn, they're counted as skipped.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pvr_capture.h"
+
+#define WIDTH 640
+#define HEIGHT 480
+#define MAX_MARKS 64
+#define MAX_TEXTURES 64
+#define DEFAULT_EVERY 60
+
+// PVR_LIST_* and how far through a frame each one is drawn
+#define LIST_OP 0
+#define LIST_TR 2
+#define LIST_PT 4
+static const int list_order[3] = { LIST_OP, LIST_PT, LIST_TR };
+
+typedef struct Vertex {
+	float x, y, z;
+	float u, v;
+	float color[4]; // a, r, g, b from 0 to 1, the offset color already added
+} vertex;
+
+typedef struct Triangle {
+	vertex v[3];
+	int header; // into frame.headers
+	int list;
+	int mark;
+} triangle;
+
+typedef struct Texture {
+	uint32_t offset; // in VRAM, what headers point to
+	const uint8_t * data;
+	uint32_t size;
+} texture;
+
+typedef struct Mark {
+	char name[32];
+	uint64_t fragments;
+	uint64_t wasted;
+} mark;
+
+// Everything one frame sent, drawn at its 'E'
+static struct {
+	uint32_t number;
+	uint32_t (*headers)[8];
+	int header_count, header_space;
+	triangle * triangles;
+	int triangle_count, triangle_space;
+	int skipped; // sprites and other things it doesn't draw
+} frame;
+
+static texture textures[MAX_TEXTURES];
+static int texture_count;
+static mark marks[MAX_MARKS];
+static int mark_count;
+static float background[3];
+
+// The frame buffer, what the PVR's tile buffer would hold
+static float pixels[WIDTH * HEIGHT][3];
+static float depth[WIDTH * HEIGHT];
+static uint16_t complexity[WIDTH * HEIGHT]; // fragments per pixel
+static uint32_t last_opaque[WIDTH * HEIGHT]; // sequence number of the last fragment nothing shows through, 0 for none
+static uint8_t translucent[WIDTH * HEIGHT]; // the translucent list drew here
+static uint32_t sequence;
+static int pass; // 0 finds last_opaque, 1 draws and counts
+
+// What the last frame drew
+static struct {
+	uint64_t fragments[5]; // by PVR_LIST_*
+	uint32_t translucent_pixels;
+	uint32_t most; // depth complexity of the busiest pixel
+	uint64_t all;
+} stats;
+
+static uint32_t get_u32(const uint8_t * p){
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static float as_float(uint32_t bits){
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+static int find_mark(const char * name, int length){
+	// Index into marks, the same name always gets the same one
+	if(length >= (int)sizeof(marks[0].name)){
+		length = sizeof(marks[0].name) - 1;
+	}
+	for(int i=0; i<mark_count; i++){
+		if(!strncmp(marks[i].name, name, length) && !marks[i].name[length]){
+			return i;
+		}
+	}
+	if(mark_count == MAX_MARKS){
+		return 0;
+	}
+	memcpy(marks[mark_count].name, name, length);
+	marks[mark_count].name[length] = 0;
+	return mark_count++;
+}
+
+/**************************************** textures ****************************************/
+
+static uint32_t twiddled_index(uint32_t x, uint32_t y, uint32_t width, uint32_t height){
+	// Twiddled textures are in Morton order, v in the low bit of each pair. A texture
+	// that isn't square is squares of the smaller side one after another.
+	uint32_t side = width < height ? width : height;
+	uint32_t index = 0;
+	for(uint32_t bit=0; (1u << bit) < side; bit++){
+		index |= ((y >> bit) & 1) << (2*bit);
+		index |= ((x >> bit) & 1) << (2*bit + 1);
+	}
+	return index + (x / side + y / side) * side * side;
+}
+
+static const texture * find_texture(uint32_t offset){
+	for(int i=0; i<texture_count; i++){
+		if(textures[i].offset == offset){
+			return &textures[i];
+		}
+	}
+	return NULL;
+}
+
+static int texture_supported(const uint32_t * header){
+	uint32_t mode3 = header[3];
+	uint32_t format = (mode3 >> 27) & 7;
+	return format <= 2 && !(mode3 & (1u << 30)) && find_texture((mode3 & 0x1fffff) << 3);
+}
+
+static void sample(const uint32_t * header, float u, float v, float * out){
+	// Point sampled, wrapping unless the header clamps
+	uint32_t mode2 = header[2];
+	uint32_t mode3 = header[3];
+	int width = 8 << ((mode2 >> 3) & 7);
+	int height = 8 << (mode2 & 7);
+	const texture * tex = find_texture((mode3 & 0x1fffff) << 3);
+
+	int x = (int)floorf(u * width);
+	int y = (int)floorf(v * height);
+	if(mode2 & (1 << 16)){
+		x = x < 0 ? 0 : (x >= width ? width-1 : x);
+	}
+	if(mode2 & (1 << 15)){
+		y = y < 0 ? 0 : (y >= height ? height-1 : y);
+	}
+	x &= width - 1;
+	y &= height - 1;
+
+	uint32_t index = (mode3 & (1u << 26)) ? (uint32_t)(y * width + x) : twiddled_index(x, y, width, height);
+	if((index+1) * 2 > tex->size){
+		out[0] = out[1] = out[2] = out[3] = 1;
+		return;
+	}
+	uint32_t texel = tex->data[index*2] | tex->data[index*2+1] << 8;
+	switch((mode3 >> 27) & 7){
+	case 0: // ARGB1555
+		out[0] = texel >> 15;
+		out[1] = ((texel >> 10) & 31) / 31.0f;
+		out[2] = ((texel >> 5) & 31) / 31.0f;
+		out[3] = (texel & 31) / 31.0f;
+		break;
+	case 1: // RGB565
+		out[0] = 1;
+		out[1] = (texel >> 11) / 31.0f;
+		out[2] = ((texel >> 5) & 63) / 63.0f;
+		out[3] = (texel & 31) / 31.0f;
+		break;
+	default: // ARGB4444
+		out[0] = (texel >> 12) / 15.0f;
+		out[1] = ((texel >> 8) & 15) / 15.0f;
+		out[2] = ((texel >> 4) & 15) / 15.0f;
+		out[3] = (texel & 15) / 15.0f;
+		break;
+	}
+}
+
+/**************************************** drawing ****************************************/
+
+static int depth_passes(int compare, float z, float stored){
+	switch(compare){
+	case 0: return 0;
+	case 1: return z < stored;
+	case 2: return z == stored;
+	case 3: return z <= stored;
+	case 4: return z > stored;
+	case 5: return z != stored;
+	case 6: return z >= stored;
+	default: return 1;
+	}
+}
+
+static float blend_factor(int factor, float alpha, const float * other, int channel){
+	// alpha is the fragment's, other is the color on the other side of the blend (r g b).
+	// The frame buffer has no alpha, what's in it counts as opaque.
+	switch(factor){
+	case 0: return 0;
+	case 1: return 1;
+	case 2: return other[channel];
+	case 3: return 1 - other[channel];
+	case 4: return alpha;
+	case 5: return 1 - alpha;
+	case 6: return 1;
+	default: return 0;
+	}
+}
+
+static void shade(const triangle * t, const float * weights, float z, float * out){
+	// The fragment's color, a r g b: Gouraud (or the last vertex's color), then the texture
+	const uint32_t * header = frame.headers[t->header];
+	uint32_t cmd = header[0];
+	uint32_t mode2 = header[2];
+
+	if(cmd & 2){
+		for(int c=0; c<4; c++){
+			out[c] = weights[0]*t->v[0].color[c] + weights[1]*t->v[1].color[c] + weights[2]*t->v[2].color[c];
+		}
+	}
+	else {
+		memcpy(out, t->v[2].color, sizeof(t->v[2].color));
+	}
+	if(!(mode2 & (1 << 20))){
+		out[0] = 1; // alpha is off
+	}
+
+	if(!(cmd & 8) || !texture_supported(header)){
+		return;
+	}
+	// u and v are perspective correct, z is 1/w
+	float u = 0, v = 0;
+	for(int i=0; i<3; i++){
+		u += weights[i] * t->v[i].u * t->v[i].z;
+		v += weights[i] * t->v[i].v * t->v[i].z;
+	}
+	float texel[4];
+	sample(header, u / z, v / z, texel);
+	if(mode2 & (1 << 19)){
+		texel[0] = 1; // texture alpha ignored
+	}
+
+	switch((mode2 >> 6) & 3){
+	case 0: // replace
+		memcpy(out, texel, sizeof(texel));
+		break;
+	case 1: // modulate
+		out[0] = texel[0];
+		for(int c=1; c<4; c++) out[c] *= texel[c];
+		break;
+	case 2: // decal
+		for(int c=1; c<4; c++) out[c] = texel[c]*texel[0] + out[c]*(1 - texel[0]);
+		break;
+	default: // modulate alpha
+		for(int c=0; c<4; c++) out[c] *= texel[c];
+		break;
+	}
+}
+
+static float edge(const vertex * p, const vertex * q, float x, float y){
+	return (q->x - p->x) * (y - p->y) - (q->y - p->y) * (x - p->x);
+}
+
+static int owns_edge(const vertex * p, const vertex * q){
+	// Top left rule: a pixel center right on an edge two triangles share goes to one of them
+	float dy = q->y - p->y;
+	return dy > 0 || (dy == 0 && q->x < p->x);
+}
+
+static void draw_triangle(const triangle * t){
+	const uint32_t * header = frame.headers[t->header];
+	uint32_t mode1 = header[1];
+	uint32_t mode2 = header[2];
+	const vertex * a = &t->v[0];
+	const vertex * b = &t->v[1];
+	const vertex * c = &t->v[2];
+
+	float area = edge(a, b, c->x, c->y);
+	if(area == 0){
+		return;
+	}
+	// positive is clockwise on screen (y goes down)
+	int culling = (mode1 >> 27) & 3;
+	if((culling == 2 && area < 0) || (culling == 3 && area > 0) || (culling == 1 && fabsf(area) < 0.01f)){
+		return;
+	}
+	int order[3] = { 0, 1, 2 }; // b and c swapped if it's counter clockwise, so area is positive
+	if(area < 0){
+		const vertex * swap = b; b = c; c = swap;
+		order[1] = 2; order[2] = 1;
+		area = -area;
+	}
+	int owns[3] = { owns_edge(b, c), owns_edge(c, a), owns_edge(a, b) };
+
+	float low_x = fminf(a->x, fminf(b->x, c->x)), high_x = fmaxf(a->x, fmaxf(b->x, c->x));
+	float low_y = fminf(a->y, fminf(b->y, c->y)), high_y = fmaxf(a->y, fmaxf(b->y, c->y));
+	int x0 = low_x < 0 ? 0 : (int)low_x;
+	int y0 = low_y < 0 ? 0 : (int)low_y;
+	int x1 = high_x >= WIDTH ? WIDTH-1 : (int)high_x;
+	int y1 = high_y >= HEIGHT ? HEIGHT-1 : (int)high_y;
+
+	int compare = (mode1 >> 29) & 7;
+	int write_depth = !(mode1 & (1 << 26)) && t->list != LIST_TR;
+	int src_factor = (mode2 >> 29) & 7;
+	int dst_factor = (mode2 >> 26) & 7;
+
+	for(int y=y0; y<=y1; y++){
+		for(int x=x0; x<=x1; x++){
+			float px = x + 0.5f, py = y + 0.5f;
+			float e[3] = { edge(b, c, px, py), edge(c, a, px, py), edge(a, b, px, py) };
+			if(e[0] < 0 || e[1] < 0 || e[2] < 0
+				|| (e[0] == 0 && !owns[0]) || (e[1] == 0 && !owns[1]) || (e[2] == 0 && !owns[2])){
+				continue;
+			}
+			float weights[3];
+			for(int i=0; i<3; i++){
+				weights[order[i]] = e[i] / area;
+			}
+			float z = weights[0]*t->v[0].z + weights[1]*t->v[1].z + weights[2]*t->v[2].z;
+			int p = y * WIDTH + x;
+			if(!depth_passes(compare, z, depth[p])){
+				continue;
+			}
+
+			float color[4];
+			shade(t, weights, z, color);
+			if(t->list == LIST_PT && color[0] <= 0){
+				continue; // punched through
+			}
+			if(write_depth){
+				depth[p] = z;
+			}
+
+			// Nothing shows through it if the blend leaves none of what was there
+			uint32_t seq = ++sequence;
+			int opaque = t->list != LIST_TR || dst_factor == 0
+				|| (dst_factor == 5 && color[0] >= 1) || (dst_factor == 4 && color[0] <= 0);
+			if(pass == 0){
+				if(opaque){
+					last_opaque[p] = seq;
+				}
+				continue;
+			}
+
+			complexity[p]++;
+			stats.fragments[t->list]++;
+			if(t->list == LIST_TR && !translucent[p]){
+				translucent[p] = 1;
+				stats.translucent_pixels++;
+			}
+			marks[t->mark].fragments++;
+			marks[t->mark].wasted += seq < last_opaque[p];
+			if(t->list != LIST_TR){
+				memcpy(pixels[p], color+1, sizeof(pixels[p]));
+				continue;
+			}
+			float result[3];
+			for(int ch=0; ch<3; ch++){
+				result[ch] = color[ch+1] * blend_factor(src_factor, color[0], pixels[p], ch)
+					+ pixels[p][ch] * blend_factor(dst_factor, color[0], color+1, ch);
+			}
+			for(int ch=0; ch<3; ch++){
+				pixels[p][ch] = result[ch] < 0 ? 0 : (result[ch] > 1 ? 1 : result[ch]);
+			}
+		}
+	}
+}
+
+static void render(){
+	// Both passes go through the fragments in the same order, so their sequence numbers agree
+	memset(&stats, 0, sizeof(stats));
+	memset(last_opaque, 0, sizeof(last_opaque));
+	memset(translucent, 0, sizeof(translucent));
+	for(pass=0; pass<2; pass++){
+		sequence = 0;
+		for(int p=0; p<WIDTH*HEIGHT; p++){
+			memcpy(pixels[p], background, sizeof(background));
+			depth[p] = 0;
+			complexity[p] = 0;
+		}
+		for(int l=0; l<3; l++){
+			for(int i=0; i<frame.triangle_count; i++){
+				if(frame.triangles[i].list == list_order[l]){
+					draw_triangle(&frame.triangles[i]);
+				}
+			}
+		}
+	}
+	for(int p=0; p<WIDTH*HEIGHT; p++){
+		stats.all += complexity[p];
+		if(complexity[p] > stats.most){
+			stats.most = complexity[p];
+		}
+	}
+}
+
+/**************************************** reading ****************************************/
+
+static void read_vertex(const uint32_t * word, uint32_t cmd, vertex * out){
+	out->x = as_float(word[1]);
+	out->y = as_float(word[2]);
+	out->z = as_float(word[3]);
+	if(cmd & 1){
+		// 16 bit u and v, the top halves of the floats
+		out->u = as_float(word[4] & 0xffff0000);
+		out->v = as_float(word[4] << 16);
+	}
+	else {
+		out->u = as_float(word[4]);
+		out->v = as_float(word[5]);
+	}
+	uint32_t argb = word[6];
+	uint32_t oargb = (cmd & 4) ? word[7] : 0;
+	out->color[0] = (argb >> 24) / 255.0f;
+	for(int c=1; c<4; c++){
+		int shift = 24 - 8*c;
+		float value = ((argb >> shift) & 255) / 255.0f + ((oargb >> shift) & 255) / 255.0f;
+		out->color[c] = value > 1 ? 1 : value;
+	}
+}
+
+static void read_prims(const uint8_t * data, uint32_t size, int list, int current_mark){
+	// Headers and vertices: strips become triangles under the last header
+	static vertex strip[2];
+	static int strip_length;
+	static int header = -1;
+	static int sprite;
+
+	if(size == 0){
+		// a new frame
+		strip_length = 0;
+		header = -1;
+		sprite = 0;
+		return;
+	}
+	for(uint32_t i=0; i+32<=size; i+=32){
+		const uint32_t * word = (const uint32_t *)(data + i);
+		uint32_t type = word[0] >> 29;
+
+		if(type == 4 || type == 5){
+			if(frame.header_count == frame.header_space){
+				frame.header_space = frame.header_space ? frame.header_space*2 : 256;
+				frame.headers = realloc(frame.headers, frame.header_space * sizeof(*frame.headers));
+			}
+			memcpy(frame.headers[frame.header_count], word, 32);
+			header = frame.header_count++;
+			sprite = (type == 5);
+			strip_length = 0;
+			if(((word[0] >> 4) & 3) != 0){
+				sprite = 1; // float or intensity colors, not drawn
+			}
+		}
+		else if(type == 7){
+			if(sprite){
+				// sprite vertices are 64 bytes
+				frame.skipped++;
+				i += 32;
+				continue;
+			}
+			if(header < 0 || (list != LIST_OP && list != LIST_TR && list != LIST_PT)){
+				frame.skipped++;
+				continue;
+			}
+			vertex v;
+			read_vertex(word, frame.headers[header][0], &v);
+			if(strip_length >= 2){
+				if(frame.triangle_count == frame.triangle_space){
+					frame.triangle_space = frame.triangle_space ? frame.triangle_space*2 : 4096;
+					frame.triangles = realloc(frame.triangles, frame.triangle_space * sizeof(*frame.triangles));
+				}
+				triangle * t = &frame.triangles[frame.triangle_count++];
+				// Every other triangle in a strip is wound the other way, put it back
+				int odd = strip_length & 1;
+				t->v[0] = strip[odd ? 1 : 0];
+				t->v[1] = strip[odd ? 0 : 1];
+				t->v[2] = v;
+				t->header = header;
+				t->list = list;
+				t->mark = current_mark;
+			}
+			if(strip_length >= 2){
+				strip[0] = strip[1];
+				strip[1] = v;
+			}
+			else {
+				strip[strip_length] = v;
+			}
+			strip_length++;
+			if(word[0] & (1 << 28)){
+				strip_length = 0; // end of strip
+			}
+		}
+	}
+}
+
+/**************************************** output ****************************************/
+
+static uint32_t crc_table[256];
+
+static uint32_t crc32(uint32_t crc, const uint8_t * data, size_t size){
+	if(!crc_table[1]){
+		for(uint32_t n=0; n<256; n++){
+			uint32_t c = n;
+			for(int k=0; k<8; k++){
+				c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			}
+			crc_table[n] = c;
+		}
+	}
+	crc = ~crc;
+	for(size_t i=0; i<size; i++){
+		crc = crc_table[(crc ^ data[i]) & 255] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static void put_u32_be(uint8_t * p, uint32_t v){
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static void write_chunk(FILE * out, const char * type, const uint8_t * data, uint32_t size){
+	uint8_t head[8];
+	put_u32_be(head, size);
+	memcpy(head+4, type, 4);
+	fwrite(head, 1, 8, out);
+	fwrite(data, 1, size, out);
+	uint8_t crc[4];
+	put_u32_be(crc, crc32(crc32(0, head+4, 4), data, size));
+	fwrite(crc, 1, 4, out);
+}
+
+static int write_png(const char * path, const uint8_t * rgb){
+	// 8 bit RGB, deflate without compression: big files, but no zlib needed
+	FILE * out = fopen(path, "wb");
+	if(!out){
+		return 0;
+	}
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+	fwrite(signature, 1, 8, out);
+
+	uint8_t ihdr[13] = { 0 };
+	put_u32_be(ihdr, WIDTH);
+	put_u32_be(ihdr+4, HEIGHT);
+	ihdr[8] = 8; // bits per channel
+	ihdr[9] = 2; // RGB
+	write_chunk(out, "IHDR", ihdr, sizeof(ihdr));
+
+	// Rows with a filter byte of 0 in front, in stored deflate blocks
+	size_t raw_size = (size_t)HEIGHT * (WIDTH*3 + 1);
+	uint8_t * raw = malloc(raw_size);
+	for(int y=0; y<HEIGHT; y++){
+		raw[y * (WIDTH*3 + 1)] = 0;
+		memcpy(raw + y * (WIDTH*3 + 1) + 1, rgb + y * WIDTH*3, WIDTH*3);
+	}
+	size_t blocks = (raw_size + 65534) / 65535;
+	uint8_t * zlib = malloc(2 + raw_size + blocks*5 + 4);
+	size_t at = 0;
+	zlib[at++] = 0x78;
+	zlib[at++] = 0x01;
+	for(size_t done=0; done<raw_size; ){
+		size_t length = raw_size - done > 65535 ? 65535 : raw_size - done;
+		zlib[at++] = done + length == raw_size; // last block
+		zlib[at++] = length;
+		zlib[at++] = length >> 8;
+		zlib[at++] = ~length;
+		zlib[at++] = ~length >> 8;
+		memcpy(zlib + at, raw + done, length);
+		at += length;
+		done += length;
+	}
+	uint32_t s1 = 1, s2 = 0;
+	for(size_t i=0; i<raw_size; i++){
+		s1 = (s1 + raw[i]) % 65521;
+		s2 = (s2 + s1) % 65521;
+	}
+	put_u32_be(zlib + at, s2 << 16 | s1);
+	at += 4;
+	write_chunk(out, "IDAT", zlib, at);
+	write_chunk(out, "IEND", NULL, 0);
+
+	free(zlib);
+	free(raw);
+	return fclose(out) == 0;
+}
+
+static int write_images(const char * dir){
+	static uint8_t rgb[WIDTH * HEIGHT * 3];
+	// Heat map: black for nothing, then blue, green, yellow, red and white from 5 up
+	static const uint8_t heat[6][3] = {
+		{ 0, 0, 0 }, { 0, 0, 255 }, { 0, 200, 0 }, { 255, 255, 0 }, { 255, 0, 0 }, { 255, 255, 255 }
+	};
+	char path[512];
+
+	for(int p=0; p<WIDTH*HEIGHT; p++){
+		for(int c=0; c<3; c++){
+			rgb[p*3+c] = (uint8_t)(pixels[p][c] * 255 + 0.5f);
+		}
+	}
+	snprintf(path, sizeof(path), "%s/frame_%05u.png", dir, (unsigned)frame.number);
+	if(!write_png(path, rgb)){
+		return 0;
+	}
+
+	for(int p=0; p<WIDTH*HEIGHT; p++){
+		memcpy(rgb + p*3, heat[complexity[p] > 5 ? 5 : complexity[p]], 3);
+	}
+	snprintf(path, sizeof(path), "%s/overdraw_%05u.png", dir, (unsigned)frame.number);
+	return write_png(path, rgb);
+}
+
+/**************************************** main ****************************************/
+
+int main(int argc, char ** argv){
+	const char * path = NULL;
+	const char * dir = NULL;
+	int every = DEFAULT_EVERY;
+
+	for(int i=1; i<argc; i++){
+		if(!strcmp(argv[i], "--every") && i+1 < argc){
+			every = atoi(argv[++i]);
+		}
+		else if(!path){
+			path = argv[i];
+		}
+		else if(!dir){
+			dir = argv[i];
+		}
+		else {
+			path = NULL;
+			break;
+		}
+	}
+	if(!path || every < 1){
+		fprintf(stderr, "usage: pvr_raster capture.tpc [output dir] [--every frames]\n");
+		return 1;
+	}
+
+	FILE * in = fopen(path, "rb");
+	if(!in){
+		fprintf(stderr, "can't open %s\n", path);
+		return 1;
+	}
+	fseek(in, 0, SEEK_END);
+	long size = ftell(in);
+	fseek(in, 0, SEEK_SET);
+	uint8_t * data = malloc(size > 0 ? size : 1);
+	if(size < PVR_CAPTURE_HEADER_SIZE || fread(data, 1, size, in) != (size_t)size
+		|| memcmp(data, "TPVC", 4) || data[4] != PVR_CAPTURE_VERSION){
+		fprintf(stderr, "%s isn't a version %d capture\n", path, PVR_CAPTURE_VERSION);
+		return 1;
+	}
+	fclose(in);
+	if((data[6] | data[7] << 8) != WIDTH || (data[8] | data[9] << 8) != HEIGHT){
+		fprintf(stderr, "%s isn't %dx%d\n", path, WIDTH, HEIGHT);
+		return 1;
+	}
+
+	int list = LIST_OP;
+	int current_mark = find_mark("(no mark)", 9);
+	int frames = 0;
+	double complexity_total = 0;
+	uint32_t most = 0;
+
+	long at = PVR_CAPTURE_HEADER_SIZE;
+	while(at + PVR_CAPTURE_RECORD_SIZE <= size){
+		int tag = data[at];
+		uint32_t length = get_u32(data + at + 4);
+		const uint8_t * payload = data + at + PVR_CAPTURE_RECORD_SIZE;
+		at += PVR_CAPTURE_RECORD_SIZE;
+		if(length > size - at){
+			fprintf(stderr, "%s is cut short\n", path);
+			break;
+		}
+		at += length;
+
+		switch(tag){
+		case 'B':
+			if(length == 12){
+				memcpy(background, payload, sizeof(background));
+			}
+			break;
+		case 'T':
+			if(length >= 4 && texture_count < MAX_TEXTURES){
+				textures[texture_count].offset = get_u32(payload);
+				textures[texture_count].data = payload + 4;
+				textures[texture_count].size = length - 4;
+				texture_count++;
+			}
+			break;
+		case 'F':
+			frame.number = length >= 4 ? get_u32(payload) : 0;
+			frame.header_count = 0;
+			frame.triangle_count = 0;
+			frame.skipped = 0;
+			current_mark = 0;
+			read_prims(NULL, 0, 0, 0);
+			break;
+		case 'L':
+			list = length >= 4 ? (int)get_u32(payload) : LIST_OP;
+			break;
+		case 'M':
+			current_mark = find_mark((const char *)payload, length);
+			break;
+		case 'P':
+			read_prims(payload, length, list, current_mark);
+			break;
+		case 'E':
+			render();
+			printf("frame %u: %d triangles, opaque %llu fragments, punch through %llu, translucent %llu over %.1f%% "
+				"of the screen, depth complexity %.2f average, %u most%s\n",
+				(unsigned)frame.number, frame.triangle_count, (unsigned long long)stats.fragments[LIST_OP],
+				(unsigned long long)stats.fragments[LIST_PT], (unsigned long long)stats.fragments[LIST_TR],
+				100.0 * stats.translucent_pixels / (WIDTH*HEIGHT), (double)stats.all / (WIDTH*HEIGHT),
+				(unsigned)stats.most, frame.skipped ? " (some skipped)" : "");
+			if(dir && frames % every == 0 && !write_images(dir)){
+				fprintf(stderr, "can't write to %s\n", dir);
+				return 1;
+			}
+			complexity_total += (double)stats.all / (WIDTH*HEIGHT);
+			if(stats.most > most){
+				most = stats.most;
+			}
+			frames++;
+			break;
+		default:
+			break; // newer record types are skipped
+		}
+	}
+	free(data);
+	if(!frames){
+		fprintf(stderr, "no frames in %s\n", path);
+		return 1;
+	}
+
+	printf("%d frames, depth complexity %.2f average, %u most\n", frames, complexity_total / frames, (unsigned)most);
+	printf("%-16s %14s %10s\n", "mark", "frags/frame", "wasted");
+	for(int m=0; m<mark_count; m++){
+		if(marks[m].fragments){
+			printf("%-16s %14.0f %9.1f%%\n", marks[m].name, (double)marks[m].fragments / frames,
+				100.0 * marks[m].wasted / marks[m].fragments);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,753 @@
+// Replay recording and seeking. See replay.h for the file layout.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+
+#ifdef _arch_dreamcast
+#include <kos.h>
+
+#include "log.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define BLOCK_KEYFRAME 'K'
+#define BLOCK_CHUNK 'C'
+#define BLOCK_HASHES 'H'
+
+// Worst case for a compressed chunk: all literals, one token byte per 128 of them
+#define MAX_CHUNK_PAYLOAD (REPLAY_CHUNK_FRAMES + REPLAY_CHUNK_FRAMES/128 + 1)
+
+/**************************************** byte order ****************************************/
+
+static inline void put_u16(uint8_t * p, uint32_t v){
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static inline void put_u32(uint8_t * p, uint32_t v){
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static inline uint32_t get_u16(const uint8_t * p){
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t get_u32(const uint8_t * p){
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**************************************** game state ****************************************/
+
+void replay_save_state(const tetris_game * game, uint8_t * out){
+	uint8_t * p = out;
+	memset(out, 0, REPLAY_STATE_SIZE);
+
+	for(int row=0; row<TETRIS_ROWS; row++){
+		put_u16(p, game->rows[row]);
+		p += 2;
+	}
+	memcpy(p, game->colors, sizeof(game->colors));
+	p += sizeof(game->colors);
+
+	*p++ = game->active.type;
+	*p++ = game->active.orientation;
+	*p++ = game->active.left_x;
+	*p++ = game->active.top_y;
+
+	put_u32(p, game->active_set); p += 4;
+	put_u32(p, game->held); p += 4;
+	put_u32(p, game->hold_eligible); p += 4;
+	for(int i=0; i<TETRIS_QUEUE_LENGTH; i++){
+		*p++ = game->queue[i];
+	}
+	put_u32(p, game->rng); p += 4;
+	put_u32(p, game->line_clears); p += 4;
+	put_u32(p, (uint32_t)game->score); p += 4; // score is 64 bits in the file
+	put_u32(p, (uint32_t)((uint64_t)game->score >> 32)); p += 4;
+
+	put_u32(p, game->level); p += 4;
+	put_u32(p, game->falltime); p += 4;
+	put_u32(p, game->fall_timer); p += 4;
+	put_u32(p, game->loss); p += 4;
+	put_u32(p, game->phase); p += 4;
+	put_u32(p, game->line_clear_delay); p += 4;
+	put_u32(p, game->clear_timer); p += 4;
+	put_u32(p, (uint32_t)game->rows_to_clear); p += 4; // the rest of a 64 bit one goes at the end
+	put_u32(p, game->last_clear); p += 4;
+	put_u32(p, game->move_timebuffer); p += 4;
+	put_u32(p, game->released_y_button); p += 4;
+	put_u32(p, game->released_x_button); p += 4;
+	put_u32(p, game->released_up_button); p += 4;
+#if TETRIS_ROWS > 32
+	put_u32(p, (uint32_t)(game->rows_to_clear >> 32));
+#endif
+}
+
+void replay_load_state(tetris_game * game, const uint8_t * in){
+	const uint8_t * p = in;
+	memset(game, 0, sizeof(*game));
+
+	for(int row=0; row<TETRIS_ROWS; row++){
+		game->rows[row] = get_u16(p);
+		p += 2;
+	}
+	memcpy(game->colors, p, sizeof(game->colors));
+	p += sizeof(game->colors);
+
+	game->active.type = (int8_t)*p++;
+	game->active.orientation = (int8_t)*p++;
+	game->active.left_x = (int8_t)*p++;
+	game->active.top_y = (int8_t)*p++;
+
+	game->active_set = (int32_t)get_u32(p); p += 4;
+	game->held = (int32_t)get_u32(p); p += 4;
+	game->hold_eligible = (int32_t)get_u32(p); p += 4;
+	for(int i=0; i<TETRIS_QUEUE_LENGTH; i++){
+		game->queue[i] = *p++;
+	}
+	game->rng = get_u32(p); p += 4;
+	game->line_clears = (int32_t)get_u32(p); p += 4;
+	uint64_t score = get_u32(p) | ((uint64_t)get_u32(p+4) << 32);
+	game->score = (int64_t)score; p += 8;
+
+	game->level = (int32_t)get_u32(p); p += 4;
+	game->falltime = (int32_t)get_u32(p); p += 4;
+	game->fall_timer = (int32_t)get_u32(p); p += 4;
+	game->loss = (int32_t)get_u32(p); p += 4;
+	game->phase = (game_phase)get_u32(p); p += 4;
+	game->line_clear_delay = (int32_t)get_u32(p); p += 4;
+	game->clear_timer = (int32_t)get_u32(p); p += 4;
+	game->rows_to_clear = get_u32(p); p += 4;
+	game->last_clear = (int32_t)get_u32(p); p += 4;
+	game->move_timebuffer = (int32_t)get_u32(p); p += 4;
+	game->released_y_button = (int32_t)get_u32(p); p += 4;
+	game->released_x_button = (int32_t)get_u32(p); p += 4;
+	game->released_up_button = (int32_t)get_u32(p); p += 4;
+#if TETRIS_ROWS > 32
+	game->rows_to_clear |= (tetris_row_set)get_u32(p) << 32;
+#endif
+}
+
+uint32_t replay_state_hash(const tetris_game * game){
+	uint8_t state[REPLAY_STATE_SIZE];
+	uint32_t hash = 2166136261u;
+
+	replay_save_state(game, state);
+	for(int i=0; i<REPLAY_STATE_SIZE; i++){
+		hash = (hash ^ state[i]) * 16777619u;
+	}
+	return hash;
+}
+
+/**************************************** writing ****************************************/
+
+#ifdef _arch_dreamcast
+static int queue_bytes(replay_writer * writer, const void * data, size_t size){
+	// Into the ring for the writer thread. Once something didn't fit, nothing else goes in
+	// either: the file ends at the last whole write, and the reader copes with that.
+	uint32_t head = writer->ring_head;
+	uint32_t tail = __atomic_load_n(&writer->ring_tail, __ATOMIC_ACQUIRE);
+
+	if(writer->overflowed || REPLAY_RING_SIZE - (head - tail) < size){
+		if(!writer->overflowed){
+			LOG_WARN("Replay writer fell behind, the rest of this recording is lost");
+		}
+		writer->overflowed = 1;
+		return 0;
+	}
+	uint32_t offset = head & (REPLAY_RING_SIZE-1);
+	uint32_t first = size < REPLAY_RING_SIZE - offset ? size : REPLAY_RING_SIZE - offset;
+	memcpy(writer->ring + offset, data, first);
+	memcpy(writer->ring, (const uint8_t *)data + first, size - first);
+	__atomic_store_n(&writer->ring_head, head + size, __ATOMIC_RELEASE); // publish it
+	return 1;
+}
+#endif
+
+static int write_bytes(replay_writer * writer, const void * data, size_t size){
+#ifdef _arch_dreamcast
+	if(writer->async){
+		if(!queue_bytes(writer, data, size)){
+			return 0;
+		}
+		writer->offset += size;
+		return 1;
+	}
+#endif
+	if(fwrite(data, 1, size, writer->file) != size){
+		return 0;
+	}
+	writer->offset += size;
+	return 1;
+}
+
+static int write_block(replay_writer * writer, int tag, int frame_count, uint32_t first_frame,
+	const uint8_t * payload, uint32_t payload_bytes){
+	uint8_t header[REPLAY_BLOCK_HEADER_SIZE];
+
+	header[0] = tag;
+	header[1] = 0;
+	put_u16(header+2, frame_count);
+	put_u32(header+4, first_frame);
+	put_u32(header+8, payload_bytes);
+	return write_bytes(writer, header, sizeof(header)) && write_bytes(writer, payload, payload_bytes);
+}
+
+int replay_writer_open(replay_writer * writer, const char * path, uint32_t seed){
+	uint8_t header[REPLAY_HEADER_SIZE];
+
+#ifdef _arch_dreamcast
+	// The last recording has to be out of the ring and closed first. By the time the next
+	// game starts it almost always is.
+	int async = writer->async;
+	if(async && writer->file){
+		replay_writer_close(writer); // one that was left open, the thread would still be writing it
+	}
+	while(__atomic_load_n(&writer->closing, __ATOMIC_ACQUIRE)){
+		thd_sleep(1);
+	}
+#endif
+	memset(writer, 0, sizeof(*writer));
+	FILE * file = fopen(path, "wb");
+	if(!file){
+		return 0;
+	}
+#ifdef _arch_dreamcast
+	writer->async = async;
+	if(async){
+		// The header goes in the ring before the thread gets to see the file
+		memcpy(header, "TRPL", 4);
+		put_u16(header+4, REPLAY_VERSION);
+		put_u16(header+6, REPLAY_CHUNK_FRAMES);
+		put_u16(header+8, REPLAY_KEYFRAME_CHUNKS);
+		put_u16(header+10, REPLAY_FIELD);
+		put_u32(header+12, seed);
+		write_bytes(writer, header, sizeof(header));
+		__atomic_store_n(&writer->file, file, __ATOMIC_RELEASE);
+		return 1;
+	}
+#endif
+	writer->file = file;
+
+	memcpy(header, "TRPL", 4);
+	put_u16(header+4, REPLAY_VERSION);
+	put_u16(header+6, REPLAY_CHUNK_FRAMES);
+	put_u16(header+8, REPLAY_KEYFRAME_CHUNKS);
+	put_u16(header+10, REPLAY_FIELD);
+	put_u32(header+12, seed);
+	return write_bytes(writer, header, sizeof(header));
+}
+
+static void write_keyframe(replay_writer * writer, const tetris_game * game){
+	uint8_t state[REPLAY_STATE_SIZE];
+
+	if(writer->index_count < REPLAY_INDEX_MAX){
+		writer->index[writer->index_count].frame = writer->frame;
+		writer->index[writer->index_count].offset = writer->offset;
+		writer->index_count++;
+	}
+
+	replay_save_state(game, state);
+	write_block(writer, BLOCK_KEYFRAME, 0, writer->frame, state, sizeof(state));
+}
+
+static uint32_t compress_chunk(const uint8_t * in, uint32_t count, uint8_t * out){
+	// A tiny LZ77 over the buttons of one chunk. Tokens:
+	//   0x00-0x7f  n+1 literal bytes follow
+	//   0x80-0xff  copy (n&0x7f)+3 bytes from distance d back, d is the next byte (1-255)
+	// A held button is a distance 1 match and repeated patterns (tapping, or a bot that
+	// presses on every other frame) are longer distance matches, both compress well.
+	uint32_t size = 0;
+	uint32_t literal_start = 0;
+	uint32_t i = 0;
+
+	while(i < count){
+		uint32_t best_length = 0;
+		uint32_t best_distance = 0;
+		for(uint32_t distance=1; distance<=i && distance<=255; distance++){
+			uint32_t length = 0;
+			while(i + length < count && length < 130 && in[i + length] == in[i + length - distance]){
+				length++;
+			}
+			if(length > best_length){
+				best_length = length;
+				best_distance = distance;
+			}
+		}
+
+		if(best_length < 3){
+			i++;
+			continue;
+		}
+		while(literal_start < i){
+			uint32_t literals = i - literal_start;
+			if(literals > 128){
+				literals = 128;
+			}
+			out[size++] = literals - 1;
+			memcpy(out + size, in + literal_start, literals);
+			size += literals;
+			literal_start += literals;
+		}
+		out[size++] = 0x80 | (best_length - 3);
+		out[size++] = best_distance;
+		i += best_length;
+		literal_start = i;
+	}
+	while(literal_start < count){
+		uint32_t literals = count - literal_start;
+		if(literals > 128){
+			literals = 128;
+		}
+		out[size++] = literals - 1;
+		memcpy(out + size, in + literal_start, literals);
+		size += literals;
+		literal_start += literals;
+	}
+	return size;
+}
+
+static int decompress_chunk(const uint8_t * in, uint32_t size, uint8_t * out, uint32_t count){
+	// Returns 0 if the data is corrupt or doesn't decode to exactly count bytes
+	const uint8_t * end = in + size;
+	uint32_t produced = 0;
+
+	while(in < end){
+		uint8_t token = *in++;
+		if(token & 0x80){
+			uint32_t length = (token & 0x7f) + 3;
+			if(in >= end){
+				return 0;
+			}
+			uint32_t distance = *in++;
+			if(distance == 0 || distance > produced || produced + length > count){
+				return 0;
+			}
+			for(uint32_t i=0; i<length; i++, produced++){
+				out[produced] = out[produced - distance];
+			}
+		}
+		else {
+			uint32_t literals = token + 1;
+			if(in + literals > end || produced + literals > count){
+				return 0;
+			}
+			memcpy(out + produced, in, literals);
+			in += literals;
+			produced += literals;
+		}
+	}
+	return produced == count;
+}
+
+static void flush_chunk(replay_writer * writer){
+	uint8_t payload[MAX_CHUNK_PAYLOAD];
+	uint32_t size = compress_chunk(writer->buttons, writer->buffered, payload);
+
+	write_block(writer, BLOCK_CHUNK, writer->buffered, writer->frame - writer->buffered, payload, size);
+	if(writer->hash_ticks){
+		uint8_t hashes[REPLAY_CHUNK_FRAMES * 4];
+		for(int i=0; i<writer->buffered; i++){
+			put_u32(hashes + i*4, writer->hashes[i]);
+		}
+		write_block(writer, BLOCK_HASHES, writer->buffered, writer->frame - writer->buffered, hashes, writer->buffered * 4);
+	}
+#ifdef _arch_dreamcast
+	if(!writer->async)
+#endif
+	fflush(writer->file); // so everything up to here survives if the recording never gets closed
+	writer->buffered = 0;
+}
+
+void replay_record(replay_writer * writer, const tetris_game * game, uint32_t buttons){
+	if(!writer->file){
+		return;
+	}
+#ifdef _arch_dreamcast
+	if(writer->closing){
+		return; // closed, the thread just hasn't got to the file yet
+	}
+#endif
+	if(writer->buffered == 0){
+		if(writer->chunks % REPLAY_KEYFRAME_CHUNKS == 0){
+			write_keyframe(writer, game);
+		}
+		writer->chunks++;
+	}
+
+	if(writer->hash_ticks){
+		writer->hashes[writer->buffered] = replay_state_hash(game);
+	}
+	writer->buttons[writer->buffered++] = buttons;
+	writer->frame++;
+	if(writer->buffered == REPLAY_CHUNK_FRAMES){
+		flush_chunk(writer);
+	}
+}
+
+int replay_writer_close(replay_writer * writer){
+	int ok = 1;
+
+	if(!writer->file){
+		return 0;
+	}
+#ifdef _arch_dreamcast
+	if(writer->closing){
+		return 1; // already handed to the writer thread
+	}
+#endif
+	if(writer->buffered){
+		flush_chunk(writer);
+	}
+
+	uint32_t index_offset = writer->offset;
+	for(uint32_t i=0; i<writer->index_count; i++){
+		uint8_t entry[8];
+		put_u32(entry, writer->index[i].frame);
+		put_u32(entry+4, writer->index[i].offset);
+		ok &= write_bytes(writer, entry, sizeof(entry));
+	}
+
+	uint8_t footer[REPLAY_FOOTER_SIZE];
+	put_u32(footer, index_offset);
+	put_u32(footer+4, writer->index_count);
+	put_u32(footer+8, writer->frame);
+	memcpy(footer+12, "TRPX", 4);
+	ok &= write_bytes(writer, footer, sizeof(footer));
+
+#ifdef _arch_dreamcast
+	if(writer->async){
+		__atomic_store_n(&writer->closing, 1, __ATOMIC_RELEASE); // the thread takes it from here
+		return ok;
+	}
+#endif
+	if(fclose(writer->file)){
+		ok = 0;
+	}
+	memset(writer, 0, sizeof(*writer));
+	return ok;
+}
+
+#ifdef _arch_dreamcast
+
+/**************************************** writer thread ****************************************/
+
+static replay_writer * thread_writer;
+static kthread_t * writer_thread;
+static volatile int writer_running = 0;
+
+static void write_queued(replay_writer * writer){
+	FILE * file = __atomic_load_n(&writer->file, __ATOMIC_ACQUIRE);
+	if(!file){
+		return;
+	}
+	int closing = __atomic_load_n(&writer->closing, __ATOMIC_ACQUIRE); // before head, see below
+	uint32_t tail = writer->ring_tail;
+	uint32_t head = __atomic_load_n(&writer->ring_head, __ATOMIC_ACQUIRE);
+
+	if(tail != head){
+		while(tail != head){
+			uint32_t offset = tail & (REPLAY_RING_SIZE-1);
+			uint32_t size = head - tail < REPLAY_RING_SIZE - offset ? head - tail : REPLAY_RING_SIZE - offset;
+			if(fwrite(writer->ring + offset, 1, size, file) != size){
+				writer->failed = 1;
+			}
+			tail += size;
+		}
+		fflush(file); // so everything up to here survives if the recording never gets closed
+		__atomic_store_n(&writer->ring_tail, tail, __ATOMIC_RELEASE); // hand the bytes back
+	}
+
+	// closing was set after the index and footer went in, so they were in head above
+	if(closing){
+		if(fclose(file)){
+			writer->failed = 1;
+		}
+		if(writer->failed){
+			LOG_WARN("Writing the replay failed, the file is incomplete");
+		}
+		__atomic_store_n(&writer->file, NULL, __ATOMIC_RELEASE);
+		__atomic_store_n(&writer->closing, 0, __ATOMIC_RELEASE);
+	}
+}
+
+static void * writer_thread_main(void * param){
+	while(writer_running){
+		write_queued(thread_writer);
+		thd_sleep(20);
+	}
+	write_queued(thread_writer);
+	return NULL;
+}
+
+void replay_start_writer_thread(replay_writer * writer){
+	thread_writer = writer;
+	writer->async = 1;
+	writer_running = 1;
+	writer_thread = thd_create(0, writer_thread_main, NULL);
+	thd_set_prio(writer_thread, PRIO_DEFAULT + 1); // only while the game thread is waiting, like the log
+}
+
+void replay_stop_writer_thread(){
+	writer_running = 0;
+	thd_join(writer_thread, NULL);
+}
+
+#endif
+
+/**************************************** reading ****************************************/
+
+typedef struct Block {
+	int tag;
+	uint32_t frame_count;
+	uint32_t first_frame;
+	const uint8_t * payload;
+	uint32_t payload_bytes;
+	size_t next; // offset of the block after this one
+} block;
+
+static int read_block(const replay_reader * reader, size_t offset, size_t end, block * out){
+	// Returns 0 at the end of the blocks or if the block got cut off
+	if(offset + REPLAY_BLOCK_HEADER_SIZE > end){
+		return 0;
+	}
+	const uint8_t * p = reader->data + offset;
+	out->tag = p[0];
+	out->frame_count = get_u16(p+2);
+	out->first_frame = get_u32(p+4);
+	out->payload_bytes = get_u32(p+8);
+	out->payload = p + REPLAY_BLOCK_HEADER_SIZE;
+	out->next = offset + REPLAY_BLOCK_HEADER_SIZE + out->payload_bytes;
+
+	if((out->tag != BLOCK_KEYFRAME && out->tag != BLOCK_CHUNK && out->tag != BLOCK_HASHES) || out->next > end){
+		return 0;
+	}
+	if(out->tag == BLOCK_KEYFRAME && out->payload_bytes < REPLAY_STATE_SIZE){
+		return 0;
+	}
+	if(out->tag == BLOCK_HASHES && out->payload_bytes != out->frame_count * 4){
+		return 0;
+	}
+	return 1;
+}
+
+static size_t blocks_end(const replay_reader * reader){
+	// With an index the blocks stop where it starts, without one they run to the end of the file
+	return reader->index ? (size_t)(reader->index - reader->data) : reader->size;
+}
+
+int replay_reader_open(replay_reader * reader, const uint8_t * data, size_t size){
+	memset(reader, 0, sizeof(*reader));
+	if(size < REPLAY_HEADER_SIZE || memcmp(data, "TRPL", 4) || get_u16(data+4) < 1 || get_u16(data+4) > REPLAY_VERSION){
+		return 0;
+	}
+	if(get_u16(data+6) != REPLAY_CHUNK_FRAMES){
+		return 0;
+	}
+	uint16_t field = get_u16(data+10);
+	if((field ? field : REPLAY_FIELD_CODE(10, 20, 0)) != REPLAY_FIELD){
+		return 0; // recorded with a different field size, it would play out differently
+	}
+	reader->data = data;
+	reader->size = size;
+	reader->seed = get_u32(data+12);
+
+	if(size >= REPLAY_HEADER_SIZE + REPLAY_FOOTER_SIZE){
+		const uint8_t * footer = data + size - REPLAY_FOOTER_SIZE;
+		uint32_t index_offset = get_u32(footer);
+		uint32_t index_count = get_u32(footer+4);
+
+		if(!memcmp(footer+12, "TRPX", 4) && index_offset >= REPLAY_HEADER_SIZE
+			&& (uint64_t)index_offset + (uint64_t)index_count*8 == size - REPLAY_FOOTER_SIZE){
+			reader->index = data + index_offset;
+			reader->index_count = index_count;
+			reader->total_frames = get_u32(footer+8);
+			return 1;
+		}
+	}
+
+	// No footer, the recording never got closed. Count the frames that made it to the file.
+	block b;
+	size_t offset = REPLAY_HEADER_SIZE;
+	while(read_block(reader, offset, reader->size, &b)){
+		if(b.tag == BLOCK_CHUNK){
+			reader->total_frames = b.first_frame + b.frame_count;
+		}
+		offset = b.next;
+	}
+	return 1;
+}
+
+#ifndef _arch_dreamcast
+int replay_reader_map(replay_reader * reader, const char * path){
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+
+	memset(reader, 0, sizeof(*reader));
+	if(fd < 0){
+		return 0;
+	}
+	if(fstat(fd, &st) || st.st_size == 0){
+		close(fd);
+		return 0;
+	}
+	void * mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // the mapping stays valid
+	if(mapping == MAP_FAILED){
+		return 0;
+	}
+
+	if(!replay_reader_open(reader, mapping, st.st_size)){
+		munmap(mapping, st.st_size);
+		return 0;
+	}
+	reader->mapping = mapping;
+	reader->mapping_size = st.st_size;
+	return 1;
+}
+#endif
+
+void replay_reader_close(replay_reader * reader){
+#ifndef _arch_dreamcast
+	if(reader->mapping){
+		munmap(reader->mapping, reader->mapping_size);
+	}
+#endif
+	memset(reader, 0, sizeof(*reader));
+}
+
+static size_t find_keyframe(const replay_reader * reader, uint32_t frame){
+	// Offset of the last keyframe at or before frame, 0 if there isn't one
+	size_t found = 0;
+
+	if(reader->index){
+		uint32_t low = 0;
+		uint32_t high = reader->index_count;
+		while(low < high){ // first entry after frame
+			uint32_t mid = (low + high) / 2;
+			if(get_u32(reader->index + mid*8) <= frame){
+				low = mid + 1;
+			}
+			else {
+				high = mid;
+			}
+		}
+		if(low > 0){
+			found = get_u32(reader->index + (low-1)*8 + 4);
+		}
+		return found;
+	}
+
+	block b;
+	size_t offset = REPLAY_HEADER_SIZE;
+	while(read_block(reader, offset, reader->size, &b) && b.first_frame <= frame){
+		if(b.tag == BLOCK_KEYFRAME){
+			found = offset;
+		}
+		offset = b.next;
+	}
+	return found;
+}
+
+static uint32_t read_buttons_from(const replay_reader * reader, size_t offset, uint32_t first_frame,
+	uint8_t * out, uint32_t count){
+	// Decodes the buttons of frames first_frame...first_frame+count-1 out of the chunks
+	// starting at offset. Returns how many frames it found.
+	size_t end = blocks_end(reader);
+	uint32_t last_frame = first_frame + count;
+	uint32_t found = 0;
+	block b;
+
+	while(read_block(reader, offset, end, &b) && b.first_frame < last_frame){
+		offset = b.next;
+		if(b.tag != BLOCK_CHUNK || b.first_frame + b.frame_count <= first_frame){
+			continue;
+		}
+
+		uint8_t chunk[REPLAY_CHUNK_FRAMES];
+		if(b.frame_count > REPLAY_CHUNK_FRAMES || !decompress_chunk(b.payload, b.payload_bytes, chunk, b.frame_count)){
+			return found; // corrupt chunk
+		}
+		for(uint32_t i=0; i<b.frame_count; i++){
+			uint32_t frame = b.first_frame + i;
+			if(frame >= first_frame && frame < last_frame){
+				out[frame - first_frame] = chunk[i];
+				found++;
+			}
+		}
+	}
+	return found;
+}
+
+uint32_t replay_read_buttons(const replay_reader * reader, uint32_t first_frame, uint8_t * out, uint32_t count){
+	// Chunks always come right after their keyframe, so start looking from there
+	size_t offset = find_keyframe(reader, first_frame);
+	if(!offset){
+		offset = REPLAY_HEADER_SIZE;
+	}
+	return read_buttons_from(reader, offset, first_frame, out, count);
+}
+
+uint32_t replay_read_hashes(const replay_reader * reader, uint32_t first_frame, uint32_t * out, uint32_t count){
+	size_t offset = find_keyframe(reader, first_frame);
+	size_t end = blocks_end(reader);
+	uint32_t last_frame = first_frame + count;
+	uint32_t found = 0;
+	block b;
+
+	if(!offset){
+		offset = REPLAY_HEADER_SIZE;
+	}
+	while(read_block(reader, offset, end, &b) && b.first_frame < last_frame){
+		offset = b.next;
+		if(b.tag != BLOCK_HASHES || b.first_frame + b.frame_count <= first_frame){
+			continue;
+		}
+		for(uint32_t i=0; i<b.frame_count; i++){
+			uint32_t frame = b.first_frame + i;
+			if(frame >= first_frame && frame < last_frame){
+				out[frame - first_frame] = get_u32(b.payload + i*4);
+				found++;
+			}
+		}
+	}
+	return found;
+}
+
+int replay_seek(const replay_reader * reader, uint32_t frame, tetris_game * game){
+	// Never more than REPLAY_KEYFRAME_CHUNKS chunks between a keyframe and the frame after it
+	uint8_t buttons[REPLAY_KEYFRAME_CHUNKS * REPLAY_CHUNK_FRAMES];
+	block b;
+
+	if(frame > reader->total_frames){
+		frame = reader->total_frames;
+	}
+
+	size_t offset = find_keyframe(reader, frame);
+	if(!offset || !read_block(reader, offset, blocks_end(reader), &b)){
+		return -1;
+	}
+	tetris_init();
+	replay_load_state(game, b.payload);
+
+	uint32_t ticks = frame - b.first_frame;
+	if(ticks > sizeof(buttons)){
+		return -1; // a keyframe went missing, the file wasn't written by replay_writer
+	}
+	if(read_buttons_from(reader, b.next, b.first_frame, buttons, ticks) != ticks){
+		return -1;
+	}
+	for(uint32_t i=0; i<ticks; i++){
+		tetris_game_tick(game, buttons[i]);
+	}
+	return ticks;
+}
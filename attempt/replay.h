@@ -0,0 +1,154 @@
+// Replay files: the buttons of every frame, plus keyframes so a viewer can seek.
+//
+// A replay is just the inputs. The rules in tetris.c are deterministic, so ticking
+// a fresh game with the same buttons plays it back exactly. Replaying from frame 0 gets
+// slow for long marathon games, though. So every REPLAY_KEYFRAME_CHUNKS chunks the
+// recorder also stores the whole game state. Seeking restores the nearest keyframe
+// before the target and only simulates what's left, never more than
+// REPLAY_KEYFRAME_CHUNKS * REPLAY_CHUNK_FRAMES ticks.
+//
+// File layout (everything little endian):
+//
+//   header     "TRPL", version, chunk/keyframe spacing, field size, seed
+//   blocks     one after the other, in frame order, as they get recorded:
+//                'K' keyframe: the game state before the block's first frame
+//                'C' chunk:    up to REPLAY_CHUNK_FRAMES frames of buttons, LZ compressed
+//                'H' hashes:   optional, right after a chunk: replay_state_hash() of the
+//                              game before each of its frames, to check another build
+//                              plays the inputs out the same way (replay_tool crosscheck)
+//   index      one (frame, file offset) entry per keyframe
+//   footer     index offset, keyframe count, total frames, "TRPX"
+//
+// Blocks are written as soon as a chunk fills up, so a recording can be streamed to a
+// file while the game runs. On the Dreamcast that's done by a writer thread (see
+// replay_start_writer_thread()): a write to /pc/ or a VMU takes milliseconds, so the
+// game thread only copies the blocks into a ring buffer. The index and footer only get
+// written when the recording is closed. If they're missing (the game crashed, the cable got pulled...), the reader
+// walks the block headers instead, so the file is still usable.
+//
+// The reader works on the file in memory. On a PC replay_reader_map() gets it there with
+// one mmap and nothing is copied.
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "tetris.h"
+
+#define REPLAY_VERSION 2 // 2 added 'H' blocks, version 1 files still read fine
+#define REPLAY_CHUNK_FRAMES 256 // frames of buttons per 'C' block
+#define REPLAY_KEYFRAME_CHUNKS 16 // a keyframe before every 16th chunk (4096 frames, ~68 seconds)
+
+#define REPLAY_INDEX_MAX 1024 // keyframes the writer indexes, over 19 hours of frames
+#define REPLAY_RING_SIZE 16384 // bytes waiting for the writer thread, ~30 seconds of chunks, must be a power of 2
+
+#define REPLAY_HEADER_SIZE 16
+#define REPLAY_BLOCK_HEADER_SIZE 12
+#define REPLAY_FOOTER_SIZE 16
+// serialized tetris_game: 425 bytes used for the standard field, the rest is room to grow
+#define REPLAY_STATE_USED (TETRIS_ROWS * 2 + TETRIS_ROWS * TETRIS_COLS + 89 + (TETRIS_ROWS > 32 ? 4 : 0))
+#define REPLAY_STATE_SIZE (REPLAY_STATE_USED <= 448 ? 448 : (REPLAY_STATE_USED + 63) & ~63)
+
+// The field size (tetris.h) a replay was recorded with, replays only play back in builds
+// with the same one. Files from before this was in the header have 0, the standard field.
+#define REPLAY_FIELD_CODE(width, visible, buffer) ((width) | ((visible) << 4) | ((buffer) << 10))
+#define REPLAY_FIELD (REPLAY_FIELD_CODE(TETRIS_WIDTH, TETRIS_VISIBLE_ROWS, TETRIS_BUFFER_ROWS))
+
+typedef struct Replay_Index_Entry {
+	uint32_t frame;
+	uint32_t offset; // of the 'K' block
+} replay_index_entry;
+
+typedef struct Replay_Writer {
+	FILE * file;
+	uint32_t offset; // bytes written so far
+	uint32_t frame; // frames recorded so far
+	uint32_t chunks; // chunks started so far
+
+	uint8_t buttons[REPLAY_CHUNK_FRAMES]; // the chunk being filled
+	int buffered;
+
+	// Set it after opening to also record a hash of the state before every frame. Costs a
+	// replay_state_hash() per frame and 4 bytes per frame in the file.
+	int hash_ticks;
+	uint32_t hashes[REPLAY_CHUNK_FRAMES]; // the chunk's hashes, if hash_ticks
+
+	// One entry per keyframe, a fixed array so recording never touches the heap. Keyframes
+	// past the end still get written, seeking past the last indexed one just has more
+	// frames to simulate.
+	replay_index_entry index[REPLAY_INDEX_MAX];
+	uint32_t index_count;
+
+#ifdef _arch_dreamcast
+	// With the writer thread, everything written goes in here and the thread takes it out.
+	// Single producer (the game thread) and single consumer, like the high score queue.
+	uint8_t ring[REPLAY_RING_SIZE];
+	uint32_t ring_head; // written by the game thread only
+	uint32_t ring_tail; // written by the writer thread only
+	int async; // the writer thread is running, file belongs to it
+	int overflowed; // the thread fell behind and the ring filled up, the rest is lost
+	int closing; // index and footer are in the ring, the thread closes the file after them
+	int failed; // a write on the thread went wrong
+#endif
+} replay_writer;
+
+// Starts a recording. Returns 0 if the file can't be created.
+int replay_writer_open(replay_writer * writer, const char * path, uint32_t seed);
+// Call once per frame, before tetris_game_tick(), with the same buttons it gets.
+void replay_record(replay_writer * writer, const tetris_game * game, uint32_t buttons);
+// Flushes the last chunk, writes the index and footer. Returns 0 if writing failed.
+// With the writer thread it only hands them over, and the thread logs failures instead.
+int replay_writer_close(replay_writer * writer);
+
+#ifdef _arch_dreamcast
+// From here on, writer's file writes happen on a thread of their own. writer has to stay
+// around until replay_stop_writer_thread(), which writes out whatever's still queued.
+void replay_start_writer_thread(replay_writer * writer);
+void replay_stop_writer_thread();
+#endif
+
+typedef struct Replay_Reader {
+	const uint8_t * data;
+	size_t size;
+	uint32_t seed;
+
+	const uint8_t * index; // NULL if the file has no footer (the blocks get scanned instead)
+	uint32_t index_count;
+	uint32_t total_frames;
+
+	void * mapping; // set by replay_reader_map()
+	size_t mapping_size;
+} replay_reader;
+
+// Reads a replay that's already in memory (the memory has to outlive the reader).
+// Returns 0 if it isn't a replay.
+int replay_reader_open(replay_reader * reader, const uint8_t * data, size_t size);
+#ifndef _arch_dreamcast
+int replay_reader_map(replay_reader * reader, const char * path); // mmap()s the file
+#endif
+void replay_reader_close(replay_reader * reader);
+
+// Copies the recorded buttons of count frames starting at first_frame into out.
+// Returns how many frames were there (fewer if it ran past the end).
+uint32_t replay_read_buttons(const replay_reader * reader, uint32_t first_frame, uint8_t * out, uint32_t count);
+
+// Same for the hashes of the states before each frame ('H' blocks). Returns 0 if the
+// replay was recorded without hash_ticks.
+uint32_t replay_read_hashes(const replay_reader * reader, uint32_t first_frame, uint32_t * out, uint32_t count);
+
+// Puts the game into its state right before frame `frame` was ticked.
+// Returns the number of ticks it had to simulate after the keyframe, or -1 on error.
+int replay_seek(const replay_reader * reader, uint32_t frame, tetris_game * game);
+
+// Copies a game state in/out of the fixed REPLAY_STATE_SIZE byte layout used in keyframes
+// (the same on the Dreamcast and on a PC, even though sizeof(long) isn't).
+void replay_save_state(const tetris_game * game, uint8_t * out);
+void replay_load_state(tetris_game * game, const uint8_t * in);
+
+// FNV-1a over that layout, so a state hashes the same on the Dreamcast and on a PC
+uint32_t replay_state_hash(const tetris_game * game);
+
+#endif
@@ -0,0 +1,350 @@
+// Host tool for replay files (replay.h).
+//
+//   replay_tool record out.trp [frames] [start level] [seed]
+//       lets the bot from bot.c play and records it, until it loses or reaches frames
+//   replay_tool info file.trp
+//   replay_tool seek file.trp frame
+//       prints the field right before that frame and how long getting there took
+//   replay_tool verify file.trp [seeks]
+//       seeks to random frames and checks every one against a playback from frame 0,
+//       then does the same again pretending the file was never closed (no index)
+//   replay_tool crosscheck file.trp
+//       plays the inputs of a replay recorded with hash_ticks (on the Dreamcast, say) and
+//       compares every state with the recorded hash. Prints the first frame where this
+//       build disagrees, with the fields of both builds at the next keyframe.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bot.h"
+#include "replay.h"
+
+static double now_seconds(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_field(const tetris_game * game){
+	for(int row=TETRIS_TOP_ROW; row<=TETRIS_BOTTOM_ROW; row++){
+		putchar('|');
+		for(int col=TETRIS_LEFT_COL; col<=TETRIS_RIGHT_COL; col++){
+			putchar(game->colors[row][col] ? '0' + game->colors[row][col] : '.');
+		}
+		puts("|");
+	}
+	printf("score %lld, level %d, lines %d%s\n", (long long)game->score, game->level, game->line_clears,
+		game->loss ? ", lost" : "");
+}
+
+static void print_fields(const tetris_game * left, const tetris_game * right){
+	// Side by side, rows that differ get a < at the end
+	for(int row=TETRIS_TOP_ROW; row<=TETRIS_BOTTOM_ROW; row++){
+		for(int side=0; side<2; side++){
+			const tetris_game * game = side ? right : left;
+			printf(side ? "   |" : "|");
+			for(int col=TETRIS_LEFT_COL; col<=TETRIS_RIGHT_COL; col++){
+				putchar(game->colors[row][col] ? '0' + game->colors[row][col] : '.');
+			}
+			putchar('|');
+		}
+		puts(left->rows[row] != right->rows[row] || memcmp(left->colors[row], right->colors[row], TETRIS_COLS) ? " <" : "");
+	}
+}
+
+static void print_differences(const tetris_game * a, const tetris_game * b){
+	#define DIFFERENT(name, value) \
+		if((a->value) != (b->value)){ printf("    %-16s %lld vs %lld\n", name, (long long)(a->value), (long long)(b->value)); }
+	DIFFERENT("score", score);
+	DIFFERENT("level", level);
+	DIFFERENT("lines", line_clears);
+	DIFFERENT("rng", rng);
+	DIFFERENT("active type", active.type);
+	DIFFERENT("active rotation", active.orientation);
+	DIFFERENT("active x", active.left_x);
+	DIFFERENT("active y", active.top_y);
+	DIFFERENT("held", held);
+	DIFFERENT("phase", phase);
+	DIFFERENT("fall timer", fall_timer);
+	DIFFERENT("clear timer", clear_timer);
+	DIFFERENT("lost", loss);
+	for(int i=0; i<TETRIS_QUEUE_LENGTH; i++){
+		DIFFERENT("queue", queue[i]);
+	}
+	#undef DIFFERENT
+}
+
+static int record(const char * path, uint32_t frames, int level, uint32_t seed){
+	replay_writer writer;
+	tetris_game game;
+	bot brain;
+
+	tetris_game_reset(&game, seed);
+	if(level > 1){
+		game.level = level;
+		game.falltime = tetris_falltime_for_level(level);
+	}
+	bot_setup(&brain, 0);
+
+	if(!replay_writer_open(&writer, path, seed)){
+		fprintf(stderr, "can't create %s\n", path);
+		return 1;
+	}
+	writer.hash_ticks = 1;
+
+	uint32_t frame = 0;
+	double start = now_seconds();
+	while(frame < frames && !game.loss){
+		uint32_t buttons = bot_buttons(&brain, &game);
+		replay_record(&writer, &game, buttons);
+		tetris_game_tick(&game, buttons);
+		frame++;
+	}
+	uint32_t keyframes = writer.index_count;
+	uint32_t bytes = writer.offset;
+	if(!replay_writer_close(&writer)){
+		fprintf(stderr, "writing %s failed\n", path);
+		return 1;
+	}
+	double elapsed = now_seconds() - start;
+
+	printf("recorded %u frames (%.1f minutes at 60 fps) in %.3f s, %u keyframes\n",
+		frame, frame / 3600.0, elapsed, keyframes);
+	printf("%u bytes of blocks, %.2f bytes per frame (%.2f without keyframes)\n",
+		bytes, (double)bytes / frame, (double)(bytes - keyframes * (REPLAY_STATE_SIZE + REPLAY_BLOCK_HEADER_SIZE)) / frame);
+	print_field(&game);
+	return 0;
+}
+
+static int info(const char * path){
+	replay_reader reader;
+
+	if(!replay_reader_map(&reader, path)){
+		fprintf(stderr, "%s isn't a replay\n", path);
+		return 1;
+	}
+	printf("%s: %zu bytes, seed %08x, %u frames\n", path, reader.size, reader.seed, reader.total_frames);
+	if(reader.index){
+		printf("index: %u keyframes\n", reader.index_count);
+	}
+	else {
+		printf("no index (recording wasn't closed), seeking scans the blocks\n");
+	}
+	replay_reader_close(&reader);
+	return 0;
+}
+
+static int seek(const char * path, uint32_t frame){
+	replay_reader reader;
+	tetris_game game;
+
+	if(!replay_reader_map(&reader, path)){
+		fprintf(stderr, "%s isn't a replay\n", path);
+		return 1;
+	}
+	double start = now_seconds();
+	int ticks = replay_seek(&reader, frame, &game);
+	double elapsed = now_seconds() - start;
+	if(ticks < 0){
+		fprintf(stderr, "seek failed\n");
+		replay_reader_close(&reader);
+		return 1;
+	}
+	print_field(&game);
+	printf("frame %u: restored a keyframe and simulated %d ticks in %.1f us\n", frame, ticks, elapsed * 1e6);
+	replay_reader_close(&reader);
+	return 0;
+}
+
+static int verify_reader(const replay_reader * reader, int seeks, const char * label){
+	uint32_t total = reader->total_frames;
+	uint32_t * targets = malloc(seeks * sizeof(uint32_t));
+	uint32_t * expected = malloc(seeks * sizeof(uint32_t));
+	uint8_t * buttons = malloc(total + 1);
+	uint32_t rng = 0xc0ffee;
+	tetris_game game;
+	int failures = 0;
+
+	// sorted targets, so a single playback from frame 0 can check them all
+	for(int i=0; i<seeks; i++){
+		targets[i] = total ? tetris_random(&rng) % (total + 1) : 0;
+	}
+	for(int i=1; i<seeks; i++){
+		for(int j=i; j>0 && targets[j-1] > targets[j]; j--){
+			uint32_t t = targets[j]; targets[j] = targets[j-1]; targets[j-1] = t;
+		}
+	}
+
+	// The reference: start from frame 0 and tick every recorded frame, no keyframes involved
+	if(replay_seek(reader, 0, &game) < 0 || replay_read_buttons(reader, 0, buttons, total) != total){
+		printf("%s: can't read the inputs\n", label);
+		free(targets);
+		free(expected);
+		free(buttons);
+		return 1;
+	}
+	uint32_t frame = 0;
+	double start = now_seconds();
+	for(int i=0; i<seeks; i++){
+		while(frame < targets[i]){
+			tetris_game_tick(&game, buttons[frame++]);
+		}
+		expected[i] = replay_state_hash(&game);
+	}
+	while(frame < total){
+		tetris_game_tick(&game, buttons[frame++]);
+	}
+	double playback_time = now_seconds() - start;
+
+	double seek_time = 0;
+	double average_target = 0;
+	int max_ticks = 0;
+	for(int i=0; i<seeks; i++){
+		double t0 = now_seconds();
+		int ticks = replay_seek(reader, targets[i], &game);
+		seek_time += now_seconds() - t0;
+		average_target += targets[i];
+		if(ticks > max_ticks){
+			max_ticks = ticks;
+		}
+		if(ticks < 0 || replay_state_hash(&game) != expected[i]){
+			printf("%s: frame %u doesn't match\n", label, targets[i]);
+			failures++;
+		}
+	}
+	average_target /= seeks;
+
+	printf("%s: %d seeks, %d mismatches, %.1f us per seek (at most %d ticks simulated),\n"
+		"    replaying from frame 0 would average %.1f us\n",
+		label, seeks, failures, seek_time * 1e6 / seeks, max_ticks,
+		total ? playback_time * 1e6 * average_target / total : 0.0);
+	free(targets);
+	free(expected);
+	free(buttons);
+	return failures != 0;
+}
+
+static int crosscheck_reader(const replay_reader * reader, const char * path, uint8_t * buttons, uint32_t * hashes){
+	uint32_t total = reader->total_frames;
+	tetris_game game;
+	tetris_game before; // the last state that still matched
+
+	if(replay_read_buttons(reader, 0, buttons, total) != total || replay_seek(reader, 0, &game) < 0){
+		fprintf(stderr, "%s: can't read the inputs\n", path);
+		return 1;
+	}
+	if(replay_read_hashes(reader, 0, hashes, total) != total){
+		fprintf(stderr, "%s: no hashes, it was recorded without hash_ticks\n", path);
+		return 1;
+	}
+
+	// Frame 0 is the recorded keyframe, everything after it is this build's own doing
+	double start = now_seconds();
+	uint32_t frame = 0;
+	before = game;
+	while(frame < total && replay_state_hash(&game) == hashes[frame]){
+		before = game;
+		tetris_game_tick(&game, buttons[frame++]);
+	}
+	double elapsed = now_seconds() - start;
+
+	if(frame == total){
+		printf("%s: all %u frames match (%.1f ns per frame)\n", path, total, elapsed * 1e9 / (total ? total : 1));
+		return 0;
+	}
+
+	printf("%s: the states disagree from frame %u on\n", path, frame);
+	if(frame == 0){
+		printf("before anything was ticked: the two builds serialize the same state differently\n");
+		return 1;
+	}
+	printf("ticking frame %u with buttons %02x went differently, the buttons before it:", frame - 1, buttons[frame - 1]);
+	for(uint32_t f = frame > 9 ? frame - 9 : 0; f < frame - 1; f++){
+		printf(" %02x", buttons[f]);
+	}
+	printf("\nthis build, before that tick and after it:\n");
+	print_fields(&before, &game);
+	print_differences(&before, &game);
+
+	// Keyframes are the recording build's own state, the next one shows what it got
+	uint32_t keyframe_frames = REPLAY_KEYFRAME_CHUNKS * REPLAY_CHUNK_FRAMES;
+	uint32_t next = (frame + keyframe_frames - 1) / keyframe_frames * keyframe_frames;
+	tetris_game recorded;
+	if(next >= total || replay_seek(reader, next, &recorded) != 0){
+		printf("no keyframe after it to compare with\n");
+		return 1;
+	}
+	while(frame < next){
+		tetris_game_tick(&game, buttons[frame++]);
+	}
+	printf("at the next keyframe (frame %u), this build and the recording:\n", next);
+	print_fields(&game, &recorded);
+	print_differences(&game, &recorded);
+	return 1;
+}
+
+static int crosscheck(const char * path){
+	replay_reader reader;
+
+	if(!replay_reader_map(&reader, path)){
+		fprintf(stderr, "%s isn't a replay\n", path);
+		return 1;
+	}
+	uint8_t * buttons = malloc(reader.total_frames + 1);
+	uint32_t * hashes = malloc((reader.total_frames + 1) * sizeof(uint32_t));
+	int failed = crosscheck_reader(&reader, path, buttons, hashes);
+	free(buttons);
+	free(hashes);
+	replay_reader_close(&reader);
+	return failed;
+}
+
+int main(int argc, char ** argv){
+	if(argc < 3){
+		fprintf(stderr, "usage: replay_tool record|info|seek|verify|crosscheck file ...\n");
+		return 1;
+	}
+	tetris_init();
+
+	const char * command = argv[1];
+	const char * path = argv[2];
+
+	if(!strcmp(command, "record")){
+		uint32_t frames = argc > 3 ? strtoul(argv[3], NULL, 0) : 60*60*30;
+		int level = argc > 4 ? atoi(argv[4]) : 1;
+		uint32_t seed = argc > 5 ? strtoul(argv[5], NULL, 0) : 12345;
+		return record(path, frames, level, seed);
+	}
+	if(!strcmp(command, "info")){
+		return info(path);
+	}
+	if(!strcmp(command, "crosscheck")){
+		return crosscheck(path);
+	}
+	if(!strcmp(command, "seek") && argc > 3){
+		return seek(path, strtoul(argv[3], NULL, 0));
+	}
+	if(!strcmp(command, "verify")){
+		int seeks = argc > 3 ? atoi(argv[3]) : 200;
+		replay_reader reader;
+		if(!replay_reader_map(&reader, path)){
+			fprintf(stderr, "%s isn't a replay\n", path);
+			return 1;
+		}
+		int failed = verify_reader(&reader, seeks, reader.index ? "with index" : "no index");
+
+		if(reader.index){
+			// Same file without the index and footer, like a recording that never got closed
+			replay_reader unclosed;
+			replay_reader_open(&unclosed, reader.data, reader.index - reader.data);
+			failed |= verify_reader(&unclosed, seeks, "without index");
+		}
+		replay_reader_close(&reader);
+		return failed;
+	}
+
+	fprintf(stderr, "unknown command %s\n", command);
+	return 1;
+}
@@ -0,0 +1,741 @@
+// The game rules. See tetris.h.
+
+#include <stddef.h>
+#include <string.h>
+
+#include "tetris.h"
+
+_Static_assert(offsetof(tetris_game, colors) <= TETRIS_HOT_BYTES,
+	"the hot part of tetris_game has outgrown TETRIS_HOT_BYTES");
+
+// When a tetromino is rotated, Tetris does a series of tests to find a valid (open) position to rotate the tetromino into.
+// The tests are done in order and the first test that succeeds determines where the tetromino is placed.
+// The test sets for Z, S, L, J, and T are all the same, but I has its own (O doesn't have one cause it doesn't rotate).
+// If they all fail, the rotation is cancelled.
+// The first test is a simple in place 90 degree rotation.
+// Tests 2-5 involve nudging the tetromino left, right, up, and down by a block or two to find a free spot.
+// This 4-dimensional matrix represents the (x, y) offsets of each test.
+// IMPORTANT: Because the tests are done IN ORDER, each pair of (x,y) represents the position RELATIVE TO THE LAST TEST,
+// NOT relative to the first test or the original position!
+// The last inner array (undo) represents the offset to get from test 5 back to the first test position.
+// First level: the tetromino type
+// Second level: the rotation type
+// Third level: the test number
+// Fourth level: x, y offset
+// Each one is 80 bytes, aligned that's 3 cache lines instead of 4.
+const int8_t rotation_tests_cw[2][4][5][2] __attribute__((aligned(TETRIS_CACHE_LINE))) =
+{
+	{ // This test matrix applies to Red/Z, Green/S, Orange/L, Dark Blue/J, Purple/T tetros. (Everything but Light Blue/I )
+		// Test 2, 3, 4, 5, and undo.
+		{ {-1,0}, {0,-1}, {1,3}, {-1,0}, {1,-2} }, // 0 to R
+		{ {1,0}, {0,1}, {-1,-3}, {1,0}, {-1,2} }, // R to 2
+		{ {1,0}, {0,-1}, {-1,3}, {1,0}, {-1,-2} }, // 2 to L
+		{ {-1,0}, {0,1}, {1,-3}, {-1,0}, {1,2} } // L to 0
+	},
+	{ // This test matrix applies only to Light Blue/I tetrominos
+		{ {-2,0}, {3,0}, {-3,1}, {3,-3}, {-1,2} }, // 0 to R
+		{ {-1,0}, {3,0}, {-3,-2}, {3,3}, {-2,-1} }, // R to 2
+		{ {2,0}, {-3,0}, {3,-1}, {-3,3}, {1,-2} }, // 2 to L
+		{ {1,0}, {-3,0}, {3,2}, {-3,-3}, {2,1} } // L to 0
+	},
+};
+
+const int8_t rotation_tests_ccw[2][4][5][2] __attribute__((aligned(TETRIS_CACHE_LINE))) =
+{
+	{ //J, L, S, T, Z
+		{ {1, 0}, {0, -1}, {-1,3}, {1,0}, {-1,-2} }, //0 to L
+		{ {1, 0}, {0, 1}, {-1,-3}, {1,0}, {-1,2} }, // R to 0
+		{ {-1, 0}, {0, -1}, {1, 3}, {-1, 0}, {1,-2} }, //2 to R
+		{ {-1, 0}, {0, 1}, {1,-3}, {-1,0}, {1,2} } //L to 2
+	},
+	{ //Light Blue
+		{ {-1, 0}, {3, 0}, {-3,-2}, {3,-3}, {-2,-1} }, //0 to L
+		{ {2, 0}, {-3, 0}, {3,-1}, {-3,3}, {1,-2} }, // R to 0
+		{ {1, 0}, {-3, 0}, {3, 2}, {-3,-3}, {2,1} }, //2 to R
+		{ {-2, 0}, {3, 0}, {-3, 1}, {3, -3}, {-1,2} } //L to 2
+	}
+};
+
+// Arrays representing what each tetromino looks like when it spawns.
+// tetris_init() rotates these into tables.shapes.
+static const uint8_t TETRO_Z[3][3] = {
+	{ 1, 1, 0 },
+	{ 0, 1, 1 },
+	{ 0, 0, 0 }
+};
+static const uint8_t TETRO_L[3][3] = {
+	{ 0, 0, 2 },
+	{ 2, 2, 2 },
+	{ 0, 0, 0 }
+};
+static const uint8_t TETRO_O[2][2] = {
+	{ 3, 3 },
+	{ 3, 3 }
+};
+static const uint8_t TETRO_S[3][3] = {
+	{ 0, 4, 4 },
+	{ 4, 4, 0 },
+	{ 0, 0, 0 }
+};
+static const uint8_t TETRO_I[4][4] = {
+	{ 0, 0, 0, 0 },
+	{ 5, 5, 5, 5 },
+	{ 0, 0, 0, 0 },
+	{ 0, 0, 0, 0 }
+};
+static const uint8_t TETRO_J[3][3] = {
+	{ 6, 0, 0 },
+	{ 6, 6, 6 },
+	{ 0, 0, 0 }
+};
+static const uint8_t TETRO_T[3][3] = {
+	{ 0, 7, 0 },
+	{ 7, 7, 7 },
+	{ 0, 0, 0 }
+};
+
+static const uint8_t * tetro_templates[8] = {
+	NULL, &TETRO_Z[0][0], &TETRO_L[0][0], &TETRO_O[0][0], &TETRO_S[0][0], &TETRO_I[0][0], &TETRO_J[0][0], &TETRO_T[0][0]
+};
+
+// What every collision test reads, together in 5 cache lines instead of spread over
+// wherever the linker put two separate arrays
+static struct {
+	uint8_t shapes[8][4][4]; // [type][orientation][row] = bitmask of the filled cells in that row of the box
+	uint8_t sizes[8]; // of the box
+} tables __attribute__((aligned(TETRIS_CACHE_LINE))) = {
+	.sizes = { 0, 3, 3, 2, 3, 4, 3, 3 }
+};
+static int tables_ready = 0;
+
+void tetris_init(){
+	if(tables_ready){
+		return;
+	}
+
+	for(int type=RED; type<=PURPLE; type++){
+		int n = tables.sizes[type];
+		uint8_t cells[4][4] = {{0}};
+
+		for(int row=0; row<n; row++){
+			for(int col=0; col<n; col++){
+				cells[row][col] = tetro_templates[type][row*n + col];
+			}
+		}
+
+		for(int orientation=0; orientation<4; orientation++){
+			for(int row=0; row<n; row++){
+				uint8_t mask = 0;
+				for(int col=0; col<n; col++){
+					if(cells[row][col]){
+						mask |= 1 << col;
+					}
+				}
+				tables.shapes[type][orientation][row] = mask;
+			}
+
+			// Rotate clockwise for the next orientation: transpose, then reverse each row.
+			// (The O is a 2x2 of the same color, so rotating it does nothing.)
+			uint8_t rotated[4][4];
+			for(int row=0; row<n; row++){
+				for(int col=0; col<n; col++){
+					rotated[col][n-1-row] = cells[row][col];
+				}
+			}
+			memcpy(cells, rotated, sizeof(cells));
+		}
+	}
+	tables_ready = 1;
+}
+
+const uint8_t * tetris_shape(color_id type, rotation orientation){
+	return tables.shapes[type & 7][orientation & 3];
+}
+
+int tetris_shape_size(color_id type){
+	return tables.sizes[type & 7];
+}
+
+uint32_t tetris_random(uint32_t * state){
+	// xorshift32: same results on the Dreamcast and on a PC, unlike rand()
+	uint32_t x = *state;
+	if(!x){
+		x = 0x9e3779b9; // 0 would get stuck at 0 forever
+	}
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+color_id tetris_random_type(uint32_t * state){
+	return (tetris_random(state) % 7) + 1;
+}
+
+void tetris_clear_rows(tetris_row * rows){
+	// Matches the old field_backup: rows 0-1 are hidden, then a solid ceiling, the
+	// buffer and visible rows (see tetris.h) and the floor.
+	for(int row=0; row<TETRIS_ROWS; row++){
+		rows[row] = TETRIS_EMPTY_ROW;
+	}
+	rows[TETRIS_CEILING_ROW] = TETRIS_FULL_ROW;
+	rows[TETRIS_ROWS-1] = TETRIS_FULL_ROW;
+}
+
+void tetris_spawn(tetris_piece * piece, color_id type){
+	// Spawn positions from the original init_new_tetro(): centered (rounding left), with
+	// the top row of blocks in the first visible row. The I's blocks are in the second
+	// row of its box, so its box starts a row higher.
+	piece->type = type;
+	piece->orientation = DEFAULT;
+	piece->left_x = TETRIS_LEFT_COL + (TETRIS_WIDTH - tables.sizes[type & 7]) / 2;
+	piece->top_y = (type==LIGHT_BLUE) ? TETRIS_TOP_ROW-1 : TETRIS_TOP_ROW;
+}
+
+static inline int place_mask(uint8_t mask, int left_x, tetris_row * placed){
+	// Shifts one row of a shape to its column on the field.
+	// Returns 0 if any filled cell would end up off the field.
+	if(left_x < 0){
+		if(mask & ((1 << -left_x) - 1)){
+			return 0;
+		}
+		*placed = mask >> -left_x;
+	}
+	else {
+		*placed = (tetris_row)(mask << left_x);
+		if((mask << left_x) & ~TETRIS_FULL_ROW){
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int tetris_collides(const tetris_row * rows, const tetris_piece * piece){
+	// Returns 1 if the piece overlaps a block or the border (or sticks out of the field).
+	const uint8_t * shape = tables.shapes[piece->type][piece->orientation];
+	int n = tables.sizes[piece->type];
+
+	for(int row=0; row<n; row++){
+		if(!shape[row]){
+			continue;
+		}
+		int y = piece->top_y + row;
+		tetris_row placed;
+		if(y < 0 || y >= TETRIS_ROWS || !place_mask(shape[row], piece->left_x, &placed)){
+			return 1;
+		}
+		if(rows[y] & placed){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int tetris_move(const tetris_row * rows, tetris_piece * piece, int dx, int dy){
+	piece->left_x += dx;
+	piece->top_y += dy;
+	if(tetris_collides(rows, piece)){
+		piece->left_x -= dx; //undo it
+		piece->top_y -= dy;
+		return 0;
+	}
+	return 1;
+}
+
+// Tetromino rotation test cases taken from here:
+// https://www.reddit.com/r/Tetris/comments/bdu02w/i_made_some_srs_charts/
+static int rotate(const tetris_row * rows, tetris_piece * piece, const int8_t tests[2][4][5][2], int turn){
+	if(piece->type==YELLOW){
+		return 0; // O tetrominos don't rotate :)
+	}
+
+	tetris_piece original = *piece;
+	int from = piece->orientation;
+	int tetro_index = (piece->type==LIGHT_BLUE) ? 1 : 0;
+
+	//test 1 - Plain rotation, no offset.
+	piece->orientation = (from + turn) & 3;
+	if(!tetris_collides(rows, piece)){
+		return 1;
+	}
+
+	// If the basic tetro rotation failed, we will start to iterate through the tests,
+	// each test involves translating the tetromino in different ways.
+	for(int test_index=0; test_index<=3; test_index++){
+		piece->left_x += tests[tetro_index][from][test_index][0];
+		piece->top_y += tests[tetro_index][from][test_index][1];
+		if(!tetris_collides(rows, piece)){
+			return 1;
+		}
+	}
+
+	//Never found a valid one, undo
+	*piece = original;
+	return 0;
+}
+
+int tetris_rotate_cw(const tetris_row * rows, tetris_piece * piece){
+	return rotate(rows, piece, rotation_tests_cw, 1);
+}
+
+int tetris_rotate_ccw(const tetris_row * rows, tetris_piece * piece){
+	return rotate(rows, piece, rotation_tests_ccw, 3);
+}
+
+int tetris_drop_distance(const tetris_row * rows, const tetris_piece * piece){
+	// How many rows the piece can fall before it lands
+	tetris_piece test = *piece;
+	int distance = 0;
+	for(;;){
+		test.top_y++;
+		if(tetris_collides(rows, &test)){
+			return distance;
+		}
+		distance++;
+	}
+}
+
+void tetris_lock(tetris_row * rows, const tetris_piece * piece){
+	// Copies the piece into the field. THIS DOES NOT DO CHECKS, the position has to be valid.
+	const uint8_t * shape = tables.shapes[piece->type][piece->orientation];
+	int n = tables.sizes[piece->type];
+
+	for(int row=0; row<n; row++){
+		tetris_row placed;
+		if(shape[row] && place_mask(shape[row], piece->left_x, &placed)){
+			rows[piece->top_y + row] |= placed;
+		}
+	}
+}
+
+tetris_row_set tetris_full_rows(const tetris_row * rows){
+	tetris_row_set mask = 0;
+	for(int row=TETRIS_FIRST_ROW; row<=TETRIS_BOTTOM_ROW; row++){
+		if(rows[row] == TETRIS_FULL_ROW){
+			mask |= TETRIS_ROW_BIT(row);
+		}
+	}
+	return mask;
+}
+
+void tetris_compact_rows(tetris_row * rows, tetris_row_set clear_mask){
+	// Removes every row in clear_mask in a single pass, moving the rows above them down.
+	// Rows are walked from the bottom up, copying each kept row to the lowest free spot,
+	// and whatever is left at the top becomes empty rows.
+	int write_row = TETRIS_BOTTOM_ROW;
+
+	for(int row=TETRIS_BOTTOM_ROW; row>=TETRIS_FIRST_ROW; row--){
+		if(clear_mask & TETRIS_ROW_BIT(row)){
+			continue;
+		}
+		rows[write_row--] = rows[row];
+	}
+	for(int row=write_row; row>=TETRIS_FIRST_ROW; row--){
+		rows[row] = TETRIS_EMPTY_ROW;
+	}
+}
+
+int tetris_insert_garbage(tetris_row * rows, int lines, int hole_col){
+	// The rows below the ceiling are contiguous, so making room is one memmove of the
+	// rows that survive instead of rebuilding the field cell by cell.
+	const int playable = TETRIS_BOTTOM_ROW - TETRIS_FIRST_ROW + 1;
+	int overflow = 0;
+
+	if(lines <= 0){
+		return 0;
+	}
+	if(lines > playable){
+		lines = playable;
+	}
+	for(int row=TETRIS_FIRST_ROW; row<TETRIS_FIRST_ROW+lines; row++){
+		if(rows[row] != TETRIS_EMPTY_ROW){
+			overflow = 1;
+		}
+	}
+
+	memmove(&rows[TETRIS_FIRST_ROW], &rows[TETRIS_FIRST_ROW+lines], (playable-lines) * sizeof(tetris_row));
+
+	tetris_row garbage = TETRIS_FULL_ROW & ~(1u << hole_col);
+	for(int row=TETRIS_BOTTOM_ROW-lines+1; row<=TETRIS_BOTTOM_ROW; row++){
+		rows[row] = garbage;
+	}
+	return overflow;
+}
+
+int64_t tetris_line_score(int lines, int level){
+	static const int line_score[5] = { 0, 100, 300, 500, 800 };
+	if(lines < 0 || lines > 4){
+		return 0;
+	}
+	return (int64_t)level * line_score[lines];
+}
+
+int tetris_level_for_lines(int line_clears, int level){
+	if(level < 15){
+		int new_level = ((line_clears-(line_clears%10))/10)+1;
+		if(new_level>level){
+			return new_level;
+		}
+	}
+	return level;
+}
+
+int tetris_falltime_for_level(int level){
+	// FALL TIME CALCULATION:
+	// Level 1 - falls every 87 frames
+	// Level 15 - falls every 3 frames
+	// Equation:  y = -6x + 93
+	// (level 1 starts at 93 until the first level up, like it always has)
+	if(level <= 1){
+		return 93;
+	}
+	return 93 - (level*6);
+}
+
+/**************************************** tetris_game ****************************************/
+
+static int count_rows(tetris_row_set x){
+	int count = 0;
+	while(x){
+		x &= x - 1;
+		count++;
+	}
+	return count;
+}
+
+void tetris_game_reset(tetris_game * game, uint32_t seed){
+	tetris_init();
+
+	memset(game, 0, sizeof(*game));
+	tetris_clear_rows(game->rows);
+	for(int row=0; row<TETRIS_ROWS; row++){
+		game->colors[row][0] = RED; // the border counts as red blocks, like it always has
+		game->colors[row][TETRIS_COLS-1] = RED;
+	}
+	for(int col=0; col<TETRIS_COLS; col++){
+		game->colors[TETRIS_CEILING_ROW][col] = RED;
+		game->colors[TETRIS_ROWS-1][col] = RED;
+	}
+
+	game->rng = seed;
+	for(int i=0; i<TETRIS_QUEUE_LENGTH; i++){
+		game->queue[i] = tetris_random_type(&game->rng);
+	}
+
+	game->hold_eligible = 1;
+	game->level = 1;
+	game->falltime = 93;
+	game->fall_timer = 93;
+	game->phase = PHASE_SPAWN;
+	game->line_clear_delay = 24;
+	game->released_y_button = 1;
+	game->released_x_button = 1;
+	game->released_up_button = 1;
+}
+
+static void set_piece_colors(tetris_game * game){
+	const uint8_t * shape = tetris_shape(game->active.type, game->active.orientation);
+	int n = tetris_shape_size(game->active.type);
+
+	for(int row=0; row<n; row++){
+		for(int col=0; col<n; col++){
+			if(shape[row] & (1 << col)){
+				game->colors[game->active.top_y + row][game->active.left_x + col] = game->active.type;
+			}
+		}
+	}
+}
+
+static int lock_active(tetris_game * game){
+	tetris_lock(game->rows, &game->active);
+	set_piece_colors(game);
+	game->active_set = 1;
+	game->version++;
+	return TETRIS_EVENT_LOCK;
+}
+
+static color_id next_queue_type(tetris_game * game){
+	if(!game->sequence_length){
+		return tetris_random_type(&game->rng);
+	}
+	if(game->sequence_next >= game->sequence_length){
+		return EMPTY; // out of tetrominos
+	}
+	return game->sequence[game->sequence_next++];
+}
+
+void tetris_game_set_sequence(tetris_game * game, const uint8_t * types, int count){
+	if(count > TETRIS_SEQUENCE_MAX){
+		count = TETRIS_SEQUENCE_MAX;
+	}
+	memcpy(game->sequence, types, count);
+	game->sequence_length = count;
+	game->sequence_next = 0;
+	for(int i=0; i<TETRIS_QUEUE_LENGTH; i++){
+		game->queue[i] = next_queue_type(game);
+	}
+	game->version++;
+}
+
+static int generate_new_tetro(tetris_game * game){
+	color_id type = game->queue[0];
+	memmove(game->queue, game->queue+1, sizeof(game->queue) - sizeof(game->queue[0]));
+	game->queue[TETRIS_QUEUE_LENGTH-1] = next_queue_type(game);
+
+	if(type == EMPTY){
+		game->loss = 1; // a fixed sequence ran out
+		return TETRIS_EVENT_LOSS;
+	}
+
+	tetris_spawn(&game->active, type);
+	game->active_set = 0;
+	game->version++;
+
+	if(tetris_collides(game->rows, &game->active)){
+		game->loss = 1;
+		return TETRIS_EVENT_LOSS;
+	}
+	return 0;
+}
+
+static int tetro_fall(tetris_game * game, int award_score){
+	int events = 0;
+	if(tetris_move(game->rows, &game->active, 0, 1)){
+		game->version++;
+	}
+	else {
+		events = lock_active(game);
+	}
+	if(award_score){
+		game->score += 1;
+		game->version++;
+	}
+	return events;
+}
+
+static int hard_drop(tetris_game * game){
+	// Falls straight down until the tetromino gets set.
+	// Scores 2 points per row, plus 2 for the final step that sets it.
+	int distance = tetris_drop_distance(game->rows, &game->active);
+	game->active.top_y += distance;
+	game->score += (distance + 1) * 2;
+	return lock_active(game) | TETRIS_EVENT_HARD_DROP;
+}
+
+static int hold_tetromino(tetris_game * game){
+	color_id tetromino_to_hold = game->active.type;
+	int events = TETRIS_EVENT_HOLD;
+
+	if(game->held){ //if there's currently a tetromino already in the hold
+	// swap it
+		tetris_spawn(&game->active, game->held);
+		game->held = tetromino_to_hold;
+		if(tetris_collides(game->rows, &game->active)){
+			game->loss = 1; // same as a blocked spawn from the queue
+			events |= TETRIS_EVENT_LOSS;
+		}
+	}
+	else {
+		//otherwise, make a new one
+		game->held = tetromino_to_hold;
+		events |= generate_new_tetro(game);
+	}
+	game->hold_eligible = 0;
+	game->version++;
+	return events;
+}
+
+static int check_lines(tetris_game * game){
+	// Flags every full row in rows_to_clear and awards the score for them.
+	// The rows stay on the field until they're compacted (after the animation).
+	tetris_row_set full = tetris_full_rows(game->rows);
+	int new_line_clears = count_rows(full);
+
+	game->rows_to_clear = full;
+	game->last_clear = new_line_clears;
+	game->line_clears += new_line_clears;
+	game->score += tetris_line_score(new_line_clears, game->level);
+	game->version++;
+
+	int new_level = tetris_level_for_lines(game->line_clears, game->level);
+	if(new_level != game->level){
+		game->level = new_level;
+		game->falltime = tetris_falltime_for_level(new_level);
+	}
+	return new_line_clears;
+}
+
+static void compact_lines(tetris_game * game){
+	tetris_compact_rows(game->rows, game->rows_to_clear);
+
+	int write_row = TETRIS_BOTTOM_ROW;
+	for(int row=TETRIS_BOTTOM_ROW; row>=TETRIS_FIRST_ROW; row--){
+		if(game->rows_to_clear & TETRIS_ROW_BIT(row)){
+			continue;
+		}
+		if(write_row != row){
+			memcpy(game->colors[write_row], game->colors[row], TETRIS_COLS);
+		}
+		write_row--;
+	}
+	for(int row=write_row; row>=TETRIS_FIRST_ROW; row--){
+		memset(game->colors[row], EMPTY, TETRIS_COLS);
+		game->colors[row][0] = RED;
+		game->colors[row][TETRIS_COLS-1] = RED;
+	}
+	game->rows_to_clear = 0;
+	game->version++;
+}
+
+static int handle_buttons(tetris_game * game, uint32_t buttons){
+	// The buttons are still read (and the timers still run) while there's no active
+	// tetromino, like during the line clear animation, they just don't move anything.
+	int events = 0;
+	int can_move = (game->phase==PHASE_FALLING && !game->active_set);
+
+	if((buttons & TETRIS_BTN_HOLD) && game->hold_eligible && can_move){
+		events |= hold_tetromino(game);
+	}
+
+	if(game->move_timebuffer==0 && can_move){
+		if((buttons & TETRIS_BTN_HARD_DROP) && game->released_up_button){
+			events |= hard_drop(game);
+			game->move_timebuffer=10;
+			game->released_up_button = 0;
+		}
+		// once the tetromino is set, nothing else this frame can move it
+		if((buttons & TETRIS_BTN_SOFT_DROP) && !game->active_set){
+			events |= tetro_fall(game, 1);
+			game->move_timebuffer=10;
+		}
+		if((buttons & TETRIS_BTN_LEFT) && !game->active_set){
+			game->version += tetris_move(game->rows, &game->active, -1, 0);
+			game->move_timebuffer=10;
+		}
+		if((buttons & TETRIS_BTN_RIGHT) && !game->active_set){
+			game->version += tetris_move(game->rows, &game->active, 1, 0);
+			game->move_timebuffer=10;
+		}
+
+		if((buttons & TETRIS_BTN_ROTATE_CW) && game->released_y_button && !game->active_set){
+			game->version += tetris_rotate_cw(game->rows, &game->active);
+			game->released_y_button=0;
+		}
+		if((buttons & TETRIS_BTN_ROTATE_CCW) && game->released_x_button && !game->active_set){
+			game->version += tetris_rotate_ccw(game->rows, &game->active);
+			game->released_x_button=0;
+		}
+	}
+
+	// keep the released flags up to date even while nothing can move, so a button held
+	// through the line clear animation doesn't fire again the moment the next tetromino spawns
+	if(game->move_timebuffer==0){
+		if(!(buttons & TETRIS_BTN_ROTATE_CCW)){
+			game->released_x_button=1;
+		}
+		if(!(buttons & TETRIS_BTN_ROTATE_CW)){
+			game->released_y_button=1;
+		}
+		if(!(buttons & TETRIS_BTN_HARD_DROP)){
+			game->released_up_button = 1;
+		}
+	}
+
+	if(game->move_timebuffer>0){
+		game->move_timebuffer-=1;
+	}
+	return events;
+}
+
+static int update_game_phase(tetris_game * game){
+	// Runs one frame of the spawn/fall/line clear state machine (see game_phase)
+	int events = 0;
+
+	switch(game->phase){
+		case PHASE_SPAWN:
+			events |= generate_new_tetro(game) | TETRIS_EVENT_SPAWN;
+			game->hold_eligible=1;
+			game->fall_timer=game->falltime;
+			game->phase=PHASE_FALLING;
+			break;
+
+		case PHASE_FALLING:
+			game->fall_timer=game->fall_timer-1;
+			if(game->fall_timer<=0 && !game->active_set){
+				game->fall_timer=game->falltime;
+				events |= tetro_fall(game, 0);
+			}
+
+			if(game->active_set){
+				int lines = check_lines(game);
+				if(lines){
+					events |= TETRIS_EVENT_LINE_CLEAR;
+					if(lines==4){
+						events |= TETRIS_EVENT_TETRIS;
+					}
+					game->phase=PHASE_LINE_CLEAR;
+					game->clear_timer=game->line_clear_delay;
+				}
+				else {
+					game->phase=PHASE_SPAWN; // the next one spawns next frame
+				}
+			}
+			if(game->phase!=PHASE_LINE_CLEAR || game->clear_timer>0){
+				break;
+			}
+			// no clear delay, fall through and remove the rows right away
+		case PHASE_LINE_CLEAR:
+			game->clear_timer--;
+			game->version++; // the animation moves on every frame
+			if(game->clear_timer<=0){
+				compact_lines(game);
+				game->phase=PHASE_SPAWN;
+			}
+			break;
+	}
+	return events;
+}
+
+int tetris_game_add_garbage(tetris_game * game, int lines, int hole_col){
+	const int playable = TETRIS_BOTTOM_ROW - TETRIS_FIRST_ROW + 1;
+
+	if(lines <= 0){
+		return 0;
+	}
+	if(lines > playable){
+		lines = playable;
+	}
+	if(hole_col < TETRIS_LEFT_COL || hole_col > TETRIS_RIGHT_COL){
+		hole_col = TETRIS_LEFT_COL;
+	}
+
+	int overflow = tetris_insert_garbage(game->rows, lines, hole_col);
+
+	// colors is laid out row after row too, so it shifts the same way
+	memmove(game->colors[TETRIS_FIRST_ROW], game->colors[TETRIS_FIRST_ROW+lines], (playable-lines) * TETRIS_COLS);
+	for(int row=TETRIS_BOTTOM_ROW-lines+1; row<=TETRIS_BOTTOM_ROW; row++){
+		memset(game->colors[row], GARBAGE, TETRIS_COLS);
+		game->colors[row][0] = RED;
+		game->colors[row][TETRIS_COLS-1] = RED;
+		game->colors[row][hole_col] = EMPTY;
+	}
+	game->version++;
+
+	if(overflow){
+		game->loss = 1;
+		return TETRIS_EVENT_GARBAGE | TETRIS_EVENT_LOSS;
+	}
+	return TETRIS_EVENT_GARBAGE;
+}
+
+int tetris_game_tick(tetris_game * game, uint32_t buttons){
+	if(game->loss){
+		return 0;
+	}
+	int events = handle_buttons(game, buttons);
+	if(game->loss){
+		return events; // holding into a blocked spawn
+	}
+	return events | update_game_phase(game);
+}
@@ -0,0 +1,226 @@
+// The game rules, with nothing Dreamcast specific in them.
+//
+// main.c draws the game and reads the controller, everything about how tetrominos move,
+// rotate, lock, clear lines and score lives here so that the exact same rules can run
+// on a PC too (see tetris_env.c).
+//
+// The field is stored as one bitmask per row (tetris_row), bit c set = column c is filled.
+// Like the old color_id field[24][12], the masks include a border: the first and last
+// column, the ceiling row and the floor row are always filled so that tetrominos can't
+// leave the field, and checking for walls is the same as checking for other blocks.
+//
+// The size of the field is fixed at compile time (TETRIS_WIDTH, TETRIS_VISIBLE_ROWS,
+// TETRIS_BUFFER_ROWS below, e.g. -DTETRIS_BUFFER_ROWS=20 for a 10x40 field like modern
+// games have). Every other dimension, mask and loop bound is derived from those, so each
+// configuration gets its own constants built into the code with no runtime lookups. The
+// defaults are the original 10x20 field:
+//
+//   rows 0-1                      hidden, never used
+//   row 2                         the ceiling
+//   rows 3 .. 3+buffer-1          buffer rows above the visible area (none by default)
+//   TETRIS_TOP_ROW .. BOTTOM_ROW  the visible area, where tetrominos spawn at the top
+//   the last row                  the floor
+//
+// There are two levels here:
+//  - piece/row functions (tetris_collides(), tetris_rotate_cw(), tetris_lock(), ...) that
+//    work on a row array and a tetris_piece, for code that keeps its own state
+//  - tetris_game, the whole single player game (phases, timers, hold, score), advanced
+//    one frame at a time with tetris_game_tick()
+
+#ifndef TETRIS_H
+#define TETRIS_H
+
+#include <stdint.h>
+
+#ifndef TETRIS_WIDTH
+#define TETRIS_WIDTH 10 // columns between the walls, at most 14 (rows are 16 bit masks)
+#endif
+#ifndef TETRIS_VISIBLE_ROWS
+#define TETRIS_VISIBLE_ROWS 20
+#endif
+#ifndef TETRIS_BUFFER_ROWS
+#define TETRIS_BUFFER_ROWS 0 // rows above the visible area that tetrominos can still go into
+#endif
+
+#define TETRIS_CEILING_ROW 2
+#define TETRIS_FIRST_ROW (TETRIS_CEILING_ROW + 1) // first row anything can be in
+#define TETRIS_TOP_ROW (TETRIS_FIRST_ROW + TETRIS_BUFFER_ROWS) // first visible row
+#define TETRIS_BOTTOM_ROW (TETRIS_TOP_ROW + TETRIS_VISIBLE_ROWS - 1) // last visible row
+#define TETRIS_ROWS (TETRIS_BOTTOM_ROW + 2) // everything up to and including the floor
+#define TETRIS_COLS (TETRIS_WIDTH + 2) // including the border column on each side
+#define TETRIS_LEFT_COL 1
+#define TETRIS_RIGHT_COL TETRIS_WIDTH
+
+#define TETRIS_FULL_ROW ((1u << TETRIS_COLS) - 1) // every column filled (border included)
+#define TETRIS_EMPTY_ROW (1u | (1u << (TETRIS_COLS - 1))) // just the two border columns
+
+#if TETRIS_WIDTH < 4 || TETRIS_WIDTH > 14
+#error "TETRIS_WIDTH has to be 4 to 14"
+#endif
+#if TETRIS_VISIBLE_ROWS < 4 || TETRIS_ROWS > 64
+#error "the field needs at least 4 visible rows, and at most 64 rows in all"
+#endif
+
+#define TETRIS_QUEUE_LENGTH 5 // how many upcoming tetrominos are known in advance
+#define TETRIS_SEQUENCE_MAX 32 // longest fixed tetromino list (see tetris_game_set_sequence())
+
+typedef uint16_t tetris_row;
+
+// A set of rows (full ones, ones being cleared), bit r = row r
+#if TETRIS_ROWS <= 32
+typedef uint32_t tetris_row_set;
+#else
+typedef uint64_t tetris_row_set;
+#endif
+#define TETRIS_ROW_BIT(row) ((tetris_row_set)1 << (row))
+
+typedef enum Color_Id {
+	EMPTY = 0,
+	RED = 1, // Z
+	ORANGE = 2, // L
+	YELLOW = 3, // O
+	GREEN = 4, // S
+	LIGHT_BLUE = 5, // I
+	DARK_BLUE = 6, // J
+	PURPLE = 7, // T
+	GARBAGE = 8 // rows sent over by the opponent in versus mode
+} color_id;
+
+typedef enum Rotation {
+	DEFAULT,
+	RIGHT,
+	TWO,
+	LEFT
+} rotation;
+
+// The active tetromino. Its shape is the tetromino type in a given rotation, placed with
+// the top left corner of its box (2x2, 3x3 or 4x4) at left_x, top_y on the field.
+typedef struct Tetris_Piece {
+	int8_t type; // color_id, EMPTY means there's no piece
+	int8_t orientation; // rotation
+	int8_t left_x;
+	int8_t top_y;
+} tetris_piece;
+
+// Buttons for tetris_game_tick() and friends. main.c maps the controller onto these.
+#define TETRIS_BTN_LEFT (1<<0)
+#define TETRIS_BTN_RIGHT (1<<1)
+#define TETRIS_BTN_SOFT_DROP (1<<2)
+#define TETRIS_BTN_HARD_DROP (1<<3)
+#define TETRIS_BTN_ROTATE_CW (1<<4)
+#define TETRIS_BTN_ROTATE_CCW (1<<5)
+#define TETRIS_BTN_HOLD (1<<6)
+
+// What happened during a tick, returned by tetris_game_tick() so the caller can play
+// sounds etc. without the rules knowing about audio.
+#define TETRIS_EVENT_LOCK (1<<0) // a tetromino got set
+#define TETRIS_EVENT_HARD_DROP (1<<1)
+#define TETRIS_EVENT_LINE_CLEAR (1<<2) // one or more rows were flagged for clearing
+#define TETRIS_EVENT_TETRIS (1<<3) // ...and it was 4 of them
+#define TETRIS_EVENT_HOLD (1<<4)
+#define TETRIS_EVENT_SPAWN (1<<5)
+#define TETRIS_EVENT_LOSS (1<<6)
+#define TETRIS_EVENT_GARBAGE (1<<7) // garbage rows got pushed in from the bottom (versus.c)
+
+// The game moves through these phases for every tetromino:
+// SPAWN -> FALLING -> (LINE_CLEAR if the piece completed any lines) -> SPAWN -> ...
+typedef enum Game_Phase {
+	PHASE_SPAWN, // a new tetromino gets generated at the start of the next tick
+	PHASE_FALLING, // the active tetromino is falling and can be moved
+	PHASE_LINE_CLEAR // full rows are flagged and animating, they get removed when the timer runs out
+} game_phase;
+
+// The SH4's operand cache works in 32 byte lines
+#define TETRIS_CACHE_LINE 32
+// tetris_game starts with everything a tick touches on a normal frame, in at most this
+// many bytes: the rows and 48 for the rest, in whole cache lines (3 for the standard
+// field). tetris.c checks that it fits.
+#define TETRIS_HOT_BYTES ((TETRIS_ROWS * (int)sizeof(tetris_row) + 48 + TETRIS_CACHE_LINE - 1) \
+	/ TETRIS_CACHE_LINE * TETRIS_CACHE_LINE)
+
+typedef struct Tetris_Game {
+	// Hot: read or written by every tick. Packed together at the start so a tick pulls in
+	// as few cache lines as it can, with small types since a 4 byte flag is 3 wasted bytes.
+	tetris_row rows[TETRIS_ROWS];
+	tetris_row_set rows_to_clear; // full rows waiting to be removed
+	tetris_piece active;
+
+	// Bumped by every change to something that gets drawn (the field, the active or held
+	// tetromino, score and lines, each frame of the line clear animation). If it hasn't
+	// changed since last frame, neither has the picture. Resetting or loading a state
+	// starts it over at 0.
+	uint32_t version;
+
+	int16_t falltime;
+	int16_t fall_timer;
+	int16_t line_clear_delay; // frames the line clear animation lasts, 0 clears rows instantly
+	int16_t clear_timer;
+	int16_t move_timebuffer; // input bookkeeping, see tetris_game_tick()
+	uint8_t phase; // game_phase
+	uint8_t active_set; // the active tetromino has been locked into the field
+	uint8_t loss;
+	uint8_t hold_eligible; // whether we will let the player perform a tetromino hold
+	uint8_t released_y_button;
+	uint8_t released_x_button;
+	uint8_t released_up_button;
+
+	// Cold: only when a tetromino locks or spawns, lines clear, or the game gets drawn
+	uint8_t colors[TETRIS_ROWS][TETRIS_COLS]; // color_id of every cell, only needed for drawing
+
+	color_id held;
+	color_id queue[TETRIS_QUEUE_LENGTH];
+	uint32_t rng;
+
+	int line_clears;
+	int64_t score; // not long, that's 32 bits on the Dreamcast and 64 on a PC
+	int level;
+	int last_clear; // how many rows the last locked tetromino completed
+
+	// A fixed list of tetrominos to play instead of random ones (puzzles, see puzzle.h)
+	uint8_t sequence[TETRIS_SEQUENCE_MAX];
+	int sequence_length; // 0 = random tetrominos
+	int sequence_next; // the next one to go into the queue
+} __attribute__((aligned(TETRIS_CACHE_LINE))) tetris_game;
+
+// Builds the rotated shape tables. Call once before anything else (calling it again is harmless).
+void tetris_init();
+
+// Row masks of a tetromino in a given orientation, one per row of its box (unused rows are 0).
+const uint8_t * tetris_shape(color_id type, rotation orientation);
+int tetris_shape_size(color_id type); // 2, 3 or 4
+
+uint32_t tetris_random(uint32_t * state);
+color_id tetris_random_type(uint32_t * state);
+
+void tetris_clear_rows(tetris_row * rows); // empty field with the border
+void tetris_spawn(tetris_piece * piece, color_id type);
+int tetris_collides(const tetris_row * rows, const tetris_piece * piece);
+int tetris_move(const tetris_row * rows, tetris_piece * piece, int dx, int dy); // 1 if it moved
+int tetris_rotate_cw(const tetris_row * rows, tetris_piece * piece); // 1 if it rotated
+int tetris_rotate_ccw(const tetris_row * rows, tetris_piece * piece);
+int tetris_drop_distance(const tetris_row * rows, const tetris_piece * piece);
+void tetris_lock(tetris_row * rows, const tetris_piece * piece);
+tetris_row_set tetris_full_rows(const tetris_row * rows);
+void tetris_compact_rows(tetris_row * rows, tetris_row_set clear_mask);
+// Shifts the field up and fills the bottom lines rows with garbage, open at hole_col.
+// Returns 1 if blocks got pushed out of the top (of the buffer rows, if there are any).
+int tetris_insert_garbage(tetris_row * rows, int lines, int hole_col);
+
+int64_t tetris_line_score(int lines, int level);
+int tetris_level_for_lines(int line_clears, int level); // level after reaching line_clears
+int tetris_falltime_for_level(int level);
+
+void tetris_game_reset(tetris_game * game, uint32_t seed);
+// Makes the game play exactly these tetrominos (color_ids) in order instead of random ones,
+// and refills the queue from them. Call it right after tetris_game_reset(). Once the list
+// runs out the next spawn fails and the game is lost.
+void tetris_game_set_sequence(tetris_game * game, const uint8_t * types, int count);
+// Runs one frame of the game. buttons is a mask of TETRIS_BTN_* that are held down.
+// Returns a mask of TETRIS_EVENT_*.
+int tetris_game_tick(tetris_game * game, uint32_t buttons);
+// tetris_insert_garbage() on the game, colors included. Only call it while there's no
+// falling tetromino (phase is PHASE_SPAWN), it doesn't move the active piece out of the way.
+// Sets loss and returns TETRIS_EVENT_LOSS if the field overflowed.
+int tetris_game_add_garbage(tetris_game * game, int lines, int hole_col);
+
+#endif
@@ -0,0 +1,244 @@
+// Batched game environment. See tetris_env.h.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tetris_env.h"
+
+// Each array gets its own 64 byte aligned slice of env->memory so that stepping through
+// one array never drags half a cache line of another one along with it.
+#define ENV_ALIGN 64
+
+static size_t align_up(size_t x){
+	return (x + ENV_ALIGN - 1) & ~(size_t)(ENV_ALIGN - 1);
+}
+
+static void * carve(uint8_t ** cursor, size_t bytes){
+	void * p = *cursor;
+	*cursor += align_up(bytes);
+	return p;
+}
+
+tetris_env * tetris_env_create(int num_boards, uint32_t seed){
+	tetris_init();
+
+	if(num_boards <= 0){
+		return NULL;
+	}
+	tetris_env * env = calloc(1, sizeof(tetris_env));
+	if(!env){
+		return NULL;
+	}
+
+	size_t n = num_boards;
+	size_t total = align_up(n * TETRIS_ROWS * sizeof(tetris_row))
+		+ 7 * align_up(n) // piece type/orientation/x/y, held, hold_eligible, done
+		+ align_up(n * TETRIS_QUEUE_LENGTH)
+		+ align_up(n * sizeof(float))
+		+ align_up(n * sizeof(int64_t))
+		+ 3 * align_up(n * sizeof(int32_t));
+
+	if(posix_memalign(&env->memory, ENV_ALIGN, total)){
+		free(env);
+		return NULL;
+	}
+	memset(env->memory, 0, total);
+
+	uint8_t * cursor = env->memory;
+	env->num_boards = num_boards;
+	env->rows = carve(&cursor, n * TETRIS_ROWS * sizeof(tetris_row));
+	env->piece_type = carve(&cursor, n);
+	env->piece_orientation = carve(&cursor, n);
+	env->piece_x = carve(&cursor, n);
+	env->piece_y = carve(&cursor, n);
+	env->held = carve(&cursor, n);
+	env->hold_eligible = carve(&cursor, n);
+	env->done = carve(&cursor, n);
+	env->queue = carve(&cursor, n * TETRIS_QUEUE_LENGTH);
+	env->reward = carve(&cursor, n * sizeof(float));
+	env->score = carve(&cursor, n * sizeof(int64_t));
+	env->lines = carve(&cursor, n * sizeof(int32_t));
+	env->level = carve(&cursor, n * sizeof(int32_t));
+	env->rng = carve(&cursor, n * sizeof(int32_t));
+
+	tetris_env_reset(env, -1, seed);
+	return env;
+}
+
+void tetris_env_destroy(tetris_env * env){
+	if(env){
+		free(env->memory);
+		free(env);
+	}
+}
+
+void tetris_env_set_gravity(tetris_env * env, int gravity){
+	env->gravity = gravity;
+}
+
+static inline void load_piece(tetris_env * env, int b, tetris_piece * piece){
+	piece->type = env->piece_type[b];
+	piece->orientation = env->piece_orientation[b];
+	piece->left_x = env->piece_x[b];
+	piece->top_y = env->piece_y[b];
+}
+
+static inline void store_piece(tetris_env * env, int b, const tetris_piece * piece){
+	env->piece_type[b] = piece->type;
+	env->piece_orientation[b] = piece->orientation;
+	env->piece_x[b] = piece->left_x;
+	env->piece_y[b] = piece->top_y;
+}
+
+static int spawn_next(tetris_env * env, int b, tetris_piece * piece){
+	// Pops the queue into the active piece. Returns 1 if it spawned on top of something (loss).
+	int8_t * queue = env->queue + b * TETRIS_QUEUE_LENGTH;
+	color_id type = queue[0];
+
+	memmove(queue, queue+1, TETRIS_QUEUE_LENGTH-1);
+	queue[TETRIS_QUEUE_LENGTH-1] = tetris_random_type(&env->rng[b]);
+
+	tetris_spawn(piece, type);
+	return tetris_collides(env->rows + b * TETRIS_ROWS, piece);
+}
+
+static void reset_board(tetris_env * env, int b, uint32_t seed){
+	tetris_piece piece;
+
+	tetris_clear_rows(env->rows + b * TETRIS_ROWS);
+	env->rng[b] = seed;
+	for(int i=0; i<TETRIS_QUEUE_LENGTH; i++){
+		env->queue[b * TETRIS_QUEUE_LENGTH + i] = tetris_random_type(&env->rng[b]);
+	}
+	env->held[b] = EMPTY;
+	env->hold_eligible[b] = 1;
+	env->reward[b] = 0;
+	env->done[b] = 0;
+	env->score[b] = 0;
+	env->lines[b] = 0;
+	env->level[b] = 1;
+
+	spawn_next(env, b, &piece);
+	store_piece(env, b, &piece);
+}
+
+void tetris_env_reset(tetris_env * env, int board, uint32_t seed){
+	if(board >= 0){
+		if(board < env->num_boards){
+			reset_board(env, board, seed);
+		}
+		return;
+	}
+	for(int b=0; b<env->num_boards; b++){
+		// different but reproducible sequence for every board
+		uint32_t board_seed = seed ^ (uint32_t)(b * 0x9e3779b9u);
+		reset_board(env, b, board_seed);
+	}
+}
+
+static void step_board(tetris_env * env, int b, int action){
+	tetris_row * rows = env->rows + b * TETRIS_ROWS;
+	tetris_piece piece;
+	int locked = 0;
+
+	if(env->done[b]){
+		// keep the board's random sequence going instead of replaying the same game
+		reset_board(env, b, tetris_random(&env->rng[b]));
+	}
+	env->reward[b] = 0;
+	load_piece(env, b, &piece);
+
+	switch(action){
+		case TETRIS_ACTION_LEFT:
+			tetris_move(rows, &piece, -1, 0);
+			break;
+		case TETRIS_ACTION_RIGHT:
+			tetris_move(rows, &piece, 1, 0);
+			break;
+		case TETRIS_ACTION_SOFT_DROP:
+			if(!tetris_move(rows, &piece, 0, 1)){
+				locked = 1;
+			}
+			env->score[b] += 1;
+			break;
+		case TETRIS_ACTION_HARD_DROP: {
+			int distance = tetris_drop_distance(rows, &piece);
+			piece.top_y += distance;
+			env->score[b] += (distance + 1) * 2;
+			locked = 1;
+			break;
+		}
+		case TETRIS_ACTION_ROTATE_CW:
+			tetris_rotate_cw(rows, &piece);
+			break;
+		case TETRIS_ACTION_ROTATE_CCW:
+			tetris_rotate_ccw(rows, &piece);
+			break;
+		case TETRIS_ACTION_HOLD:
+			if(env->hold_eligible[b]){
+				color_id to_hold = piece.type;
+				if(env->held[b]){
+					tetris_spawn(&piece, env->held[b]);
+				}
+				else if(spawn_next(env, b, &piece)){
+					env->done[b] = 1;
+				}
+				env->held[b] = to_hold;
+				env->hold_eligible[b] = 0;
+			}
+			break;
+		default:
+			break;
+	}
+
+	if(!locked && env->gravity && !env->done[b]){
+		if(!tetris_move(rows, &piece, 0, 1)){
+			locked = 1;
+		}
+	}
+
+	if(locked){
+		tetris_lock(rows, &piece);
+
+		tetris_row_set full = tetris_full_rows(rows);
+		if(full){
+			int cleared = __builtin_popcountll(full);
+			int64_t points = tetris_line_score(cleared, env->level[b]);
+			tetris_compact_rows(rows, full);
+			env->lines[b] += cleared;
+			env->score[b] += points;
+			env->reward[b] = points;
+			env->level[b] = tetris_level_for_lines(env->lines[b], env->level[b]);
+		}
+
+		env->hold_eligible[b] = 1;
+		if(spawn_next(env, b, &piece)){
+			env->done[b] = 1;
+		}
+	}
+
+	store_piece(env, b, &piece);
+}
+
+void tetris_env_step(tetris_env * env, const uint8_t * actions){
+	for(int b=0; b<env->num_boards; b++){
+		step_board(env, b, actions[b]);
+	}
+}
+
+int tetris_env_field_rows(){ return TETRIS_ROWS; }
+int tetris_env_field_cols(){ return TETRIS_COLS; }
+int tetris_env_num_boards(tetris_env * env){ return env->num_boards; }
+tetris_row * tetris_env_rows(tetris_env * env){ return env->rows; }
+int8_t * tetris_env_piece_type(tetris_env * env){ return env->piece_type; }
+int8_t * tetris_env_piece_orientation(tetris_env * env){ return env->piece_orientation; }
+int8_t * tetris_env_piece_x(tetris_env * env){ return env->piece_x; }
+int8_t * tetris_env_piece_y(tetris_env * env){ return env->piece_y; }
+int8_t * tetris_env_held(tetris_env * env){ return env->held; }
+uint8_t * tetris_env_hold_eligible(tetris_env * env){ return env->hold_eligible; }
+int8_t * tetris_env_queue(tetris_env * env){ return env->queue; }
+float * tetris_env_reward(tetris_env * env){ return env->reward; }
+uint8_t * tetris_env_done(tetris_env * env){ return env->done; }
+int64_t * tetris_env_score(tetris_env * env){ return env->score; }
+int32_t * tetris_env_lines(tetris_env * env){ return env->lines; }
+int32_t * tetris_env_level(tetris_env * env){ return env->level; }
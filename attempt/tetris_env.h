@@ -0,0 +1,93 @@
+// Batched game environment for training placement policies on a PC.
+//
+// Runs many independent boards with the real rules from tetris.c. Each call to
+// tetris_env_step() applies one action to every board. State is kept as a structure of
+// arrays (all the rows of all boards together, all the piece types together, ...) so
+// stepping a batch walks memory in order, and the arrays are the observations: the
+// buffer getters return pointers straight into them, so Python (tetris_env.py) can wrap
+// them as numpy arrays without copying anything.
+//
+// Differences from tetris_game: there are no frame timers (no fall timer, no button
+// repeat delay, no line clear animation), one step is one action. Set gravity to make
+// the piece fall one row after every action.
+//
+// Everything here is exported with plain C types so it can be called through ctypes.
+
+#ifndef TETRIS_ENV_H
+#define TETRIS_ENV_H
+
+#include <stdint.h>
+
+#include "tetris.h"
+
+typedef enum Tetris_Action {
+	TETRIS_ACTION_NONE = 0,
+	TETRIS_ACTION_LEFT,
+	TETRIS_ACTION_RIGHT,
+	TETRIS_ACTION_SOFT_DROP,
+	TETRIS_ACTION_HARD_DROP,
+	TETRIS_ACTION_ROTATE_CW,
+	TETRIS_ACTION_ROTATE_CCW,
+	TETRIS_ACTION_HOLD,
+	TETRIS_ACTION_COUNT
+} tetris_action;
+
+typedef struct Tetris_Env {
+	int num_boards;
+	int gravity; // 1 = the piece falls a row after every action
+
+	// Observations, one entry per board unless noted
+	tetris_row * rows; // [num_boards][TETRIS_ROWS] row occupancy masks, border bits included
+	int8_t * piece_type; // color_id of the active tetromino
+	int8_t * piece_orientation;
+	int8_t * piece_x;
+	int8_t * piece_y;
+	int8_t * held; // EMPTY if nothing is held
+	uint8_t * hold_eligible;
+	int8_t * queue; // [num_boards][TETRIS_QUEUE_LENGTH] upcoming tetrominos
+
+	// Results of the last step
+	float * reward; // line clear score from this step (the same points check_lines() used to give)
+	uint8_t * done; // 1 = topped out, the board resets at the start of the next step
+
+	// Stats
+	int64_t * score; // total score, drops included, like the game shows it
+	int32_t * lines;
+	int32_t * level;
+	uint32_t * rng;
+
+	void * memory; // every array above lives in this one allocation
+} tetris_env;
+
+tetris_env * tetris_env_create(int num_boards, uint32_t seed);
+void tetris_env_destroy(tetris_env * env);
+
+// Resets one board, or every board if board is -1
+void tetris_env_reset(tetris_env * env, int board, uint32_t seed);
+
+void tetris_env_set_gravity(tetris_env * env, int gravity);
+
+// actions: one tetris_action per board
+void tetris_env_step(tetris_env * env, const uint8_t * actions);
+
+// The field size this was built with (TETRIS_ROWS, TETRIS_COLS), rows holds TETRIS_ROWS per board
+int tetris_env_field_rows();
+int tetris_env_field_cols();
+
+// Buffer getters for ctypes (C code can just use the struct)
+int tetris_env_num_boards(tetris_env * env);
+tetris_row * tetris_env_rows(tetris_env * env);
+int8_t * tetris_env_piece_type(tetris_env * env);
+int8_t * tetris_env_piece_orientation(tetris_env * env);
+int8_t * tetris_env_piece_x(tetris_env * env);
+int8_t * tetris_env_piece_y(tetris_env * env);
+int8_t * tetris_env_held(tetris_env * env);
+uint8_t * tetris_env_hold_eligible(tetris_env * env);
+int8_t * tetris_env_queue(tetris_env * env);
+float * tetris_env_reward(tetris_env * env);
+uint8_t * tetris_env_done(tetris_env * env);
+int64_t * tetris_env_score(tetris_env * env);
+int32_t * tetris_env_lines(tetris_env * env);
+int32_t * tetris_env_level(tetris_env * env);
+
+#endif
@@ -0,0 +1,147 @@
+"""ctypes wrapper around libtetris_env.so (build it with: make -f Makefile.host).
+
+The observation attributes (rows, piece_type, reward, done, ...) are views straight into
+the C arrays, nothing is copied when stepping. With numpy installed they are numpy arrays,
+otherwise plain ctypes arrays.
+
+Running this file benchmarks random play: python3 tetris_env.py [boards] [steps]
+"""
+
+import ctypes
+import os
+import random
+import sys
+import time
+
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
+TETRIS_QUEUE_LENGTH = 5
+
+(ACTION_NONE, ACTION_LEFT, ACTION_RIGHT, ACTION_SOFT_DROP, ACTION_HARD_DROP,
+ ACTION_ROTATE_CW, ACTION_ROTATE_CCW, ACTION_HOLD) = range(8)
+ACTION_COUNT = 8
+
+_lib = ctypes.CDLL(os.path.join(os.path.dirname(os.path.abspath(__file__)), "libtetris_env.so"))
+
+# The field size is picked when the library is built (TETRIS_WIDTH etc. in tetris.h)
+TETRIS_ROWS = _lib.tetris_env_field_rows()
+TETRIS_COLS = _lib.tetris_env_field_cols()
+
+_lib.tetris_env_create.restype = ctypes.c_void_p
+_lib.tetris_env_create.argtypes = [ctypes.c_int, ctypes.c_uint32]
+_lib.tetris_env_destroy.argtypes = [ctypes.c_void_p]
+_lib.tetris_env_reset.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_uint32]
+_lib.tetris_env_set_gravity.argtypes = [ctypes.c_void_p, ctypes.c_int]
+_lib.tetris_env_step.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+
+# name -> (ctypes type, values per board)
+_BUFFERS = {
+    "rows": (ctypes.c_uint16, TETRIS_ROWS),
+    "piece_type": (ctypes.c_int8, 1),
+    "piece_orientation": (ctypes.c_int8, 1),
+    "piece_x": (ctypes.c_int8, 1),
+    "piece_y": (ctypes.c_int8, 1),
+    "held": (ctypes.c_int8, 1),
+    "hold_eligible": (ctypes.c_uint8, 1),
+    "queue": (ctypes.c_int8, TETRIS_QUEUE_LENGTH),
+    "reward": (ctypes.c_float, 1),
+    "done": (ctypes.c_uint8, 1),
+    "score": (ctypes.c_int64, 1),
+    "lines": (ctypes.c_int32, 1),
+    "level": (ctypes.c_int32, 1),
+}
+
+for _name, (_ctype, _) in _BUFFERS.items():
+    _getter = getattr(_lib, "tetris_env_" + _name)
+    _getter.restype = ctypes.POINTER(_ctype)
+    _getter.argtypes = [ctypes.c_void_p]
+
+
+class TetrisEnv:
+    def __init__(self, num_boards, seed=0, gravity=False):
+        self.num_boards = num_boards
+        self._env = _lib.tetris_env_create(num_boards, seed)
+        if not self._env:
+            raise MemoryError("tetris_env_create failed")
+        _lib.tetris_env_set_gravity(self._env, int(gravity))
+
+        for name, (ctype, width) in _BUFFERS.items():
+            ptr = getattr(_lib, "tetris_env_" + name)(self._env)
+            if np is not None:
+                shape = (num_boards, width) if width > 1 else (num_boards,)
+                view = np.ctypeslib.as_array(ptr, shape=shape)
+            else:
+                view = ctypes.cast(ptr, ctypes.POINTER(ctype * (num_boards * width))).contents
+            setattr(self, name, view)
+
+        if np is not None:
+            self._actions = np.zeros(num_boards, dtype=np.uint8)
+        else:
+            self._actions = (ctypes.c_uint8 * num_boards)()
+
+    def reset(self, board=-1, seed=0):
+        _lib.tetris_env_reset(self._env, board, seed)
+
+    def step(self, actions):
+        """actions: one ACTION_* per board (a uint8 numpy array is passed without copying)."""
+        if np is not None:
+            actions = np.ascontiguousarray(actions, dtype=np.uint8)
+            _lib.tetris_env_step(self._env, actions.ctypes.data)
+        else:
+            buf = self._actions
+            if actions is not buf:
+                for i, a in enumerate(actions):
+                    buf[i] = a
+            _lib.tetris_env_step(self._env, ctypes.addressof(buf))
+        return self.reward, self.done
+
+    def close(self):
+        if self._env:
+            _lib.tetris_env_destroy(self._env)
+            self._env = None
+
+    def __del__(self):
+        self.close()
+
+
+def _benchmark(num_boards, steps):
+    env = TetrisEnv(num_boards, seed=1234, gravity=True)
+    rng = random.Random(1)
+
+    # a fixed pool of action batches, so the benchmark measures stepping, not Python's RNG
+    if np is not None:
+        gen = np.random.default_rng(1)
+        pool = [gen.integers(0, ACTION_COUNT, num_boards, dtype=np.uint8) for _ in range(64)]
+    else:
+        pool = []
+        for _ in range(64):
+            batch = (ctypes.c_uint8 * num_boards)()
+            for i in range(num_boards):
+                batch[i] = rng.randrange(ACTION_COUNT)
+            pool.append(batch)
+
+    episodes = 0
+    start = time.perf_counter()
+    for s in range(steps):
+        actions = pool[s & 63]
+        if np is not None:
+            _lib.tetris_env_step(env._env, actions.ctypes.data)
+            episodes += int(env.done.sum())
+        else:
+            _lib.tetris_env_step(env._env, ctypes.addressof(actions))
+            episodes += sum(env.done)
+    elapsed = time.perf_counter() - start
+
+    total = num_boards * steps
+    print("%d boards x %d steps: %.3f s, %.0f board steps/sec, %d games finished (%s)"
+          % (num_boards, steps, elapsed, total / elapsed, episodes,
+             "numpy" if np is not None else "ctypes arrays"))
+    env.close()
+
+
+if __name__ == "__main__":
+    _benchmark(int(sys.argv[1]) if len(sys.argv) > 1 else 1024,
+               int(sys.argv[2]) if len(sys.argv) > 2 else 2000)
@@ -0,0 +1,159 @@
+// Two player versus mode. See versus.h.
+
+#include <string.h>
+
+#include "versus.h"
+
+int garbage_queue_push(garbage_queue * queue, garbage_packet packet){
+	// Sender side: only this end writes head, the receiver only writes tail.
+	uint32_t head = queue->head;
+	uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+
+	if(head - tail >= VERSUS_QUEUE_SIZE){
+		queue->dropped++;
+		return 0;
+	}
+	queue->packets[head & (VERSUS_QUEUE_SIZE-1)] = packet;
+	__atomic_store_n(&queue->head, head+1, __ATOMIC_RELEASE); // publish the packet
+	return 1;
+}
+
+int garbage_queue_pop(garbage_queue * queue, garbage_packet * packet){
+	uint32_t tail = queue->tail;
+	uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+
+	if(tail == head){
+		return 0;
+	}
+	*packet = queue->packets[tail & (VERSUS_QUEUE_SIZE-1)];
+	__atomic_store_n(&queue->tail, tail+1, __ATOMIC_RELEASE); // hand the slot back
+	return 1;
+}
+
+int garbage_queue_peek(garbage_queue * queue, garbage_packet * packet){
+	uint32_t tail = queue->tail;
+	uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+
+	if(tail == head){
+		return 0;
+	}
+	*packet = queue->packets[tail & (VERSUS_QUEUE_SIZE-1)];
+	return 1;
+}
+
+int versus_garbage_for_lines(int lines){
+	static const int garbage[5] = { 0, 0, 1, 2, 4 };
+	if(lines < 0 || lines > 4){
+		return 0;
+	}
+	return garbage[lines];
+}
+
+void versus_reset(versus_match * match, uint32_t seed){
+	memset(match, 0, sizeof(*match));
+
+	for(int i=0; i<2; i++){
+		versus_player * player = &match->players[i];
+		tetris_game_reset(&player->game, seed);
+		player->incoming = &match->queues[i];
+		player->outgoing = &match->queues[i^1];
+		player->hole_rng = seed ^ (0x85ebca6bu * (i+1));
+	}
+}
+
+static void receive_garbage(versus_player * player){
+	garbage_packet packet;
+	while(player->pending_count < VERSUS_QUEUE_SIZE && garbage_queue_peek(player->incoming, &packet)){
+		if(player->garbage_delay && packet.tick + player->garbage_delay > player->ticks){
+			break; // not due yet, and nothing behind it is either
+		}
+		garbage_queue_pop(player->incoming, &packet);
+		player->pending[player->pending_count++] = packet;
+		player->pending_lines += packet.lines;
+	}
+}
+
+static int cancel_garbage(versus_player * player, int lines){
+	// Uses our own clears to cancel garbage that's still waiting, oldest first.
+	// Returns how many lines are left over to send.
+	int consumed = 0;
+
+	while(lines > 0 && consumed < player->pending_count){
+		garbage_packet * packet = &player->pending[consumed];
+		int cancelled = (lines < packet->lines) ? lines : packet->lines;
+		packet->lines -= cancelled;
+		player->pending_lines -= cancelled;
+		lines -= cancelled;
+		if(packet->lines == 0){
+			consumed++;
+		}
+	}
+	if(consumed){
+		player->pending_count -= consumed;
+		memmove(player->pending, player->pending+consumed, player->pending_count * sizeof(garbage_packet));
+	}
+	return lines;
+}
+
+static int insert_pending_garbage(versus_player * player){
+	int events = 0;
+
+	for(int i=0; i<player->pending_count && !player->game.loss; i++){
+		events |= tetris_game_add_garbage(&player->game, player->pending[i].lines, player->pending[i].hole_col);
+		player->lines_received += player->pending[i].lines;
+	}
+	player->pending_count = 0;
+	player->pending_lines = 0;
+	return events;
+}
+
+int versus_tick(versus_player * player, uint32_t buttons){
+	int events = 0;
+
+	if(player->game.loss){
+		return 0;
+	}
+	player->ticks++;
+
+	receive_garbage(player);
+	if(player->game.phase==PHASE_SPAWN && player->pending_count){
+		events |= insert_pending_garbage(player);
+	}
+	if(!player->game.loss){
+		events |= tetris_game_tick(&player->game, buttons);
+	}
+	if(player->game.loss){
+		__atomic_store_n(&player->lost, 1, __ATOMIC_RELEASE);
+		return events;
+	}
+
+	if(events & TETRIS_EVENT_LINE_CLEAR){
+		int lines = cancel_garbage(player, versus_garbage_for_lines(player->game.last_clear));
+		if(lines > 0){
+			garbage_packet packet;
+			packet.lines = lines;
+			packet.hole_col = TETRIS_LEFT_COL + tetris_random(&player->hole_rng) % (TETRIS_RIGHT_COL - TETRIS_LEFT_COL + 1);
+			packet.tick = player->ticks;
+			if(garbage_queue_push(player->outgoing, packet)){
+				player->lines_sent += lines;
+			}
+		}
+	}
+	return events;
+}
+
+int versus_winner(const versus_match * match){
+	int lost0 = __atomic_load_n(&match->players[0].lost, __ATOMIC_ACQUIRE);
+	int lost1 = __atomic_load_n(&match->players[1].lost, __ATOMIC_ACQUIRE);
+
+	if(lost0 && lost1){
+		return 2;
+	}
+	if(lost0){
+		return 1;
+	}
+	if(lost1){
+		return 0;
+	}
+	return -1;
+}
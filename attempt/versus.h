@@ -0,0 +1,83 @@
+// Two player versus mode: line clears send garbage rows to the other board.
+//
+// Each player is a normal tetris_game plus a garbage_queue that the opponent writes into.
+// The queue is single producer/single consumer and lock-free, so the two boards never
+// have to be ticked together: on the Dreamcast main.c ticks both in the same frame, and
+// on a PC (versus_host.c) each board can run on its own thread.
+//
+// Garbage sent for a line clear: 1 line = 0, 2 = 1, 3 = 2, a Tetris = 4. Lines cleared
+// while garbage is waiting cancel that garbage first and only the rest gets sent.
+// Waiting garbage goes in right before the next tetromino spawns, so it never has to
+// push a falling tetromino around.
+
+#ifndef VERSUS_H
+#define VERSUS_H
+
+#include <stdint.h>
+
+#include "tetris.h"
+
+#define VERSUS_QUEUE_SIZE 16 // packets, must be a power of 2
+
+// Both ends of the queue get their own cache line, so a board thread writing its
+// counter doesn't keep invalidating the line the other board thread is reading.
+#define VERSUS_CACHE_LINE 64
+
+typedef struct Garbage_Packet {
+	uint8_t lines;
+	uint8_t hole_col; // the column left open in every row of this packet
+	uint32_t tick; // the sender's versus_player.ticks when it was sent
+} garbage_packet;
+
+typedef struct Garbage_Queue {
+	uint32_t head __attribute__((aligned(VERSUS_CACHE_LINE))); // written by the sender only
+	uint32_t dropped; // packets that didn't fit, sender side
+	uint32_t tail __attribute__((aligned(VERSUS_CACHE_LINE))); // written by the receiver only
+	garbage_packet packets[VERSUS_QUEUE_SIZE] __attribute__((aligned(VERSUS_CACHE_LINE)));
+} garbage_queue;
+
+typedef struct Versus_Player {
+	tetris_game game;
+	garbage_queue * incoming; // the opponent pushes into this one
+	garbage_queue * outgoing; // and this is the opponent's incoming
+
+	// garbage taken off incoming that hasn't been inserted yet (only this player's thread touches it)
+	garbage_packet pending[VERSUS_QUEUE_SIZE];
+	int pending_count;
+	int pending_lines;
+
+	int lost; // game.loss, published so the other board's thread can read it
+	uint32_t ticks; // versus_tick() calls so far that weren't after a loss
+
+	// 0 takes garbage as soon as it's in the queue. Otherwise garbage sent on the
+	// opponent's tick n goes in on this board's tick n + garbage_delay, at the earliest,
+	// so the result doesn't depend on how far apart two board threads are (as long as
+	// the opponent has finished tick n by then, see versus_host.c).
+	uint32_t garbage_delay;
+	uint32_t hole_rng; // picks the hole column of the garbage we send
+	int lines_sent;
+	int lines_received;
+} versus_player;
+
+typedef struct Versus_Match {
+	garbage_queue queues[2]; // queues[i] carries garbage to players[i]
+	versus_player players[2];
+} versus_match;
+
+int garbage_queue_push(garbage_queue * queue, garbage_packet packet); // 0 if it was full
+int garbage_queue_pop(garbage_queue * queue, garbage_packet * packet); // 0 if it was empty
+int garbage_queue_peek(garbage_queue * queue, garbage_packet * packet); // the next pop, without popping it
+
+int versus_garbage_for_lines(int lines);
+
+// Both players get the same tetromino sequence, so the match is decided by play, not luck
+void versus_reset(versus_match * match, uint32_t seed);
+
+// Runs one frame for one player, takes TETRIS_BTN_* like tetris_game_tick() and
+// returns TETRIS_EVENT_*. Safe to call for the two players from two different threads.
+int versus_tick(versus_player * player, uint32_t buttons);
+
+// -1 while both are still playing, otherwise the index of the winner (2 if both lost)
+int versus_winner(const versus_match * match);
+
+#endif
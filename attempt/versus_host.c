@@ -0,0 +1,175 @@
+// Bot vs bot versus matches on a PC, for testing the garbage exchange at full speed.
+//
+// Usage: versus_host [matches] [--single]
+//
+// By default every board runs on its own thread, the only thing the two threads share
+// is the garbage queues and how far each board has got. Left to themselves the threads
+// would make the scheduler decide the match: a board whose thread doesn't get the CPU
+// for a while gets buried in garbage without ever moving. So garbage is stamped with
+// the tick it was sent on and only goes in GARBAGE_DELAY ticks later
+// (versus_player.garbage_delay), and a board only waits for the other one when it's
+// about to get that far ahead of it. Which garbage a board gets on which tick is then
+// the same on every run.
+//
+// The end is worked out the same way: a board stops when it loses, or GARBAGE_DELAY
+// ticks after the other board lost (it can't know any sooner, and stopping there every
+// time keeps the numbers the same from run to run). Whoever lost on the earlier tick
+// loses the match, the same tick is a draw.
+//
+// With --single both boards are ticked one after the other in one thread, the same way
+// the Dreamcast does it, garbage goes in as soon as it's there. Matches come out
+// differently than threaded ones because of that.
+//
+// The bots are the simple one-piece placers from bot.c, the two players get slightly
+// different weights.
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bot.h"
+#include "versus.h"
+
+#define MAX_TICKS 500000 // per board, a match that gets this far is a draw
+#define GARBAGE_DELAY 60 // ticks, one second of game time
+
+typedef struct Board_Thread {
+	versus_match * match;
+	int index;
+	bot brain;
+	long ticks;
+	struct Board_Thread * other;
+	uint32_t done; // ticks finished, published for the other board's thread
+	int finished; // done won't change any more
+} board_thread;
+
+static void * board_thread_main(void * arg){
+	board_thread * self = arg;
+	board_thread * other = self->other;
+	versus_player * player = &self->match->players[self->index];
+
+	while(!player->game.loss && self->ticks < MAX_TICKS){
+		// Garbage the other board sends on its tick n is due on our tick n + GARBAGE_DELAY,
+		// so all of its ticks up to ours - GARBAGE_DELAY have to be finished
+		int other_finished = __atomic_load_n(&other->finished, __ATOMIC_ACQUIRE);
+		uint32_t other_done = __atomic_load_n(&other->done, __ATOMIC_ACQUIRE);
+		if(other_finished){
+			if(self->ticks >= (long)other_done + GARBAGE_DELAY){
+				break;
+			}
+		}
+		else if(other_done + GARBAGE_DELAY <= self->ticks){
+			sched_yield();
+			continue;
+		}
+
+		versus_tick(player, bot_buttons(&self->brain, &player->game));
+		self->ticks++;
+		__atomic_store_n(&self->done, self->ticks, __ATOMIC_RELEASE);
+	}
+	__atomic_store_n(&self->finished, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static int threaded_winner(const board_thread * boards){
+	// Whoever lost first, see above
+	long lost[2];
+	for(int i=0; i<2; i++){
+		lost[i] = boards[i].match->players[i].game.loss ? boards[i].ticks : MAX_TICKS + 1;
+	}
+	if(lost[0] == lost[1]){
+		return 2;
+	}
+	return lost[0] < lost[1];
+}
+
+static double now_seconds(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char ** argv){
+	int matches = 10;
+	int single = 0;
+
+	for(int i=1; i<argc; i++){
+		if(!strcmp(argv[i], "--single")){
+			single = 1;
+		}
+		else {
+			matches = atoi(argv[i]);
+		}
+	}
+
+	static versus_match match;
+	int wins[3] = {0, 0, 0};
+	long total_ticks = 0;
+	long total_sent = 0;
+	long total_dropped = 0;
+	double start = now_seconds();
+
+	for(int m=0; m<matches; m++){
+		board_thread boards[2];
+
+		versus_reset(&match, 0x1234567u + m*7919);
+		for(int i=0; i<2; i++){
+			boards[i].match = &match;
+			boards[i].index = i;
+			boards[i].ticks = 0;
+			bot_setup(&boards[i].brain, i);
+		}
+
+		if(single){
+			while(versus_winner(&match) < 0 && boards[0].ticks < MAX_TICKS){
+				for(int i=0; i<2; i++){
+					versus_player * player = &match.players[i];
+					versus_tick(player, bot_buttons(&boards[i].brain, &player->game));
+					boards[i].ticks++;
+				}
+			}
+		}
+		else {
+			pthread_t threads[2];
+			for(int i=0; i<2; i++){
+				boards[i].other = &boards[i^1];
+				boards[i].done = 0;
+				boards[i].finished = 0;
+				match.players[i].garbage_delay = GARBAGE_DELAY;
+			}
+			for(int i=0; i<2; i++){
+				pthread_create(&threads[i], NULL, board_thread_main, &boards[i]);
+			}
+			for(int i=0; i<2; i++){
+				pthread_join(threads[i], NULL);
+			}
+		}
+
+		int winner = single ? versus_winner(&match) : threaded_winner(boards);
+		if(winner < 0){
+			winner = 2; // ran out of ticks
+		}
+		wins[winner]++;
+
+		for(int i=0; i<2; i++){
+			total_ticks += boards[i].ticks;
+			total_sent += match.players[i].lines_sent;
+			total_dropped += match.queues[i].dropped;
+		}
+		printf("match %d: %s, ticks %ld/%ld, sent %d/%d lines, lines cleared %d/%d\n",
+			m, winner==2 ? "draw" : (winner ? "player 2 wins" : "player 1 wins"),
+			boards[0].ticks, boards[1].ticks,
+			match.players[0].lines_sent, match.players[1].lines_sent,
+			match.players[0].game.line_clears, match.players[1].game.line_clears);
+	}
+
+	double elapsed = now_seconds() - start;
+	printf("%d matches (%s): player 1 %d, player 2 %d, draws %d\n",
+		matches, single ? "one thread" : "thread per board", wins[0], wins[1], wins[2]);
+	printf("%ld board ticks in %.3f s = %.0f ticks/sec, %ld garbage lines sent, %ld packets dropped\n",
+		total_ticks, elapsed, total_ticks / elapsed, total_sent, total_dropped);
+	return 0;
+}
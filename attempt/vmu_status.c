@@ -0,0 +1,158 @@
+// VMU status screen. See vmu_status.h.
+//
+//   +-----------+-----------+
+//   |   next    |   held    |   tetrominos with 4x4 pixel blocks
+//   +-----------+-----------+
+//   | LV  level             |   3x5 pixel font
+//   | LN  lines             |
+//   +-----------------------+
+
+#include <string.h>
+
+#include "vmu_status.h"
+
+// 3x5 glyphs, one bit per pixel, top row in the highest 3 bits
+#define GLYPH(a, b, c, d, e) (((a) << 12) | ((b) << 9) | ((c) << 6) | ((d) << 3) | (e))
+
+static const uint16_t digit_glyphs[10] = {
+	GLYPH(7, 5, 5, 5, 7), // 0
+	GLYPH(2, 6, 2, 2, 7), // 1
+	GLYPH(7, 1, 7, 4, 7), // 2
+	GLYPH(7, 1, 3, 1, 7), // 3
+	GLYPH(5, 5, 7, 1, 1), // 4
+	GLYPH(7, 4, 7, 1, 7), // 5
+	GLYPH(7, 4, 7, 5, 7), // 6
+	GLYPH(7, 1, 1, 2, 2), // 7
+	GLYPH(7, 5, 7, 5, 7), // 8
+	GLYPH(7, 5, 7, 1, 7), // 9
+};
+static const uint16_t glyph_l = GLYPH(4, 4, 4, 4, 7);
+static const uint16_t glyph_v = GLYPH(5, 5, 5, 5, 2);
+static const uint16_t glyph_n = GLYPH(7, 5, 5, 5, 5);
+
+static inline void set_pixel(uint8_t * screen, int x, int y){
+	if(x >= 0 && x < VMU_SCREEN_WIDTH && y >= 0 && y < VMU_SCREEN_HEIGHT){
+		screen[y * (VMU_SCREEN_WIDTH/8) + x/8] |= 0x80 >> (x % 8);
+	}
+}
+
+static void fill_rect(uint8_t * screen, int left, int top, int width, int height){
+	for(int y=top; y<top+height; y++){
+		for(int x=left; x<left+width; x++){
+			set_pixel(screen, x, y);
+		}
+	}
+}
+
+static void draw_glyph(uint8_t * screen, int left, int top, uint16_t glyph){
+	for(int y=0; y<5; y++){
+		for(int x=0; x<3; x++){
+			if(glyph & (1 << (14 - y*3 - x))){
+				set_pixel(screen, left+x, top+y);
+			}
+		}
+	}
+}
+
+static void draw_number(uint8_t * screen, int left, int top, int value){
+	char digits[12];
+	int count = 0;
+	if(value < 0){
+		value = 0;
+	}
+	do {
+		digits[count++] = value % 10;
+		value /= 10;
+	} while(value && count < (int)sizeof(digits));
+
+	for(int i=count-1; i>=0; i--){
+		draw_glyph(screen, left, top, digit_glyphs[(int)digits[i]]);
+		left += 4;
+	}
+}
+
+static void draw_tetromino(uint8_t * screen, int center_x, int top, color_id type){
+	// Spawn orientation, empty rows of the box skipped so every tetromino sits at the top
+	if(type == EMPTY || type > PURPLE){
+		return;
+	}
+	const uint8_t * shape = tetris_shape(type, DEFAULT);
+	int size = tetris_shape_size(type);
+	int width = 0;
+	for(int row=0; row<size; row++){
+		for(int col=0; col<size; col++){
+			if((shape[row] & (1 << col)) && col+1 > width){
+				width = col+1;
+			}
+		}
+	}
+
+	int left = center_x - width*2;
+	int y = top;
+	for(int row=0; row<size; row++){
+		if(!shape[row]){
+			continue;
+		}
+		for(int col=0; col<size; col++){
+			if(shape[row] & (1 << col)){
+				fill_rect(screen, left + col*4, y, 3, 3); // a gap between blocks
+			}
+		}
+		y += 4;
+	}
+}
+
+void vmu_status_draw(uint8_t * screen, const tetris_game * game){
+	memset(screen, 0, VMU_SCREEN_BYTES);
+
+	draw_tetromino(screen, 12, 2, game->queue[0]);
+	draw_tetromino(screen, 36, 2, game->held);
+	fill_rect(screen, 23, 0, 1, 12); // between next and held
+	fill_rect(screen, 0, 12, VMU_SCREEN_WIDTH, 1);
+
+	draw_glyph(screen, 1, 16, glyph_l);
+	draw_glyph(screen, 5, 16, glyph_v);
+	draw_number(screen, 12, 16, game->level);
+
+	draw_glyph(screen, 1, 24, glyph_l);
+	draw_glyph(screen, 5, 24, glyph_n);
+	draw_number(screen, 12, 24, game->line_clears);
+}
+
+void vmu_status_init(vmu_status * status, int min_frames){
+	memset(status, 0, sizeof(*status));
+	status->min_frames = min_frames;
+}
+
+void vmu_status_invalidate(vmu_status * status){
+	status->have_sent = 0;
+	status->drawn = 0;
+}
+
+int vmu_status_update(vmu_status * status, const tetris_game * game){
+	status->frames_since_send++;
+
+	// Nothing visible on the VMU can change without the version changing
+	if(!status->drawn || status->drawn_version != game->version){
+		vmu_status_draw(status->screen, game);
+		status->drawn_version = game->version;
+		status->drawn = 1;
+	}
+
+	if(status->have_sent && !memcmp(status->screen, status->sent, VMU_SCREEN_BYTES)){
+		status->unchanged++;
+		return 0;
+	}
+	if(status->have_sent && status->frames_since_send < status->min_frames){
+		status->held_back++;
+		return 0;
+	}
+	return 1;
+}
+
+void vmu_status_sent(vmu_status * status){
+	memcpy(status->sent, status->screen, VMU_SCREEN_BYTES);
+	status->have_sent = 1;
+	status->frames_since_send = 0;
+	status->sends++;
+}
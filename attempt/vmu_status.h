@@ -0,0 +1,50 @@
+// Live game info on the VMU screen: next and held tetromino, level and lines.
+//
+// The VMU screen is 48x32 pixels, 1 bit each (6 bytes a row, leftmost pixel in the top
+// bit, like the images in vmu_img.h). Every vmu_draw_lcd() is a maple transaction that
+// shares the bus with the controller polling, so the screen is only sent when it
+// actually looks different from what's already on the VMU, and never more often than
+// once every min_frames frames. Whatever changed in between goes out with the next send.
+//
+// Drawing the screen doesn't need KOS, main.c does the sending.
+
+#ifndef VMU_STATUS_H
+#define VMU_STATUS_H
+
+#include <stdint.h>
+
+#include "tetris.h"
+
+#define VMU_SCREEN_WIDTH 48
+#define VMU_SCREEN_HEIGHT 32
+#define VMU_SCREEN_BYTES (VMU_SCREEN_WIDTH * VMU_SCREEN_HEIGHT / 8)
+
+typedef struct Vmu_Status {
+	uint8_t screen[VMU_SCREEN_BYTES]; // the latest picture
+	uint8_t sent[VMU_SCREEN_BYTES]; // what the VMU is showing
+	int have_sent; // sent is valid
+	uint32_t drawn_version; // tetris_game.version the screen was drawn from
+	int drawn; // drawn_version is valid
+
+	int min_frames; // at least this many frames between sends
+	int frames_since_send;
+
+	// counters, for checking how much the diffing saves
+	uint32_t sends;
+	uint32_t unchanged; // frames where the picture was the same as on the VMU
+	uint32_t held_back; // frames where it changed but the last send was too recent
+} vmu_status;
+
+void vmu_status_init(vmu_status * status, int min_frames);
+// Forget what's on the VMU (something else drew on it), the next update sends again.
+void vmu_status_invalidate(vmu_status * status);
+
+// Draws the status screen for a game into a VMU_SCREEN_BYTES bitmap.
+void vmu_status_draw(uint8_t * screen, const tetris_game * game);
+
+// Call once a frame. Redraws the screen if the game changed, and returns 1 if it should
+// be sent now. Call vmu_status_sent() once it has been.
+int vmu_status_update(vmu_status * status, const tetris_game * game);
+void vmu_status_sent(vmu_status * status);
+
+#endif